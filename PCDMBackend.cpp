@@ -23,9 +23,8 @@
 #include "PCDMBackend.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
-#include <exception>
-#include <future>
 #include <new>
 #include <stdexcept>
 
@@ -33,6 +32,8 @@
 
 #include <Eigen/Geometry>
 
+#include "pCDM_thread_pool.h"
+
 
 using pCDM::t_FP;
 
@@ -40,154 +41,326 @@ using pCDM::t_FP;
 namespace
 {
 
-template<int rows, int cols> using Array = Eigen::Array<t_FP, rows, cols>;
 template<int rows, int cols> using Matrix = Eigen::Matrix<t_FP, rows, cols>;
-using ArrayX1 = Array<Eigen::Dynamic, 1>;
-using ArrayX2 = Array<Eigen::Dynamic, 2>;
-using ArrayX3 = Array<Eigen::Dynamic, 3>;
-using Matrix2 = Matrix<2, 2>;
-using Matrix2X = Matrix<2, Eigen::Dynamic>;
 using Matrix3 = Matrix<3, 3>;
-using MatrixX = Matrix<Eigen::Dynamic, Eigen::Dynamic>;
-using MatrixX2 = Matrix<Eigen::Dynamic, 2>;
 using Vector3 = Matrix<3, 1>;
-using VectorX = Matrix<Eigen::Dynamic, 1>;
 
 const auto pi = static_cast<t_FP>(M_PI);
 
+pCDM::PTDConstants ptdConstants(const t_FP strike, const t_FP dipRad, const t_FP DV)
+{
+    const t_FP beta = (strike - 90.f) * pi / 180.f;
+
+    pCDM::PTDConstants c;
+    c.cosBeta = std::cos(beta);
+    c.sinBeta = std::sin(beta);
+    c.sinDip = std::sin(dipRad);
+    c.cosDip = std::cos(dipRad);
+    c.scaledDV = DV / 2 / pi;
+    return c;
+}
+
+/** @return whether the parameters only differ in their potencies */
+bool sameGeometry(const pCDM::PointCDMParameters & lhs, const pCDM::PointCDMParameters & rhs)
+{
+    return lhs.horizontalCoord == rhs.horizontalCoord
+        && lhs.depth == rhs.depth
+        && lhs.omega == rhs.omega;
+}
+
 /**
- * PTDdispSurf calculates surface displacements associated with a tensile
- * point dislocation(PTD) in an elastic half - space(Okada, 1985). */
-void PTDdispSurf(
-    const std::array<std::vector<t_FP>, 2> & horizontalCoords,
-    const std::array<t_FP, 2> & xy0,
-    const t_FP depth,
-    const t_FP strike,
-    const t_FP dipRad,
-    const t_FP DV,
-    const t_FP nu,
-    ArrayX3 & ue_un_uv)
-{
-    const auto & x = horizontalCoords[0];
-    const auto & y = horizontalCoords[1];
-    assert(x.size() == y.size());
-
-    const auto numCoords = static_cast<Eigen::Index>(x.size());
-
-    MatrixX2 XY;
-    XY.resize(numCoords, Eigen::NoChange);
-    // Eigen defaults to column-major ordering, thus the entire first column is stored first, etc.
-    std::copy(x.begin(), x.end(), XY.col(0).data());
-    std::copy(y.begin(), y.end(), XY.col(1).data());
-
-    // Eigen: Coefficient-wise operations can be applied only to arrays not to matrices.
-    // .array() represents the matrix as array and has (usually?) no runtime cost.
-    XY.col(0).array() -= xy0[0];
-    XY.col(1).array() -= xy0[1];
+ * Results for potencies DV and the Poisson's ratio factor nuScaled as linear combination of the
+ * unit responses, for [begin, end). targetsBegin is the index of the first value of the targets.
+ */
+template<typename T, typename U>
+void combineUnitResponses(const PCDMUnitResponses<T> & responses, const std::array<t_FP, 3> & DV,
+    const t_FP nuScaled, const size_t begin, const size_t end, U * const * const targets,
+    const size_t targetsBegin = 0)
+{
+    // Weights of the parts A and B of each PTD
+    T weights[6];
+    for (size_t p = 0; p < 3; ++p)
+    {
+        weights[2 * p] = static_cast<T>(DV[p]);
+        weights[2 * p + 1] = static_cast<T>(DV[p] * nuScaled);
+    }
 
-    const t_FP beta = (strike - 90.f) * pi / 180.f;
-    Matrix2 Rz;
-    Rz <<
-        std::cos(beta), -std::sin(beta),
-        std::sin(beta), std::cos(beta);
-    const Matrix2X r_beta = Rz * XY.transpose();
-
-    // Create a few array wrappers that are required multiple times
-    const auto aX = r_beta.transpose().col(0).array();
-    const auto aY = r_beta.transpose().col(1).array();
-
-    // Compute intermediate results that are required multiple times
-    const ArrayX1 aXSq = aX.square();
-    const ArrayX1 aYSq = aY.square();
-
-    const t_FP d = depth;
-    const ArrayX1 r = (aXSq + aYSq + d * d).sqrt();
-    const ArrayX1 q = aY * std::sin(dipRad) - d * std::cos(dipRad);
-
-    const t_FP nuScaled = (1.f - 2.f * nu);
-
-    const ArrayX1 rCb = r.cube();
-    const ArrayX1 rd = r + d;
-    const ArrayX1 rdSq = rd.square();
-    const ArrayX1 rdCb = rd.cube();
-
-    const ArrayX1 I1 = nuScaled * aY * (1 / r / rdSq - aXSq * (3 * r + d) / rCb / rdCb);
-    const ArrayX1 I2 = nuScaled * aX * (1 / r / rdSq - aYSq * (3 * r + d) / rCb / rdCb);
-    const ArrayX1 I3 = nuScaled * aX / rCb - I2;
-    const ArrayX1 I5 = nuScaled * (1 / r / rd - aXSq * (2 * r + d) / rCb / rdSq);
-
-    const t_FP sinDipSq = std::sin(dipRad) * std::sin(dipRad);
-    const ArrayX1 qSqTimes3DivRPow5 = 3 * q.square() / r.pow(5);
-    // Note: For a PTD M0 = DV*mu!
-    ArrayX2 ue_un_temp;
-    ue_un_temp.resize(numCoords, Eigen::NoChange);
-    ue_un_uv.resize(numCoords, Eigen::NoChange);
-
-    ue_un_temp.col(0) = DV / 2 / pi * (aX * qSqTimes3DivRPow5 - I3 * sinDipSq);
-    ue_un_temp.col(1) = DV / 2 / pi * (aY * qSqTimes3DivRPow5 - I1 * sinDipSq);
-    ue_un_uv.col(2) = DV / 2 / pi * (d * qSqTimes3DivRPow5 - I5 * sinDipSq);
-
-    ue_un_uv.block<Eigen::Dynamic, 2>(0, 0, numCoords, 2) =
-        (Rz.transpose() * ue_un_temp.matrix().transpose()).transpose();
-}
-
-void PTDdispSurf_checked(
-    const std::array<std::vector<t_FP>, 2> & horizontalCoords,
-    const std::array<t_FP, 2> & xy0,
-    const t_FP depth,
-    const t_FP strike,
-    const t_FP dipRad,
-    const t_FP DV,
-    const t_FP nu,
-    ArrayX3 & ue_un_uv,
-    std::exception_ptr & exceptionPtr)
+    for (size_t c = 0; c < 3; ++c)
+    {
+        const T * r[6];
+        for (size_t p = 0; p < 3; ++p)
+        {
+            r[2 * p] = responses.values[6 * p + c].data();
+            r[2 * p + 1] = responses.values[6 * p + 3 + c].data();
+        }
+        const auto target = targets[c];
+        for (size_t i = begin; i < end; ++i)
+        {
+            target[i - targetsBegin] = static_cast<U>(
+                weights[0] * r[0][i] + weights[1] * r[1][i]
+                + weights[2] * r[2][i] + weights[3] * r[3][i]
+                + weights[4] * r[4][i] + weights[5] * r[5][i]);
+        }
+    }
+}
+
+/** Parts A and B (see pCDM::PartsKernelFunction) as linear combination of the unit responses */
+template<typename T, typename U>
+void combineUnitResponseParts(const PCDMUnitResponses<T> & responses,
+    const std::array<t_FP, 3> & DV,
+    const size_t begin, const size_t end, U * const * const targets)
+{
+    const auto dv0 = static_cast<T>(DV[0]);
+    const auto dv1 = static_cast<T>(DV[1]);
+    const auto dv2 = static_cast<T>(DV[2]);
+
+    for (size_t o = 0; o < 6; ++o)
+    {
+        const auto r0 = responses.values[o].data();
+        const auto r1 = responses.values[6 + o].data();
+        const auto r2 = responses.values[12 + o].data();
+        const auto target = targets[o];
+        for (size_t i = begin; i < end; ++i)
+        {
+            target[i] = static_cast<U>(dv0 * r0[i] + dv1 * r1[i] + dv2 * r2[i]);
+        }
+    }
+}
+
+/**
+ * Project the displacements u (east, north, up) of the points [begin, begin + size) onto the line
+ * of sight, or compute their wrapped phase. u and target point to the values of the point begin.
+ */
+template<typename T>
+void projectOntoLineOfSight(const pCDM::LineOfSight & los, const size_t begin, const size_t size,
+    const T * const * const u, t_FP * const target)
+{
+    const auto ue = u[0];
+    const auto un = u[1];
+    const auto uv = u[2];
+    if (los.hasPointDirections())
+    {
+        const auto le = los.pointDirections[0] + begin;
+        const auto ln = los.pointDirections[1] + begin;
+        const auto lv = los.pointDirections[2] + begin;
+        for (size_t i = 0; i < size; ++i)
+        {
+            target[i] = le[i] * static_cast<t_FP>(ue[i])
+                + ln[i] * static_cast<t_FP>(un[i])
+                + lv[i] * static_cast<t_FP>(uv[i]);
+        }
+    }
+    else
+    {
+        const auto & l = los.direction;
+        for (size_t i = 0; i < size; ++i)
+        {
+            target[i] = l[0] * static_cast<t_FP>(ue[i])
+                + l[1] * static_cast<t_FP>(un[i])
+                + l[2] * static_cast<t_FP>(uv[i]);
+        }
+    }
+
+    if (los.wavelength > 0)
+    {
+        const auto radiansPerUnit = 4 * pi / los.wavelength;
+        for (size_t i = 0; i < size; ++i)
+        {
+            target[i] = pCDM::wrapPhase(radiansPerUnit * target[i]);
+        }
+    }
+}
+
+/**
+ * Computes blocks of numOutputs result arrays in the kernel's scalar type T and converts them to
+ * t_FP. Kernels computing in t_FP directly write to the targets.
+ */
+template<typename T, size_t numOutputs>
+struct ChunkScratch
 {
+    std::array<std::vector<T>, numOutputs> buffers;
+
+    bool allocate(size_t size)
+    {
+        try
+        {
+            for (auto & buffer : buffers)
+            {
+                buffer.resize(size);
+            }
+        }
+        catch (const std::bad_alloc & /*ex*/)
+        {
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * kernel(x, y, 0, end - begin, outputs) computes the block [begin, end). x and y point to the
+     * coordinates of the point begin.
+     */
+    template<typename Kernel>
+    void compute(const Kernel & kernel, const t_FP * x, const t_FP * y,
+        const size_t begin, const size_t end, t_FP * const * targets)
+    {
+        T * outputs[numOutputs];
+        for (size_t o = 0; o < numOutputs; ++o)
+        {
+            outputs[o] = buffers[o].data();
+        }
+        kernel(x, y, 0, end - begin, outputs);
+
+        for (size_t o = 0; o < numOutputs; ++o)
+        {
+            std::copy(buffers[o].begin(), buffers[o].begin() + (end - begin), targets[o] + begin);
+        }
+    }
+};
+
+template<size_t numOutputs>
+struct ChunkScratch<t_FP, numOutputs>
+{
+    bool allocate(size_t /*size*/)
+    {
+        return true;
+    }
+
+    template<typename Kernel>
+    void compute(const Kernel & kernel, const t_FP * x, const t_FP * y,
+        const size_t begin, const size_t end, t_FP * const * targets)
+    {
+        t_FP * outputs[numOutputs];
+        for (size_t o = 0; o < numOutputs; ++o)
+        {
+            outputs[o] = targets[o] + begin;
+        }
+        kernel(x, y, 0, end - begin, outputs);
+    }
+};
+
+/**
+ * Call func(x, y) with the coordinates of the points [begin, end), with x and y pointing to the
+ * coordinates of the point begin. Grid coordinates are generated for the block.
+ * @return false if running out of memory.
+ */
+template<typename Func>
+bool withBlockCoordinates(const pCDM::HorizontalCoordinates & coords,
+    const size_t begin, const size_t end, const Func & func)
+{
+    pCDM::HorizontalCoordinates::Columns buffers;
+    std::array<const t_FP *, 2> xy;
     try
     {
-        PTDdispSurf(horizontalCoords, xy0, depth, strike, dipRad, DV, nu, ue_un_uv);
+        xy = coords.block(begin, end, buffers);
     }
-    catch (...)
+    catch (const std::bad_alloc & /*ex*/)
     {
-        exceptionPtr = std::current_exception();
+        return false;
     }
+
+    func(xy[0], xy[1]);
+    return true;
 }
 
 }
 
 
-PCDMBackend::PCDMBackend()
+const size_t PCDMBackendBase::chunkSize;
+
+PCDMBackendBase::PCDMBackendBase()
     : QObject()
     , m_state{ State::uninitialized }
+    , m_kernelVariant{ pCDM::bestKernelVariant() }
+    , m_numThreads{ 0 }
+    , m_horizontalCoords{ std::make_shared<const pCDM::HorizontalCoordinates>() }
 {
 }
 
-PCDMBackend::~PCDMBackend() = default;
+PCDMBackendBase::~PCDMBackendBase() = default;
 
-auto PCDMBackend::state() const -> State
+auto PCDMBackendBase::state() const -> State
 {
     return m_state;
 }
 
-void PCDMBackend::setHorizontalCoords(const std::array<std::vector<t_FP>, 2> & coords)
+void PCDMBackendBase::setHorizontalCoords(const pCDM::HorizontalCoordinates & coords)
 {
-    if (coords[0].size() != coords[1].size())
+    setHorizontalCoords(std::make_shared<const pCDM::HorizontalCoordinates>(coords));
+}
+
+void PCDMBackendBase::setHorizontalCoords(const pCDM::HorizontalCoordinates::Columns & columns)
+{
+    setHorizontalCoords(std::make_shared<const pCDM::HorizontalCoordinates>(columns));
+}
+
+void PCDMBackendBase::setHorizontalCoords(pCDM::SharedHorizontalCoordinates coords)
+{
+    if (!coords)
+    {
+        coords = std::make_shared<const pCDM::HorizontalCoordinates>();
+    }
+
+    if (!coords->isValid())
     {
         qWarning() << "Input X, Y must have same size";
         setState(State::invalidParameters);
         return;
     }
 
-    m_horizontalCoords = coords;
+    m_horizontalCoords = std::move(coords);
 
     setState(State::parametersChanged);
 }
 
-const std::array<std::vector<t_FP>, 2> & PCDMBackend::horizontalCoords() const
+const pCDM::HorizontalCoordinates & PCDMBackendBase::horizontalCoords() const
+{
+    return *m_horizontalCoords;
+}
+
+pCDM::KernelVariant PCDMBackendBase::kernelVariant() const
+{
+    return m_kernelVariant;
+}
+
+bool PCDMBackendBase::setKernelVariant(pCDM::KernelVariant variant)
+{
+    if (!pCDM::isKernelVariantSupported(variant))
+    {
+        return false;
+    }
+
+    m_kernelVariant = variant;
+
+    return true;
+}
+
+size_t PCDMBackendBase::numThreads() const
+{
+    return m_numThreads;
+}
+
+void PCDMBackendBase::setNumThreads(size_t numThreads)
+{
+    m_numThreads = numThreads;
+}
+
+void PCDMBackendBase::setUnitResponseCache(std::shared_ptr<PCDMUnitResponseCache> cache)
 {
-    return m_horizontalCoords;
+    m_unitResponseCache = std::move(cache);
 }
 
-void PCDMBackend::setParameters(const Parameters & parameters)
+const std::shared_ptr<PCDMUnitResponseCache> & PCDMBackendBase::unitResponseCache() const
+{
+    return m_unitResponseCache;
+}
+
+void PCDMBackendBase::setProgressCallback(ProgressCallback callback)
+{
+    m_progressCallback = std::move(callback);
+}
+
+void PCDMBackendBase::setParameters(const Parameters & parameters)
 {
     if (m_parameters == parameters)
     {
@@ -207,45 +380,78 @@ void PCDMBackend::setParameters(const Parameters & parameters)
     setState(State::parametersChanged);
 }
 
-const PCDMBackend::Parameters & PCDMBackend::parameters() const
+const PCDMBackendBase::Parameters & PCDMBackendBase::parameters() const
 {
     return m_parameters;
 }
 
-auto PCDMBackend::run() -> State
+auto PCDMBackendBase::setState(State state) -> State
+{
+    if (state != State::resultsReady)
+    {
+        clearResults();
+    }
+
+    const auto previousState = m_state;
+    m_state = state;
+    if (previousState != m_state)
+    {
+        emit stateChanged(m_state);
+    }
+
+    return m_state;
+}
+
+bool PCDMBackendBase::checkRunRequired()
 {
     switch (m_state)
     {
-    case PCDMBackend::State::uninitialized:
+    case State::uninitialized:
         break;
-    case PCDMBackend::State::parametersChanged:
+    case State::parametersChanged:
         break;
-    case PCDMBackend::State::errOutOfMemory:
+    case State::errOutOfMemory:
         // Out of memory error in last run: try again
         break;
-    case PCDMBackend::State::invalidParameters:
+    case State::cancelled:
+        break;
+    case State::invalidParameters:
         qWarning() << "Invalid parameters.";
-        return m_state;
-    case PCDMBackend::State::resultsReady:
-        return m_state; // Nothing to do
+        return false;
+    case State::resultsReady:
+        return false; // Nothing to do
     }
 
-    if (m_horizontalCoords[0].size() != m_horizontalCoords[1].size())
+    if (!m_horizontalCoords->isValid())
     {
         qWarning() << "Input X, Y must have same size";
-        return setState(State::invalidParameters);
+        setState(State::invalidParameters);
+        return false;
     }
 
-    if (m_horizontalCoords[0].empty())
+    if (m_horizontalCoords->empty())
     {
         qWarning() << "No input set.";
-        return setState(State::invalidParameters);
+        setState(State::invalidParameters);
+        return false;
     }
 
-    const auto inputSize = static_cast<Eigen::Index>(m_horizontalCoords[0].size());
+    return true;
+}
 
-    const auto & omega = m_parameters.sourceParameters.omega;
-    const auto & DV = m_parameters.sourceParameters.dv;
+pCDM::PCDMConstants PCDMBackendBase::kernelConstants(const bool unitPotencies,
+    const bool excludePoissonsRatio) const
+{
+    return kernelConstantsFor(m_parameters, unitPotencies, excludePoissonsRatio);
+}
+
+pCDM::PCDMConstants PCDMBackendBase::kernelConstantsFor(const Parameters & parameters,
+    const bool unitPotencies, const bool excludePoissonsRatio)
+{
+    const auto & omega = parameters.sourceParameters.omega;
+    const auto & DV = unitPotencies
+        ? std::array<t_FP, 3>{ { 1, 1, 1 } }
+        : parameters.sourceParameters.dv;
 
     const Vector3 rotationRad = Vector3(omega[0], omega[1], omega[2]) * pi / 180.0f;
 
@@ -279,110 +485,694 @@ auto PCDMBackend::run() -> State
     }
     const auto dip3Rad = std::acos(R(2, 2));
 
-    std::array<std::future<void>, 3> PTDdispSurfFutures;
-    std::array<std::exception_ptr, 3> exceptions;
+    pCDM::PCDMConstants constants;
+    constants.xy0[0] = parameters.sourceParameters.horizontalCoord[0];
+    constants.xy0[1] = parameters.sourceParameters.horizontalCoord[1];
+    constants.depth = parameters.sourceParameters.depth;
+    constants.nuScaled = excludePoissonsRatio ? 1.f : 1.f - 2.f * parameters.nu;
+    constants.numPTDs = 0;
+    // PTDs without potency don't contribute to the displacements.
+    const std::array<std::array<t_FP, 2>, 3> strikeDips = { {
+        { strike1, dip1Rad }, { strike2, dip2Rad }, { strike3, dip3Rad } } };
+    for (size_t i = 0; i < 3; ++i)
+    {
+        if (DV[i] != 0)
+        {
+            constants.ptds[constants.numPTDs++] =
+                ptdConstants(strikeDips[i][0], strikeDips[i][1], DV[i]);
+        }
+    }
+
+    return constants;
+}
 
-    // Calculate contribution of the first PTD
-    ArrayX3 ue_un_uv1;
-    if (DV[0] != 0)
+pCDM::PCDMJacobianConstants PCDMBackendBase::jacobianConstantsFor(const Parameters & parameters)
+{
+    const auto & omega = parameters.sourceParameters.omega;
+    const auto & DV = parameters.sourceParameters.dv;
+    const auto degToRad = pi / 180.0f;
+
+    // Rotations as in kernelConstantsFor, and their derivatives with respect to omega:
+    // d/da AngleAxis(-a, axis) = -[axis]_x * AngleAxis(-a, axis)
+    const std::array<Vector3, 3> axes = { { Vector3::UnitX(), Vector3::UnitY(), Vector3::UnitZ() } };
+    std::array<Matrix3, 3> rotations, derivatives;
+    for (size_t i = 0; i < 3; ++i)
     {
-        PTDdispSurfFutures[0] = 
-            std::async(
-                std::launch::async,
-                PTDdispSurf_checked,
-                m_horizontalCoords,
-                m_parameters.sourceParameters.horizontalCoord, m_parameters.sourceParameters.depth,
-                strike1, dip1Rad, DV[0], m_parameters.nu,
-                std::ref(ue_un_uv1),
-                std::ref(exceptions[0]));
+        rotations[i] = Eigen::AngleAxis<t_FP>(-omega[i] * degToRad, axes[i]);
+        Matrix3 cross;
+        cross << 0, -axes[i](2), axes[i](1),
+            axes[i](2), 0, -axes[i](0),
+            -axes[i](1), axes[i](0), 0;
+        derivatives[i] = -degToRad * cross * rotations[i];
     }
-    else
+    const auto & Rx = rotations[0], & Ry = rotations[1], & Rz = rotations[2];
+    const Matrix3 R = Rz * Ry * Rx;
+    const std::array<Matrix3, 3> dR = { {
+        Rz * Ry * derivatives[0],
+        Rz * derivatives[1] * Rx,
+        derivatives[2] * Ry * Rx } };
+
+    // The potency tensor includes the factor 1 / 2 / pi of the PTD formulas.
+    const Matrix3 D = Matrix3(Vector3(DV[0], DV[1], DV[2]).asDiagonal()) / (2 * pi);
+
+    pCDM::PCDMJacobianConstants constants;
+    constants.xy0[0] = parameters.sourceParameters.horizontalCoord[0];
+    constants.xy0[1] = parameters.sourceParameters.horizontalCoord[1];
+    constants.depth = parameters.sourceParameters.depth;
+    constants.nuScaled = 1.f - 2.f * parameters.nu;
+
+    const auto storeTensor = [&constants] (size_t index, const Matrix3 & M)
+    {
+        auto & tensor = constants.tensors[index];
+        tensor[0] = M(0, 0);
+        tensor[1] = M(1, 1);
+        tensor[2] = M(2, 2);
+        tensor[3] = M(0, 1);
+        tensor[4] = M(0, 2);
+        tensor[5] = M(1, 2);
+    };
+
+    storeTensor(0, R * D * R.transpose());
+    for (size_t i = 0; i < 3; ++i)
+    {
+        const Matrix3 dM = dR[i] * D * R.transpose();
+        storeTensor(1 + i, dM + dM.transpose());
+    }
+    for (size_t p = 0; p < 3; ++p)
     {
-        ue_un_uv1.resize(inputSize, Eigen::NoChange);
-        ue_un_uv1.setZero();
+        const Vector3 normal = R.col(p);
+        storeTensor(4 + p, normal * normal.transpose() / (2 * pi));
     }
 
-    // Calculate contribution of the second PTD
-    ArrayX3 ue_un_uv2;
-    if (DV[1] != 0)
+    return constants;
+}
+
+bool PCDMBackendBase::combineParts(const std::array<std::vector<t_FP>, 6> & parts, const t_FP nu,
+    std::array<std::vector<t_FP>, 3> & results, const size_t numThreads,
+    const ProgressCallback & progress)
+{
+    std::array<const t_FP *, 6> partPointers;
+    for (size_t p = 0; p < 6; ++p)
     {
-        PTDdispSurfFutures[1] =
-            std::async(
-                std::launch::async,
-                PTDdispSurf_checked,
-                m_horizontalCoords,
-                m_parameters.sourceParameters.horizontalCoord, m_parameters.sourceParameters.depth,
-                strike2, dip2Rad, DV[1], m_parameters.nu,
-                std::ref(ue_un_uv2),
-                std::ref(exceptions[1]));
+        partPointers[p] = parts[p].data();
     }
-    else
+    return combineParts(partPointers, parts[0].size(), nu, results, numThreads, progress);
+}
+
+bool PCDMBackendBase::combineParts(const std::array<const t_FP *, 6> & parts, const size_t numTuples,
+    const t_FP nu, std::array<std::vector<t_FP>, 3> & results, const size_t numThreads,
+    const ProgressCallback & progress)
+{
+    try
+    {
+        for (auto & component : results)
+        {
+            component.resize(numTuples);
+        }
+    }
+    catch (const std::bad_alloc & /*ex*/)
     {
-        ue_un_uv2.resize(inputSize, Eigen::NoChange);
-        ue_un_uv2.setZero();
+        return false;
     }
 
-    // Calculate contribution of the third PTD
-    ArrayX3 ue_un_uv3;
-    if (DV[2] != 0)
+    const auto nuScaled = 1 - 2 * nu;
+    std::atomic<size_t> numProcessed{ 0 };
+    std::atomic<bool> cancelled{ false };
+    pCDM::ThreadPool::instance().parallelFor(numTuples, chunkSize,
+        [&parts, nuScaled, &results, numTuples, &progress, &numProcessed, &cancelled]
+        (size_t begin, size_t end)
+    {
+        if (cancelled)
+        {
+            return;
+        }
+        for (size_t c = 0; c < 3; ++c)
+        {
+            const auto a = parts[c];
+            const auto b = parts[3 + c];
+            const auto u = results[c].data();
+            for (size_t i = begin; i < end; ++i)
+            {
+                u[i] = a[i] + nuScaled * b[i];
+            }
+        }
+        if (progress && !progress(numProcessed += end - begin, numTuples))
+        {
+            cancelled = true;
+        }
+    }, numThreads);
+
+    return !cancelled;
+}
+
+bool PCDMBackendBase::parallelForBlocks(const size_t numTuples,
+    const std::function<void(size_t, size_t)> & func) const
+{
+    if (!m_progressCallback)
     {
-        PTDdispSurfFutures[2] =
-            std::async(
-                std::launch::async,
-                PTDdispSurf_checked,
-                m_horizontalCoords,
-                m_parameters.sourceParameters.horizontalCoord, m_parameters.sourceParameters.depth,
-                strike3, dip3Rad, DV[2], m_parameters.nu,
-                std::ref(ue_un_uv3),
-                std::ref(exceptions[2]));
+        pCDM::ThreadPool::instance().parallelFor(numTuples, chunkSize, func, m_numThreads);
+        return true;
     }
-    else
+
+    std::atomic<size_t> numProcessed{ 0 };
+    std::atomic<bool> cancelled{ false };
+
+    pCDM::ThreadPool::instance().parallelFor(numTuples, chunkSize,
+        [this, numTuples, &func, &numProcessed, &cancelled] (size_t begin, size_t end)
+    {
+        if (cancelled)
+        {
+            return;
+        }
+        func(begin, end);
+        if (!m_progressCallback(numProcessed += end - begin, numTuples))
+        {
+            cancelled = true;
+        }
+    }, m_numThreads);
+
+    return !cancelled;
+}
+
+bool PCDMBackendBase::Parameters::operator==(const Parameters & other) const
+{
+    return sourceParameters == other.sourceParameters
+        && nu == other.nu;
+}
+
+bool PCDMBackendBase::Parameters::operator!=(const Parameters & other) const
+{
+    return !(*this == other);
+}
+
+
+template<typename T>
+PCDMBackendT<T>::PCDMBackendT()
+    : PCDMBackendBase()
+{
+}
+
+template<typename T>
+PCDMBackendT<T>::~PCDMBackendT() = default;
+
+template<typename T>
+auto PCDMBackendT<T>::run() -> State
+{
+    if (!checkRunRequired())
+    {
+        return m_state;
+    }
+
+    bool cancelled = false;
+    const auto responses = unitResponses(cancelled);
+    if (cancelled)
+    {
+        return setState(State::cancelled);
+    }
+
+    const auto constants = kernelConstants();
+
+    const auto numTuples = m_horizontalCoords->size();
+    try
+    {
+        for (auto & component : m_results)
+        {
+            component.resize(numTuples);
+        }
+    }
+    catch (const std::bad_alloc & /*ex*/)
+    {
+        return setState(State::errOutOfMemory);
+    }
+
+    const auto ue = m_results[0].data();
+    const auto un = m_results[1].data();
+    const auto uv = m_results[2].data();
+
+    if (responses)
+    {
+        const auto & DV = m_parameters.sourceParameters.dv;
+        const auto nuScaled = constants.nuScaled;
+        T * const outputs[3] = { ue, un, uv };
+        if (!parallelForBlocks(numTuples,
+            [&responses, &DV, nuScaled, &outputs] (size_t begin, size_t end)
+        {
+            combineUnitResponses(*responses, DV, nuScaled, begin, end, outputs);
+        }))
+        {
+            return setState(State::cancelled);
+        }
+
+        return setState(State::resultsReady);
+    }
+
+    const auto kernel = pCDM::kernelFunction<T>(m_kernelVariant);
+    assert(kernel);
+
+    const auto & coords = *m_horizontalCoords;
+    std::atomic<bool> outOfMemory{ false };
+
+    const auto completed = parallelForBlocks(numTuples,
+        [kernel, &constants, &coords, ue, un, uv, &outOfMemory] (size_t begin, size_t end)
+    {
+        if (!withBlockCoordinates(coords, begin, end,
+            [kernel, &constants, begin, end, ue, un, uv] (const t_FP * x, const t_FP * y)
+        {
+            kernel(constants, x, y, 0, end - begin, ue + begin, un + begin, uv + begin);
+        }))
+        {
+            outOfMemory = true;
+        }
+    });
+
+    if (outOfMemory)
+    {
+        clearResults();
+        return setState(State::errOutOfMemory);
+    }
+    if (!completed)
+    {
+        return setState(State::cancelled);
+    }
+
+    return setState(State::resultsReady);
+}
+
+template<typename T>
+auto PCDMBackendT<T>::runInto(std::array<std::vector<t_FP>, 3> & targets) -> State
+{
+    if (m_state != State::resultsReady && !checkRunRequired())
+    {
+        return m_state;
+    }
+
+    std::array<t_FP *, 3> outputs;
+    if (!prepareTargets(targets, outputs))
     {
-        ue_un_uv3.resize(inputSize, Eigen::NoChange);
-        ue_un_uv3.setZero();
+        return setState(State::errOutOfMemory);
     }
 
-    assert(PTDdispSurfFutures.size() == exceptions.size());
-    for (size_t i = 0; i < PTDdispSurfFutures.size(); ++i)
+    return runInto(outputs);
+}
+
+template<typename T>
+auto PCDMBackendT<T>::runInto(const std::array<t_FP *, 3> & targets) -> State
+{
+    if (m_state == State::resultsReady)
     {
-        PTDdispSurfFutures[i].get();
-        if (!exceptions[i])
+        // Results computed by run() are still available, only convert them.
+        for (size_t c = 0; c < 3; ++c)
         {
-            continue;
+            std::copy(m_results[c].begin(), m_results[c].end(), targets[c]);
         }
+        return State::resultsReady;
+    }
+
+    if (!checkRunRequired())
+    {
+        return m_state;
+    }
+
+    clearResults();
+
+    bool cancelled = false;
+    const auto responses = unitResponses(cancelled);
+    if (cancelled)
+    {
+        return setState(State::cancelled);
+    }
+    const auto constants = kernelConstants();
+    const auto & DV = m_parameters.sourceParameters.dv;
+    const auto kernel = pCDM::kernelFunction<T>(m_kernelVariant);
+    assert(kernel);
+
+    return evaluateInto(targets, responses != nullptr,
+        [&responses, &DV, &constants] (size_t begin, size_t end, t_FP * const * outputs)
+    {
+        combineUnitResponses(*responses, DV, constants.nuScaled, begin, end, outputs);
+    },
+        [kernel, &constants] (const t_FP * x, const t_FP * y, size_t begin, size_t end,
+            T * const * outputs)
+    {
+        kernel(constants, x, y, begin, end, outputs[0], outputs[1], outputs[2]);
+    });
+}
+
+template<typename T>
+auto PCDMBackendT<T>::runLineOfSightInto(const pCDM::LineOfSight & los, std::vector<t_FP> & target)
+    -> State
+{
+    if (m_state != State::resultsReady && !checkRunRequired())
+    {
+        return m_state;
+    }
+
+    try
+    {
+        target.resize(m_horizontalCoords->size());
+    }
+    catch (const std::bad_alloc & /*ex*/)
+    {
+        return setState(State::errOutOfMemory);
+    }
+
+    return runLineOfSightInto(los, target.data());
+}
+
+template<typename T>
+auto PCDMBackendT<T>::runLineOfSightInto(const pCDM::LineOfSight & los, t_FP * const target)
+    -> State
+{
+    const auto numTuples = m_horizontalCoords->size();
+
+    if (m_state == State::resultsReady)
+    {
+        // Results computed by run() are still available, only project them.
+        pCDM::ThreadPool::instance().parallelFor(numTuples, chunkSize,
+            [this, &los, target] (size_t begin, size_t end)
+        {
+            const T * const u[3] = {
+                m_results[0].data() + begin, m_results[1].data() + begin, m_results[2].data() + begin };
+            projectOntoLineOfSight(los, begin, end - begin, u, target + begin);
+        }, m_numThreads);
+        return State::resultsReady;
+    }
+
+    if (!checkRunRequired())
+    {
+        return m_state;
+    }
+
+    clearResults();
+
+    bool cancelled = false;
+    const auto responses = unitResponses(cancelled);
+    if (cancelled)
+    {
+        return setState(State::cancelled);
+    }
+    const auto constants = kernelConstants();
+    const auto & DV = m_parameters.sourceParameters.dv;
+    const auto kernel = pCDM::kernelFunction<T>(m_kernelVariant);
+    assert(kernel);
+
+    const auto & coords = *m_horizontalCoords;
+    std::atomic<bool> outOfMemory{ false };
+
+    // Displacement components are only held for a block of points per thread.
+    const auto completed = parallelForBlocks(numTuples,
+        [&responses, &DV, &constants, kernel, &coords, &los, target, &outOfMemory]
+        (size_t begin, size_t end)
+    {
+        const auto size = end - begin;
+        std::array<std::vector<T>, 3> u;
         try
         {
-            std::rethrow_exception(exceptions[i]);
+            for (auto & component : u)
+            {
+                component.resize(size);
+            }
         }
         catch (const std::bad_alloc & /*ex*/)
         {
-            return setState(State::errOutOfMemory);
+            outOfMemory = true;
+            return;
         }
+        T * const outputs[3] = { u[0].data(), u[1].data(), u[2].data() };
+
+        if (responses)
+        {
+            combineUnitResponses(*responses, DV, constants.nuScaled, begin, end, outputs, begin);
+        }
+        else if (!withBlockCoordinates(coords, begin, end,
+            [kernel, &constants, size, &outputs] (const t_FP * x, const t_FP * y)
+        {
+            kernel(constants, x, y, 0, size, outputs[0], outputs[1], outputs[2]);
+        }))
+        {
+            outOfMemory = true;
+            return;
+        }
+
+        projectOntoLineOfSight(los, begin, size, outputs, target + begin);
+    });
+
+    if (outOfMemory)
+    {
+        return setState(State::errOutOfMemory);
+    }
+    if (!completed)
+    {
+        return setState(State::cancelled);
     }
 
-    const auto numTuples = static_cast<size_t>(ue_un_uv1.rows());
-    m_results[0].resize(numTuples);
-    m_results[1].resize(numTuples);
-    m_results[2].resize(numTuples);
+    return State::resultsReady;
+}
 
-    Eigen::Map<VectorX> ue(m_results[0].data(), ue_un_uv1.rows());
-    Eigen::Map<VectorX> un(m_results[1].data(), ue_un_uv1.rows());
-    Eigen::Map<VectorX> uv(m_results[2].data(), ue_un_uv1.rows());
+template<typename T>
+auto PCDMBackendT<T>::runPartsInto(std::array<std::vector<t_FP>, 6> & parts) -> State
+{
+    // Parts are not stored in the backend, so compute them even if results are ready.
+    if (m_state != State::resultsReady && !checkRunRequired())
+    {
+        return m_state;
+    }
 
-    ue = ue_un_uv1.col(0) + ue_un_uv2.col(0) + ue_un_uv3.col(0);
-    un = ue_un_uv1.col(1) + ue_un_uv2.col(1) + ue_un_uv3.col(1);
-    uv = ue_un_uv1.col(2) + ue_un_uv2.col(2) + ue_un_uv3.col(2);
+    bool cancelled = false;
+    const auto responses = unitResponses(cancelled);
+    if (cancelled)
+    {
+        return setState(State::cancelled);
+    }
+    const auto constants = kernelConstants(false, true);
+    const auto & DV = m_parameters.sourceParameters.dv;
+    const auto kernel = pCDM::partsKernelFunction<T>(m_kernelVariant);
+    assert(kernel);
 
-    return setState(State::resultsReady);
+    std::array<t_FP *, 6> outputs;
+    if (!prepareTargets(parts, outputs))
+    {
+        return setState(State::errOutOfMemory);
+    }
+
+    return evaluateInto(outputs, responses != nullptr,
+        [&responses, &DV] (size_t begin, size_t end, t_FP * const * outputs)
+    {
+        combineUnitResponseParts(*responses, DV, begin, end, outputs);
+    },
+        [kernel, &constants] (const t_FP * x, const t_FP * y, size_t begin, size_t end,
+            T * const * outputs)
+    {
+        kernel(constants, x, y, begin, end, outputs);
+    });
 }
 
-const std::array<std::vector<t_FP>, 3> & PCDMBackend::results() const
+template<typename T>
+auto PCDMBackendT<T>::runJacobianInto(JacobianOutputs & outputs) -> State
+{
+    // Derivatives are not stored in the backend, so compute them even if results are ready.
+    if (m_state != State::resultsReady && !checkRunRequired())
+    {
+        return m_state;
+    }
+
+    const auto constants = jacobianConstantsFor(m_parameters);
+    const auto kernel = pCDM::jacobianKernelFunction<T>(m_kernelVariant);
+    assert(kernel);
+
+    std::array<t_FP *, pCDM::numJacobianOutputs> targets;
+    if (!prepareTargets(outputs, targets))
+    {
+        return setState(State::errOutOfMemory);
+    }
+
+    return evaluateInto(targets, false,
+        [] (size_t /*begin*/, size_t /*end*/, t_FP * const * /*outputs*/) { },
+        [kernel, &constants] (const t_FP * x, const t_FP * y, size_t begin, size_t end,
+            T * const * outputs)
+    {
+        kernel(constants, x, y, begin, end, outputs);
+    });
+}
+
+template<typename T>
+template<size_t numOutputs>
+bool PCDMBackendT<T>::prepareTargets(std::array<std::vector<t_FP>, numOutputs> & targets,
+    std::array<t_FP *, numOutputs> & outputs) const
+{
+    const auto numTuples = m_horizontalCoords->size();
+    try
+    {
+        for (size_t o = 0; o < numOutputs; ++o)
+        {
+            targets[o].resize(numTuples);
+            outputs[o] = targets[o].data();
+        }
+    }
+    catch (const std::bad_alloc & /*ex*/)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+template<typename T>
+template<size_t numOutputs, typename Combine, typename Kernel>
+auto PCDMBackendT<T>::evaluateInto(const std::array<t_FP *, numOutputs> & outputs,
+    const bool useUnitResponses, const Combine & combine, const Kernel & kernel) -> State
+{
+    const auto numTuples = m_horizontalCoords->size();
+
+    if (useUnitResponses)
+    {
+        if (!parallelForBlocks(numTuples, [&combine, &outputs] (size_t begin, size_t end)
+        {
+            combine(begin, end, outputs.data());
+        }))
+        {
+            return setState(State::cancelled);
+        }
+
+        return State::resultsReady;
+    }
+
+    const auto & coords = *m_horizontalCoords;
+    std::atomic<bool> outOfMemory{ false };
+
+    const auto completed = parallelForBlocks(numTuples,
+        [&kernel, &coords, &outputs, &outOfMemory] (size_t begin, size_t end)
+    {
+        ChunkScratch<T, numOutputs> scratch;
+        if (!scratch.allocate(end - begin)
+            || !withBlockCoordinates(coords, begin, end,
+                [&kernel, &scratch, begin, end, &outputs] (const t_FP * x, const t_FP * y)
+            {
+                scratch.compute(kernel, x, y, begin, end, outputs.data());
+            }))
+        {
+            outOfMemory = true;
+        }
+    });
+
+    if (outOfMemory)
+    {
+        return setState(State::errOutOfMemory);
+    }
+    if (!completed)
+    {
+        return setState(State::cancelled);
+    }
+
+    return State::resultsReady;
+}
+
+template<typename T>
+size_t PCDMBackendT<T>::estimatedMemoryFootprint(size_t numTuples)
+{
+    return numTuples * 3u * sizeof(T);
+}
+
+template<typename T>
+size_t PCDMBackendT<T>::estimatedUnitResponsesFootprint(size_t numTuples)
+{
+    return numTuples * 18u * sizeof(T);
+}
+
+template<typename T>
+auto PCDMBackendT<T>::unitResponses(bool & cancelled) -> std::shared_ptr<const PCDMUnitResponses<T>>
+{
+    cancelled = false;
+
+    if (!m_unitResponseCache)
+    {
+        return{};
+    }
+
+    const auto repeatedGeometry = m_unitResponseCache->recordGeometry(m_horizontalCoords, m_parameters);
+
+    if (auto cached = m_unitResponseCache->responses<T>())
+    {
+        if (cached->isValidFor(m_horizontalCoords, m_parameters))
+        {
+            return cached;
+        }
+    }
+
+    // Release outdated responses before allocating new ones.
+    m_unitResponseCache->clear();
+
+    // Geometry changes are cheaper with the fused kernel than with 18 response arrays.
+    if (!repeatedGeometry)
+    {
+        return{};
+    }
+
+    const auto numTuples = m_horizontalCoords->size();
+    auto responses = std::make_shared<PCDMUnitResponses<T>>();
+    std::array<T *, 18> outputs;
+    try
+    {
+        for (size_t i = 0; i < 18; ++i)
+        {
+            responses->values[i].resize(numTuples);
+            outputs[i] = responses->values[i].data();
+        }
+    }
+    catch (const std::bad_alloc & /*ex*/)
+    {
+        // Compute the results without the cache.
+        return{};
+    }
+
+    const auto constants = kernelConstants(true, true);
+
+    const auto kernel = pCDM::ptdKernelFunction<T>(m_kernelVariant);
+    assert(kernel);
+
+    const auto & coords = *m_horizontalCoords;
+    std::atomic<bool> outOfMemory{ false };
+
+    const auto completed = parallelForBlocks(numTuples,
+        [kernel, &constants, &coords, &outputs, &outOfMemory] (size_t begin, size_t end)
+    {
+        if (!withBlockCoordinates(coords, begin, end,
+            [kernel, &constants, begin, end, &outputs] (const t_FP * x, const t_FP * y)
+        {
+            T * blockOutputs[18];
+            for (size_t i = 0; i < 18; ++i)
+            {
+                blockOutputs[i] = outputs[i] + begin;
+            }
+            kernel(constants, x, y, 0, end - begin, blockOutputs);
+        }))
+        {
+            outOfMemory = true;
+        }
+    });
+
+    if (outOfMemory || !completed)
+    {
+        cancelled = !completed;
+        return{};
+    }
+
+    responses->coords = m_horizontalCoords;
+    responses->sourceParameters = m_parameters.sourceParameters;
+    m_unitResponseCache->setResponses<T>(responses);
+
+    return responses;
+}
+
+template<typename T>
+const std::array<std::vector<T>, 3> & PCDMBackendT<T>::results() const
 {
     assert(m_state == State::resultsReady);
     return m_results;
 }
 
-std::array<std::vector<t_FP>, 3> && PCDMBackend::takeResults()
+template<typename T>
+std::array<std::vector<T>, 3> && PCDMBackendT<T>::takeResults()
 {
     assert(m_state == State::resultsReady);
     if (m_state == State::resultsReady)
@@ -392,33 +1182,75 @@ std::array<std::vector<t_FP>, 3> && PCDMBackend::takeResults()
     return std::move(m_results);
 }
 
-auto PCDMBackend::setState(State state) -> State
+template<typename T>
+void PCDMBackendT<T>::clearResults()
 {
-    if (state != State::resultsReady)
+    for (auto && vec : m_results)
     {
-        for (auto && vec : m_results)
-        {
-            vec.clear();
-        }
+        // Release the memory, which may be required for other result buffers
+        std::vector<T>().swap(vec);
     }
+}
 
-    const auto previousState = m_state;
-    m_state = state;
-    if (previousState != m_state)
-    {
-        emit stateChanged(m_state);
-    }
 
-    return m_state;
+template<typename T>
+bool PCDMUnitResponses<T>::isValidFor(const pCDM::SharedHorizontalCoordinates & otherCoords,
+    const PCDMBackendBase::Parameters & otherParameters) const
+{
+    return coords == otherCoords && sameGeometry(sourceParameters, otherParameters.sourceParameters);
 }
 
-bool PCDMBackend::Parameters::operator==(const Parameters & other) const
+
+template<>
+std::shared_ptr<const PCDMUnitResponses<float>> PCDMUnitResponseCache::responses<float>() const
 {
-    return sourceParameters == other.sourceParameters
-        && nu == other.nu;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_singlePrecision;
 }
 
-bool PCDMBackend::Parameters::operator!=(const Parameters & other) const
+template<>
+std::shared_ptr<const PCDMUnitResponses<double>> PCDMUnitResponseCache::responses<double>() const
 {
-    return !(*this == other);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_doublePrecision;
 }
+
+template<>
+void PCDMUnitResponseCache::setResponses<float>(std::shared_ptr<const PCDMUnitResponses<float>> responses)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_singlePrecision = std::move(responses);
+    m_doublePrecision.reset();
+}
+
+template<>
+void PCDMUnitResponseCache::setResponses<double>(std::shared_ptr<const PCDMUnitResponses<double>> responses)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_doublePrecision = std::move(responses);
+    m_singlePrecision.reset();
+}
+
+void PCDMUnitResponseCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_singlePrecision.reset();
+    m_doublePrecision.reset();
+}
+
+bool PCDMUnitResponseCache::recordGeometry(const pCDM::SharedHorizontalCoordinates & coords,
+    const PCDMBackendBase::Parameters & parameters)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto repeated = coords && m_recordedCoords.lock() == coords
+        && sameGeometry(m_recordedSourceParameters, parameters.sourceParameters);
+    m_recordedCoords = coords;
+    m_recordedSourceParameters = parameters.sourceParameters;
+    return repeated;
+}
+
+
+template struct PCDMUnitResponses<float>;
+template struct PCDMUnitResponses<double>;
+template class PCDMBackendT<float>;
+template class PCDMBackendT<double>;
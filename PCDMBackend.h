@@ -19,13 +19,20 @@
 #pragma once
 
 #include <array>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #include <QObject>
 
+#include "pCDM_kernel.h"
 #include "pCDM_types.h"
 
 
+class PCDMUnitResponseCache;
+
+
 /**
  * pCDM: point Compound Dislocation Model
  * calculates the surface displacements associated with a point CDM that is 
@@ -37,8 +44,10 @@
  *   Created: 2015.5.22
  *   Last modified: 2016.10.18
  *
+ * PCDMBackendBase implements state and parameter handling, independent of the scalar type used
+ * for computations. See PCDMBackendT for the actual computation engines.
 */
-class PCDMBackend : public QObject
+class PCDMBackendBase : public QObject
 {
     Q_OBJECT
 
@@ -49,7 +58,9 @@ public:
         parametersChanged,
         invalidParameters,
         resultsReady,
-        errOutOfMemory
+        errOutOfMemory,
+        /** The progress callback requested to stop the last run. */
+        cancelled
     };
 
     struct Parameters
@@ -63,33 +74,293 @@ public:
     };
 
 public:
-    PCDMBackend();
-    ~PCDMBackend() override;
+    ~PCDMBackendBase() override;
 
     State state() const;
 
-    void setHorizontalCoords(const std::array<std::vector<pCDM::t_FP>, 2> & coords);
-    const std::array<std::vector<pCDM::t_FP>, 2> & horizontalCoords() const;
+    /** Copy the coordinates into a new coordinate snapshot */
+    void setHorizontalCoords(const pCDM::HorizontalCoordinates & coords);
+    void setHorizontalCoords(const pCDM::HorizontalCoordinates::Columns & columns);
+    /** Share a coordinate snapshot, e.g., the one of a PCDMProject */
+    void setHorizontalCoords(pCDM::SharedHorizontalCoordinates coords);
+    const pCDM::HorizontalCoordinates & horizontalCoords() const;
+
+    /**
+     * Kernel implementation used for computations. Defaults to the fastest variant that is supported
+     * by the CPU.
+     */
+    pCDM::KernelVariant kernelVariant() const;
+    /** @return false if the variant is not supported by the build or the CPU. */
+    bool setKernelVariant(pCDM::KernelVariant variant);
 
     void setParameters(const Parameters & parameters);
     const Parameters & parameters() const;
 
-    State run();
+    /**
+     * Maximum number of threads used for computations, including the calling thread.
+     * Defaults to 0, which uses all threads of pCDM::ThreadPool::instance().
+     */
+    size_t numThreads() const;
+    void setNumThreads(size_t numThreads);
 
-    const std::array<std::vector<pCDM::t_FP>, 3> & results() const;
-    /** Take the result memory from the backend, omitting an additional copy step. */
-    std::array<std::vector<pCDM::t_FP>, 3> && takeResults();
+    /**
+     * Cache for unit responses, which may be shared with other backends. If set, run() and runInto()
+     * compute results as linear combination of cached unit responses, if only the potencies
+     * or the Poisson's ratio changed. Computing the unit responses requires memory for 18 values per
+     * coordinate. They are only computed once a run repeats the geometry of the previous run, so
+     * that geometry changes are computed by the fused kernel.
+     * nullptr (default) disables caching.
+     */
+    void setUnitResponseCache(std::shared_ptr<PCDMUnitResponseCache> cache);
+    const std::shared_ptr<PCDMUnitResponseCache> & unitResponseCache() const;
+
+    /**
+     * Called by the computing threads after each block of points, with the number of points
+     * processed in the current pass over the coordinates. Runs computing unit responses make two
+     * passes. Returning false cancels the run: remaining blocks are skipped and the run returns
+     * State::cancelled.
+     * The callback is called concurrently from multiple threads and should return quickly.
+     */
+    using ProgressCallback = std::function<bool(size_t numProcessed, size_t numTotal)>;
+    void setProgressCallback(ProgressCallback callback);
+
+    /**
+     * Compute results for the Poisson's ratio nu from displacement parts computed by runPartsInto.
+     * @param progress Called after each block of points, as set by setProgressCallback.
+     * @return false if running out of memory or if progress returned false.
+     */
+    static bool combineParts(const std::array<std::vector<pCDM::t_FP>, 6> & parts, pCDM::t_FP nu,
+        std::array<std::vector<pCDM::t_FP>, 3> & results, size_t numThreads = 0,
+        const ProgressCallback & progress = {});
+    /** Combine numTuples values of each part, e.g., of a mapped result file. */
+    static bool combineParts(const std::array<const pCDM::t_FP *, 6> & parts, size_t numTuples,
+        pCDM::t_FP nu, std::array<std::vector<pCDM::t_FP>, 3> & results, size_t numThreads = 0,
+        const ProgressCallback & progress = {});
+
+    /**
+     * Point independent parameters for the kernel, derived from parameters
+     * @param unitPotencies Use a potency of 1 for all three PTDs instead of the parameters'
+     *  potencies, e.g., to compute unit responses.
+     * @param excludePoissonsRatio Set nuScaled to 1, to compute displacement parts (see
+     *  pCDM::PartsKernelFunction).
+     */
+    static pCDM::PCDMConstants kernelConstantsFor(const Parameters & parameters,
+        bool unitPotencies = false, bool excludePoissonsRatio = false);
+    /**
+     * Point independent parameters for the Jacobian kernel (see pCDM::JacobianKernelFunction),
+     * derived from parameters
+     */
+    static pCDM::PCDMJacobianConstants jacobianConstantsFor(const Parameters & parameters);
+
+    /**
+     * Number of points per block of work. Blocks are distributed to the threads of the pool, and
+     * chunked evaluation (runInto) uses scratch buffers of this size, if required.
+     */
+    static const size_t chunkSize = 4096;
 
 signals:
     void stateChanged(State state);
 
-private:
+protected:
+    PCDMBackendBase();
+
     State setState(State state);
+    virtual void clearResults() = 0;
 
-private:
+    /** @return whether the current state and inputs require running the kernel. */
+    bool checkRunRequired();
+    /** Kernel constants for the current parameters, see kernelConstantsFor */
+    pCDM::PCDMConstants kernelConstants(bool unitPotencies = false,
+        bool excludePoissonsRatio = false) const;
+    /**
+     * Split [0, numTuples) into blocks of chunkSize points and call func(begin, end) for each of
+     * them on the thread pool. Progress is reported to the progress callback after each block.
+     * @return false if the progress callback cancelled the loop.
+     */
+    bool parallelForBlocks(size_t numTuples, const std::function<void(size_t, size_t)> & func) const;
+
+protected:
     State m_state;
+    pCDM::KernelVariant m_kernelVariant;
+    size_t m_numThreads;
+    std::shared_ptr<PCDMUnitResponseCache> m_unitResponseCache;
+    ProgressCallback m_progressCallback;
 
     Parameters m_parameters;
-    std::array<std::vector<pCDM::t_FP>, 2> m_horizontalCoords;
-    std::array<std::vector<pCDM::t_FP>, 3> m_results;
+    /** Never nullptr */
+    pCDM::SharedHorizontalCoordinates m_horizontalCoords;
+};
+
+
+/**
+ * Displacement parts (see pCDM::PartsKernelFunction) of the three PTDs of a point CDM with unit
+ * potencies. Displacements are linear in the potencies and in (1 - 2nu), so results for any
+ * potencies and Poisson's ratios are linear combinations of the unit responses.
+ */
+template<typename T>
+struct PCDMUnitResponses
+{
+    pCDM::SharedHorizontalCoordinates coords;
+    /** Source parameters the responses are computed for. The potencies are not relevant. */
+    pCDM::PointCDMParameters sourceParameters;
+    /** Displacement parts, ordered as [6 * PTD + 3 * part + component] */
+    std::array<std::vector<T>, 18> values;
+
+    /**
+     * @return whether the responses apply to coordinates and parameters, ignoring potencies and the
+     * Poisson's ratio.
+     */
+    bool isValidFor(const pCDM::SharedHorizontalCoordinates & coords,
+        const PCDMBackendBase::Parameters & parameters) const;
+};
+
+/**
+ * Thread-safe store of the unit responses of the most recently computed geometry. Only one set of
+ * responses (in single or double precision) is kept at a time.
+ * Responses are only worth computing if several runs share a geometry, so the cache also records
+ * the geometry of the latest run.
+ */
+class PCDMUnitResponseCache
+{
+public:
+    template<typename T>
+    std::shared_ptr<const PCDMUnitResponses<T>> responses() const;
+    /** Replace the cached responses, also releasing responses cached in other precisions. */
+    template<typename T>
+    void setResponses(std::shared_ptr<const PCDMUnitResponses<T>> responses);
+    void clear();
+
+    /**
+     * Record the geometry (coordinates, location, depth and rotation) of a run.
+     * @return whether the previously recorded run had the same geometry, i.e., only the potencies
+     * or the Poisson's ratio changed since then.
+     */
+    bool recordGeometry(const pCDM::SharedHorizontalCoordinates & coords,
+        const PCDMBackendBase::Parameters & parameters);
+
+private:
+    mutable std::mutex m_mutex;
+    std::shared_ptr<const PCDMUnitResponses<float>> m_singlePrecision;
+    std::shared_ptr<const PCDMUnitResponses<double>> m_doublePrecision;
+    /** Not owning the coordinates, which are only compared */
+    std::weak_ptr<const pCDM::HorizontalCoordinates> m_recordedCoords;
+    pCDM::PointCDMParameters m_recordedSourceParameters;
+};
+
+template<> std::shared_ptr<const PCDMUnitResponses<float>> PCDMUnitResponseCache::responses<float>() const;
+template<> std::shared_ptr<const PCDMUnitResponses<double>> PCDMUnitResponseCache::responses<double>() const;
+template<> void PCDMUnitResponseCache::setResponses<float>(std::shared_ptr<const PCDMUnitResponses<float>>);
+template<> void PCDMUnitResponseCache::setResponses<double>(std::shared_ptr<const PCDMUnitResponses<double>>);
+
+
+/**
+ * Computation engine that computes results in scalar type T (float or double).
+ * Source parameters and coordinates are passed as pCDM::t_FP in any case.
+ * Single precision engines halve the memory traffic for results and double the SIMD width, while
+ * double precision engines should be used for final results.
+ */
+template<typename T>
+class PCDMBackendT : public PCDMBackendBase
+{
+public:
+    using value_type = T;
+
+    PCDMBackendT();
+    ~PCDMBackendT() override;
+
+    State run();
+
+    /**
+     * Chunked evaluation: compute results directly into caller owned arrays of pCDM::t_FP.
+     * The coordinates are evaluated in blocks of chunkSize points. Engines that don't compute in
+     * pCDM::t_FP convert each block from a small scratch buffer. Thus, the peak memory of
+     * the computation is the size of the target arrays plus a constant, and no result memory is
+     * held by the backend.
+     * The targets are resized to the number of coordinates. As results are not stored in the
+     * backend, the state is not set to resultsReady, but resultsReady is returned on success.
+     */
+    State runInto(std::array<std::vector<pCDM::t_FP>, 3> & targets);
+    /**
+     * Chunked evaluation into caller owned component arrays (east, north, up) that hold at least
+     * one value per coordinate, e.g., the components of a memory-mapped result file or of a
+     * visualization array. Nothing is allocated for the results.
+     */
+    State runInto(const std::array<pCDM::t_FP *, 3> & targets);
+
+    /**
+     * Chunked evaluation of the displacements projected onto the line of sight, e.g., to compare
+     * them with InSAR data. If los has a wavelength, the wrapped phase is computed instead.
+     * Displacement components are only held for a block of points per thread, so the target
+     * requires a third of the memory of runInto's targets.
+     * target and the point directions of los must hold a value per coordinate.
+     */
+    State runLineOfSightInto(const pCDM::LineOfSight & los, pCDM::t_FP * target);
+    /** The target is resized to the number of coordinates. */
+    State runLineOfSightInto(const pCDM::LineOfSight & los, std::vector<pCDM::t_FP> & target);
+
+    /**
+     * Compute the displacement parts A (east, north, up) and B (east, north, up) in chunks, similar
+     * to runInto. Results for any Poisson's ratio nu are A + (1 - 2nu) * B, see combineParts.
+     * The backend's Poisson's ratio is not used.
+     */
+    State runPartsInto(std::array<std::vector<pCDM::t_FP>, 6> & parts);
+
+    using JacobianOutputs = std::array<std::vector<pCDM::t_FP>, pCDM::numJacobianOutputs>;
+    /**
+     * Compute the displacements (east, north, up) and their partial derivatives with respect to
+     * the nine source parameters in chunks, similar to runInto. See pCDM::jacobianOutput for the
+     * order of the outputs. Derivatives with respect to omega are per degree.
+     * All values are derived in a single pass over the coordinates, at a few times the cost of
+     * run(), which is considerably cheaper than finite differences.
+     */
+    State runJacobianInto(JacobianOutputs & outputs);
+
+    /** @return Estimated number of bytes allocated by run() for numTuples coordinates. */
+    static size_t estimatedMemoryFootprint(size_t numTuples);
+    /** @return Estimated number of bytes of unit responses for numTuples coordinates. */
+    static size_t estimatedUnitResponsesFootprint(size_t numTuples);
+
+    const std::array<std::vector<T>, 3> & results() const;
+    /** Take the result memory from the backend, omitting an additional copy step. */
+    std::array<std::vector<T>, 3> && takeResults();
+
+protected:
+    void clearResults() override;
+
+private:
+    /**
+     * @return Unit responses for the current coordinates and parameters from the cache. Computes
+     * and caches them if the previous run had the same geometry. nullptr if caching is disabled,
+     * if the geometry changed, if running out of memory or if the computation is cancelled.
+     * cancelled is set in the latter case.
+     */
+    std::shared_ptr<const PCDMUnitResponses<T>> unitResponses(bool & cancelled);
+
+    /**
+     * Resize the targets to the number of coordinates and store pointers to their data in outputs.
+     * @return false if running out of memory.
+     */
+    template<size_t numOutputs>
+    bool prepareTargets(std::array<std::vector<pCDM::t_FP>, numOutputs> & targets,
+        std::array<pCDM::t_FP *, numOutputs> & outputs) const;
+
+    /**
+     * Compute the outputs blockwise, either by combine(begin, end, outputs) from unit responses,
+     * or by kernel(x, y, begin, end, outputs) with scratch buffers in T. Each output must hold a
+     * value per coordinate.
+     */
+    template<size_t numOutputs, typename Combine, typename Kernel>
+    State evaluateInto(const std::array<pCDM::t_FP *, numOutputs> & outputs,
+        bool useUnitResponses, const Combine & combine, const Kernel & kernel);
+
+private:
+    std::array<std::vector<T>, 3> m_results;
 };
+
+extern template struct PCDMUnitResponses<float>;
+extern template struct PCDMUnitResponses<double>;
+extern template class PCDMBackendT<float>;
+extern template class PCDMBackendT<double>;
+
+using PCDMBackend = PCDMBackendT<pCDM::t_FP>;
+using PCDMBackendFloat = PCDMBackendT<float>;
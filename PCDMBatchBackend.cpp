@@ -0,0 +1,430 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PCDMBatchBackend.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <limits>
+#include <new>
+
+#include <QDebug>
+
+#include "pCDM_thread_pool.h"
+
+
+using pCDM::t_FP;
+
+
+namespace
+{
+
+/**
+ * Kernel constants of all parameter sets. Invalid sets are flagged and don't have constants.
+ */
+void kernelConstants(const std::vector<pCDM::PointCDMParameters> & parameters, const t_FP nu,
+    std::vector<pCDM::PCDMConstants> & constants, std::vector<char> & valid)
+{
+    constants.resize(parameters.size());
+    valid.resize(parameters.size());
+
+    PCDMBackendBase::Parameters setParameters;
+    setParameters.nu = nu;
+    for (size_t s = 0; s < parameters.size(); ++s)
+    {
+        valid[s] = parameters[s].isValid();
+        if (!valid[s])
+        {
+            continue;
+        }
+        setParameters.sourceParameters = parameters[s];
+        constants[s] = PCDMBackendBase::kernelConstantsFor(setParameters);
+    }
+}
+
+}
+
+
+template<typename T>
+const size_t PCDMBatchBackendT<T>::pointBlockSize;
+template<typename T>
+const size_t PCDMBatchBackendT<T>::parameterTileSize;
+template<typename T>
+const size_t PCDMBatchBackendT<T>::maxPointRanges;
+
+template<typename T>
+PCDMBatchBackendT<T>::PCDMBatchBackendT()
+    : m_horizontalCoords{ std::make_shared<const pCDM::HorizontalCoordinates>() }
+    , m_kernelVariant{ pCDM::bestKernelVariant() }
+    , m_numThreads{ 0 }
+    , m_nu{ 0.25 }
+{
+}
+
+template<typename T>
+void PCDMBatchBackendT<T>::setHorizontalCoords(pCDM::SharedHorizontalCoordinates coords)
+{
+    m_horizontalCoords = coords
+        ? std::move(coords)
+        : std::make_shared<const pCDM::HorizontalCoordinates>();
+}
+
+template<typename T>
+const pCDM::HorizontalCoordinates & PCDMBatchBackendT<T>::horizontalCoords() const
+{
+    return *m_horizontalCoords;
+}
+
+template<typename T>
+pCDM::KernelVariant PCDMBatchBackendT<T>::kernelVariant() const
+{
+    return m_kernelVariant;
+}
+
+template<typename T>
+bool PCDMBatchBackendT<T>::setKernelVariant(pCDM::KernelVariant variant)
+{
+    if (!pCDM::isKernelVariantSupported(variant))
+    {
+        return false;
+    }
+
+    m_kernelVariant = variant;
+    return true;
+}
+
+template<typename T>
+size_t PCDMBatchBackendT<T>::numThreads() const
+{
+    return m_numThreads;
+}
+
+template<typename T>
+void PCDMBatchBackendT<T>::setNumThreads(size_t numThreads)
+{
+    m_numThreads = numThreads;
+}
+
+template<typename T>
+t_FP PCDMBatchBackendT<T>::poissonsRatio() const
+{
+    return m_nu;
+}
+
+template<typename T>
+void PCDMBatchBackendT<T>::setPoissonsRatio(t_FP nu)
+{
+    m_nu = nu;
+}
+
+template<typename T>
+auto PCDMBatchBackendT<T>::evaluateFields(
+    const std::vector<pCDM::PointCDMParameters> & parameters,
+    std::vector<Fields> & fields) const -> State
+{
+    const auto & coords = *m_horizontalCoords;
+    if (!coords.isValid() || coords.empty())
+    {
+        qWarning() << "No valid input set.";
+        return State::invalidParameters;
+    }
+
+    const auto numTuples = coords.size();
+    const auto numSets = parameters.size();
+
+    std::vector<pCDM::PCDMConstants> constants;
+    std::vector<char> valid;
+    try
+    {
+        fields.resize(numSets);
+        for (auto & field : fields)
+        {
+            for (auto & component : field)
+            {
+                component.resize(numTuples);
+            }
+        }
+        kernelConstants(parameters, m_nu, constants, valid);
+    }
+    catch (const std::bad_alloc & /*ex*/)
+    {
+        fields.clear();
+        return State::errOutOfMemory;
+    }
+
+    for (size_t s = 0; s < numSets; ++s)
+    {
+        if (!valid[s])
+        {
+            for (auto & component : fields[s])
+            {
+                std::fill(component.begin(), component.end(), std::numeric_limits<T>::quiet_NaN());
+            }
+        }
+    }
+
+    const auto kernel = pCDM::kernelFunction<T>(m_kernelVariant);
+    assert(kernel);
+
+    const auto success = forEachTile(numSets,
+        [kernel, &constants, &valid, &fields] (size_t /*range*/, size_t setsBegin, size_t setsEnd,
+            size_t begin, size_t end, const t_FP * x, const t_FP * y, Fields & /*scratch*/)
+    {
+        for (size_t s = setsBegin; s < setsEnd; ++s)
+        {
+            if (!valid[s])
+            {
+                continue;
+            }
+            auto & field = fields[s];
+            kernel(constants[s], x, y, 0, end - begin,
+                field[0].data() + begin, field[1].data() + begin, field[2].data() + begin);
+        }
+    });
+
+    if (!success)
+    {
+        fields.clear();
+        return State::errOutOfMemory;
+    }
+
+    return State::resultsReady;
+}
+
+template<typename T>
+auto PCDMBatchBackendT<T>::evaluateMisfits(
+    const std::vector<pCDM::PointCDMParameters> & parameters,
+    const Observations & observations,
+    std::vector<t_FP> & misfits) const -> State
+{
+    const auto & coords = *m_horizontalCoords;
+    if (!coords.isValid() || coords.empty())
+    {
+        qWarning() << "No valid input set.";
+        return State::invalidParameters;
+    }
+
+    const auto numTuples = coords.size();
+    for (size_t c = 0; c < 3; ++c)
+    {
+        const auto & values = observations.values[c];
+        const auto & weights = observations.weights[c];
+        if ((!values.empty() && values.size() != numTuples)
+            || (!weights.empty() && weights.size() != values.size()))
+        {
+            qWarning() << "Observations and coordinates must have same size";
+            return State::invalidParameters;
+        }
+    }
+    if ((!observations.lineOfSightValues.empty() && observations.lineOfSightValues.size() != numTuples)
+        || (!observations.lineOfSightWeights.empty()
+            && observations.lineOfSightWeights.size() != observations.lineOfSightValues.size()))
+    {
+        qWarning() << "Observations and coordinates must have same size";
+        return State::invalidParameters;
+    }
+    const auto hasPointLos = !observations.pointLineOfSight[0].empty();
+    for (const auto & component : observations.pointLineOfSight)
+    {
+        if (component.size() != (hasPointLos ? numTuples : 0))
+        {
+            qWarning() << "Line of sight and coordinates must have same size";
+            return State::invalidParameters;
+        }
+    }
+
+    const auto numSets = parameters.size();
+    const auto numRanges = numPointRanges();
+
+    std::vector<pCDM::PCDMConstants> constants;
+    std::vector<char> valid;
+    // Partial sums per point range and parameter set
+    std::vector<t_FP> partials;
+    try
+    {
+        misfits.resize(numSets);
+        kernelConstants(parameters, m_nu, constants, valid);
+        partials.resize(numRanges * numSets, 0);
+    }
+    catch (const std::bad_alloc & /*ex*/)
+    {
+        return State::errOutOfMemory;
+    }
+
+    const auto kernel = pCDM::kernelFunction<T>(m_kernelVariant);
+    assert(kernel);
+
+    const auto success = forEachTile(numSets,
+        [kernel, &constants, &valid, &observations, &partials, numSets, hasPointLos]
+        (size_t range, size_t setsBegin, size_t setsEnd,
+            size_t begin, size_t end, const t_FP * x, const t_FP * y, Fields & scratch)
+    {
+        const auto size = end - begin;
+        for (auto & component : scratch)
+        {
+            if (component.size() < size)
+            {
+                component.resize(size);
+            }
+        }
+
+        for (size_t s = setsBegin; s < setsEnd; ++s)
+        {
+            if (!valid[s])
+            {
+                continue;
+            }
+
+            kernel(constants[s], x, y, 0, size,
+                scratch[0].data(), scratch[1].data(), scratch[2].data());
+
+            t_FP sum = 0;
+            for (size_t c = 0; c < 3; ++c)
+            {
+                if (observations.values[c].empty())
+                {
+                    continue;
+                }
+                const auto u = scratch[c].data();
+                const auto obs = observations.values[c].data() + begin;
+                if (observations.weights[c].empty())
+                {
+                    for (size_t i = 0; i < size; ++i)
+                    {
+                        const auto residual = obs[i] - static_cast<t_FP>(u[i]);
+                        sum += residual * residual;
+                    }
+                }
+                else
+                {
+                    const auto w = observations.weights[c].data() + begin;
+                    for (size_t i = 0; i < size; ++i)
+                    {
+                        const auto residual = obs[i] - static_cast<t_FP>(u[i]);
+                        sum += w[i] * residual * residual;
+                    }
+                }
+            }
+            if (!observations.lineOfSightValues.empty())
+            {
+                auto los = observations.lineOfSight;
+                const auto ue = scratch[0].data();
+                const auto un = scratch[1].data();
+                const auto uv = scratch[2].data();
+                const auto obs = observations.lineOfSightValues.data() + begin;
+                const auto w = observations.lineOfSightWeights.empty()
+                    ? nullptr : observations.lineOfSightWeights.data() + begin;
+                for (size_t i = 0; i < size; ++i)
+                {
+                    if (hasPointLos)
+                    {
+                        for (size_t c = 0; c < 3; ++c)
+                        {
+                            los[c] = observations.pointLineOfSight[c][begin + i];
+                        }
+                    }
+                    const auto residual = obs[i] - (los[0] * static_cast<t_FP>(ue[i])
+                        + los[1] * static_cast<t_FP>(un[i]) + los[2] * static_cast<t_FP>(uv[i]));
+                    sum += (w ? w[i] : t_FP(1)) * residual * residual;
+                }
+            }
+            partials[range * numSets + s] += sum;
+        }
+    });
+
+    if (!success)
+    {
+        return State::errOutOfMemory;
+    }
+
+    for (size_t s = 0; s < numSets; ++s)
+    {
+        if (!valid[s])
+        {
+            misfits[s] = std::numeric_limits<t_FP>::infinity();
+            continue;
+        }
+        t_FP misfit = 0;
+        for (size_t r = 0; r < numRanges; ++r)
+        {
+            misfit += partials[r * numSets + s];
+        }
+        misfits[s] = misfit;
+    }
+
+    return State::resultsReady;
+}
+
+template<typename T>
+template<typename BlockFunc>
+bool PCDMBatchBackendT<T>::forEachTile(const size_t numSets, const BlockFunc & blockFunc) const
+{
+    const auto & coords = *m_horizontalCoords;
+    const auto numTuples = coords.size();
+    const auto numBlocks = (numTuples + pointBlockSize - 1) / pointBlockSize;
+    const auto numRanges = numPointRanges();
+    const auto numSetTiles = (numSets + parameterTileSize - 1) / parameterTileSize;
+
+    std::atomic<bool> outOfMemory{ false };
+
+    // Each task evaluates one tile of parameter sets for one range of point blocks.
+    pCDM::ThreadPool::instance().parallelFor(numSetTiles * numRanges, 1,
+        [&] (size_t taskBegin, size_t taskEnd)
+    {
+        pCDM::HorizontalCoordinates::Columns coordsBuffers;
+        Fields scratch;
+        for (size_t task = taskBegin; task < taskEnd; ++task)
+        {
+            const auto range = task % numRanges;
+            const auto setsBegin = (task / numRanges) * parameterTileSize;
+            const auto setsEnd = std::min(numSets, setsBegin + parameterTileSize);
+            const auto blocksBegin = numBlocks * range / numRanges;
+            const auto blocksEnd = numBlocks * (range + 1) / numRanges;
+
+            for (auto block = blocksBegin; block < blocksEnd; ++block)
+            {
+                const auto begin = block * pointBlockSize;
+                const auto end = std::min(numTuples, begin + pointBlockSize);
+                try
+                {
+                    const auto xy = coords.block(begin, end, coordsBuffers);
+                    blockFunc(range, setsBegin, setsEnd, begin, end, xy[0], xy[1], scratch);
+                }
+                catch (const std::bad_alloc & /*ex*/)
+                {
+                    outOfMemory = true;
+                    return;
+                }
+            }
+        }
+    }, m_numThreads);
+
+    return !outOfMemory;
+}
+
+template<typename T>
+size_t PCDMBatchBackendT<T>::numPointRanges() const
+{
+    const auto numBlocks = (m_horizontalCoords->size() + pointBlockSize - 1) / pointBlockSize;
+    return std::max(size_t(1), std::min(numBlocks, maxPointRanges));
+}
+
+
+template class PCDMBatchBackendT<float>;
+template class PCDMBatchBackendT<double>;
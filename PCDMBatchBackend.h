@@ -0,0 +1,132 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "PCDMBackend.h"
+
+
+/**
+ * Evaluates many point CDM parameter sets for one coordinate set, e.g., for parameter sweeps,
+ * Monte Carlo sampling and inversions.
+ *
+ * Work is tiled over points and parameter sets: each task evaluates a tile of parameter sets for
+ * blocks of pointBlockSize points, so that the coordinates (and observations) of a block stay in
+ * the cache while all sets of the tile are evaluated. Kernel constants are derived once per set.
+ * Results are either full displacement fields, or only the misfit of each set to observations,
+ * which does not require memory per point and set.
+ */
+template<typename T>
+class PCDMBatchBackendT
+{
+public:
+    using value_type = T;
+    using State = PCDMBackendBase::State;
+    /** Displacements east, north, up of one parameter set */
+    using Fields = std::array<std::vector<T>, 3>;
+
+    /** Observed displacements (east, north, up) for misfit evaluations */
+    struct Observations
+    {
+        /** Components without values are not included in the misfit. */
+        std::array<std::vector<pCDM::t_FP>, 3> values;
+        /** Per point weights of squared residuals, e.g., inverse variances. Empty for weights of 1. */
+        std::array<std::vector<pCDM::t_FP>, 3> weights;
+        /**
+         * Observed displacements projected onto lineOfSight, e.g., of InSAR data. Empty if not
+         * included in the misfit.
+         */
+        std::vector<pCDM::t_FP> lineOfSightValues;
+        std::vector<pCDM::t_FP> lineOfSightWeights;
+        /** Unit vector (east, north, up) */
+        std::array<pCDM::t_FP, 3> lineOfSight;
+        /** Unit vectors per point, overriding lineOfSight. Empty to use lineOfSight. */
+        std::array<std::vector<pCDM::t_FP>, 3> pointLineOfSight;
+    };
+
+    PCDMBatchBackendT();
+
+    void setHorizontalCoords(pCDM::SharedHorizontalCoordinates coords);
+    const pCDM::HorizontalCoordinates & horizontalCoords() const;
+
+    pCDM::KernelVariant kernelVariant() const;
+    /** @return false if the variant is not supported by the build or the CPU. */
+    bool setKernelVariant(pCDM::KernelVariant variant);
+
+    /** Maximum number of threads, including the calling thread. 0 (default) uses all threads. */
+    size_t numThreads() const;
+    void setNumThreads(size_t numThreads);
+
+    /** Poisson's ratio used for all parameter sets */
+    pCDM::t_FP poissonsRatio() const;
+    void setPoissonsRatio(pCDM::t_FP nu);
+
+    /**
+     * Compute displacement fields for all parameter sets. fields is resized to the number of sets,
+     * each field to the number of coordinates. Fields of invalid parameter sets are set to NaN.
+     */
+    State evaluateFields(const std::vector<pCDM::PointCDMParameters> & parameters,
+        std::vector<Fields> & fields) const;
+
+    /**
+     * Compute the weighted sum of squared residuals between the observations and the displacements
+     * of each parameter set. Misfits of invalid parameter sets are set to infinity.
+     * Sums are accumulated in pCDM::t_FP in a fixed order, so results do not depend on the number of
+     * threads.
+     */
+    State evaluateMisfits(const std::vector<pCDM::PointCDMParameters> & parameters,
+        const Observations & observations,
+        std::vector<pCDM::t_FP> & misfits) const;
+
+    /** Number of points evaluated for all parameter sets of a tile, before moving on */
+    static const size_t pointBlockSize = 1024;
+    /** Number of parameter sets per task */
+    static const size_t parameterTileSize = 64;
+    /**
+     * Maximum number of point ranges tasks are split into. Misfits require a partial sum per
+     * range and parameter set.
+     */
+    static const size_t maxPointRanges = 64;
+
+private:
+    /**
+     * Call blockFunc(range, setsBegin, setsEnd, pointsBegin, pointsEnd, x, y, scratch) for blocks
+     * of points and tiles of parameter sets. range identifies the point range the block belongs
+     * to, x and y point to the coordinates of pointsBegin. scratch is reused by blocks of a task.
+     * @return false if running out of memory.
+     */
+    template<typename BlockFunc>
+    bool forEachTile(size_t numSets, const BlockFunc & blockFunc) const;
+
+    size_t numPointRanges() const;
+
+private:
+    pCDM::SharedHorizontalCoordinates m_horizontalCoords;
+    pCDM::KernelVariant m_kernelVariant;
+    size_t m_numThreads;
+    pCDM::t_FP m_nu;
+};
+
+extern template class PCDMBatchBackendT<float>;
+extern template class PCDMBatchBackendT<double>;
+
+using PCDMBatchBackend = PCDMBatchBackendT<pCDM::t_FP>;
+using PCDMBatchBackendFloat = PCDMBatchBackendT<float>;
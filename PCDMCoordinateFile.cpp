@@ -0,0 +1,157 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "PCDMCoordinateFile.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <memory>
+
+#include <QDebug>
+#include <QFile>
+#include <QSaveFile>
+
+
+using pCDM::t_FP;
+
+
+namespace
+{
+
+/** Written as stored in memory, to detect files written with a different byte order */
+const std::uint32_t byteOrderMark = 0x01020304u;
+
+struct Header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrderMark;
+    std::uint32_t valueSize;
+    std::uint32_t reserved;
+    std::uint64_t numPoints;
+};
+
+static_assert(sizeof(Header) <= PCDMCoordinateFile::headerSize, "Coordinate file header too large");
+static_assert(PCDMCoordinateFile::headerSize % sizeof(t_FP) == 0, "Columns must be aligned");
+
+}
+
+
+const char PCDMCoordinateFile::magic[8] = { 'P', 'C', 'D', 'M', 'C', 'R', 'D', 'S' };
+const std::uint32_t PCDMCoordinateFile::version;
+const size_t PCDMCoordinateFile::headerSize;
+
+bool PCDMCoordinateFile::write(const QString & fileName, const pCDM::HorizontalCoordinates & coords)
+{
+    if (coords.isGrid() || !coords.isValid())
+    {
+        return false;
+    }
+
+    std::array<char, headerSize> headerBytes;
+    headerBytes.fill(0);
+    Header header;
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.byteOrderMark = byteOrderMark;
+    header.valueSize = sizeof(t_FP);
+    header.reserved = 0;
+    header.numPoints = coords.size();
+    std::memcpy(headerBytes.data(), &header, sizeof(header));
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "Cannot open coordinate file for writing:" << fileName;
+        return false;
+    }
+
+    const auto columnBytes = static_cast<qint64>(coords.size() * sizeof(t_FP));
+    bool success = file.write(headerBytes.data(), headerSize) == static_cast<qint64>(headerSize);
+    for (const auto column : coords.columns())
+    {
+        success = success
+            && file.write(reinterpret_cast<const char *>(column), columnBytes) == columnBytes;
+    }
+
+    if (!success || !file.commit())
+    {
+        qWarning() << "Failed to write coordinate file:" << fileName;
+        return false;
+    }
+
+    return true;
+}
+
+pCDM::SharedHorizontalCoordinates PCDMCoordinateFile::map(const QString & fileName)
+{
+    auto file = std::make_shared<QFile>(fileName);
+    if (!file->open(QIODevice::ReadOnly) || file->size() < static_cast<qint64>(headerSize))
+    {
+        return{};
+    }
+
+    Header header;
+    if (file->read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header)
+        || std::memcmp(header.magic, magic, sizeof(magic)) != 0)
+    {
+        qWarning() << "Not a coordinate file:" << fileName;
+        return{};
+    }
+    if (header.version != version
+        || header.byteOrderMark != byteOrderMark
+        || header.valueSize != sizeof(t_FP))
+    {
+        qWarning() << "Unsupported coordinate file version or format:" << fileName;
+        return{};
+    }
+
+    const auto columnBytes = header.numPoints * sizeof(t_FP);
+    if (static_cast<std::uint64_t>(file->size()) != headerSize + 2 * columnBytes)
+    {
+        qWarning() << "Coordinate file size does not match its header:" << fileName;
+        return{};
+    }
+
+    const auto numPoints = static_cast<size_t>(header.numPoints);
+    if (numPoints == 0)
+    {
+        return std::make_shared<const pCDM::HorizontalCoordinates>();
+    }
+
+    const auto data = file->map(0, file->size());
+    if (!data)
+    {
+        qWarning() << "Cannot map coordinate file:" << fileName;
+        return{};
+    }
+    file->close();  // The mapping remains valid.
+
+    // Unmap with the last reference to the coordinates.
+    std::shared_ptr<const void> storage(data, [file] (const void * mapped)
+    {
+        file->unmap(const_cast<uchar *>(static_cast<const uchar *>(mapped)));
+    });
+
+    const auto x = reinterpret_cast<const t_FP *>(data + headerSize);
+    return std::make_shared<const pCDM::HorizontalCoordinates>(
+        pCDM::HorizontalCoordinates::ColumnPointers{ { x, x + numPoints } },
+        numPoints, std::move(storage));
+}
@@ -0,0 +1,58 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+
+#include "pCDM_types.h"
+
+
+class QString;
+
+
+/**
+ * Versioned binary storage of the horizontal coordinates of point cloud projects.
+ *
+ * Files consist of a header of headerSize bytes, followed by the X column and the Y column, stored
+ * as pCDM::t_FP in native byte order. The header size keeps the columns aligned, so that
+ * coordinates are used directly from a read-only memory mapping of the file, without parsing or
+ * copying them. Pages of the mapping are loaded by the operating system on first access.
+ */
+class PCDMCoordinateFile
+{
+public:
+    /**
+     * Write the columns of point coordinates to fileName. The file is replaced atomically, so
+     * that mappings of the previous file remain valid.
+     * @return false if coords is a grid or invalid, or if writing fails.
+     */
+    static bool write(const QString & fileName, const pCDM::HorizontalCoordinates & coords);
+
+    /**
+     * Map the file into memory and reference its columns. The mapping is released with the last
+     * copy of the returned coordinates.
+     * @return nullptr if the file cannot be mapped or is not a valid coordinate file.
+     */
+    static pCDM::SharedHorizontalCoordinates map(const QString & fileName);
+
+    static const char magic[8];
+    static const std::uint32_t version = 1;
+    static const size_t headerSize = 64;
+};
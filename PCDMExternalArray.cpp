@@ -0,0 +1,101 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PCDMExternalArray.h"
+
+#include <cassert>
+#include <mutex>
+#include <unordered_map>
+
+
+using pCDM::t_FP;
+
+
+namespace
+{
+
+/**
+ * Storage referenced by components of VTK arrays. VTK only passes the component pointer to the
+ * free function, so storage is looked up by the pointer. Arrays may be released in any thread.
+ */
+class StorageRegistry
+{
+public:
+    static StorageRegistry & instance()
+    {
+        static StorageRegistry registry;
+        return registry;
+    }
+
+    void add(const void * component, std::shared_ptr<const void> storage)
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        m_storage.emplace(component, std::move(storage));
+    }
+
+    void release(const void * component)
+    {
+        std::shared_ptr<const void> storage;
+        {
+            std::lock_guard<std::mutex> lock{ m_mutex };
+            const auto it = m_storage.find(component);
+            assert(it != m_storage.end());
+            if (it == m_storage.end())
+            {
+                return;
+            }
+            storage = std::move(it->second);
+            m_storage.erase(it);
+        }
+        // storage is released outside of the lock, which may unmap a file.
+    }
+
+private:
+    std::mutex m_mutex;
+    std::unordered_multimap<const void *, std::shared_ptr<const void>> m_storage;
+};
+
+void releaseComponent(void * component)
+{
+    StorageRegistry::instance().release(component);
+}
+
+}
+
+
+vtkSmartPointer<PCDMExternalArray::Array> PCDMExternalArray::wrap(
+    const std::array<const t_FP *, 3> & components,
+    const size_t numTuples,
+    std::shared_ptr<const void> storage)
+{
+    auto array = vtkSmartPointer<Array>::New();
+    array->SetNumberOfComponents(static_cast<int>(components.size()));
+
+    auto & registry = StorageRegistry::instance();
+    for (size_t c = 0; c < components.size(); ++c)
+    {
+        assert(components[c] || numTuples == 0);
+        registry.add(components[c], storage);
+        // VTK does not provide read-only arrays. The values are not modified by the visualization.
+        array->SetArray(static_cast<int>(c), const_cast<t_FP *>(components[c]),
+            static_cast<vtkIdType>(numTuples), true, false, Array::VTK_DATA_ARRAY_USER_DEFINED);
+        array->SetArrayFreeFunction(static_cast<int>(c), &releaseComponent);
+    }
+
+    return array;
+}
@@ -0,0 +1,46 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <memory>
+
+#include <vtkSmartPointer.h>
+#include <vtkSOADataArrayTemplate.h>
+
+#include "pCDM_types.h"
+
+
+/**
+ * Exposes memory owned outside of VTK, e.g., results mapped from a result file, as VTK data array
+ * without copying it.
+ */
+class PCDMExternalArray
+{
+public:
+    using Array = vtkSOADataArrayTemplate<pCDM::t_FP>;
+
+    /**
+     * Create an array of three components that reference the specified memory. storage keeps the
+     * memory alive until VTK releases the array.
+     * The array must not be modified, as the memory may be shared or read-only.
+     */
+    static vtkSmartPointer<Array> wrap(const std::array<const pCDM::t_FP *, 3> & components,
+        size_t numTuples, std::shared_ptr<const void> storage);
+};
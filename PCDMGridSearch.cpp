@@ -0,0 +1,467 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PCDMGridSearch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <unordered_map>
+
+#include <Eigen/Cholesky>
+#include <Eigen/Core>
+
+#include "PCDMBackend.h"
+#include "pCDM_thread_pool.h"
+
+
+using pCDM::t_FP;
+
+
+namespace
+{
+
+const size_t numPTDs = 3;
+
+/** Weighted sums over all points of the LOS unit responses G of the PTDs and the observations d */
+struct NodeSums
+{
+    /** G^T W G, ordered as 00, 11, 22, 01, 02, 12 */
+    t_FP GG[6];
+    /** G^T W d */
+    t_FP Gd[numPTDs];
+};
+
+/**
+ * Least squares potencies of the same sign, from the normal equations of all subsets of PTDs.
+ * @return the misfit of the potencies.
+ */
+t_FP solvePotencies(const NodeSums & sums, const t_FP dWd, std::array<t_FP, 3> & dv)
+{
+    Eigen::Matrix3d A;
+    A << sums.GG[0], sums.GG[3], sums.GG[4],
+        sums.GG[3], sums.GG[1], sums.GG[5],
+        sums.GG[4], sums.GG[5], sums.GG[2];
+    const Eigen::Vector3d b{ sums.Gd[0], sums.Gd[1], sums.Gd[2] };
+
+    dv = { 0, 0, 0 };
+    auto bestMisfit = dWd;
+
+    for (unsigned subset = 1; subset < (1u << numPTDs); ++subset)
+    {
+        Eigen::Index indices[numPTDs];
+        Eigen::Index size = 0;
+        for (Eigen::Index k = 0; k < Eigen::Index(numPTDs); ++k)
+        {
+            if (subset & (1u << k))
+            {
+                indices[size++] = k;
+            }
+        }
+
+        Eigen::MatrixXd subA(size, size);
+        Eigen::VectorXd subB(size);
+        for (Eigen::Index i = 0; i < size; ++i)
+        {
+            subB(i) = b(indices[i]);
+            for (Eigen::Index j = 0; j < size; ++j)
+            {
+                subA(i, j) = A(indices[i], indices[j]);
+            }
+        }
+        const Eigen::VectorXd x = subA.ldlt().solve(subB);
+
+        if (!x.allFinite() || !((x.array() >= 0).all() || (x.array() <= 0).all()))
+        {
+            continue;
+        }
+
+        // Exact for any x, so that inaccurate solutions of singular systems are not preferred.
+        const auto misfit = std::max(t_FP(0), dWd - 2 * x.dot(subB) + x.dot(subA * x));
+        if (misfit < bestMisfit)
+        {
+            bestMisfit = misfit;
+            dv = { 0, 0, 0 };
+            for (Eigen::Index i = 0; i < size; ++i)
+            {
+                dv[indices[i]] = x(i);
+            }
+        }
+    }
+
+    return bestMisfit;
+}
+
+/** Cell of the lattice, with its lower corner and size in units of the finest lattice */
+struct Cell
+{
+    std::array<std::uint64_t, 3> corner;
+    std::uint64_t size;
+};
+
+}
+
+
+const size_t PCDMGridSearch::pointBlockSize;
+const size_t PCDMGridSearch::maxPointRanges;
+
+PCDMGridSearch::Settings::Settings()
+    : xRange{ { 0, 0 } }
+    , yRange{ { 0, 0 } }
+    , depthRange{ { 0, 0 } }
+    , divisions{ { 8, 8, 4 } }
+    , numLevels{ 4 }
+    , numRefinedCells{ 16 }
+    , numCandidates{ 10 }
+    , omega{ { 0, 0, 0 } }
+    , nu{ 0.25 }
+    , numThreads{ 0 }
+{
+}
+
+PCDMGridSearch::PCDMGridSearch(PCDMObservations observations)
+    : m_observations{ std::move(observations) }
+{
+}
+
+const PCDMObservations & PCDMGridSearch::observations() const
+{
+    return m_observations;
+}
+
+auto PCDMGridSearch::run(const Settings & settings) const -> Result
+{
+    Result result;
+    result.status = Status::invalidInput;
+    result.volumeDimensions = { 0, 0, 0 };
+    result.volumeOrigin = { settings.xRange[0], settings.yRange[0], settings.depthRange[0] };
+    result.volumeSpacing = { 0, 0, 0 };
+
+    const std::array<std::array<t_FP, 2>, 3> ranges = {
+        settings.xRange, settings.yRange, settings.depthRange };
+    if (!m_observations.isValid()
+        || settings.numLevels == 0 || settings.numLevels > 20
+        || !(settings.depthRange[0] >= 0)
+        || std::any_of(ranges.begin(), ranges.end(),
+            [] (const std::array<t_FP, 2> & range) { return !(range[0] <= range[1]); })
+        || std::any_of(settings.divisions.begin(), settings.divisions.end(),
+            [] (size_t divisions) { return divisions == 0; }))
+    {
+        return result;
+    }
+
+    const auto & coords = *m_observations.coords;
+    const auto & pointLos = m_observations.pointLineOfSight;
+    const auto hasPointLos = m_observations.hasPointLineOfSight();
+    const auto & obs = m_observations.values;
+    const auto & weights = m_observations.weights;
+    const auto numTuples = coords.size();
+    const auto numBlocks = (numTuples + pointBlockSize - 1) / pointBlockSize;
+    const auto numRanges = std::max(size_t(1), std::min(numBlocks, maxPointRanges));
+    const auto nuScaled = 1 - 2 * settings.nu;
+
+    const auto kernel = pCDM::ptdKernelFunction<t_FP>(pCDM::bestKernelVariant());
+    assert(kernel);
+
+    // Lattice coordinates in units of the finest lattice
+    const std::uint64_t finestPerCell = std::uint64_t(1) << (settings.numLevels - 1);
+    std::array<std::uint64_t, 3> numFinestNodes;
+    std::array<t_FP, 3> finestSpacing;
+    for (size_t a = 0; a < 3; ++a)
+    {
+        numFinestNodes[a] = settings.divisions[a] * finestPerCell + 1;
+        finestSpacing[a] = (ranges[a][1] - ranges[a][0])
+            / static_cast<t_FP>(settings.divisions[a] * finestPerCell);
+    }
+    const auto nodeKey = [&numFinestNodes] (const std::array<std::uint64_t, 3> & index)
+    {
+        return (index[2] * numFinestNodes[1] + index[1]) * numFinestNodes[0] + index[0];
+    };
+
+    try
+    {
+        t_FP dWd = 0;
+        for (size_t i = 0; i < numTuples; ++i)
+        {
+            dWd += (weights.empty() ? 1 : weights[i]) * obs[i] * obs[i];
+        }
+
+        std::unordered_map<std::uint64_t, size_t> nodeIndices;
+
+        // Evaluate all nodes that are not evaluated yet.
+        const auto evaluateNodes = [&] (const std::vector<std::array<std::uint64_t, 3>> & indices,
+            const size_t level)
+        {
+            std::vector<std::array<std::uint64_t, 3>> newIndices;
+            for (const auto & index : indices)
+            {
+                const auto key = nodeKey(index);
+                if (nodeIndices.find(key) == nodeIndices.end())
+                {
+                    nodeIndices.emplace(key, result.nodes.size() + newIndices.size());
+                    newIndices.push_back(index);
+                }
+            }
+            const auto numNodes = newIndices.size();
+            if (numNodes == 0)
+            {
+                return true;
+            }
+
+            std::vector<pCDM::PCDMConstants> constants(numNodes);
+            PCDMBackendBase::Parameters parameters;
+            parameters.nu = settings.nu;
+            parameters.sourceParameters.omega = settings.omega;
+            parameters.sourceParameters.dv = { 1, 1, 1 };
+            for (size_t n = 0; n < numNodes; ++n)
+            {
+                auto & source = parameters.sourceParameters;
+                source.horizontalCoord[0] = ranges[0][0] + finestSpacing[0] * static_cast<t_FP>(newIndices[n][0]);
+                source.horizontalCoord[1] = ranges[1][0] + finestSpacing[1] * static_cast<t_FP>(newIndices[n][1]);
+                source.depth = ranges[2][0] + finestSpacing[2] * static_cast<t_FP>(newIndices[n][2]);
+                constants[n] = PCDMBackendBase::kernelConstantsFor(parameters, true, true);
+
+                Node node;
+                node.parameters = source;
+                node.misfit = std::numeric_limits<t_FP>::infinity();
+                node.level = level;
+                result.nodes.push_back(node);
+            }
+
+            // Partial sums per point range and node, reduced in a fixed order below
+            std::vector<NodeSums> partials(numRanges * numNodes, NodeSums{});
+            std::atomic<bool> outOfMemory{ false };
+
+            pCDM::ThreadPool::instance().parallelFor(numNodes * numRanges, 1,
+                [&] (size_t taskBegin, size_t taskEnd)
+            {
+                try
+                {
+                    pCDM::HorizontalCoordinates::Columns coordsBuffers;
+                    std::vector<t_FP> scratch(18 * pointBlockSize);
+                    t_FP * outputs[18];
+                    for (size_t o = 0; o < 18; ++o)
+                    {
+                        outputs[o] = scratch.data() + o * pointBlockSize;
+                    }
+
+                    for (size_t task = taskBegin; task < taskEnd; ++task)
+                    {
+                        const auto node = task / numRanges;
+                        const auto range = task % numRanges;
+                        auto & sums = partials[range * numNodes + node];
+                        const auto blocksBegin = numBlocks * range / numRanges;
+                        const auto blocksEnd = numBlocks * (range + 1) / numRanges;
+
+                        for (auto block = blocksBegin; block < blocksEnd; ++block)
+                        {
+                            const auto begin = block * pointBlockSize;
+                            const auto end = std::min(numTuples, begin + pointBlockSize);
+                            const auto xy = coords.block(begin, end, coordsBuffers);
+                            kernel(constants[node], xy[0], xy[1], 0, end - begin, outputs);
+
+                            auto los = m_observations.lineOfSight;
+                            for (size_t i = 0; i < end - begin; ++i)
+                            {
+                                if (hasPointLos)
+                                {
+                                    for (size_t c = 0; c < 3; ++c)
+                                    {
+                                        los[c] = pointLos[c][begin + i];
+                                    }
+                                }
+                                t_FP g[numPTDs];
+                                for (size_t k = 0; k < numPTDs; ++k)
+                                {
+                                    g[k] = 0;
+                                    for (size_t c = 0; c < 3; ++c)
+                                    {
+                                        g[k] += los[c] * (outputs[6 * k + c][i]
+                                            + nuScaled * outputs[6 * k + 3 + c][i]);
+                                    }
+                                }
+                                const t_FP w = weights.empty() ? 1 : weights[begin + i];
+                                const auto wd = w * obs[begin + i];
+                                sums.GG[0] += w * g[0] * g[0];
+                                sums.GG[1] += w * g[1] * g[1];
+                                sums.GG[2] += w * g[2] * g[2];
+                                sums.GG[3] += w * g[0] * g[1];
+                                sums.GG[4] += w * g[0] * g[2];
+                                sums.GG[5] += w * g[1] * g[2];
+                                sums.Gd[0] += wd * g[0];
+                                sums.Gd[1] += wd * g[1];
+                                sums.Gd[2] += wd * g[2];
+                            }
+                        }
+                    }
+                }
+                catch (const std::bad_alloc & /*ex*/)
+                {
+                    outOfMemory = true;
+                }
+            }, settings.numThreads);
+
+            if (outOfMemory)
+            {
+                return false;
+            }
+
+            const auto firstNew = result.nodes.size() - numNodes;
+            for (size_t n = 0; n < numNodes; ++n)
+            {
+                NodeSums sums{};
+                for (size_t r = 0; r < numRanges; ++r)
+                {
+                    const auto & partial = partials[r * numNodes + n];
+                    for (size_t i = 0; i < 6; ++i)
+                    {
+                        sums.GG[i] += partial.GG[i];
+                    }
+                    for (size_t i = 0; i < numPTDs; ++i)
+                    {
+                        sums.Gd[i] += partial.Gd[i];
+                    }
+                }
+                auto & node = result.nodes[firstNew + n];
+                const auto misfit = solvePotencies(sums, dWd, node.parameters.dv);
+                node.misfit = std::isfinite(misfit) ? misfit : std::numeric_limits<t_FP>::infinity();
+            }
+
+            return true;
+        };
+
+        const auto cornerIndices = [] (const std::vector<Cell> & cells)
+        {
+            std::vector<std::array<std::uint64_t, 3>> indices;
+            indices.reserve(cells.size() * 8);
+            for (const auto & cell : cells)
+            {
+                for (unsigned corner = 0; corner < 8; ++corner)
+                {
+                    indices.push_back({ {
+                        cell.corner[0] + ((corner & 1u) ? cell.size : 0),
+                        cell.corner[1] + ((corner & 2u) ? cell.size : 0),
+                        cell.corner[2] + ((corner & 4u) ? cell.size : 0) } });
+                }
+            }
+            return indices;
+        };
+
+        // Coarsest level: all cells. Their corners are evaluated in volume order.
+        std::vector<Cell> cells;
+        for (size_t iz = 0; iz < settings.divisions[2]; ++iz)
+        {
+            for (size_t iy = 0; iy < settings.divisions[1]; ++iy)
+            {
+                for (size_t ix = 0; ix < settings.divisions[0]; ++ix)
+                {
+                    cells.push_back({ { { ix * finestPerCell, iy * finestPerCell, iz * finestPerCell } },
+                        finestPerCell });
+                }
+            }
+        }
+
+        std::vector<std::array<std::uint64_t, 3>> volumeIndices;
+        for (size_t iz = 0; iz <= settings.divisions[2]; ++iz)
+        {
+            for (size_t iy = 0; iy <= settings.divisions[1]; ++iy)
+            {
+                for (size_t ix = 0; ix <= settings.divisions[0]; ++ix)
+                {
+                    volumeIndices.push_back({ { ix * finestPerCell, iy * finestPerCell, iz * finestPerCell } });
+                }
+            }
+        }
+        if (!evaluateNodes(volumeIndices, 0))
+        {
+            result.status = Status::errOutOfMemory;
+            return result;
+        }
+
+        result.misfitVolume.resize(volumeIndices.size());
+        for (size_t i = 0; i < volumeIndices.size(); ++i)
+        {
+            result.misfitVolume[i] = result.nodes[nodeIndices.at(nodeKey(volumeIndices[i]))].misfit;
+        }
+        for (size_t a = 0; a < 3; ++a)
+        {
+            result.volumeDimensions[a] = settings.divisions[a] + 1;
+            result.volumeSpacing[a] = finestSpacing[a] * static_cast<t_FP>(finestPerCell);
+        }
+
+        for (size_t level = 1; level < settings.numLevels; ++level)
+        {
+            // Rank the cells of the previous level by the lowest misfit at their corners.
+            std::vector<std::pair<t_FP, size_t>> scores(cells.size());
+            const auto corners = cornerIndices(cells);
+            for (size_t c = 0; c < cells.size(); ++c)
+            {
+                auto score = std::numeric_limits<t_FP>::infinity();
+                for (size_t corner = 0; corner < 8; ++corner)
+                {
+                    score = std::min(score,
+                        result.nodes[nodeIndices.at(nodeKey(corners[8 * c + corner]))].misfit);
+                }
+                scores[c] = { score, c };
+            }
+            const auto numRefined = std::min(settings.numRefinedCells, cells.size());
+            std::partial_sort(scores.begin(), scores.begin() + numRefined, scores.end());
+
+            std::vector<Cell> children;
+            for (size_t r = 0; r < numRefined; ++r)
+            {
+                const auto & parent = cells[scores[r].second];
+                const auto size = parent.size / 2;
+                for (unsigned child = 0; child < 8; ++child)
+                {
+                    children.push_back({ { {
+                        parent.corner[0] + ((child & 1u) ? size : 0),
+                        parent.corner[1] + ((child & 2u) ? size : 0),
+                        parent.corner[2] + ((child & 4u) ? size : 0) } },
+                        size });
+                }
+            }
+            cells.swap(children);
+
+            if (!evaluateNodes(cornerIndices(cells), level))
+            {
+                result.status = Status::errOutOfMemory;
+                return result;
+            }
+        }
+
+        result.candidates = result.nodes;
+        const auto numCandidates = std::min(settings.numCandidates, result.candidates.size());
+        std::partial_sort(result.candidates.begin(), result.candidates.begin() + numCandidates,
+            result.candidates.end(),
+            [] (const Node & lhs, const Node & rhs) { return lhs.misfit < rhs.misfit; });
+        result.candidates.resize(numCandidates);
+    }
+    catch (const std::bad_alloc & /*ex*/)
+    {
+        result.status = Status::errOutOfMemory;
+        return result;
+    }
+
+    result.status = Status::finished;
+    return result;
+}
@@ -0,0 +1,118 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "PCDMInversion.h"
+
+
+/**
+ * Global search for the source location: evaluates the misfit to observations on a hierarchical
+ * lattice of horizontal positions and depths, with the orientation (omega) kept fixed.
+ *
+ * Displacements are linear in the potencies, so the best potencies at each lattice node follow in
+ * closed form from the weighted least squares normal equations of the three PTDs' unit responses.
+ * Potencies are constrained to the same sign (see pCDM::PointCDMParameters::isValid) by solving
+ * the normal equations for all subsets of PTDs.
+ *
+ * The search starts on a regular lattice of cells spanning the search range. On each level, the
+ * numRefinedCells cells with the lowest misfit at their corners are split into eight cells each.
+ * Cells share corners with their neighbors and children share corners with their parents, so
+ * nodes are evaluated only once and looked up by their index on the finest lattice.
+ * Nodes are evaluated in batches, distributing nodes and point ranges to all threads.
+ */
+class PCDMGridSearch
+{
+public:
+    struct Settings
+    {
+        Settings();
+
+        /** Search range of the position (X, Y) and the depth, each as {min, max} */
+        std::array<pCDM::t_FP, 2> xRange;
+        std::array<pCDM::t_FP, 2> yRange;
+        std::array<pCDM::t_FP, 2> depthRange;
+        /** Number of cells of the coarsest lattice along X, Y, depth */
+        std::array<size_t, 3> divisions;
+        /** Number of lattice levels, including the coarsest one */
+        size_t numLevels;
+        /** Number of cells refined per level */
+        size_t numRefinedCells;
+        /** Number of candidates in the result */
+        size_t numCandidates;
+
+        /** Fixed orientation of the source */
+        std::array<pCDM::t_FP, 3> omega;
+        pCDM::t_FP nu;
+        /** Maximum number of threads, 0 for all threads of the pool */
+        size_t numThreads;
+    };
+
+    enum class Status
+    {
+        finished,
+        invalidInput,
+        errOutOfMemory
+    };
+
+    struct Node
+    {
+        /** Position, depth and orientation of the node, with the best fitting potencies */
+        pCDM::PointCDMParameters parameters;
+        pCDM::t_FP misfit;
+        /** Coarsest level the node is a corner of */
+        size_t level;
+    };
+
+    struct Result
+    {
+        Status status;
+        /** All evaluated nodes, e.g., for visualization as point cloud */
+        std::vector<Node> nodes;
+        /** Nodes with the lowest misfits in ascending order, e.g., as initial parameters of a PCDMInversion */
+        std::vector<Node> candidates;
+
+        /**
+         * Misfits of the coarsest lattice as regular volume, with X varying fastest, then Y, then
+         * depth. There are divisions + 1 nodes along each axis.
+         */
+        std::vector<pCDM::t_FP> misfitVolume;
+        std::array<size_t, 3> volumeDimensions;
+        /** Position and depth of the first node, and the spacing of the coarsest lattice */
+        std::array<pCDM::t_FP, 3> volumeOrigin;
+        std::array<pCDM::t_FP, 3> volumeSpacing;
+    };
+
+    explicit PCDMGridSearch(PCDMObservations observations);
+
+    const PCDMObservations & observations() const;
+
+    /** Run the search. This function is thread-safe. */
+    Result run(const Settings & settings) const;
+
+    /** Number of points per block of the unit response evaluation */
+    static const size_t pointBlockSize = 1024;
+    /** Maximum number of point ranges node evaluations are split into */
+    static const size_t maxPointRanges = 64;
+
+private:
+    PCDMObservations m_observations;
+};
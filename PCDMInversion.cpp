@@ -0,0 +1,461 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PCDMInversion.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <new>
+
+#include <Eigen/Cholesky>
+#include <Eigen/Core>
+
+#include "PCDMBackend.h"
+#include "pCDM_thread_pool.h"
+
+
+using pCDM::t_FP;
+
+
+namespace
+{
+
+const size_t numParameters = pCDM::numJacobianParameters;
+
+const t_FP initialLambda = 1e-3;
+const t_FP minLambda = 1e-12;
+const t_FP maxLambda = 1e12;
+
+/** Weighted least squares terms of a range of points */
+struct NormalEquations
+{
+    /** J^T W J, row major */
+    std::array<t_FP, numParameters * numParameters> JTJ;
+    /** J^T W r */
+    std::array<t_FP, numParameters> JTr;
+    t_FP misfit;
+
+    NormalEquations & operator+=(const NormalEquations & other)
+    {
+        for (size_t i = 0; i < JTJ.size(); ++i)
+        {
+            JTJ[i] += other.JTJ[i];
+        }
+        for (size_t i = 0; i < JTr.size(); ++i)
+        {
+            JTr[i] += other.JTr[i];
+        }
+        misfit += other.misfit;
+        return *this;
+    }
+};
+
+struct Misfit
+{
+    t_FP misfit;
+
+    Misfit & operator+=(const Misfit & other)
+    {
+        misfit += other.misfit;
+        return *this;
+    }
+};
+
+/**
+ * Call func(begin, end, partial) for blocks of [0, count) on the thread pool and sum up the partial
+ * results in block order, so that sums don't depend on the number of threads.
+ */
+template<typename Partial, typename Func>
+Partial reduceBlocks(const size_t count, const size_t numThreads, const Func & func)
+{
+    const auto blockSize = PCDMBackendBase::chunkSize;
+    const auto numBlocks = (count + blockSize - 1) / blockSize;
+    std::vector<Partial> partials(numBlocks, Partial{});
+
+    pCDM::ThreadPool::instance().parallelFor(numBlocks, 1,
+        [&partials, &func, count, blockSize] (size_t blocksBegin, size_t blocksEnd)
+    {
+        for (auto block = blocksBegin; block < blocksEnd; ++block)
+        {
+            const auto begin = block * blockSize;
+            func(begin, std::min(count, begin + blockSize), partials[block]);
+        }
+    }, numThreads);
+
+    Partial sum{};
+    for (const auto & partial : partials)
+    {
+        sum += partial;
+    }
+    return sum;
+}
+
+/** Evaluates misfits and normal equations, reusing the memory of the backend outputs. */
+class Evaluator
+{
+public:
+    Evaluator(const PCDMObservations & observations, const t_FP nu, const size_t numThreads,
+        std::vector<size_t> freeParameters)
+        : m_observations{ observations }
+        , m_nu{ nu }
+        , m_numThreads{ numThreads }
+        , m_freeParameters{ std::move(freeParameters) }
+        , m_lineOfSight{ observations.lineOfSightSpec() }
+    {
+        m_backend.setHorizontalCoords(observations.coords);
+        m_backend.setNumThreads(numThreads);
+    }
+
+    PCDMBackend::State misfit(const PCDMInversion::ParameterVector & parameters, t_FP & misfit)
+    {
+        setParameters(parameters);
+        // The backend computes exactly the observed quantity, without storing the components.
+        const auto state = m_backend.runLineOfSightInto(m_lineOfSight, m_modeled);
+        if (state != PCDMBackend::State::resultsReady)
+        {
+            return state;
+        }
+
+        const auto & obs = m_observations.values;
+        const auto & weights = m_observations.weights;
+        const auto & modeled = m_modeled;
+
+        misfit = reduceBlocks<Misfit>(obs.size(), m_numThreads,
+            [&] (size_t begin, size_t end, Misfit & partial)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const auto r = obs[i] - modeled[i];
+                partial.misfit += (weights.empty() ? 1 : weights[i]) * r * r;
+            }
+        }).misfit;
+
+        return state;
+    }
+
+    PCDMBackend::State normalEquations(const PCDMInversion::ParameterVector & parameters,
+        NormalEquations & equations)
+    {
+        setParameters(parameters);
+        const auto state = m_backend.runJacobianInto(m_jacobian);
+        if (state != PCDMBackend::State::resultsReady)
+        {
+            return state;
+        }
+
+        const auto & obs = m_observations.values;
+        const auto & weights = m_observations.weights;
+        const auto & outputs = m_jacobian;
+        const auto & free = m_freeParameters;
+        const auto pointLos = m_observations.hasPointLineOfSight();
+
+        equations = reduceBlocks<NormalEquations>(obs.size(), m_numThreads,
+            [&] (size_t begin, size_t end, NormalEquations & partial)
+        {
+            std::array<t_FP, numParameters> row;
+            auto los = m_observations.lineOfSight;
+            for (size_t i = begin; i < end; ++i)
+            {
+                if (pointLos)
+                {
+                    for (size_t c = 0; c < 3; ++c)
+                    {
+                        los[c] = m_observations.pointLineOfSight[c][i];
+                    }
+                }
+                const auto r = obs[i]
+                    - (los[0] * outputs[0][i] + los[1] * outputs[1][i] + los[2] * outputs[2][i]);
+                const t_FP w = weights.empty() ? 1 : weights[i];
+                partial.misfit += w * r * r;
+
+                for (size_t j = 0; j < free.size(); ++j)
+                {
+                    const auto parameter = static_cast<pCDM::JacobianParameter>(free[j]);
+                    row[j] = los[0] * outputs[pCDM::jacobianOutput(parameter, 0)][i]
+                        + los[1] * outputs[pCDM::jacobianOutput(parameter, 1)][i]
+                        + los[2] * outputs[pCDM::jacobianOutput(parameter, 2)][i];
+                }
+                for (size_t j = 0; j < free.size(); ++j)
+                {
+                    const auto wRow = w * row[j];
+                    partial.JTr[j] += wRow * r;
+                    for (size_t k = j; k < free.size(); ++k)
+                    {
+                        partial.JTJ[j * numParameters + k] += wRow * row[k];
+                    }
+                }
+            }
+        });
+
+        return state;
+    }
+
+private:
+    void setParameters(const PCDMInversion::ParameterVector & parameters)
+    {
+        m_backend.setParameters({ PCDMInversion::fromVector(parameters), m_nu });
+    }
+
+private:
+    const PCDMObservations & m_observations;
+    const t_FP m_nu;
+    const size_t m_numThreads;
+    const std::vector<size_t> m_freeParameters;
+    const pCDM::LineOfSight m_lineOfSight;
+
+    PCDMBackend m_backend;
+    /** Modeled line of sight displacements */
+    std::vector<t_FP> m_modeled;
+    PCDMBackend::JacobianOutputs m_jacobian;
+};
+
+}
+
+
+bool PCDMObservations::isValid() const
+{
+    return coords && coords->isValid() && !coords->empty()
+        && values.size() == coords->size()
+        && (weights.empty() || weights.size() == values.size())
+        && std::all_of(pointLineOfSight.begin(), pointLineOfSight.end(),
+            [this] (const std::vector<t_FP> & component)
+            {
+                return component.size() == (hasPointLineOfSight() ? values.size() : 0);
+            });
+}
+
+bool PCDMObservations::hasPointLineOfSight() const
+{
+    return !pointLineOfSight[0].empty();
+}
+
+pCDM::LineOfSight PCDMObservations::lineOfSightSpec() const
+{
+    pCDM::LineOfSight los(lineOfSight);
+    if (hasPointLineOfSight())
+    {
+        los.pointDirections = {
+            pointLineOfSight[0].data(), pointLineOfSight[1].data(), pointLineOfSight[2].data() };
+    }
+    return los;
+}
+
+auto PCDMInversion::toVector(const pCDM::PointCDMParameters & parameters) -> ParameterVector
+{
+    return{ {
+        parameters.horizontalCoord[0], parameters.horizontalCoord[1],
+        parameters.depth,
+        parameters.omega[0], parameters.omega[1], parameters.omega[2],
+        parameters.dv[0], parameters.dv[1], parameters.dv[2] } };
+}
+
+pCDM::PointCDMParameters PCDMInversion::fromVector(const ParameterVector & values)
+{
+    pCDM::PointCDMParameters parameters;
+    parameters.horizontalCoord = { values[0], values[1] };
+    parameters.depth = values[2];
+    parameters.omega = { values[3], values[4], values[5] };
+    parameters.dv = { values[6], values[7], values[8] };
+    return parameters;
+}
+
+PCDMInversion::Settings::Settings()
+    : nu{ 0.25 }
+    , maxIterations{ 100 }
+    , relativeTolerance{ 1e-8 }
+    , numThreads{ 0 }
+{
+    lowerBounds.fill(-std::numeric_limits<t_FP>::infinity());
+    upperBounds.fill(std::numeric_limits<t_FP>::infinity());
+    fixed.fill(false);
+}
+
+PCDMInversion::PCDMInversion(PCDMObservations observations)
+    : m_observations{ std::move(observations) }
+{
+}
+
+const PCDMObservations & PCDMInversion::observations() const
+{
+    return m_observations;
+}
+
+auto PCDMInversion::run(const Settings & settings) const -> Result
+{
+    Result result;
+    result.status = Status::invalidInput;
+    result.parameters = settings.initialParameters;
+    result.initialMisfit = result.misfit = std::numeric_limits<t_FP>::infinity();
+    result.iterations = 0;
+
+    if (!m_observations.isValid())
+    {
+        return result;
+    }
+
+    auto lowerBounds = settings.lowerBounds;
+    const auto depthIndex = static_cast<size_t>(pCDM::JacobianParameter::depth);
+    lowerBounds[depthIndex] = std::max(t_FP(0), lowerBounds[depthIndex]);
+    const auto & upperBounds = settings.upperBounds;
+
+    const auto clamp = [&lowerBounds, &upperBounds] (ParameterVector & values)
+    {
+        for (size_t i = 0; i < numParameters; ++i)
+        {
+            values[i] = std::min(upperBounds[i], std::max(lowerBounds[i], values[i]));
+        }
+    };
+
+    auto current = toVector(settings.initialParameters);
+    clamp(current);
+    if (!fromVector(current).isValid())
+    {
+        return result;
+    }
+
+    std::vector<size_t> freeParameters;
+    for (size_t i = 0; i < numParameters; ++i)
+    {
+        if (!settings.fixed[i] && lowerBounds[i] < upperBounds[i])
+        {
+            freeParameters.push_back(i);
+        }
+    }
+    const auto numFree = static_cast<Eigen::Index>(freeParameters.size());
+
+    const auto stateToStatus = [] (PCDMBackend::State state)
+    {
+        return state == PCDMBackend::State::errOutOfMemory
+            ? Status::errOutOfMemory
+            : Status::invalidInput;
+    };
+
+    try
+    {
+        Evaluator evaluator(m_observations, settings.nu, settings.numThreads, freeParameters);
+
+        NormalEquations equations;
+        auto state = evaluator.normalEquations(current, equations);
+        if (state != PCDMBackend::State::resultsReady)
+        {
+            result.status = stateToStatus(state);
+            return result;
+        }
+
+        result.parameters = fromVector(current);
+        result.initialMisfit = result.misfit = equations.misfit;
+        result.status = Status::maxIterationsReached;
+
+        t_FP lambda = initialLambda;
+        for (; result.iterations < settings.maxIterations; ++result.iterations)
+        {
+            if (numFree == 0 || result.misfit == 0)
+            {
+                result.status = Status::converged;
+                break;
+            }
+
+            Eigen::MatrixXd JTJ(numFree, numFree);
+            Eigen::VectorXd JTr(numFree);
+            for (Eigen::Index j = 0; j < numFree; ++j)
+            {
+                JTr(j) = equations.JTr[j];
+                for (Eigen::Index k = j; k < numFree; ++k)
+                {
+                    JTJ(j, k) = JTJ(k, j) = equations.JTJ[j * numParameters + k];
+                }
+            }
+
+            ParameterVector trial;
+            t_FP trialMisfit = result.misfit;
+            bool accepted = false;
+            for (; lambda <= maxLambda; lambda *= 10)
+            {
+                // Marquardt's scaling of the damping term by the diagonal makes steps independent
+                // of the units of the parameters. Parameters without influence are not moved.
+                Eigen::MatrixXd A = JTJ;
+                for (Eigen::Index j = 0; j < numFree; ++j)
+                {
+                    A(j, j) = JTJ(j, j) > 0 ? JTJ(j, j) * (1 + lambda) : 1;
+                }
+                const Eigen::VectorXd delta = A.ldlt().solve(JTr);
+
+                trial = current;
+                for (Eigen::Index j = 0; j < numFree; ++j)
+                {
+                    trial[freeParameters[j]] += delta(j);
+                }
+                clamp(trial);
+                if (trial == current)
+                {
+                    break;
+                }
+                if (!fromVector(trial).isValid())
+                {
+                    continue;
+                }
+
+                state = evaluator.misfit(trial, trialMisfit);
+                if (state != PCDMBackend::State::resultsReady)
+                {
+                    result.status = stateToStatus(state);
+                    return result;
+                }
+                if (trialMisfit < result.misfit)
+                {
+                    accepted = true;
+                    break;
+                }
+            }
+
+            if (!accepted)
+            {
+                result.status = Status::converged;
+                break;
+            }
+
+            const auto decrease = (result.misfit - trialMisfit) / result.misfit;
+            current = trial;
+            result.parameters = fromVector(current);
+            result.misfit = trialMisfit;
+            lambda = std::max(minLambda, lambda / 10);
+
+            if (decrease < settings.relativeTolerance)
+            {
+                ++result.iterations;
+                result.status = Status::converged;
+                break;
+            }
+
+            state = evaluator.normalEquations(current, equations);
+            if (state != PCDMBackend::State::resultsReady)
+            {
+                result.status = stateToStatus(state);
+                return result;
+            }
+        }
+    }
+    catch (const std::bad_alloc & /*ex*/)
+    {
+        result.status = Status::errOutOfMemory;
+    }
+
+    return result;
+}
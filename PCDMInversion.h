@@ -0,0 +1,123 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "pCDM_kernel.h"
+#include "pCDM_types.h"
+
+
+/**
+ * Observed line of sight displacements, e.g., of InSAR data, at horizontal coordinates in the
+ * coordinate system of the modeling project.
+ */
+struct PCDMObservations
+{
+    pCDM::SharedHorizontalCoordinates coords;
+    /** Observed displacements along lineOfSight, one per coordinate */
+    std::vector<pCDM::t_FP> values;
+    /** Weights of the squared residuals, e.g., inverse variances. Empty for weights of 1. */
+    std::vector<pCDM::t_FP> weights;
+    /** Unit vector (east, north, up) the displacements are projected onto */
+    std::array<pCDM::t_FP, 3> lineOfSight;
+    /**
+     * Unit vectors per coordinate (east, north and up components), e.g., for wide swaths. Empty to
+     * use lineOfSight for all coordinates.
+     */
+    std::array<std::vector<pCDM::t_FP>, 3> pointLineOfSight;
+
+    /**
+     * @return whether coordinates are set and the values, weights and per point line of sight
+     * match them in size.
+     */
+    bool isValid() const;
+    bool hasPointLineOfSight() const;
+    /** Line of sight referencing pointLineOfSight, if set */
+    pCDM::LineOfSight lineOfSightSpec() const;
+};
+
+/**
+ * Nonlinear least squares fit of point CDM parameters to observations, using the
+ * Levenberg-Marquardt method.
+ *
+ * The misfit is the weighted sum of squared residuals between the observations and the modeled
+ * displacements projected onto the line of sight. Each iteration evaluates the displacements and
+ * their analytic derivatives (see PCDMBackendT::runJacobianInto) in a single multithreaded pass, and
+ * reduces them to the normal equations of the free parameters in parallel.
+ * Parameters are clamped to their bounds after each step. Steps to invalid parameters (see
+ * pCDM::PointCDMParameters::isValid) are rejected like steps that increase the misfit.
+ */
+class PCDMInversion
+{
+public:
+    /** Source parameters ordered as pCDM::JacobianParameter */
+    using ParameterVector = std::array<pCDM::t_FP, pCDM::numJacobianParameters>;
+
+    static ParameterVector toVector(const pCDM::PointCDMParameters & parameters);
+    static pCDM::PointCDMParameters fromVector(const ParameterVector & values);
+
+    struct Settings
+    {
+        Settings();
+
+        pCDM::PointCDMParameters initialParameters;
+        /** Poisson's ratio of the model */
+        pCDM::t_FP nu;
+        /** Bounds of the parameters, infinite by default. The depth is at least 0. */
+        ParameterVector lowerBounds;
+        ParameterVector upperBounds;
+        /** Fixed parameters remain at their initial values. */
+        std::array<bool, pCDM::numJacobianParameters> fixed;
+
+        size_t maxIterations;
+        /** Stop if an iteration decreases the misfit by less than this fraction */
+        pCDM::t_FP relativeTolerance;
+        /** Maximum number of threads, 0 for all threads of the pool */
+        size_t numThreads;
+    };
+
+    enum class Status
+    {
+        converged,
+        maxIterationsReached,
+        invalidInput,
+        errOutOfMemory
+    };
+
+    struct Result
+    {
+        Status status;
+        pCDM::PointCDMParameters parameters;
+        pCDM::t_FP initialMisfit;
+        pCDM::t_FP misfit;
+        size_t iterations;
+    };
+
+    explicit PCDMInversion(PCDMObservations observations);
+
+    const PCDMObservations & observations() const;
+
+    /** Run the inversion. This function is thread-safe. */
+    Result run(const Settings & settings) const;
+
+private:
+    PCDMObservations m_observations;
+};
@@ -0,0 +1,138 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PCDMInversionDialog.h"
+
+#include <cmath>
+#include <limits>
+
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QSpinBox>
+#include <QTableWidget>
+#include <QVBoxLayout>
+
+
+using pCDM::t_FP;
+
+
+namespace
+{
+
+enum Column
+{
+    nameColumn,
+    initialColumn,
+    fixedColumn,
+    lowerBoundColumn,
+    upperBoundColumn,
+    numColumns
+};
+
+const char * const parameterNames[pCDM::numJacobianParameters] = {
+    "X0", "Y0", "Depth", "Omega X", "Omega Y", "Omega Z", "DV X", "DV Y", "DV Z"
+};
+
+QString boundToString(t_FP bound)
+{
+    return std::isfinite(bound) ? QString::number(bound) : QString();
+}
+
+t_FP boundFromString(const QString & text, t_FP unbounded)
+{
+    bool okay;
+    const auto value = static_cast<t_FP>(text.trimmed().toDouble(&okay));
+    return okay ? value : unbounded;
+}
+
+}
+
+
+PCDMInversionDialog::PCDMInversionDialog(const PCDMInversion::Settings & settings,
+    QWidget * parent, Qt::WindowFlags f)
+    : QDialog(parent, f)
+    , m_settings{ settings }
+    , m_parametersTable{ new QTableWidget(static_cast<int>(pCDM::numJacobianParameters), numColumns) }
+    , m_maxIterationsSpinBox{ new QSpinBox() }
+{
+    setWindowTitle("Fit to Observations");
+
+    auto layout = new QVBoxLayout(this);
+    layout->addWidget(new QLabel("Fit the point CDM parameters to the observations shown in the "
+        "residual view, starting at the current parameters. Leave bounds empty for unbounded "
+        "parameters."));
+    layout->addWidget(m_parametersTable);
+
+    auto formLayout = new QFormLayout();
+    m_maxIterationsSpinBox->setRange(1, 100000);
+    m_maxIterationsSpinBox->setValue(static_cast<int>(settings.maxIterations));
+    formLayout->addRow("Maximum Iterations", m_maxIterationsSpinBox);
+    layout->addLayout(formLayout);
+
+    auto buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+    connect(buttons, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+    layout->addWidget(buttons);
+
+    m_parametersTable->setHorizontalHeaderLabels({ "Parameter", "Initial", "Fixed", "Lower Bound", "Upper Bound" });
+    m_parametersTable->verticalHeader()->hide();
+
+    const auto initial = PCDMInversion::toVector(settings.initialParameters);
+    for (int row = 0; row < static_cast<int>(pCDM::numJacobianParameters); ++row)
+    {
+        auto nameItem = new QTableWidgetItem(parameterNames[row]);
+        nameItem->setFlags(Qt::ItemIsEnabled);
+        m_parametersTable->setItem(row, nameColumn, nameItem);
+
+        auto initialItem = new QTableWidgetItem(QString::number(initial[row]));
+        initialItem->setFlags(Qt::ItemIsEnabled);
+        m_parametersTable->setItem(row, initialColumn, initialItem);
+
+        auto fixedItem = new QTableWidgetItem();
+        fixedItem->setFlags(Qt::ItemIsEnabled | Qt::ItemIsUserCheckable);
+        fixedItem->setCheckState(settings.fixed[row] ? Qt::Checked : Qt::Unchecked);
+        m_parametersTable->setItem(row, fixedColumn, fixedItem);
+
+        m_parametersTable->setItem(row, lowerBoundColumn,
+            new QTableWidgetItem(boundToString(settings.lowerBounds[row])));
+        m_parametersTable->setItem(row, upperBoundColumn,
+            new QTableWidgetItem(boundToString(settings.upperBounds[row])));
+    }
+    m_parametersTable->resizeColumnsToContents();
+}
+
+PCDMInversionDialog::~PCDMInversionDialog() = default;
+
+PCDMInversion::Settings PCDMInversionDialog::settings() const
+{
+    auto settings = m_settings;
+    for (int row = 0; row < static_cast<int>(pCDM::numJacobianParameters); ++row)
+    {
+        settings.fixed[row] = m_parametersTable->item(row, fixedColumn)->checkState() == Qt::Checked;
+        settings.lowerBounds[row] = boundFromString(
+            m_parametersTable->item(row, lowerBoundColumn)->text(),
+            -std::numeric_limits<t_FP>::infinity());
+        settings.upperBounds[row] = boundFromString(
+            m_parametersTable->item(row, upperBoundColumn)->text(),
+            std::numeric_limits<t_FP>::infinity());
+    }
+    settings.maxIterations = static_cast<size_t>(m_maxIterationsSpinBox->value());
+    return settings;
+}
@@ -0,0 +1,48 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QDialog>
+
+#include "PCDMInversion.h"
+
+
+class QSpinBox;
+class QTableWidget;
+
+
+/**
+ * Setup of a PCDMInversion: fixed parameters, parameter bounds and the maximum number of
+ * iterations. Initial parameters and Poisson's ratio are passed through.
+ */
+class PCDMInversionDialog : public QDialog
+{
+public:
+    explicit PCDMInversionDialog(const PCDMInversion::Settings & settings,
+        QWidget * parent = nullptr, Qt::WindowFlags f = {});
+    ~PCDMInversionDialog() override;
+
+    /** Settings as configured by the user. Empty bound fields result in unbounded parameters. */
+    PCDMInversion::Settings settings() const;
+
+private:
+    PCDMInversion::Settings m_settings;
+    QTableWidget * m_parametersTable;
+    QSpinBox * m_maxIterationsSpinBox;
+};
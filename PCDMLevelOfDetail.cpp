@@ -0,0 +1,276 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "PCDMLevelOfDetail.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <unordered_map>
+
+#include "pCDM_thread_pool.h"
+
+
+using pCDM::t_FP;
+
+
+namespace
+{
+
+const size_t expandBlockSize = 4096;
+
+}
+
+
+PCDMLevelOfDetail::PCDMLevelOfDetail(pCDM::SharedHorizontalCoordinates coords,
+    const size_t coarsestSize, const size_t strideFactor)
+    : m_coords{ coords
+        ? std::move(coords)
+        : std::make_shared<const pCDM::HorizontalCoordinates>() }
+    , m_levels{}
+    , m_bounds{}
+{
+    assert(m_coords->isValid());
+
+    if (m_coords->isGrid())
+    {
+        initializeGridLevels(std::max(coarsestSize, size_t(1)), std::max(strideFactor, size_t(2)));
+    }
+    else
+    {
+        initializePointLevels(std::max(coarsestSize, size_t(1)), std::max(strideFactor, size_t(2)));
+    }
+}
+
+const pCDM::SharedHorizontalCoordinates & PCDMLevelOfDetail::coordinates() const
+{
+    return m_coords;
+}
+
+size_t PCDMLevelOfDetail::numLevels() const
+{
+    return m_levels.size();
+}
+
+const pCDM::SharedHorizontalCoordinates & PCDMLevelOfDetail::levelCoordinates(const size_t level) const
+{
+    return m_levels.at(level).coords;
+}
+
+template<size_t numComponents>
+void PCDMLevelOfDetail::expand(const size_t levelIndex,
+    const std::array<std::vector<t_FP>, numComponents> & samples,
+    std::array<std::vector<t_FP>, numComponents> & targets,
+    const size_t numThreads) const
+{
+    const auto & level = m_levels.at(levelIndex);
+    const auto numPoints = m_coords->size();
+    for (size_t c = 0; c < numComponents; ++c)
+    {
+        assert(samples[c].size() == level.coords->size());
+        targets[c].resize(numPoints);
+    }
+
+    pCDM::ThreadPool::instance().parallelFor(numPoints, expandBlockSize,
+        [this, &level, &samples, &targets] (size_t begin, size_t end)
+    {
+        const auto & columns = m_coords->columns();
+        for (auto i = begin; i < end; ++i)
+        {
+            const auto sample = m_coords->isGrid()
+                ? sampleIndex(level, i, 0, 0)
+                : sampleIndex(level, i, columns[0][i], columns[1][i]);
+            for (size_t c = 0; c < numComponents; ++c)
+            {
+                targets[c][i] = samples[c][sample];
+            }
+        }
+    }, numThreads);
+}
+
+void PCDMLevelOfDetail::initializeGridLevels(const size_t coarsestSize, const size_t strideFactor)
+{
+    const auto & grid = m_coords->grid();
+    const auto numColumns = grid.numColumns();
+    const auto numRows = grid.numRows();
+    const auto numPoints = grid.numPoints();
+
+    std::vector<size_t> strides{ 1 };
+    for (size_t stride = strideFactor;
+        numPoints / ((stride / strideFactor) * (stride / strideFactor)) > coarsestSize
+            && (numColumns - 1) / stride > 0 && (numRows - 1) / stride > 0;
+        stride *= strideFactor)
+    {
+        strides.push_back(stride);
+    }
+    std::reverse(strides.begin(), strides.end());
+
+    for (const auto stride : strides)
+    {
+        Level level;
+        level.stride = stride;
+        level.depth = 0;
+        if (stride == 1)
+        {
+            level.coords = m_coords;
+        }
+        else
+        {
+            pCDM::HorizontalGrid subGrid;
+            for (size_t a = 0; a < 2; ++a)
+            {
+                subGrid.origin[a] = grid.origin[a]
+                    + static_cast<t_FP>(grid.extent[2 * a]) * grid.spacing[a];
+                subGrid.spacing[a] = grid.spacing[a] * static_cast<t_FP>(stride);
+            }
+            subGrid.extent = { 0, static_cast<int>((numColumns - 1) / stride),
+                0, static_cast<int>((numRows - 1) / stride) };
+            level.coords = std::make_shared<const pCDM::HorizontalCoordinates>(subGrid);
+        }
+        m_levels.push_back(std::move(level));
+    }
+}
+
+void PCDMLevelOfDetail::initializePointLevels(const size_t coarsestSize, const size_t strideFactor)
+{
+    const auto & columns = m_coords->columns();
+    const auto numPoints = m_coords->size();
+
+    if (numPoints > 0)
+    {
+        const auto x = std::minmax_element(columns[0], columns[0] + numPoints);
+        const auto y = std::minmax_element(columns[1], columns[1] + numPoints);
+        m_bounds = { *x.first, *y.first, *x.second, *y.second };
+    }
+
+    // Levels of the quadtree: the number of cells is at most coarsestSize on the first level
+    // and is multiplied by strideFactor^2 per level, as long as there are fewer cells than points.
+    const auto depthStep = std::max(1u,
+        static_cast<unsigned>(std::lround(std::log2(static_cast<double>(strideFactor)))));
+    const unsigned maxDepth = 31;
+    unsigned depth = 0;
+    while (depth < maxDepth && (uint64_t(4) << (2 * depth)) <= coarsestSize)
+    {
+        ++depth;
+    }
+
+    for (; depth <= maxDepth && (uint64_t(1) << (2 * depth)) < numPoints; depth += depthStep)
+    {
+        // Represent each occupied cell by its first point.
+        std::unordered_map<uint64_t, size_t> firstPoints;
+        for (size_t i = 0; i < numPoints; ++i)
+        {
+            firstPoints.emplace(cellKey(depth, columns[0][i], columns[1][i]), i);
+        }
+        if (firstPoints.size() * 2 > numPoints)
+        {
+            // Not worth another level before evaluating all points
+            break;
+        }
+
+        std::vector<size_t> sampledPoints;
+        sampledPoints.reserve(firstPoints.size());
+        for (const auto & cell : firstPoints)
+        {
+            sampledPoints.push_back(cell.second);
+        }
+        std::sort(sampledPoints.begin(), sampledPoints.end());
+
+        Level level;
+        level.stride = 1;
+        level.depth = depth;
+        pCDM::HorizontalCoordinates::Columns sampleColumns;
+        for (auto & column : sampleColumns)
+        {
+            column.resize(sampledPoints.size());
+        }
+        level.cells.resize(sampledPoints.size());
+        for (size_t s = 0; s < sampledPoints.size(); ++s)
+        {
+            const auto i = sampledPoints[s];
+            sampleColumns[0][s] = columns[0][i];
+            sampleColumns[1][s] = columns[1][i];
+            level.cells[s] = { cellKey(depth, columns[0][i], columns[1][i]), s };
+        }
+        std::sort(level.cells.begin(), level.cells.end());
+        level.coords = std::make_shared<const pCDM::HorizontalCoordinates>(std::move(sampleColumns));
+        m_levels.push_back(std::move(level));
+    }
+
+    // All points, no lookup required
+    Level full;
+    full.coords = m_coords;
+    full.stride = 1;
+    full.depth = 0;
+    m_levels.push_back(std::move(full));
+}
+
+size_t PCDMLevelOfDetail::sampleIndex(const Level & level, const size_t i,
+    const t_FP x, const t_FP y) const
+{
+    if (m_coords->isGrid())
+    {
+        if (level.stride == 1)
+        {
+            return i;
+        }
+        const auto & grid = m_coords->grid();
+        const auto numColumns = grid.numColumns();
+        const auto levelColumns = (numColumns - 1) / level.stride + 1;
+        const auto levelRows = (grid.numRows() - 1) / level.stride + 1;
+        const auto column = std::min((i % numColumns + level.stride / 2) / level.stride,
+            levelColumns - 1);
+        const auto row = std::min((i / numColumns + level.stride / 2) / level.stride,
+            levelRows - 1);
+        return row * levelColumns + column;
+    }
+
+    if (level.cells.empty())
+    {
+        return i;
+    }
+    const auto key = cellKey(level.depth, x, y);
+    const auto it = std::lower_bound(level.cells.begin(), level.cells.end(),
+        std::make_pair(key, size_t(0)));
+    assert(it != level.cells.end() && it->first == key);
+    return it->second;
+}
+
+uint64_t PCDMLevelOfDetail::cellKey(const unsigned depth, const t_FP x, const t_FP y) const
+{
+    const auto numCells = uint64_t(1) << depth;
+    const auto cellIndex = [numCells] (t_FP value, t_FP min, t_FP max) -> uint64_t
+    {
+        const auto size = max - min;
+        if (!(size > 0))
+        {
+            return 0;
+        }
+        const auto index = std::floor((value - min) / size * static_cast<t_FP>(numCells));
+        return static_cast<uint64_t>(
+            std::max(t_FP(0), std::min(index, static_cast<t_FP>(numCells - 1))));
+    };
+
+    return (cellIndex(y, m_bounds[1], m_bounds[3]) << depth)
+        | cellIndex(x, m_bounds[0], m_bounds[2]);
+}
+
+
+template void PCDMLevelOfDetail::expand<3>(size_t,
+    const std::array<std::vector<t_FP>, 3> &, std::array<std::vector<t_FP>, 3> &, size_t) const;
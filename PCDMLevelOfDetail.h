@@ -0,0 +1,96 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "pCDM_types.h"
+
+
+/**
+ * Hierarchy of point subsets for progressive evaluation: results are first computed for a small
+ * subset of the coordinates and refined level by level until all points are evaluated.
+ *
+ * For grids, levels are strided sub-grids, with the stride decreasing by a factor of
+ * strideFactor per level. For point sets, levels sample a quadtree over the bounds of the points:
+ * each occupied cell of a level is represented by its first point, and the cell size is divided by
+ * strideFactor per level.
+ * expand() assigns each point the value of its representative sample, so that results of coarse
+ * levels can be displayed on the full resolution data set.
+ * The last level always contains all points, in their original order.
+ */
+class PCDMLevelOfDetail
+{
+public:
+    /**
+     * @param coarsestSize Approximate maximum number of points of the coarsest level
+     * @param strideFactor Ratio of the grid strides or quadtree cell sizes of consecutive levels.
+     *  The number of points grows by about the square of it per level.
+     */
+    explicit PCDMLevelOfDetail(pCDM::SharedHorizontalCoordinates coords,
+        size_t coarsestSize = 16384, size_t strideFactor = 4);
+
+    const pCDM::SharedHorizontalCoordinates & coordinates() const;
+
+    size_t numLevels() const;
+    /** Points evaluated on a level. The last level holds the coordinates passed to the constructor. */
+    const pCDM::SharedHorizontalCoordinates & levelCoordinates(size_t level) const;
+
+    /**
+     * Assign each point the value of the sample of level that represents it: the nearest node of
+     * the sub-grid for grids, the first point of its quadtree cell for point sets.
+     * @param samples numComponents arrays of levelCoordinates(level)->size() values
+     * @param targets numComponents arrays, resized to the number of points
+     */
+    template<size_t numComponents>
+    void expand(size_t level,
+        const std::array<std::vector<pCDM::t_FP>, numComponents> & samples,
+        std::array<std::vector<pCDM::t_FP>, numComponents> & targets,
+        size_t numThreads = 0) const;
+
+private:
+    /** Lookup of the sample of a point on a level */
+    struct Level
+    {
+        pCDM::SharedHorizontalCoordinates coords;
+        /** Grid stride */
+        size_t stride;
+        /** Quadtree depth: number of cells per axis is 2^depth */
+        unsigned depth;
+        /** Sorted pairs of quadtree cell keys and sample indices */
+        std::vector<std::pair<uint64_t, size_t>> cells;
+    };
+
+    void initializeGridLevels(size_t coarsestSize, size_t strideFactor);
+    void initializePointLevels(size_t coarsestSize, size_t strideFactor);
+
+    /** Index of the sample of level that represents point i */
+    size_t sampleIndex(const Level & level, size_t i, pCDM::t_FP x, pCDM::t_FP y) const;
+    uint64_t cellKey(unsigned depth, pCDM::t_FP x, pCDM::t_FP y) const;
+
+private:
+    pCDM::SharedHorizontalCoordinates m_coords;
+    std::vector<Level> m_levels;
+    /** Bounds of point sets: xMin, yMin, xMax, yMax */
+    std::array<pCDM::t_FP, 4> m_bounds;
+};
@@ -20,18 +20,22 @@
 
 #include <algorithm>
 #include <cassert>
+#include <new>
+#include <type_traits>
 
 #include <QDebug>
 #include <QDir>
+#include <QFile>
 #include <QSettings>
 #include <QtConcurrent>
 
 #include <core/data_objects/DataObject.h>
-#include <core/io/BinaryFile.h>
 #include <core/utility/conversions.h>
 
 #include "PCDMBackend.h"
 #include "PCDMProject.h"
+#include "PCDMResultCache.h"
+#include "PCDMResultFile.h"
 
 
 namespace
@@ -44,13 +48,238 @@ QString settingsFileName(const QString & baseDir, const QDateTime & timestamp)
     return QDir(baseDir).filePath(PCDMProject::timestampToString(timestamp) + ".ini");
 }
 
-QString resultsFileName(const QString & baseDir, const QDateTime & timestamp)
+QString resultFilePrefix(const QDateTime & timestamp)
 {
-    return QDir(baseDir).filePath(PCDMProject::timestampToString(timestamp) + "_u_vec.bin");
+    return PCDMProject::timestampToString(timestamp) + "_u_";
 }
 
+/** Result file names of earlier versions, which were replaced by each write. */
+QString legacyResultsFileName(const QDateTime & timestamp)
+{
+    return resultFilePrefix(timestamp) + "vec.bin";
+}
+
+QString legacyNuPartsFileName(const QDateTime & timestamp)
+{
+    return resultFilePrefix(timestamp) + "nu_parts.bin";
+}
+
+/**
+ * Name of a new result file of the model, relative to baseDir.
+ * Each write uses a new file, as mapped files cannot be replaced on all platforms.
+ * @param kind "vec" for results, "nu_parts" for Poisson's ratio parts
+ */
+QString newResultFileName(const QString & baseDir, const QDateTime & timestamp, const QString & kind)
+{
+    const auto base = resultFilePrefix(timestamp) + kind + "_"
+        + PCDMProject::timestampToString(QDateTime::currentDateTime());
+    auto fileName = base + ".bin";
+    for (int i = 1; QFile::exists(QDir(baseDir).filePath(fileName)); ++i)
+    {
+        fileName = base + "_" + QString::number(i) + ".bin";
+    }
+    return fileName;
+}
+
+/**
+ * Load stored results for the key. Files of other parameters or coordinates are rejected by their
+ * header. Components of uncompressed files are loaded by page faults when accessed.
+ * @return nullptr if the file cannot be read or does not match the key.
+ */
+PCDMResultCache::SharedResults loadResultFile(const QString & fileName,
+    const PCDMResultCache::Key & key, const size_t numThreads)
+{
+    PCDMResultCache::Displacements::Components components;
+    std::shared_ptr<const void> storage;
+    size_t memoryUsage = 0;
+    const auto numTuples = key.coords ? key.coords->size() : size_t(0);
+    if (!PCDMResultFile::load(fileName, PCDMResultFile::parametersHash(key.sourceParameters, key.nu),
+        numTuples, components, storage, memoryUsage, numThreads))
+    {
+        return{};
+    }
+
+    return std::make_shared<const PCDMResultCache::Displacements>(
+        components, numTuples, std::move(storage), memoryUsage);
+}
+
+/**
+ * Read a value per memory page of mapped results, so that they are paged in before they are
+ * shown. Results decompressed to memory are already resident.
+ */
+void touchPages(const PCDMResultCache::Displacements & results)
+{
+    if (results.memoryUsage() != 0)
+    {
+        return;
+    }
+
+    const size_t valuesPerPage = 4096 / sizeof(t_FP);
+    t_FP sum = 0;
+    for (const auto component : results.components())
+    {
+        for (size_t i = 0; i < results.size(); i += valuesPerPage)
+        {
+            sum += component[i];
+        }
+    }
+    // Keep the reads from being optimized out.
+    volatile t_FP sink = sum;
+    (void)sink;
 }
 
+void assignResults(std::array<std::vector<t_FP>, 3> && source, std::array<std::vector<t_FP>, 3> & target)
+{
+    target = std::move(source);
+}
+
+/** Results of single precision engines are stored and visualized in t_FP. */
+void assignResults(std::array<std::vector<float>, 3> && source, std::array<std::vector<t_FP>, 3> & target)
+{
+    for (size_t c = 0; c < 3; ++c)
+    {
+        target[c].assign(source[c].begin(), source[c].end());
+        std::vector<float>().swap(source[c]);
+    }
+}
+
+/**
+ * Run the backend and store its results in t_FP. If the estimated memory footprint of the
+ * computation exceeds the memory budget, or if it runs out of memory, the results are evaluated in
+ * chunks directly into the result arrays.
+ * Unit responses are cached if they fit into the memory budget in addition to the computation.
+ */
+template<typename Backend>
+PCDMBackendBase::State runBackend(
+    const pCDM::SharedHorizontalCoordinates & coords,
+    const PCDMBackendBase::Parameters & parameters,
+    const size_t memoryBudget,
+    const size_t numThreads,
+    const std::shared_ptr<PCDMUnitResponseCache> & unitResponseCache,
+    const PCDMBackendBase::ProgressCallback & progress,
+    std::array<std::vector<t_FP>, 3> & results)
+{
+    // Release previous results before allocating new ones.
+    for (auto & component : results)
+    {
+        std::vector<t_FP>().swap(component);
+    }
+
+    Backend backend;
+    backend.setHorizontalCoords(coords);
+    backend.setParameters(parameters);
+    backend.setNumThreads(numThreads);
+    backend.setProgressCallback(progress);
+
+    // Results not computed in t_FP exist twice while converting them.
+    const auto numTuples = backend.horizontalCoords().size();
+    auto footprint = Backend::estimatedMemoryFootprint(numTuples);
+    if (!std::is_same<typename Backend::value_type, t_FP>::value)
+    {
+        footprint += numTuples * 3u * sizeof(t_FP);
+    }
+
+    const auto responsesFootprint = Backend::estimatedUnitResponsesFootprint(numTuples);
+    const auto chunkedFootprint = numTuples * 3u * sizeof(t_FP);
+
+    if (footprint <= memoryBudget)
+    {
+        if (footprint + responsesFootprint <= memoryBudget)
+        {
+            backend.setUnitResponseCache(unitResponseCache);
+        }
+
+        const auto state = backend.run();
+        if (state == PCDMBackendBase::State::resultsReady)
+        {
+            try
+            {
+                assignResults(backend.takeResults(), results);
+                return state;
+            }
+            catch (const std::bad_alloc & /*ex*/)
+            {
+                for (auto & component : results)
+                {
+                    std::vector<t_FP>().swap(component);
+                }
+            }
+        }
+        else if (state != PCDMBackendBase::State::errOutOfMemory)
+        {
+            return state;
+        }
+    }
+
+    backend.setUnitResponseCache(chunkedFootprint + responsesFootprint <= memoryBudget
+        ? unitResponseCache : nullptr);
+
+    return backend.runInto(results);
+}
+
+/**
+ * Memory required to compute the Poisson's ratio independent displacement parts in chunks and to
+ * derive results from them. Computations exceeding the memory budget use runBackend instead.
+ */
+size_t partsFootprint(const size_t numTuples)
+{
+    return numTuples * (6u + 3u) * sizeof(t_FP);
+}
+
+/**
+ * Compute the displacement parts (see PCDMBackendBase::runPartsInto).
+ * Unit responses are cached if they fit into the memory budget in addition to the parts and
+ * results.
+ */
+template<typename Backend>
+PCDMBackendBase::State runBackendParts(
+    const pCDM::SharedHorizontalCoordinates & coords,
+    const PCDMBackendBase::Parameters & parameters,
+    const size_t memoryBudget,
+    const size_t numThreads,
+    const std::shared_ptr<PCDMUnitResponseCache> & unitResponseCache,
+    const PCDMBackendBase::ProgressCallback & progress,
+    std::array<std::vector<t_FP>, 6> & parts)
+{
+    Backend backend;
+    backend.setHorizontalCoords(coords);
+    backend.setParameters(parameters);
+    backend.setNumThreads(numThreads);
+    backend.setProgressCallback(progress);
+
+    const auto numTuples = backend.horizontalCoords().size();
+    if (partsFootprint(numTuples) + Backend::estimatedUnitResponsesFootprint(numTuples)
+        <= memoryBudget)
+    {
+        backend.setUnitResponseCache(unitResponseCache);
+    }
+
+    return backend.runPartsInto(parts);
+}
+
+}
+
+
+struct PCDMModel::Request
+{
+    PCDMResultCache::Key key;
+    QString baseDir;
+    QDateTime timestamp;
+    /** Stored parts to derive results from, relative to baseDir, empty if none */
+    QString nuPartsFileName;
+    /** Results cached for another model with equal parameters, which only need to be stored */
+    PCDMResultCache::SharedResults cachedResults;
+    pCDM::Precision precision;
+    size_t memoryBudget;
+    size_t numThreads;
+    bool storeNuParts;
+    PCDMResultFile::Compression compression;
+    std::shared_ptr<PCDMUnitResponseCache> unitResponseCache;
+    std::shared_ptr<PCDMResultCache> resultCache;
+    /** Set by cancelRequest() */
+    std::shared_ptr<std::atomic<bool>> cancelled;
+};
+
 
 PCDMModel::PCDMModel(
     PCDMProject & project,
@@ -60,12 +289,15 @@ PCDMModel::PCDMModel(
     , m_project{ project }
     , m_baseDir{ baseDir }
     , m_isRemoved{ false }
-    , m_hasStoredResults{ false }
+    , m_resultsFileName{}
+    , m_nuPartsFileName{}
     , m_timestamp{ timestamp }
     , m_name{}
     , m_parameters{}
+    , m_cancelRequested{ std::make_shared<std::atomic<bool>>(false) }
+    , m_requestPending{ false }
+    , m_progress{ 0 }
     , m_errorFlags{ ErrorFlag::noError }
-    , m_results{}
     , m_resultDataObject{}
 {
     if (!parametersFromFile())
@@ -77,17 +309,35 @@ PCDMModel::PCDMModel(
     readSettings([this] (const QSettings & settings)
     {
         m_name = settings.value("Name").toString();
-        m_hasStoredResults = settings.value("HasStoredResults").toBool();
+        m_resultsFileName = settings.value("ResultsFile").toString();
+        m_nuPartsFileName = settings.value("NuPartsFile").toString();
+        // Projects of earlier versions only flag stored files.
+        if (m_resultsFileName.isEmpty() && settings.value("HasStoredResults").toBool())
+        {
+            m_resultsFileName = legacyResultsFileName(m_timestamp);
+        }
+        if (m_nuPartsFileName.isEmpty() && settings.value("HasStoredNuParts").toBool())
+        {
+            m_nuPartsFileName = legacyNuPartsFileName(m_timestamp);
+        }
     });
 
-    connect(&m_computeFutureWatcher, &QFutureWatcher<void>::finished,
-        this, &PCDMModel::requestCompleted);
+    removeStaleResultFiles();
+
+    connect(&m_computeFutureWatcher, &QFutureWatcher<RequestOutcome>::finished,
+        this, &PCDMModel::finishRequest);
 }
 
 PCDMModel::~PCDMModel()
 {
+    // Requests refer to the model to report their progress.
+    cancelRequest();
+    m_computeFutureWatcher.waitForFinished();
+
     if (m_isRemoved)
     {
+        // Files written by a request while the model was removed
+        removeStaleResultFiles();
         return;
     }
 
@@ -143,7 +393,7 @@ bool PCDMModel::isValid() const
 
 bool PCDMModel::hasResults() const
 {
-    return loadedResultsAreValid() || m_hasStoredResults;
+    return loadedResultsAreValid() || !m_resultsFileName.isEmpty();
 }
 
 PCDMModel::ErrorFlags PCDMModel::errorFlags() const
@@ -158,6 +408,8 @@ void PCDMModel::setParameters(const pCDM::PointCDMParameters & sourceParameters)
         return;
     }
 
+    cancelRequest();
+
     m_parameters = sourceParameters;
 
     invalidateResults();
@@ -172,100 +424,310 @@ const pCDM::PointCDMParameters & PCDMModel::parameters() const
 
 void PCDMModel::requestResultsAsync()
 {
-    waitForResults();
+    // A superseded request stops after its current block of work. It is not waited for here, the
+    // new request runs after it in the worker thread.
+    cancelRequest();
+    m_requestPending = false;
 
-    struct EmitOnExit
+    const auto coords = m_project.horizontalCoordinateValues();
+    const auto nu = m_project.poissonsRatio();
+
+    // Results of this or other models with equal parameters are shared via the result cache.
+    auto cached = results();
+    if (cached && !m_resultsFileName.isEmpty())
     {
-        explicit EmitOnExit(PCDMModel & p) : p{ p } , skipEmit{ false } { }
-        ~EmitOnExit()
+        m_errorFlags = ErrorFlag::noError;
+        emit requestCompleted();
+        return;
+    }
+
+    // The worker thread works on a snapshot of the model and project state. Changes are applied
+    // by finishRequest().
+    Request request;
+    request.key = resultCacheKey(coords, nu);
+    request.baseDir = m_baseDir;
+    request.timestamp = m_timestamp;
+    request.nuPartsFileName = m_nuPartsFileName;
+    // Cached results of another model are also stored for this model, as they may be evicted.
+    request.cachedResults = std::move(cached);
+    request.precision = m_project.computationPrecision();
+    request.memoryBudget = m_project.memoryBudget();
+    request.numThreads = m_project.numThreads();
+    request.storeNuParts = m_project.storeNuParts();
+    request.compression = m_project.resultCompression();
+    request.unitResponseCache = m_project.unitResponseCache();
+    request.resultCache = m_project.resultCache();
+    request.cancelled = m_cancelRequested = std::make_shared<std::atomic<bool>>(false);
+
+    m_progress = 0;
+    m_requestPending = true;
+    m_computeFutureWatcher.setFuture(QtConcurrent::run(
+        [this, request, previous = m_computeFutureWatcher.future()] () mutable
+    {
+        // Requests of a model write its files, so they run one after another.
+        previous.waitForFinished();
+
+        // Called concurrently by the computing threads
+        const auto progress = [this, &request] (size_t numProcessed, size_t numTotal)
         {
-            if (!skipEmit)
+            if (*request.cancelled)
             {
-                emit p.requestCompleted();
+                return false;
             }
-        }
+            // Runs may make several passes, only report increasing progress.
+            const auto percent = static_cast<int>(100u * numProcessed / std::max(numTotal, size_t(1)));
+            auto reported = m_progress.load();
+            while (percent > reported)
+            {
+                if (m_progress.compare_exchange_weak(reported, percent))
+                {
+                    emit progressChanged(percent);
+                    break;
+                }
+            }
+            return true;
+        };
 
-        PCDMModel & p;
-        bool skipEmit;
-    } emitOnExit(*this);
+        return runRequest(request, progress);
+    }));
+}
 
-    if (loadedResultsAreValid())
+PCDMModel::RequestOutcome PCDMModel::runRequest(const Request & request,
+    const std::function<bool(size_t, size_t)> & progress)
+{
+    RequestOutcome outcome;
+    outcome.errorFlags = ErrorFlag::noError;
+    outcome.discardNuParts = false;
+    outcome.invalidateResults = false;
+
+    const auto & key = request.key;
+    const auto & coords = key.coords;
+    const auto nu = key.nu;
+    const auto storeResults = [&request, &outcome] (PCDMResultCache::SharedResults results)
     {
-        return;
+        outcome.resultsFileName = writeResults(request, results);
+    };
+
+    if (request.cachedResults)
+    {
+        storeResults(request.cachedResults);
+        return outcome;
     }
 
-    if (m_hasStoredResults)
+    PCDMResultCache::Results results;
+
+    // Results for a changed Poisson's ratio are derived from stored parts without the kernel.
+    if (!request.nuPartsFileName.isEmpty() && resultsFromNuParts(request, progress, results, outcome))
+    {
+        storeResults(std::make_shared<const PCDMResultCache::Displacements>(std::move(results)));
+        return outcome;
+    }
+    if (*request.cancelled)
     {
-        readResults();
-        if (loadedResultsAreValid())
+        outcome.errorFlags |= ErrorFlag::cancelled;
+        return outcome;
+    }
+
+    const PCDMBackendBase::Parameters parameters{ key.sourceParameters, nu };
+    const auto singlePrecision = request.precision == pCDM::Precision::singlePrecision;
+    const auto memoryBudget = request.memoryBudget;
+    const auto numThreads = request.numThreads;
+    const auto & unitResponseCache = request.unitResponseCache;
+
+    // Parts are only computed if they are stored, as results are cheaper to compute directly.
+    if (coords && request.storeNuParts && partsFootprint(coords->size()) <= memoryBudget)
+    {
+        std::array<std::vector<t_FP>, 6> parts;
+        const auto state = singlePrecision
+            ? runBackendParts<PCDMBackendFloat>(coords, parameters,
+                memoryBudget, numThreads, unitResponseCache, progress, parts)
+            : runBackendParts<PCDMBackend>(coords, parameters,
+                memoryBudget, numThreads, unitResponseCache, progress, parts);
+
+        if (state == PCDMBackendBase::State::resultsReady
+            && PCDMBackendBase::combineParts(parts, nu, results, numThreads, progress))
+        {
+            outcome.nuPartsFileName = writeNuParts(request, parts);
+            storeResults(std::make_shared<const PCDMResultCache::Displacements>(std::move(results)));
+            return outcome;
+        }
+        if (state == PCDMBackendBase::State::cancelled || *request.cancelled)
         {
-            return;
+            outcome.errorFlags |= ErrorFlag::cancelled;
+            return outcome;
         }
+        if (state != PCDMBackendBase::State::resultsReady
+            && state != PCDMBackendBase::State::errOutOfMemory)
+        {
+            outcome.invalidateResults = true;
+            return outcome;
+        }
+        // Out of memory: retry without parts.
     }
 
-    auto runFunc = [this] ()
+    const auto state = singlePrecision
+        ? runBackend<PCDMBackendFloat>(coords, parameters,
+            memoryBudget, numThreads, unitResponseCache, progress, results)
+        : runBackend<PCDMBackend>(coords, parameters,
+            memoryBudget, numThreads, unitResponseCache, progress, results);
+
+    if (state == PCDMBackend::State::cancelled)
     {
-        m_errorFlags = ErrorFlag::noError;
+        outcome.errorFlags |= ErrorFlag::cancelled;
+        return outcome;
+    }
+    if (state != PCDMBackend::State::resultsReady)
+    {
+        if (state == PCDMBackend::State::errOutOfMemory)
+        {
+            outcome.errorFlags |= ErrorFlag::outOfMemory;
+        }
 
-        PCDMBackend backend;
-        backend.setHorizontalCoords(m_project.horizontalCoordinateValues());
-        backend.setParameters({ m_parameters, m_project.poissonsRatio() });
+        outcome.invalidateResults = true;
+        return outcome;
+    }
 
-        backend.run();
+    storeResults(std::make_shared<const PCDMResultCache::Displacements>(std::move(results)));
+    return outcome;
+}
 
-        if (backend.state() != PCDMBackend::State::resultsReady)
-        {
-            if (backend.state() == PCDMBackend::State::errOutOfMemory)
-            {
-                m_errorFlags |= PCDMModel::ErrorFlag::outOfMemory;
-            }
+void PCDMModel::finishRequest()
+{
+    // Skip superseded requests and requests that were already finished by waitForResults().
+    if (!m_requestPending || !m_computeFutureWatcher.future().isFinished())
+    {
+        return;
+    }
+    m_requestPending = false;
 
-            invalidateResults();
-            return;
+    if (*m_cancelRequested)
+    {
+        // Cancelled, or the parameters changed after the request completed. Its files are stale.
+        m_errorFlags = ErrorFlag::cancelled;
+    }
+    else
+    {
+        const auto outcome = m_computeFutureWatcher.result();
+        m_errorFlags = outcome.errorFlags;
+        if (outcome.invalidateResults)
+        {
+            m_resultsFileName.clear();
+            m_nuPartsFileName.clear();
         }
+        if (outcome.discardNuParts)
+        {
+            m_nuPartsFileName.clear();
+        }
+        if (!outcome.nuPartsFileName.isEmpty())
+        {
+            m_nuPartsFileName = outcome.nuPartsFileName;
+        }
+        if (!outcome.resultsFileName.isEmpty())
+        {
+            m_resultsFileName = outcome.resultsFileName;
+        }
+        writeStoredResultFiles();
+    }
+    removeStaleResultFiles();
 
-        m_results = std::move(backend.takeResults());
-
-        storeResults();
-    };
-
-    m_computeFutureWatcher.setFuture(QtConcurrent::run(runFunc));
+    emit requestCompleted();
+}
 
-    emitOnExit.skipEmit = true;
+void PCDMModel::cancelRequest()
+{
+    *m_cancelRequested = true;
 }
 
 bool PCDMModel::waitForResults()
 {
     m_computeFutureWatcher.waitForFinished();
+    finishRequest();
 
     return loadedResultsAreValid();
 }
 
-const std::array<std::vector<pCDM::t_FP>, 3> & PCDMModel::results()
+PCDMResultCache::SharedResults PCDMModel::results()
 {
-    if (m_results[0].empty() && m_hasStoredResults)
+    const auto key = resultCacheKey(m_project.horizontalCoordinateValues(), m_project.poissonsRatio());
+    if (auto cached = m_project.resultCache()->find(key))
+    {
+        return cached;
+    }
+
+    if (!m_resultsFileName.isEmpty())
     {
-        readResults();
+        return readResults(key);
     }
 
-    return m_results;
+    return{};
 }
 
-void PCDMModel::invalidateResults()
+std::function<PCDMResultCache::SharedResults()> PCDMModel::resultsLoader() const
 {
-    for (auto & r : m_results)
+    const auto key = resultCacheKey(m_project.horizontalCoordinateValues(), m_project.poissonsRatio());
+    const auto cache = m_project.resultCache();
+    if (auto cached = cache->find(key))
     {
-        r.clear();
+        return [cached] () { return cached; };
     }
 
-    QFile(resultsFileName(m_baseDir, m_timestamp)).remove();
+    if (m_resultsFileName.isEmpty())
+    {
+        return{};
+    }
 
-    m_hasStoredResults = false;
-    writeHasStoredResults();
+    const auto fileName = QDir(m_baseDir).filePath(m_resultsFileName);
+    const auto numThreads = m_project.numThreads();
+    return [cache, key, fileName, numThreads] () -> PCDMResultCache::SharedResults
+    {
+        if (auto cached = cache->find(key))
+        {
+            return cached;
+        }
+
+        auto results = loadResultFile(fileName, key, numThreads);
+        if (!results)
+        {
+            // Broken files are discarded when results() is called for the model.
+            return{};
+        }
+
+        touchPages(*results);
+        cache->insert(key, results);
+        return results;
+    };
+}
+
+void PCDMModel::invalidateResults()
+{
+    cancelRequest();
+
+    // Cached results remain valid for their parameters, e.g., to undo parameter changes.
+    m_resultsFileName.clear();
+    m_nuPartsFileName.clear();
+    writeStoredResultFiles();
+    removeStaleResultFiles();
+}
+
+void PCDMModel::handlePoissonsRatioChanged()
+{
+    cancelRequest();
+
+    if (m_nuPartsFileName.isEmpty())
+    {
+        invalidateResults();
+        return;
+    }
+
+    m_resultsFileName.clear();
+    writeStoredResultFiles();
+    removeStaleResultFiles();
 }
 
 void PCDMModel::prepareDelete()
 {
+    cancelRequest();
+
     m_isRemoved = true;
 
     invalidateResults();
@@ -324,89 +786,148 @@ bool PCDMModel::parametersToFile() const
     });
 }
 
-void PCDMModel::readResults()
+PCDMResultCache::SharedResults PCDMModel::readResults(const PCDMResultCache::Key & key)
 {
-    const auto fileName = resultsFileName(m_baseDir, m_timestamp);
-
-    if (!m_hasStoredResults)
+    if (m_resultsFileName.isEmpty())
     {
-        QFile(fileName).remove();
-        return;
+        return{};
     }
 
-    auto failDiscardData = [this, &fileName] ()
+    auto failDiscardData = [this] () -> PCDMResultCache::SharedResults
     {
         qWarning() << "Reading previously stored results failed. Discarding data.";
-        QFile(fileName).remove();
-        m_hasStoredResults = false;
-        writeHasStoredResults();
+        m_resultsFileName.clear();
+        writeStoredResultFiles();
+        removeStaleResultFiles();
+        return{};
     };
 
-    const auto numTuples = m_project.numHorizontalCoordinates();
+    auto results = loadResultFile(QDir(m_baseDir).filePath(m_resultsFileName), key,
+        m_project.numThreads());
+    if (!results)
+    {
+        return failDiscardData();
+    }
+
+    m_project.resultCache()->insert(key, results);
 
-    auto reader = BinaryFile(fileName, BinaryFile::OpenMode::Read);
+    return results;
+}
 
-    for (auto & component : m_results)
+QString PCDMModel::writeResults(const Request & request,
+    const PCDMResultCache::SharedResults & results)
+{
+    const auto & key = request.key;
+    const auto numTuples = key.coords ? key.coords->size() : size_t(0);
+    assert(results && results->size() > 0);
+    if (!results || results->size() == 0 || results->size() != numTuples)
     {
-        if (!reader.read(numTuples, component))
+        qWarning() << "Trying to write invalid results";
+        return{};
+    }
+
+    // A superseding request doesn't wait for writing, but the results are cached beforehand.
+    request.resultCache->insert(key, results);
+
+    const auto fileName = newResultFileName(request.baseDir, request.timestamp, "vec");
+    if (!PCDMResultFile::write(QDir(request.baseDir).filePath(fileName),
+        PCDMResultFile::parametersHash(key.sourceParameters, key.nu), results->components(),
+        numTuples, request.compression, request.numThreads,
+        [&request] () { return request.cancelled->load(); }))
+    {
+        if (!*request.cancelled)
         {
-            return failDiscardData();
+            qWarning() << "Failed to write results file:" << fileName;
         }
+        return{};
     }
+    return fileName;
 }
 
-void PCDMModel::storeResults()
+QString PCDMModel::writeNuParts(const Request & request,
+    const std::array<std::vector<t_FP>, 6> & parts)
 {
-    const auto fileName = resultsFileName(m_baseDir, m_timestamp);
-
-    const auto numTuples = m_project.numHorizontalCoordinates();
-    assert(!m_results[0].empty());
-    if (m_results[0].empty()
-        || !std::all_of(m_results.begin(), m_results.end(),
-            [numTuples] (const decltype(m_results)::value_type & vec)
-        { return vec.size() == numTuples; }))
+    // Parts don't depend on the Poisson's ratio. They are not stored lossy, as their errors would be
+    // scaled when combining them.
+    auto compression = request.compression;
+    if (compression.codec == PCDMResultFile::Codec::quantizedDeflate)
     {
-        qWarning() << "Trying to write invalid results";
-        return;
+        compression.codec = PCDMResultFile::Codec::shuffleDeflate;
     }
-
-    auto setHasSuccess = [this, &fileName] (bool success)
+    const auto fileName = newResultFileName(request.baseDir, request.timestamp, "nu_parts");
+    if (!PCDMResultFile::write(QDir(request.baseDir).filePath(fileName),
+        PCDMResultFile::parametersHash(request.key.sourceParameters), parts, compression,
+        request.numThreads, [&request] () { return request.cancelled->load(); }))
     {
-        m_hasStoredResults = success;
-        if (!success)
+        if (!*request.cancelled)
         {
-            qWarning() << "Failed to write results file:" << fileName;
-            QFile(fileName).remove();
+            qWarning() << "Failed to write Poisson's ratio parts file:" << fileName;
         }
-        writeHasStoredResults();
-    };
+        return{};
+    }
+    return fileName;
+}
 
-    auto writer = BinaryFile(fileName, BinaryFile::OpenMode::Write | BinaryFile::OpenMode::Truncate);
-    for (auto & component : m_results)
+bool PCDMModel::resultsFromNuParts(const Request & request,
+    const std::function<bool(size_t, size_t)> & progress, PCDMResultCache::Results & results,
+    RequestOutcome & outcome)
+{
+    const auto & key = request.key;
+    const auto fileName = QDir(request.baseDir).filePath(request.nuPartsFileName);
+    const auto numTuples = key.coords ? key.coords->size() : size_t(0);
+
+    std::array<const t_FP *, 6> parts;
+    std::shared_ptr<const void> storage;
+    size_t memoryUsage = 0;
+    if (!PCDMResultFile::load(fileName, PCDMResultFile::parametersHash(key.sourceParameters),
+        numTuples, parts, storage, memoryUsage, request.numThreads,
+        [&request] () { return request.cancelled->load(); }))
     {
-        if (!writer.write(component))
+        if (!*request.cancelled)
         {
-            return setHasSuccess(false);
+            qWarning() << "Reading previously stored Poisson's ratio parts failed. Discarding data.";
+            outcome.discardNuParts = true;
         }
+        return false;
     }
 
-    return setHasSuccess(true);
+    return PCDMBackendBase::combineParts(parts, numTuples, key.nu, results, request.numThreads,
+        progress);
 }
 
 bool PCDMModel::loadedResultsAreValid() const
 {
-    const auto numTuples = m_project.numHorizontalCoordinates();
+    return m_project.resultCache()->contains(
+        resultCacheKey(m_project.horizontalCoordinateValues(), m_project.poissonsRatio()));
+}
 
-    return !m_results[0].empty()
-        && std::all_of(m_results.begin(), m_results.end(),
-            [numTuples] (const decltype(m_results)::value_type & vec)
-                { return vec.size() == numTuples; });
+PCDMResultCache::Key PCDMModel::resultCacheKey(const pCDM::SharedHorizontalCoordinates & coords,
+    const t_FP nu) const
+{
+    return{ m_parameters, nu, coords };
 }
 
-void PCDMModel::writeHasStoredResults() const
+void PCDMModel::writeStoredResultFiles() const
 {
     accessSettings([this] (QSettings & settings)
     {
-        settings.setValue("HasStoredResults", m_hasStoredResults);
+        settings.setValue("ResultsFile", m_resultsFileName);
+        settings.setValue("NuPartsFile", m_nuPartsFileName);
+        settings.remove("HasStoredResults");
+        settings.remove("HasStoredNuParts");
     });
 }
+
+void PCDMModel::removeStaleResultFiles() const
+{
+    const QDir dir(m_baseDir);
+    for (const auto & fileName : dir.entryList({ resultFilePrefix(m_timestamp) + "*.bin" },
+        QDir::Files))
+    {
+        if (fileName != m_resultsFileName && fileName != m_nuPartsFileName)
+        {
+            // Fails for files that are still mapped on some platforms, retried with the next call.
+            QFile::remove(dir.filePath(fileName));
+        }
+    }
+}
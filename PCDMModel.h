@@ -19,6 +19,7 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <vector>
@@ -28,6 +29,7 @@
 #include <QObject>
 #include <QString>
 
+#include "PCDMResultCache.h"
 #include "pCDM_types.h"
 
 
@@ -81,20 +83,25 @@ public:
      */
     bool isValid() const;
 
-    /** @return whether valid results are computed for this parametrization. */
+    /**
+     * @return whether valid results are computed for this parametrization, either cached in the
+     * project or stored in the model's directory.
+     */
     bool hasResults() const;
 
     enum ErrorFlag
     {
         noError = 0x0,
-        outOfMemory = 0x1
+        outOfMemory = 0x1,
+        /** The computation was stopped by cancelRequest(). */
+        cancelled = 0x2
     };
     Q_DECLARE_FLAGS(ErrorFlags, ErrorFlag)
     ErrorFlags errorFlags() const;
 
     /**
      * Set parameters related to the point CDM.
-     * Modifying parameters invalidates previously computed results.
+     * Modifying parameters invalidates previously computed results and cancels a running request.
      * Further parameters are the computing points and the Poisson's ratio. Those are defined in
      * the project and are equal for all parametrizations in a project.
      */
@@ -103,29 +110,86 @@ public:
 
     /**
      * Request to compute modeling results using the PCDMBackend.
-     * This function first checks if results are already available and if the parameters are valid,
-     * and then asynchronously triggers the computing process, if required.
+     * This function first checks if results are already available in the project's result cache or
+     * in the model's directory, and then asynchronously triggers the computing process, if required.
      * In any case, requestCompleted() is emitted when all required steps are done.
      * Use hasResults() afterwards to check if the computation was successful.
+     * A request supersedes a running one without waiting for it: the running computation is
+     * cancelled and stops after its current block of points per thread, also while reading or
+     * combining Poisson's ratio parts or writing results. The new computation starts afterwards.
+     * requestCompleted() is only emitted for the latest request. progressChanged() reports the
+     * progress of the computation.
      */
     void requestResultsAsync();
+    /**
+     * Stop a running computation without waiting for it. requestCompleted() is emitted when the
+     * computation stopped, with the cancelled error flag set.
+     */
+    void cancelRequest();
     /**
      * Block until results are available or an error occurred during the computation.
      * @return true only if valid outputs are available.
     */
     bool waitForResults();
 
-    const std::array<std::vector<pCDM::t_FP>, 3> & results();
+    /**
+     * Results for the current parameters, from the project's result cache or read from the model's
+     * directory.
+     * @return nullptr if no results are available.
+     */
+    PCDMResultCache::SharedResults results();
+    /**
+     * Loader for the results of the current parameters that can be called from any thread, e.g.,
+     * to prefetch results of several models (see PCDMResultPrefetcher). The loader returns cached
+     * results, or reads stored results, pages them in and inserts them into the project's result
+     * cache. It returns nullptr if reading fails; results() handles broken files.
+     * @return An empty function if no results are available.
+     */
+    std::function<PCDMResultCache::SharedResults()> resultsLoader() const;
 
     void invalidateResults();
+    /**
+     * Discard results that depend on the project's Poisson's ratio. If the Poisson's ratio
+     * independent displacement parts are stored for the model (see PCDMProject::storeNuParts,
+     * enabled by default), they are kept, and the next request derives the results from them
+     * without running the backend. The parts take about twice the storage of the results. Without
+     * stored parts, the model is recomputed.
+     */
+    void handlePoissonsRatioChanged();
 
     void prepareDelete();
 
 signals:
     void nameChanged(const QString & name);
     void requestCompleted();
+    /** Progress of the running computation in percent, emitted from the computing thread. */
+    void progressChanged(int percent);
 
 private:
+    /** Snapshot of the model and project state that a request is computed for */
+    struct Request;
+    /** Changes to the model made by a request, applied by finishRequest() */
+    struct RequestOutcome
+    {
+        ErrorFlags errorFlags;
+        /** Newly written files relative to m_baseDir, empty if nothing was written */
+        QString resultsFileName;
+        QString nuPartsFileName;
+        /** Reading the stored parts failed. */
+        bool discardNuParts;
+        /** Computing failed, stored files don't match the parameters anymore. */
+        bool invalidateResults;
+    };
+
+    /**
+     * Compute, cache and store the results of a request. Runs in a worker thread.
+     * @param progress See PCDMBackendBase::ProgressCallback
+     */
+    static RequestOutcome runRequest(const Request & request,
+        const std::function<bool(size_t, size_t)> & progress);
+    /** Apply the outcome of the latest request once it finished, unless it was cancelled. */
+    void finishRequest();
+
     /**
      * Read/Write access to the settings file.
      * @return whether syncing settings to the file did succeed.
@@ -140,27 +204,72 @@ private:
     bool parametersFromFile();
     bool parametersToFile() const;
 
-    void readResults();
-    void storeResults();
+    /**
+     * Map stored results read-only and insert them into the project's result cache. Stored results
+     * that don't match the key are discarded.
+     */
+    PCDMResultCache::SharedResults readResults(const PCDMResultCache::Key & key);
+    /**
+     * Insert results into the project's result cache and write them to a new file in the model's
+     * directory, e.g., also if the results were computed for another model with equal parameters.
+     * Writing stops when the request is cancelled, but the results are still cached.
+     * @return the name of the written file, empty if writing failed or was cancelled.
+     */
+    static QString writeResults(const Request & request,
+        const PCDMResultCache::SharedResults & results);
 
+    /**
+     * Write displacement parts to a new file, see PCDMBackendBase::runPartsInto
+     * @return the name of the written file, empty if writing failed or was cancelled.
+     */
+    static QString writeNuParts(const Request & request,
+        const std::array<std::vector<pCDM::t_FP>, 6> & parts);
+    /**
+     * Compute results from the stored displacement parts. Sets outcome.discardNuParts if reading
+     * them fails.
+     * @param progress See PCDMBackendBase::ProgressCallback
+     * @return false if reading the parts fails, or if the request was cancelled.
+     */
+    static bool resultsFromNuParts(const Request & request,
+        const std::function<bool(size_t, size_t)> & progress, PCDMResultCache::Results & results,
+        RequestOutcome & outcome);
+
+    /** @return whether results for the current parameters are in the project's result cache. */
     bool loadedResultsAreValid() const;
-    void writeHasStoredResults() const;
+    PCDMResultCache::Key resultCacheKey(const pCDM::SharedHorizontalCoordinates & coords,
+        pCDM::t_FP nu) const;
+    /** Record the names of the stored result files in the settings file. */
+    void writeStoredResultFiles() const;
+    /**
+     * Remove result files of the model that are not recorded as stored, e.g., files of previous
+     * writes. Files that are still mapped cannot be removed on all platforms. Those are removed by
+     * a later call.
+     */
+    void removeStaleResultFiles() const;
 
 private:
     PCDMProject & m_project;
     const QString m_baseDir;
     bool m_isRemoved;
-    bool m_hasStoredResults;
+    /** Stored result files relative to m_baseDir, empty if nothing is stored */
+    QString m_resultsFileName;
+    QString m_nuPartsFileName;
 
     QDateTime m_timestamp;
     QString m_name;
 
     pCDM::PointCDMParameters m_parameters;
 
-    QFutureWatcher<void> m_computeFutureWatcher;
+    /** Requests are chained, each one runs after the previous one finished. */
+    QFutureWatcher<RequestOutcome> m_computeFutureWatcher;
+    /** Cancel flag of the latest request, shared with its worker thread */
+    std::shared_ptr<std::atomic<bool>> m_cancelRequested;
+    /** Whether the latest request is still to be finished by finishRequest() */
+    bool m_requestPending;
+    /** Progress reported for the running computation, in percent */
+    std::atomic<int> m_progress;
     ErrorFlags m_errorFlags;
 
-    std::array<std::vector<pCDM::t_FP>, 3> m_results;
     std::unique_ptr<DataObject> m_resultDataObject;
 };
 
@@ -0,0 +1,213 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "PCDMProgressivePreview.h"
+
+#include <algorithm>
+#include <cassert>
+#include <new>
+
+#include <QDebug>
+#include <QtConcurrent>
+
+#include "pCDM_thread_pool.h"
+#include "PCDMLevelOfDetail.h"
+
+
+using pCDM::t_FP;
+
+
+bool PCDMProgressivePreview::Preview::isComplete() const
+{
+    return results && level + 1 == numLevels;
+}
+
+PCDMProgressivePreview::PCDMProgressivePreview(QObject * parent)
+    : QObject(parent)
+    , m_generation{ 0 }
+    , m_preview{ nullptr, 0, 0 }
+{
+}
+
+PCDMProgressivePreview::~PCDMProgressivePreview()
+{
+    cancel();
+
+    for (auto & future : m_futures)
+    {
+        future.waitForFinished();
+    }
+}
+
+void PCDMProgressivePreview::request(pCDM::SharedHorizontalCoordinates coords,
+    const PCDMBackendBase::Parameters & parameters,
+    const size_t numThreads)
+{
+    cancel();
+
+    if (!coords || coords->empty() || !coords->isValid() || !parameters.sourceParameters.isValid())
+    {
+        return;
+    }
+
+    m_futures.erase(std::remove_if(m_futures.begin(), m_futures.end(),
+        [] (const QFuture<void> & future) { return future.isFinished(); }),
+        m_futures.end());
+
+    const auto generation = m_generation.load();
+    m_futures.push_back(QtConcurrent::run(
+        [this, generation, coords, parameters, numThreads] ()
+    {
+        compute(generation, coords, parameters, numThreads);
+    }));
+}
+
+void PCDMProgressivePreview::cancel()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_generation;
+    m_preview = { nullptr, 0, 0 };
+}
+
+auto PCDMProgressivePreview::preview() const -> Preview
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_preview;
+}
+
+void PCDMProgressivePreview::compute(const uint64_t generation,
+    const pCDM::SharedHorizontalCoordinates & coords,
+    const PCDMBackendBase::Parameters & parameters,
+    const size_t numThreads)
+{
+    const auto kernel = pCDM::kernelFunction<float>(pCDM::bestKernelVariant());
+    assert(kernel);
+    const auto constants = PCDMBackendBase::kernelConstantsFor(parameters);
+
+    try
+    {
+        const auto lod = levelOfDetail(coords);
+        const auto numLevels = lod->numLevels();
+
+        for (size_t level = 0; level < numLevels; ++level)
+        {
+            if (isCancelled(generation))
+            {
+                return;
+            }
+
+            const auto & levelCoords = *lod->levelCoordinates(level);
+            const auto numPoints = levelCoords.size();
+            PCDMResultCache::Results samples;
+            for (auto & component : samples)
+            {
+                component.resize(numPoints);
+            }
+
+            std::atomic<bool> outOfMemory{ false };
+            pCDM::ThreadPool::instance().parallelFor(numPoints, PCDMBackendBase::chunkSize,
+                [this, generation, kernel, &constants, &levelCoords, &samples, &outOfMemory]
+                (size_t begin, size_t end)
+            {
+                // Skip remaining blocks when a new request is started.
+                if (isCancelled(generation))
+                {
+                    return;
+                }
+                try
+                {
+                    pCDM::HorizontalCoordinates::Columns coordsBuffers;
+                    std::array<std::vector<float>, 3> scratch;
+                    for (auto & component : scratch)
+                    {
+                        component.resize(end - begin);
+                    }
+                    const auto xy = levelCoords.block(begin, end, coordsBuffers);
+                    kernel(constants, xy[0], xy[1], 0, end - begin,
+                        scratch[0].data(), scratch[1].data(), scratch[2].data());
+                    for (size_t c = 0; c < 3; ++c)
+                    {
+                        std::copy(scratch[c].begin(), scratch[c].end(), samples[c].begin() + begin);
+                    }
+                }
+                catch (const std::bad_alloc & /*ex*/)
+                {
+                    outOfMemory = true;
+                }
+            }, numThreads);
+
+            if (outOfMemory)
+            {
+                throw std::bad_alloc();
+            }
+            if (isCancelled(generation))
+            {
+                return;
+            }
+
+            PCDMResultCache::Results expanded;
+            if (level + 1 == numLevels)
+            {
+                expanded = std::move(samples);
+            }
+            else
+            {
+                lod->expand(level, samples, expanded, numThreads);
+            }
+            auto results = std::make_shared<const PCDMResultCache::Displacements>(std::move(expanded));
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_generation != generation)
+                {
+                    return;
+                }
+                m_preview = { std::move(results), level, numLevels };
+            }
+            emit levelReady();
+        }
+    }
+    catch (const std::bad_alloc & /*ex*/)
+    {
+        qWarning() << "Not enough memory to compute the preview.";
+    }
+}
+
+bool PCDMProgressivePreview::isCancelled(const uint64_t generation) const
+{
+    return m_generation != generation;
+}
+
+std::shared_ptr<const PCDMLevelOfDetail> PCDMProgressivePreview::levelOfDetail(
+    const pCDM::SharedHorizontalCoordinates & coords)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_levelOfDetail && m_levelOfDetail->coordinates() == coords)
+        {
+            return m_levelOfDetail;
+        }
+    }
+
+    auto lod = std::make_shared<const PCDMLevelOfDetail>(coords);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_levelOfDetail = lod;
+    return lod;
+}
@@ -0,0 +1,104 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <QFuture>
+#include <QObject>
+
+#include "PCDMBackend.h"
+#include "PCDMResultCache.h"
+
+
+class PCDMLevelOfDetail;
+
+
+/**
+ * Progressive preview of modeling results while parameters are edited.
+ *
+ * A request evaluates the levels of detail of the coordinates (see PCDMLevelOfDetail) on a worker
+ * thread, from a coarse subset up to full resolution. Each level is expanded to all points and
+ * reported via levelReady(), so that views can be updated immediately and refined in the
+ * background. A new request or cancel() stops the running request within a block of points.
+ *
+ * Previews are computed in single precision and are not stored. Models should be run to get final
+ * results.
+ */
+class PCDMProgressivePreview : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Preview
+    {
+        /** Results for all coordinates of the request, nullptr if no level is computed yet */
+        PCDMResultCache::SharedResults results;
+        size_t level;
+        size_t numLevels;
+
+        bool isComplete() const;
+    };
+
+    explicit PCDMProgressivePreview(QObject * parent = nullptr);
+    /** Cancels and waits for running requests */
+    ~PCDMProgressivePreview() override;
+
+    /**
+     * Start computing a preview for parameters, cancelling the current request.
+     * @param numThreads Maximum number of threads, 0 for all threads of the pool
+     */
+    void request(pCDM::SharedHorizontalCoordinates coords,
+        const PCDMBackendBase::Parameters & parameters,
+        size_t numThreads = 0);
+    /** Stop the current request and discard its preview. */
+    void cancel();
+
+    /** Most recent level computed for the current request */
+    Preview preview() const;
+
+signals:
+    /**
+     * Emitted from the worker thread when a level of the current request is computed. Connected
+     * slots in other threads should check preview(), as later requests may already have replaced
+     * it.
+     */
+    void levelReady();
+
+private:
+    void compute(uint64_t generation, const pCDM::SharedHorizontalCoordinates & coords,
+        const PCDMBackendBase::Parameters & parameters, size_t numThreads);
+    bool isCancelled(uint64_t generation) const;
+    std::shared_ptr<const PCDMLevelOfDetail> levelOfDetail(
+        const pCDM::SharedHorizontalCoordinates & coords);
+
+private:
+    mutable std::mutex m_mutex;
+    /** Incremented for each request and cancellation. Workers of older generations stop. */
+    std::atomic<uint64_t> m_generation;
+    Preview m_preview;
+    /** Levels of the most recently used coordinates */
+    std::shared_ptr<const PCDMLevelOfDetail> m_levelOfDetail;
+    std::vector<QFuture<void>> m_futures;
+};
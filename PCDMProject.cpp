@@ -27,10 +27,8 @@
 
 #include <vtkAOSDataArrayTemplate.h>
 #include <vtkDataSet.h>
-#include <vtkDelimitedTextWriter.h>
 #include <vtkImageData.h>
 #include <vtkPolyData.h>
-#include <vtkTable.h>
 #include <vtkVector.h>
 
 #include <core/CoordinateSystems.h>
@@ -39,7 +37,10 @@
 #include <core/utility/DataExtent.h>
 #include <core/utility/vtkvectorhelper.h>
 
+#include "PCDMBackend.h"
+#include "PCDMCoordinateFile.h"
 #include "PCDMModel.h"
+#include "PCDMResultCache.h"
 
 
 using pCDM::t_FP;
@@ -55,16 +56,162 @@ QString projectFileName(const QString & rootFolder)
     return QDir(rootFolder).filePath(PCDMProject::projectFileNameFilter());
 }
 
+/** Grid specification, or point coordinates as text for projects of earlier versions */
 QString coordsFileName(const QString & rootFolder)
 {
     return QDir(rootFolder).filePath("Coordinates.txt");
 }
 
+const QString & coordsBinaryFilePrefix()
+{
+    static const QString prefix = "Coordinates_";
+    return prefix;
+}
+
+/**
+ * Write point coordinates to a new PCDMCoordinateFile in the project folder and map it.
+ * Each import uses a new file, as mapped files cannot be replaced on all platforms.
+ * @param fileName Set to the name of the new file, relative to the root folder.
+ * @return the mapped coordinates, or coords if the file cannot be mapped. nullptr if writing
+ *  fails.
+ */
+pCDM::SharedHorizontalCoordinates storeCoordinates(const QString & rootFolder,
+    const pCDM::SharedHorizontalCoordinates & coords, QString & fileName)
+{
+    fileName = coordsBinaryFilePrefix()
+        + PCDMProject::timestampToString(QDateTime::currentDateTime()) + ".bin";
+    const auto filePath = QDir(rootFolder).filePath(fileName);
+    if (!PCDMCoordinateFile::write(filePath, *coords))
+    {
+        QFile::remove(filePath);
+        return{};
+    }
+
+    if (auto mapped = PCDMCoordinateFile::map(filePath))
+    {
+        return mapped;
+    }
+    return coords;
+}
+
+/**
+ * Read point coordinates from the text file of projects of earlier versions.
+ * @return nullptr if the file is missing or invalid.
+ */
+pCDM::SharedHorizontalCoordinates readLegacyCoordinates(const QString & fileName)
+{
+    TextFileReader::Vector_t<t_FP> coords;
+
+    auto reader = TextFileReader(fileName);
+    TextFileReader::Vector_t<QString> header;
+    reader.read(header, 1); // skip the header written by vtkDelimitedTextWriter
+    reader.read(coords);
+    if (!reader.stateFlags().testFlag(TextFileReader::successful)
+        || (coords.size() != 2) || coords.front().empty())
+    {
+        return{};
+    }
+
+    pCDM::HorizontalCoordinates::Columns columns{ { std::move(coords[0]), std::move(coords[1]) } };
+    return std::make_shared<const pCDM::HorizontalCoordinates>(std::move(columns));
+}
+
+/**
+ * Remove coordinate files except the current one. Files still mapped by other processes or
+ * threads may fail to be removed on some platforms, they are removed with the next call.
+ */
+void removeStaleCoordinateFiles(const QString & rootFolder, const QString & currentFileName)
+{
+    const QDir dir(rootFolder);
+    for (const auto & fileName : dir.entryList({ coordsBinaryFilePrefix() + "*.bin" }, QDir::Files))
+    {
+        if (fileName != currentFileName)
+        {
+            QFile::remove(dir.filePath(fileName));
+        }
+    }
+}
+
 QString modelsDir(const QString & rootFolder)
 {
     return QDir(rootFolder).filePath("models");
 }
 
+QString samplesDir(const QString & rootFolder)
+{
+    return QDir(rootFolder).filePath("samples");
+}
+
+const QString & samplesFileSuffix()
+{
+    static const QString suffix = "samples";
+    return suffix;
+}
+
+const QString & precisionToString(pCDM::Precision precision)
+{
+    static const QString single = "single";
+    static const QString double_ = "double";
+    return precision == pCDM::Precision::singlePrecision ? single : double_;
+}
+
+const QString & codecToString(PCDMResultFile::Codec codec)
+{
+    static const QString none = "none";
+    static const QString deflate = "deflate";
+    static const QString quantized = "quantized";
+    switch (codec)
+    {
+    case PCDMResultFile::Codec::shuffleDeflate:
+        return deflate;
+    case PCDMResultFile::Codec::quantizedDeflate:
+        return quantized;
+    case PCDMResultFile::Codec::none:
+    default:
+        return none;
+    }
+}
+
+PCDMResultFile::Codec stringToCodec(const QString & codec)
+{
+    for (const auto value : { PCDMResultFile::Codec::shuffleDeflate,
+        PCDMResultFile::Codec::quantizedDeflate })
+    {
+        if (codec == codecToString(value))
+        {
+            return value;
+        }
+    }
+    return PCDMResultFile::Codec::none;
+}
+
+const size_t defaultMemoryBudgetMiB = 2048;
+const size_t defaultResultCacheBudgetMiB = 1024;
+const size_t bytesPerMiB = 1024u * 1024u;
+const t_FP defaultMaxStorageError = 1e-6;
+
+/** Grid description of the horizontal image, without materializing its coordinates */
+pCDM::SharedHorizontalCoordinates gridCoordinates(vtkImageData & image)
+{
+    const auto origin = image.GetOrigin();
+    const auto spacing = image.GetSpacing();
+    const auto extent = image.GetExtent();
+
+    pCDM::HorizontalGrid grid;
+    grid.origin = { origin[0], origin[1] };
+    grid.spacing = { spacing[0], spacing[1] };
+    grid.extent = { extent[0], extent[1], extent[2], extent[3] };
+
+    return std::make_shared<const pCDM::HorizontalCoordinates>(grid);
+}
+
+pCDM::Precision stringToPrecision(const QString & precision)
+{
+    return precision == precisionToString(pCDM::Precision::singlePrecision)
+        ? pCDM::Precision::singlePrecision
+        : pCDM::Precision::doublePrecision;
+}
+
 }
 
 
@@ -73,6 +220,14 @@ PCDMProject::PCDMProject(const QString & rootFolder)
     , m_rootFolder{ rootFolder }
     , m_projectFileName{ projectFileName(rootFolder) }
     , m_modelsDir{ modelsDir(rootFolder) }
+    , m_precision{ pCDM::Precision::doublePrecision }
+    , m_memoryBudgetMiB{ defaultMemoryBudgetMiB }
+    , m_numThreads{ 0 }
+    , m_resultCompression{ PCDMResultFile::Codec::none, defaultMaxStorageError }
+    , m_storeNuParts{ true }
+    , m_unitResponseCache{ std::make_shared<PCDMUnitResponseCache>() }
+    , m_resultCacheBudgetMiB{ defaultResultCacheBudgetMiB }
+    , m_resultCache{ std::make_shared<PCDMResultCache>() }
 {
     {   // touch the project file if it doesn't exist
         QFile projectFile(m_projectFileName);
@@ -86,7 +241,18 @@ PCDMProject::PCDMProject(const QString & rootFolder)
     {
         m_lastModelTimestamp = settings.value("MostRecentlyUsedModel").toDateTime();
         m_nu = settings.value("Material/nu").value<t_FP>();
+        m_precision = stringToPrecision(settings.value("Computation/Precision").toString());
+        m_memoryBudgetMiB = static_cast<size_t>(settings.value("Computation/MemoryBudgetMiB",
+            static_cast<qulonglong>(defaultMemoryBudgetMiB)).toULongLong());
+        m_numThreads = static_cast<size_t>(settings.value("Computation/NumThreads").toULongLong());
+        m_resultCacheBudgetMiB = static_cast<size_t>(settings.value("Computation/ResultCacheMiB",
+            static_cast<qulonglong>(defaultResultCacheBudgetMiB)).toULongLong());
+        m_resultCompression.codec = stringToCodec(settings.value("Storage/ResultCodec").toString());
+        m_resultCompression.maxError = settings.value("Storage/MaxError",
+            defaultMaxStorageError).value<t_FP>();
+        m_storeNuParts = settings.value("Storage/PoissonsRatioParts", true).toBool();
     });
+    m_resultCache->setMemoryBudget(m_resultCacheBudgetMiB * bytesPerMiB);
 
     readCoordinates();
 
@@ -146,13 +312,14 @@ bool PCDMProject::importHorizontalCoordinatesFrom(vtkDataSet & dataSet)
         return false;
     }
 
-    auto applyNewDataSet = [this, &dataSet] (vtkDataSet & newDataSet, const QString & dataTypeString)
+    auto applyNewDataSet = [this, &dataSet] (vtkDataSet & newDataSet, const QString & dataTypeString,
+        pCDM::SharedHorizontalCoordinates values, const QString & coordinateFileName)
     {
         invalidateModels();
 
-        for (auto & vec : m_horizontalCoordsValues)
         {
-            vec.clear();
+            std::lock_guard<std::mutex> lock(m_horizontalCoordsValuesMutex);
+            m_horizontalCoordsValues = std::move(values);
         }
 
         m_coordsDataSet = &newDataSet;
@@ -160,7 +327,7 @@ bool PCDMProject::importHorizontalCoordinatesFrom(vtkDataSet & dataSet)
         const auto coordsSpec = ReferencedCoordinateSystemSpecification::fromFieldData(*dataSet.GetFieldData());
         coordsSpec.writeToFieldData(*newDataSet.GetFieldData());
 
-        accessSettings([&dataTypeString, &coordsSpec] (QSettings & settings)
+        accessSettings([&dataTypeString, &coordsSpec, &coordinateFileName] (QSettings & settings)
         {
             settings.beginGroup("Surface");
             settings.setValue("ValidData", true);
@@ -168,7 +335,16 @@ bool PCDMProject::importHorizontalCoordinatesFrom(vtkDataSet & dataSet)
             QVariant coordsVariant;
             coordsVariant.setValue(coordsSpec);
             settings.setValue("CoordinateSystem", coordsVariant);
+            if (coordinateFileName.isEmpty())
+            {
+                settings.remove("CoordinateFile");
+            }
+            else
+            {
+                settings.setValue("CoordinateFile", coordinateFileName);
+            }
         });
+        removeStaleCoordinateFiles(m_rootFolder, coordinateFileName);
 
         emit horizontalCoordinatesChanged();
 
@@ -205,7 +381,7 @@ bool PCDMProject::importHorizontalCoordinatesFrom(vtkDataSet & dataSet)
         imageSpec.setValue("Extent", arrayToString(std::array<int, 4>(extent.convertTo<2>())));
         imageSpec.setValue("Spacing", vectorToString(convertTo<2>(spacing)));
 
-        return applyNewDataSet(image, "Regular Grid");
+        return applyNewDataSet(image, "Regular Grid", gridCoordinates(image), {});
     }
 
     if (auto sourcePolyPtr = vtkPolyData::SafeDownCast(&dataSet))
@@ -246,34 +422,29 @@ bool PCDMProject::importHorizontalCoordinatesFrom(vtkDataSet & dataSet)
 
         // Copy X/Y columns to be used in the modeling backend
 
-        m_horizontalCoordsValues[0].resize(static_cast<size_t>(numPoints));
-        m_horizontalCoordsValues[1].resize(static_cast<size_t>(numPoints));
-
-        // Map backend data into the VTK arrays for text export
-        auto x = vtkSmartPointer<vtkAOSDataArrayTemplate<t_FP>>::New();
-        auto y = vtkSmartPointer<vtkAOSDataArrayTemplate<t_FP>>::New();
-        x->SetName("X");
-        y->SetName("Y");
-        x->SetArray(m_horizontalCoordsValues[0].data(), numPoints, 1);
-        y->SetArray(m_horizontalCoordsValues[1].data(), numPoints, 1);
-        x->CopyComponent(0, newPoints, 0);
-        y->CopyComponent(0, newPoints, 1);
-
-        auto table = vtkSmartPointer<vtkTable>::New();
-        table->AddColumn(x);
-        table->AddColumn(y);
-
-        auto writer = vtkSmartPointer<vtkDelimitedTextWriter>::New();
-        writer->SetFieldDelimiter(" ");
-        writer->SetUseStringDelimiter(false);
-        writer->SetInputData(table);
-        writer->SetFileName(fileName.toUtf8().data());
-        if (writer->Write() != 1)
+        pCDM::HorizontalCoordinates::Columns columns;
+        columns[0].resize(static_cast<size_t>(numPoints));
+        columns[1].resize(static_cast<size_t>(numPoints));
+
+        const auto xy = newPoints->GetPointer(0);
+        for (size_t i = 0; i < static_cast<size_t>(numPoints); ++i)
+        {
+            columns[0][i] = xy[3 * i];
+            columns[1][i] = xy[3 * i + 1];
+        }
+
+        // The backend uses the mapped file instead of the columns.
+        QString coordinateFileName;
+        const auto values = storeCoordinates(m_rootFolder,
+            std::make_shared<const pCDM::HorizontalCoordinates>(std::move(columns)),
+            coordinateFileName);
+        if (!values)
         {
             return false;
         }
+        QFile::remove(fileName);
 
-        return applyNewDataSet(poly, "Point Cloud");
+        return applyNewDataSet(poly, "Point Cloud", values, coordinateFileName);
     }
 
     return false;
@@ -284,31 +455,9 @@ vtkDataSet * PCDMProject::horizontalCoordinatesDataSet()
     return m_coordsDataSet;
 }
 
-const std::array<std::vector<pCDM::t_FP>, 2> & PCDMProject::horizontalCoordinateValues()
+pCDM::SharedHorizontalCoordinates PCDMProject::horizontalCoordinateValues()
 {
-    if (!m_horizontalCoordsValues[0].empty())
-    {
-        return m_horizontalCoordsValues;
-    }
-
-    if (!m_coordsDataSet)
-    {
-        return m_horizontalCoordsValues;
-    }
-
-    const auto numCoords = static_cast<size_t>(m_coordsDataSet->GetNumberOfPoints());
-    for (auto & vec : m_horizontalCoordsValues)
-    {
-        vec.resize(numCoords);
-    }
-
-    for (size_t i = 0; i < numCoords; ++i)
-    {
-        std::array<t_FP, 3> point;
-        m_coordsDataSet->GetPoint(static_cast<vtkIdType>(i), point.data());
-        m_horizontalCoordsValues[0][i] = point[0];
-        m_horizontalCoordsValues[1][i] = point[1];
-    }
+    std::lock_guard<std::mutex> lock(m_horizontalCoordsValuesMutex);
 
     return m_horizontalCoordsValues;
 }
@@ -351,7 +500,11 @@ void PCDMProject::setPoissonsRatio(pCDM::t_FP nu)
 
     m_nu = nu;
 
-    invalidateModels();
+    // Unit responses and stored displacement parts do not depend on nu.
+    for (const auto & p : m_models)
+    {
+        p.second->handlePoissonsRatioChanged();
+    }
 
     accessSettings([nu] (QSettings & settings)
     {
@@ -365,6 +518,147 @@ pCDM::t_FP PCDMProject::poissonsRatio() const
     return m_nu;
 }
 
+void PCDMProject::setComputationPrecision(pCDM::Precision precision)
+{
+    if (precision == m_precision)
+    {
+        return;
+    }
+
+    m_precision = precision;
+
+    accessSettings([precision] (QSettings & settings)
+    {
+        settings.beginGroup("Computation");
+        settings.setValue("Precision", precisionToString(precision));
+    });
+}
+
+pCDM::Precision PCDMProject::computationPrecision() const
+{
+    return m_precision;
+}
+
+void PCDMProject::setMemoryBudget(size_t bytes)
+{
+    const auto budgetMiB = bytes / bytesPerMiB;
+    if (budgetMiB == m_memoryBudgetMiB)
+    {
+        return;
+    }
+
+    m_memoryBudgetMiB = budgetMiB;
+
+    accessSettings([budgetMiB] (QSettings & settings)
+    {
+        settings.beginGroup("Computation");
+        settings.setValue("MemoryBudgetMiB", static_cast<qulonglong>(budgetMiB));
+    });
+}
+
+size_t PCDMProject::memoryBudget() const
+{
+    return m_memoryBudgetMiB * bytesPerMiB;
+}
+
+void PCDMProject::setNumThreads(size_t numThreads)
+{
+    if (numThreads == m_numThreads)
+    {
+        return;
+    }
+
+    m_numThreads = numThreads;
+
+    accessSettings([numThreads] (QSettings & settings)
+    {
+        settings.beginGroup("Computation");
+        settings.setValue("NumThreads", static_cast<qulonglong>(numThreads));
+    });
+}
+
+size_t PCDMProject::numThreads() const
+{
+    return m_numThreads;
+}
+
+void PCDMProject::setResultCompression(const PCDMResultFile::Compression & compression)
+{
+    if (compression.codec == m_resultCompression.codec
+        && compression.maxError == m_resultCompression.maxError)
+    {
+        return;
+    }
+
+    m_resultCompression = compression;
+
+    accessSettings([compression] (QSettings & settings)
+    {
+        settings.beginGroup("Storage");
+        settings.setValue("ResultCodec", codecToString(compression.codec));
+        settings.setValue("MaxError", compression.maxError);
+    });
+}
+
+const PCDMResultFile::Compression & PCDMProject::resultCompression() const
+{
+    return m_resultCompression;
+}
+
+void PCDMProject::setStoreNuParts(bool storeNuParts)
+{
+    if (storeNuParts == m_storeNuParts)
+    {
+        return;
+    }
+
+    m_storeNuParts = storeNuParts;
+
+    accessSettings([storeNuParts] (QSettings & settings)
+    {
+        settings.beginGroup("Storage");
+        settings.setValue("PoissonsRatioParts", storeNuParts);
+    });
+}
+
+bool PCDMProject::storeNuParts() const
+{
+    return m_storeNuParts;
+}
+
+const std::shared_ptr<PCDMUnitResponseCache> & PCDMProject::unitResponseCache() const
+{
+    return m_unitResponseCache;
+}
+
+const std::shared_ptr<PCDMResultCache> & PCDMProject::resultCache() const
+{
+    return m_resultCache;
+}
+
+void PCDMProject::setResultCacheBudget(size_t bytes)
+{
+    const auto budgetMiB = bytes / bytesPerMiB;
+    if (budgetMiB == m_resultCacheBudgetMiB)
+    {
+        return;
+    }
+
+    m_resultCacheBudgetMiB = budgetMiB;
+    m_resultCache->setMemoryBudget(budgetMiB * bytesPerMiB);
+
+    accessSettings([budgetMiB] (QSettings & settings)
+    {
+        settings.beginGroup("Computation");
+        settings.setValue("ResultCacheMiB", static_cast<qulonglong>(budgetMiB));
+    });
+}
+
+size_t PCDMProject::resultCacheBudget() const
+{
+    return m_resultCacheBudgetMiB * bytesPerMiB;
+}
+
 const std::map<QDateTime, std::unique_ptr<PCDMModel>> & PCDMProject::models() const
 {
     return m_models;
@@ -470,6 +764,44 @@ QDateTime PCDMProject::stringToTimestamp(const QString & timestamp)
     return QDateTime::fromString(timestamp, "yyyy-MM-dd HH-mm-ss.zzz");
 }
 
+QString PCDMProject::samplesFileName(const QDateTime & timestamp)
+{
+    const auto samplesPath = samplesDir(m_rootFolder);
+
+    auto dir = QDir(samplesPath);
+    if (!dir.exists())
+    {
+        const auto dirName = dir.dirName();
+        auto upDir = dir;
+        upDir.cdUp();
+        if (!upDir.mkdir(dirName))
+        {
+            return{};
+        }
+    }
+
+    return dir.filePath(timestampToString(timestamp) + "." + samplesFileSuffix());
+}
+
+std::vector<QDateTime> PCDMProject::sampleRunTimestamps() const
+{
+    const auto entries = QDir(samplesDir(m_rootFolder)).entryInfoList(
+        { "*." + samplesFileSuffix() }, QDir::Filter::Files | QDir::Readable, QDir::Name);
+
+    std::vector<QDateTime> timestamps;
+    for (auto && file : entries)
+    {
+        const auto timestamp = stringToTimestamp(file.completeBaseName());
+        if (timestamp.isValid())
+        {
+            timestamps.push_back(timestamp);
+        }
+    }
+    std::sort(timestamps.begin(), timestamps.end());
+
+    return timestamps;
+}
+
 void PCDMProject::readModels()
 {
     const auto entries = QDir(modelsDir(m_rootFolder)).entryInfoList(
@@ -509,10 +841,11 @@ void PCDMProject::readCoordinates()
     bool isGrid = false;
     bool isPoints = false;
     QString geometryType;
+    QString coordinateFileName;
 
     ReferencedCoordinateSystemSpecification coordsSpec;
 
-    readSettings([&hasValidData, &isGrid, &isPoints, &geometryType, &coordsSpec]
+    readSettings([&hasValidData, &isGrid, &isPoints, &geometryType, &coordinateFileName, &coordsSpec]
     (const QSettings & settings)
     {
         if (!settings.value("Surface/ValidData", false).toBool())
@@ -521,6 +854,8 @@ void PCDMProject::readCoordinates()
         }
         hasValidData = true;
 
+        coordinateFileName = settings.value("Surface/CoordinateFile").toString();
+
         coordsSpec =
             settings.value("Surface/CoordinateSystem").value<ReferencedCoordinateSystemSpecification>();
 
@@ -548,10 +883,16 @@ void PCDMProject::readCoordinates()
             settings.beginGroup("Surface");
             settings.setValue("ValidData", false);
             settings.remove("DataType");
+            settings.remove("CoordinateFile");
         });
         m_coordsDataSet = {};
         m_coordsGeometryType.clear();
+        {
+            std::lock_guard<std::mutex> lock(m_horizontalCoordsValuesMutex);
+            m_horizontalCoordsValues = {};
+        }
         QFile(fileName).remove();
+        removeStaleCoordinateFiles(m_rootFolder, {});
     };
 
     if (!hasValidData || (!isGrid && !isPoints))
@@ -560,15 +901,22 @@ void PCDMProject::readCoordinates()
         return;
     }
 
-    auto setToValid = [this, &geometryType, &coordsSpec] (vtkDataSet & dataSet)
+    auto setToValid = [this, &geometryType, &coordsSpec] (vtkDataSet & dataSet,
+        pCDM::SharedHorizontalCoordinates values)
     {
         m_coordsGeometryType = geometryType;
         m_coordsDataSet = &dataSet;
         coordsSpec.writeToFieldData(*dataSet.GetFieldData());
+        {
+            std::lock_guard<std::mutex> lock(m_horizontalCoordsValuesMutex);
+            m_horizontalCoordsValues = std::move(values);
+        }
     };
 
     if (isGrid)
     {
+        removeStaleCoordinateFiles(m_rootFolder, {});
+
         const QSettings imageSpec(fileName, QSettings::IniFormat);
         if (!imageSpec.contains("Grid/Origin")
             || !imageSpec.contains("Grid/Extent")
@@ -598,52 +946,56 @@ void PCDMProject::readCoordinates()
         image->SetExtent(extent.data());
         image->SetSpacing(spacing.GetData());
 
-        setToValid(*image);
+        setToValid(*image, gridCoordinates(*image));
 
         return;
     }
 
     if (isPoints)
     {
-        TextFileReader::Vector_t<t_FP> coords;
-
-        auto reader = TextFileReader(fileName);
-        TextFileReader::Vector_t<QString> header;
-        reader.read(header, 1); // skip the header written by vtkDelimitedTextWriter
-        reader.read(coords);
-        if (!reader.stateFlags().testFlag(TextFileReader::successful)
-            || (coords.size() != 2) || coords.front().empty())
+        pCDM::SharedHorizontalCoordinates coords;
+        if (!coordinateFileName.isEmpty())
+        {
+            coords = PCDMCoordinateFile::map(QDir(m_rootFolder).filePath(coordinateFileName));
+        }
+        else
+        {
+            // Convert coordinates of projects of earlier versions
+            coords = readLegacyCoordinates(fileName);
+            if (coords)
+            {
+                coords = storeCoordinates(m_rootFolder, coords, coordinateFileName);
+            }
+            if (coords)
+            {
+                accessSettings([&coordinateFileName] (QSettings & settings)
+                {
+                    settings.setValue("Surface/CoordinateFile", coordinateFileName);
+                });
+                QFile::remove(fileName);
+            }
+        }
+        if (!coords || coords->empty())
         {
             setToInvalid();
             return;
         }
+        removeStaleCoordinateFiles(m_rootFolder, coordinateFileName);
 
-        const auto numPoints = static_cast<vtkIdType>(coords.front().size());
-
-        // TODO enable SOA Array dispatch in VTK build and try if it has performance benefits
-        /*auto pointsData = vtkSmartPointer<vtkSOADataArrayTemplate<t_FP>>::New();
-        pointsData->SetNumberOfComponents(3);
-        pointsData->SetNumberOfTuples(numPoints);
-        for (int c = 0; c < 2; ++c)
-        {
-            std::copy(coords[c].begin(), coords[c].end(), pointsData->GetComponentArrayPointer(c));
-        }
-        std::fill_n(pointsData->GetComponentArrayPointer(2),
-            coords[0].size(),
-            static_cast<t_FP>(0.f));*/
+        const auto numPoints = static_cast<vtkIdType>(coords->size());
 
+        // TODO enable SOA Array dispatch in VTK build and map the columns without copying
         auto pointsData = vtkSmartPointer<vtkAOSDataArrayTemplate<t_FP>>::New();
         pointsData->SetNumberOfComponents(3);
         pointsData->SetNumberOfTuples(numPoints);
-        for (int c = 0; c < 2; ++c)
+        const auto & columns = coords->columns();
+        const auto xyz = pointsData->GetPointer(0);
+        for (size_t i = 0; i < coords->size(); ++i)
         {
-            for (vtkIdType i = 0; i < numPoints; ++i)
-            {
-                pointsData->SetTypedComponent(i, c,
-                    coords[static_cast<size_t>(c)][static_cast<size_t>(i)]);
-            }
+            xyz[3 * i] = columns[0][i];
+            xyz[3 * i + 1] = columns[1][i];
+            xyz[3 * i + 2] = static_cast<t_FP>(0);
         }
-        pointsData->FillTypedComponent(2, static_cast<t_FP>(0));
 
         auto points = vtkSmartPointer<vtkPoints>::New();
         points->SetData(pointsData);
@@ -661,7 +1013,8 @@ void PCDMProject::readCoordinates()
         poly->SetPoints(points);
         poly->SetVerts(verts);
 
-        setToValid(*poly);
+        // The backend uses the mapped X/Y columns.
+        setToValid(*poly, std::move(coords));
 
         return;
     }
@@ -683,6 +1036,10 @@ void PCDMProject::readSettings(std::function<void(const QSettings &)> func)
 
 void PCDMProject::invalidateModels()
 {
+    m_unitResponseCache->clear();
+    // Release results and the coordinate snapshots they refer to.
+    m_resultCache->clear();
+
     for (const auto & p : m_models)
     {
         p.second->invalidateResults();
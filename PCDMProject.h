@@ -22,6 +22,7 @@
 #include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include <QDateTime>
@@ -32,12 +33,15 @@
 #include <core/CoordinateSystems_fwd.h>
 
 #include "pCDM_types.h"
+#include "PCDMResultFile.h"
 
 
 class QSettings;
 class vtkDataSet;
 
 class PCDMModel;
+class PCDMResultCache;
+class PCDMUnitResponseCache;
 
 
 class PCDMProject : public QObject
@@ -63,7 +67,15 @@ public:
      */
     bool importHorizontalCoordinatesFrom(vtkDataSet & dataSet);
     vtkDataSet * horizontalCoordinatesDataSet();
-    const std::array<std::vector<pCDM::t_FP>, 2> & horizontalCoordinateValues();
+    /**
+     * Snapshot of the horizontal coordinates, shared with backends and worker threads. Regular grids
+     * are described by origin, spacing and extent, their coordinates are never stored per point.
+     * Importing new coordinates creates a new snapshot, previous snapshots remain valid as long as
+     * they are referenced.
+     * This function is thread-safe.
+     * @return nullptr if no coordinates are set.
+     */
+    pCDM::SharedHorizontalCoordinates horizontalCoordinateValues();
     const QString & horizontalCoordinatesGeometryType() const;
     size_t numHorizontalCoordinates() const;
     /**
@@ -71,10 +83,73 @@ public:
      */
     ReferencedCoordinateSystemSpecification coordinateSystem() const;
 
-    /** Set the Poisson's ratio. Changing nu invalidates previous modeling results. */
+    /**
+     * Set the Poisson's ratio. Changing nu invalidates previous modeling results. Models storing
+     * Poisson's ratio independent displacement parts derive new results from them on request.
+     */
     void setPoissonsRatio(pCDM::t_FP nu);
     pCDM::t_FP poissonsRatio() const;
 
+    /**
+     * Set the floating point precision used to compute models. This does not invalidate previous
+     * modeling results, and results are stored as pCDM::t_FP in any case.
+     */
+    void setComputationPrecision(pCDM::Precision precision);
+    pCDM::Precision computationPrecision() const;
+
+    /**
+     * Memory in bytes that a model computation should allocate at most. Computations with a larger
+     * estimated footprint are evaluated in chunks, which only requires memory for the results plus a
+     * small constant.
+     * The budget is stored in MiB and rounded down accordingly.
+     */
+    void setMemoryBudget(size_t bytes);
+    size_t memoryBudget() const;
+
+    /**
+     * Maximum number of threads used to compute a model. 0 (default) uses all threads of the
+     * thread pool.
+     */
+    void setNumThreads(size_t numThreads);
+    size_t numThreads() const;
+
+    /**
+     * Codec used to store model results, defaults to uncompressed storage. Changes apply to results
+     * stored afterwards. Result files are self-describing, so that results stored with other codecs
+     * remain readable.
+     * Poisson's ratio parts are stored lossless if a lossy codec is set, as errors of the parts
+     * would be scaled when combining them.
+     */
+    void setResultCompression(const PCDMResultFile::Compression & compression);
+    const PCDMResultFile::Compression & resultCompression() const;
+
+    /**
+     * Whether models store their Poisson's ratio independent displacement parts in addition to the
+     * results, so that changing the Poisson's ratio does not require recomputing them. This is
+     * enabled by default. Parts are stored with the result compression and require about twice the
+     * storage of results, so disabling it saves storage at the cost of recomputing all models when
+     * the Poisson's ratio changes.
+     */
+    void setStoreNuParts(bool storeNuParts);
+    bool storeNuParts() const;
+
+    /**
+     * Unit responses of the most recently computed model geometry, shared by the models of the
+     * project. Models that only differ in the potencies or the Poisson's ratio reuse the responses.
+     */
+    const std::shared_ptr<PCDMUnitResponseCache> & unitResponseCache() const;
+
+    /**
+     * Results of the project's models, keyed by their parameters. Results exceeding the budget are
+     * evicted in least recently used order, models read them again from their directories on
+     * request. Previous results are kept when model parameters change, so that reverting a change
+     * does not require a computation.
+     * The budget is stored in MiB and rounded down accordingly.
+     */
+    const std::shared_ptr<PCDMResultCache> & resultCache() const;
+    void setResultCacheBudget(size_t bytes);
+    size_t resultCacheBudget() const;
+
     const std::map<QDateTime, std::unique_ptr<PCDMModel>> & models() const;
     PCDMModel * addModel(const QDateTime & timestamp = QDateTime::currentDateTime());
     bool deleteModel(const QDateTime & timestamp);
@@ -82,6 +157,15 @@ public:
     PCDMModel * model(const QDateTime & timestamp);
     const PCDMModel * model(const QDateTime & timestamp) const;
 
+    /**
+     * File name for the samples of a posterior sampling run (see PCDMSampleFile), in the project's
+     * "samples" folder next to the models. Creates the folder if required.
+     * @return an empty string if the folder cannot be created.
+     */
+    QString samplesFileName(const QDateTime & timestamp = QDateTime::currentDateTime());
+    /** Timestamps of the stored sampling runs, in ascending order */
+    std::vector<QDateTime> sampleRunTimestamps() const;
+
     /** Store the timestamp of a specific model, e.g., the last one the user worked with. */
     const QDateTime & lastModelTimestamp() const;
     void setLastModelTimestamp(const QDateTime & timestamp);
@@ -109,11 +193,20 @@ private:
     const QString m_modelsDir;
 
     vtkSmartPointer<vtkDataSet> m_coordsDataSet;
-    std::array<std::vector<pCDM::t_FP>, 2> m_horizontalCoordsValues;
+    pCDM::SharedHorizontalCoordinates m_horizontalCoordsValues;
+    std::mutex m_horizontalCoordsValuesMutex;
     QString m_coordsGeometryType;
 
     std::map<QDateTime, std::unique_ptr<PCDMModel>> m_models;
     QDateTime m_lastModelTimestamp;
 
     pCDM::t_FP m_nu;
+    pCDM::Precision m_precision;
+    size_t m_memoryBudgetMiB;
+    size_t m_numThreads;
+    PCDMResultFile::Compression m_resultCompression;
+    bool m_storeNuParts;
+    std::shared_ptr<PCDMUnitResponseCache> m_unitResponseCache;
+    size_t m_resultCacheBudgetMiB;
+    std::shared_ptr<PCDMResultCache> m_resultCache;
 };
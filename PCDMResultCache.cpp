@@ -0,0 +1,255 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PCDMResultCache.h"
+
+#include <cassert>
+#include <functional>
+#include <iterator>
+
+
+namespace
+{
+
+using pCDM::t_FP;
+
+void hashCombine(size_t & seed, const t_FP value)
+{
+    // -0 and 0 compare equal and need the same hash.
+    seed ^= std::hash<t_FP>()(value == 0 ? t_FP(0) : value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+template<size_t N>
+void hashCombine(size_t & seed, const std::array<t_FP, N> & values)
+{
+    for (const auto value : values)
+    {
+        hashCombine(seed, value);
+    }
+}
+
+/** Exact comparison, where -0 and 0 are equal as for hashCombine */
+bool equalValues(const pCDM::PointCDMParameters & lhs, const pCDM::PointCDMParameters & rhs)
+{
+    return lhs.horizontalCoord == rhs.horizontalCoord
+        && lhs.depth == rhs.depth
+        && lhs.omega == rhs.omega
+        && lhs.dv == rhs.dv;
+}
+
+}
+
+
+PCDMResultCache::Displacements::Displacements(Results results)
+    : m_storage{}
+    , m_components{}
+    , m_numTuples{ results[0].size() }
+    , m_memoryUsage{ 0 }
+{
+    assert(results[1].size() == m_numTuples && results[2].size() == m_numTuples);
+
+    auto storage = std::make_shared<const Results>(std::move(results));
+    for (size_t c = 0; c < 3; ++c)
+    {
+        m_components[c] = (*storage)[c].data();
+        m_memoryUsage += (*storage)[c].size() * sizeof(t_FP);
+    }
+    m_storage = std::move(storage);
+}
+
+PCDMResultCache::Displacements::Displacements(const Components & components,
+    const size_t numTuples, std::shared_ptr<const void> storage, const size_t memoryUsage)
+    : m_storage{ std::move(storage) }
+    , m_components(components)
+    , m_numTuples{ numTuples }
+    , m_memoryUsage{ memoryUsage }
+{
+}
+
+size_t PCDMResultCache::Displacements::size() const
+{
+    return m_numTuples;
+}
+
+auto PCDMResultCache::Displacements::components() const -> const Components &
+{
+    return m_components;
+}
+
+const t_FP * PCDMResultCache::Displacements::operator[](const size_t component) const
+{
+    assert(component < 3);
+    return m_components[component];
+}
+
+size_t PCDMResultCache::Displacements::memoryUsage() const
+{
+    return m_memoryUsage;
+}
+
+
+bool PCDMResultCache::Key::operator==(const Key & other) const
+{
+    return equalValues(sourceParameters, other.sourceParameters)
+        && nu == other.nu
+        && coords == other.coords;
+}
+
+size_t PCDMResultCache::KeyHash::operator()(const Key & key) const
+{
+    size_t seed = std::hash<const pCDM::HorizontalCoordinates *>()(key.coords.get());
+    hashCombine(seed, key.nu);
+    hashCombine(seed, key.sourceParameters.horizontalCoord);
+    hashCombine(seed, key.sourceParameters.depth);
+    hashCombine(seed, key.sourceParameters.omega);
+    hashCombine(seed, key.sourceParameters.dv);
+    return seed;
+}
+
+const size_t PCDMResultCache::maxMappedEntries;
+
+PCDMResultCache::PCDMResultCache(const size_t memoryBudget)
+    : m_memoryBudget{ memoryBudget }
+    , m_memoryUsage{ 0 }
+    , m_numMappedEntries{ 0 }
+{
+}
+
+void PCDMResultCache::setMemoryBudget(const size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_memoryBudget = bytes;
+    evict();
+}
+
+size_t PCDMResultCache::memoryBudget() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_memoryBudget;
+}
+
+size_t PCDMResultCache::memoryUsage() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_memoryUsage;
+}
+
+size_t PCDMResultCache::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+auto PCDMResultCache::find(const Key & key) -> SharedResults
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_index.find(key);
+    if (it == m_index.end())
+    {
+        return{};
+    }
+
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return it->second->results;
+}
+
+bool PCDMResultCache::contains(const Key & key) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_index.find(key) != m_index.end();
+}
+
+void PCDMResultCache::insert(const Key & key, SharedResults results)
+{
+    assert(results);
+    if (!results)
+    {
+        return;
+    }
+
+    const auto bytes = results->memoryUsage();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_index.find(key);
+    if (it != m_index.end())
+    {
+        erase(it->second);
+    }
+
+    m_entries.push_front(Entry{ key, std::move(results), bytes });
+    m_index.emplace(key, m_entries.begin());
+    m_memoryUsage += bytes;
+    if (bytes == 0)
+    {
+        ++m_numMappedEntries;
+    }
+
+    evict();
+}
+
+void PCDMResultCache::remove(const Key & key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_index.find(key);
+    if (it == m_index.end())
+    {
+        return;
+    }
+
+    erase(it->second);
+}
+
+void PCDMResultCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_index.clear();
+    m_entries.clear();
+    m_memoryUsage = 0;
+    m_numMappedEntries = 0;
+}
+
+void PCDMResultCache::evict()
+{
+    // Keep the most recently used entry in any case.
+    while (m_memoryUsage > m_memoryBudget && m_entries.size() > 1)
+    {
+        erase(std::prev(m_entries.end()));
+    }
+
+    // Mapped results don't count against the budget, but each one holds a file mapping.
+    auto it = m_entries.end();
+    while (m_numMappedEntries > maxMappedEntries && it != m_entries.begin())
+    {
+        --it;
+        if (it->bytes == 0 && it != m_entries.begin())
+        {
+            it = erase(it);
+        }
+    }
+}
+
+auto PCDMResultCache::erase(const EntryList::iterator entry) -> EntryList::iterator
+{
+    m_memoryUsage -= entry->bytes;
+    if (entry->bytes == 0)
+    {
+        --m_numMappedEntries;
+    }
+    m_index.erase(entry->key);
+    return m_entries.erase(entry);
+}
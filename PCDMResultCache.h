@@ -0,0 +1,143 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "pCDM_types.h"
+
+
+/**
+ * Modeling results of a project, keyed by the source parameters, the Poisson's ratio and the
+ * coordinate snapshot they are computed for.
+ *
+ * The cache holds results up to a memory budget and evicts the least recently used results first.
+ * Results without memory usage (mapped files) are limited in number by maxMappedEntries instead.
+ * Results are immutable and shared, so evicted results remain valid as long as they are referenced.
+ * The most recently inserted results are always kept, even if they exceed the budget on their own.
+ * This class is thread-safe.
+ */
+class PCDMResultCache
+{
+public:
+    /** Displacements east, north, up, as computed by the backends */
+    using Results = std::array<std::vector<pCDM::t_FP>, 3>;
+
+    /**
+     * Immutable displacements east, north, up. Components either reference moved-in Results, or
+     * external memory such as a mapped or decompressed result file (see PCDMResultFile), which is
+     * kept alive by a shared storage handle.
+     */
+    class Displacements
+    {
+    public:
+        using Components = std::array<const pCDM::t_FP *, 3>;
+
+        explicit Displacements(Results results);
+        /** @param memoryUsage Bytes of memory held by storage, 0 for mapped files */
+        Displacements(const Components & components, size_t numTuples,
+            std::shared_ptr<const void> storage, size_t memoryUsage = 0);
+
+        size_t size() const;
+        const Components & components() const;
+        const pCDM::t_FP * operator[](size_t component) const;
+        /**
+         * Bytes of memory held by the displacements. Mapped files are paged by the operating system
+         * and not included.
+         */
+        size_t memoryUsage() const;
+
+    private:
+        std::shared_ptr<const void> m_storage;
+        Components m_components;
+        size_t m_numTuples;
+        size_t m_memoryUsage;
+    };
+    using SharedResults = std::shared_ptr<const Displacements>;
+
+    struct Key
+    {
+        pCDM::PointCDMParameters sourceParameters;
+        pCDM::t_FP nu;
+        /**
+         * Coordinate snapshot (see PCDMProject::horizontalCoordinateValues), compared by identity.
+         * Cached entries keep their snapshot alive, so that its address is not reused.
+         */
+        pCDM::SharedHorizontalCoordinates coords;
+
+        /**
+         * Parameters are compared exactly (other than PointCDMParameters::operator==), consistent
+         * with KeyHash.
+         */
+        bool operator==(const Key & other) const;
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key & key) const;
+    };
+
+    explicit PCDMResultCache(size_t memoryBudget = 0);
+
+    void setMemoryBudget(size_t bytes);
+    size_t memoryBudget() const;
+    /** Sum of the sizes of all cached results in bytes */
+    size_t memoryUsage() const;
+    size_t size() const;
+
+    /** @return cached results for the key and mark them as most recently used, or nullptr. */
+    SharedResults find(const Key & key);
+    /** @return whether results are cached for the key, without changing the eviction order. */
+    bool contains(const Key & key) const;
+    /** Insert or replace results for the key and evict results exceeding the budget. */
+    void insert(const Key & key, SharedResults results);
+    void remove(const Key & key);
+    void clear();
+
+    /** Maximum number of cached results without memory usage, i.e., of mapped result files */
+    static const size_t maxMappedEntries = 64;
+
+private:
+    struct Entry
+    {
+        Key key;
+        SharedResults results;
+        size_t bytes;
+    };
+    using EntryList = std::list<Entry>;
+
+    void evict();
+    /** @return the entry following the erased one */
+    EntryList::iterator erase(EntryList::iterator entry);
+
+private:
+    mutable std::mutex m_mutex;
+    size_t m_memoryBudget;
+    size_t m_memoryUsage;
+    size_t m_numMappedEntries;
+    /** Most recently used entries first */
+    EntryList m_entries;
+    std::unordered_map<Key, EntryList::iterator, KeyHash> m_index;
+};
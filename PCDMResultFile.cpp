@@ -0,0 +1,725 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "PCDMResultFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <new>
+
+#include <QByteArray>
+#include <QDebug>
+#include <QFile>
+#include <QSaveFile>
+
+#include "pCDM_thread_pool.h"
+
+
+using pCDM::t_FP;
+
+
+namespace
+{
+
+/** Written as stored in memory, to detect files written with a different byte order */
+const std::uint32_t byteOrderMark = 0x01020304u;
+
+struct Header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrderMark;
+    std::uint32_t valueSize;
+    std::uint32_t layout;
+    std::uint32_t numComponents;
+    /** PCDMResultFile::Codec of the payload */
+    std::uint32_t codec;
+    std::uint64_t numPoints;
+    std::uint64_t parametersHash;
+    /** Checksum of the payload following the header */
+    std::uint64_t dataChecksum;
+    /** Checksum of all preceding header fields */
+    std::uint64_t headerChecksum;
+};
+
+static_assert(sizeof(Header) <= PCDMResultFile::headerSize, "Result file header too large");
+static_assert(PCDMResultFile::headerSize % sizeof(t_FP) == 0, "Components must be aligned");
+
+/** Precedes the chunk table of compressed payloads */
+struct ChunkedPayloadHeader
+{
+    std::uint64_t chunkSize;
+    /** Quantization step of quantized chunks */
+    double quantizationStep;
+};
+
+/** First byte of each compressed chunk */
+enum ChunkEncoding : char
+{
+    shuffledValues = 0,
+    quantizedResiduals = 1
+};
+
+const std::uint64_t fnvOffsetBasis = 14695981039346656037ull;
+const std::uint64_t fnvPrime = 1099511628211ull;
+
+/** FNV-1a over bytes, continuing from hash */
+std::uint64_t fnv1a(const void * data, const size_t numBytes, std::uint64_t hash = fnvOffsetBasis)
+{
+    const auto bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < numBytes; ++i)
+    {
+        hash = (hash ^ bytes[i]) * fnvPrime;
+    }
+    return hash;
+}
+
+/**
+ * FNV-1a variant over 64 bit words, which is fast enough for large payloads. Remaining bytes are
+ * hashed bytewise. Payloads hashed in several calls must be split at multiples of 8 bytes.
+ */
+std::uint64_t checksum(const void * data, const size_t numBytes, std::uint64_t hash)
+{
+    const auto bytes = static_cast<const unsigned char *>(data);
+    const auto numWords = numBytes / sizeof(std::uint64_t);
+    for (size_t i = 0; i < numWords; ++i)
+    {
+        std::uint64_t word;
+        std::memcpy(&word, bytes + i * sizeof(word), sizeof(word));
+        hash = (hash ^ word) * fnvPrime;
+    }
+    const auto wordBytes = numWords * sizeof(std::uint64_t);
+    return fnv1a(bytes + wordBytes, numBytes - wordBytes, hash);
+}
+
+/**
+ * checksum() in blocks of chunkSize values, polling isCancelled in between.
+ * @return false if cancelled
+ */
+bool checksumBlocks(const void * data, const size_t numBytes, std::uint64_t & hash,
+    const std::function<bool()> & isCancelled)
+{
+    const auto blockBytes = PCDMResultFile::chunkSize * sizeof(t_FP);
+    const auto bytes = static_cast<const char *>(data);
+    for (size_t offset = 0; offset < numBytes; offset += blockBytes)
+    {
+        if (isCancelled && isCancelled())
+        {
+            return false;
+        }
+        hash = checksum(bytes + offset, std::min(blockBytes, numBytes - offset), hash);
+    }
+    return true;
+}
+
+void hashValue(std::uint64_t & hash, const t_FP value)
+{
+    // -0 and 0 compare equal and need the same hash.
+    const auto normalized = value == 0 ? t_FP(0) : value;
+    hash = fnv1a(&normalized, sizeof(normalized), hash);
+}
+
+template<size_t N>
+void hashValues(std::uint64_t & hash, const std::array<t_FP, N> & values)
+{
+    for (const auto value : values)
+    {
+        hashValue(hash, value);
+    }
+}
+
+std::uint64_t headerChecksum(const Header & header)
+{
+    return fnv1a(&header, offsetof(Header, headerChecksum));
+}
+
+/** Group byte b of all words at shuffled[b * numWords] */
+void shuffle(const std::vector<std::uint64_t> & words, std::vector<unsigned char> & shuffled)
+{
+    const auto numWords = words.size();
+    const auto bytes = reinterpret_cast<const unsigned char *>(words.data());
+    shuffled.resize(numWords * sizeof(std::uint64_t));
+    for (size_t b = 0; b < sizeof(std::uint64_t); ++b)
+    {
+        for (size_t i = 0; i < numWords; ++i)
+        {
+            shuffled[b * numWords + i] = bytes[i * sizeof(std::uint64_t) + b];
+        }
+    }
+}
+
+void unshuffle(const unsigned char * shuffled, std::vector<std::uint64_t> & words)
+{
+    const auto numWords = words.size();
+    const auto bytes = reinterpret_cast<unsigned char *>(words.data());
+    for (size_t b = 0; b < sizeof(std::uint64_t); ++b)
+    {
+        for (size_t i = 0; i < numWords; ++i)
+        {
+            bytes[i * sizeof(std::uint64_t) + b] = shuffled[b * numWords + i];
+        }
+    }
+}
+
+/** Map signed residuals to unsigned words with small magnitudes first */
+std::uint64_t zigzag(const std::int64_t value)
+{
+    return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+std::int64_t unzigzag(const std::uint64_t word)
+{
+    return static_cast<std::int64_t>((word >> 1) ^ (~(word & 1u) + 1u));
+}
+
+/** Linear prediction of the next quantized value from the two previous ones */
+std::int64_t predict(const size_t i, const std::int64_t previous, const std::int64_t beforePrevious)
+{
+    return i == 0 ? 0 : (i == 1 ? previous : 2 * previous - beforePrevious);
+}
+
+/**
+ * Quantize values and compute the residuals to their prediction.
+ * @return false if a value is not finite or exceeds the exactly representable range.
+ */
+bool quantize(const t_FP * values, const t_FP step, std::vector<std::uint64_t> & residuals)
+{
+    const t_FP maxQuantized = 4503599627370496.0;  // 2^52
+    std::int64_t previous = 0;
+    std::int64_t beforePrevious = 0;
+    for (size_t i = 0; i < residuals.size(); ++i)
+    {
+        const auto scaled = values[i] / step;
+        if (!(std::abs(scaled) < maxQuantized))
+        {
+            return false;
+        }
+        const auto quantized = static_cast<std::int64_t>(std::llround(scaled));
+        residuals[i] = zigzag(quantized - predict(i, previous, beforePrevious));
+        beforePrevious = previous;
+        previous = quantized;
+    }
+    return true;
+}
+
+void dequantize(const std::vector<std::uint64_t> & residuals, const t_FP step, t_FP * values)
+{
+    std::int64_t previous = 0;
+    std::int64_t beforePrevious = 0;
+    for (size_t i = 0; i < residuals.size(); ++i)
+    {
+        const auto quantized = predict(i, previous, beforePrevious) + unzigzag(residuals[i]);
+        values[i] = static_cast<t_FP>(quantized) * step;
+        beforePrevious = previous;
+        previous = quantized;
+    }
+}
+
+/** @param quantizationStep 0 to store values lossless */
+QByteArray encodeChunk(const t_FP * values, const size_t numValues, const t_FP quantizationStep)
+{
+    static_assert(sizeof(t_FP) == sizeof(std::uint64_t), "Chunk encoding requires 64 bit values");
+
+    std::vector<std::uint64_t> words(numValues);
+    auto encoding = ChunkEncoding::shuffledValues;
+    if (quantizationStep > 0 && quantize(values, quantizationStep, words))
+    {
+        encoding = ChunkEncoding::quantizedResiduals;
+    }
+    else
+    {
+        std::memcpy(words.data(), values, numValues * sizeof(t_FP));
+    }
+
+    std::vector<unsigned char> shuffled;
+    shuffle(words, shuffled);
+
+    QByteArray chunk(1, encoding);
+    chunk.append(qCompress(shuffled.data(), static_cast<int>(shuffled.size())));
+    return chunk;
+}
+
+bool decodeChunk(const unsigned char * chunk, const size_t numBytes, const t_FP quantizationStep,
+    const size_t numValues, t_FP * values)
+{
+    if (numBytes < 1)
+    {
+        return false;
+    }
+    const auto encoding = static_cast<char>(chunk[0]);
+    if (encoding != ChunkEncoding::shuffledValues && encoding != ChunkEncoding::quantizedResiduals)
+    {
+        return false;
+    }
+
+    const auto shuffled = qUncompress(chunk + 1, static_cast<int>(numBytes - 1));
+    if (static_cast<size_t>(shuffled.size()) != numValues * sizeof(t_FP))
+    {
+        return false;
+    }
+
+    std::vector<std::uint64_t> words(numValues);
+    unshuffle(reinterpret_cast<const unsigned char *>(shuffled.constData()), words);
+
+    if (encoding == ChunkEncoding::quantizedResiduals)
+    {
+        dequantize(words, quantizationStep, values);
+    }
+    else
+    {
+        std::memcpy(values, words.data(), numValues * sizeof(t_FP));
+    }
+    return true;
+}
+
+/**
+ * Map the file, if its header matches the expected parameters hash, number of points and
+ * components.
+ * @return the mapping including the header, released with the last reference. nullptr if the
+ *  file does not match.
+ */
+std::shared_ptr<const uchar> mapFile(const QString & fileName, const std::uint64_t parametersHash,
+    const size_t numPoints, const size_t numComponents, Header & header, size_t & fileSize)
+{
+    auto file = std::make_shared<QFile>(fileName);
+    if (!file->open(QIODevice::ReadOnly))
+    {
+        return{};
+    }
+
+    if (file->read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header)
+        || std::memcmp(header.magic, PCDMResultFile::magic, sizeof(PCDMResultFile::magic)) != 0
+        || header.headerChecksum != headerChecksum(header))
+    {
+        qWarning() << "Not a valid result file:" << fileName;
+        return{};
+    }
+    if (header.version != PCDMResultFile::version
+        || header.byteOrderMark != byteOrderMark
+        || header.valueSize != sizeof(t_FP)
+        || header.layout != static_cast<std::uint32_t>(PCDMResultFile::Layout::componentMajor)
+        || header.codec > static_cast<std::uint32_t>(PCDMResultFile::Codec::quantizedDeflate))
+    {
+        qWarning() << "Unsupported result file version or format:" << fileName;
+        return{};
+    }
+    if (header.numComponents != numComponents
+        || header.numPoints != numPoints
+        || header.parametersHash != parametersHash)
+    {
+        // Stale results, e.g., of previous parameters or coordinates
+        return{};
+    }
+
+    fileSize = static_cast<size_t>(file->size());
+    const auto isCompressed =
+        header.codec != static_cast<std::uint32_t>(PCDMResultFile::Codec::none);
+    const auto expectedSize = PCDMResultFile::headerSize + numComponents * numPoints * sizeof(t_FP);
+    if (isCompressed ? fileSize < PCDMResultFile::headerSize + sizeof(ChunkedPayloadHeader)
+        : fileSize != expectedSize)
+    {
+        qWarning() << "Result file size does not match its header:" << fileName;
+        return{};
+    }
+
+    const auto data = file->map(0, static_cast<qint64>(fileSize));
+    if (!data)
+    {
+        qWarning() << "Cannot map result file:" << fileName;
+        return{};
+    }
+    file->close();  // The mapping remains valid.
+
+    return std::shared_ptr<const uchar>(data, [file] (const uchar * mapped)
+    {
+        file->unmap(const_cast<uchar *>(mapped));
+    });
+}
+
+}
+
+
+const char PCDMResultFile::magic[8] = { 'P', 'C', 'D', 'M', 'R', 'S', 'L', 'T' };
+const std::uint32_t PCDMResultFile::version;
+const size_t PCDMResultFile::headerSize;
+const size_t PCDMResultFile::chunkSize;
+
+std::uint64_t PCDMResultFile::parametersHash(const pCDM::PointCDMParameters & parameters)
+{
+    auto hash = fnvOffsetBasis;
+    hashValues(hash, parameters.horizontalCoord);
+    hashValue(hash, parameters.depth);
+    hashValues(hash, parameters.omega);
+    hashValues(hash, parameters.dv);
+    return hash;
+}
+
+std::uint64_t PCDMResultFile::parametersHash(const pCDM::PointCDMParameters & parameters,
+    const t_FP nu)
+{
+    auto hash = parametersHash(parameters);
+    hashValue(hash, nu);
+    return hash;
+}
+
+template<size_t N>
+bool PCDMResultFile::write(const QString & fileName, const std::uint64_t parametersHash,
+    const std::array<std::vector<t_FP>, N> & components, const Compression & compression,
+    const size_t numThreads, const std::function<bool()> & isCancelled)
+{
+    const auto numPoints = components[0].size();
+    std::array<const t_FP *, N> componentPointers;
+    for (size_t c = 0; c < N; ++c)
+    {
+        if (components[c].size() != numPoints)
+        {
+            qWarning() << "Result components must have same size";
+            return false;
+        }
+        componentPointers[c] = components[c].data();
+    }
+
+    return write(fileName, parametersHash, componentPointers, numPoints, compression, numThreads,
+        isCancelled);
+}
+
+template<size_t N>
+bool PCDMResultFile::write(const QString & fileName, const std::uint64_t parametersHash,
+    const std::array<const t_FP *, N> & components, const size_t numPoints,
+    const Compression & compression, const size_t numThreads,
+    const std::function<bool()> & isCancelled)
+{
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.byteOrderMark = byteOrderMark;
+    header.valueSize = sizeof(t_FP);
+    header.layout = static_cast<std::uint32_t>(Layout::componentMajor);
+    header.numComponents = static_cast<std::uint32_t>(N);
+    header.codec = static_cast<std::uint32_t>(compression.codec);
+    header.numPoints = numPoints;
+    header.parametersHash = parametersHash;
+    header.dataChecksum = fnvOffsetBasis;
+
+    // Checksums and file contents are processed in blocks of chunkSize values, checking for
+    // cancellation in between.
+    const auto blockBytes = chunkSize * sizeof(t_FP);
+    const auto cancelled = [&isCancelled] () { return isCancelled && isCancelled(); };
+
+    // Compressed payloads are assembled in memory: the chunk table, followed by the chunks.
+    std::vector<char> payload;
+    if (compression.codec == Codec::none)
+    {
+        for (const auto component : components)
+        {
+            if (!checksumBlocks(component, numPoints * sizeof(t_FP), header.dataChecksum,
+                isCancelled))
+            {
+                return false;
+            }
+        }
+    }
+    else
+    {
+        ChunkedPayloadHeader payloadHeader;
+        payloadHeader.chunkSize = chunkSize;
+        payloadHeader.quantizationStep = compression.codec == Codec::quantizedDeflate
+            ? 2 * std::max(compression.maxError, t_FP(0))
+            : 0;
+
+        const auto chunksPerComponent = (numPoints + chunkSize - 1) / chunkSize;
+        std::vector<QByteArray> chunks;
+        try
+        {
+            chunks.resize(N * chunksPerComponent);
+            std::atomic<bool> encodingCancelled{ false };
+            pCDM::ThreadPool::instance().parallelFor(chunks.size(), 1,
+                [&components, &chunks, &payloadHeader, chunksPerComponent, numPoints, &cancelled,
+                    &encodingCancelled]
+                (size_t begin, size_t end)
+            {
+                for (auto chunk = begin; chunk < end; ++chunk)
+                {
+                    if (encodingCancelled || cancelled())
+                    {
+                        encodingCancelled = true;
+                        return;
+                    }
+                    const auto first = (chunk % chunksPerComponent) * chunkSize;
+                    chunks[chunk] = encodeChunk(components[chunk / chunksPerComponent] + first,
+                        std::min(chunkSize, numPoints - first),
+                        static_cast<t_FP>(payloadHeader.quantizationStep));
+                }
+            }, numThreads);
+            if (encodingCancelled)
+            {
+                return false;
+            }
+
+            std::vector<std::uint64_t> chunkEnds(chunks.size());
+            std::uint64_t offset = 0;
+            for (size_t chunk = 0; chunk < chunks.size(); ++chunk)
+            {
+                offset += static_cast<std::uint64_t>(chunks[chunk].size());
+                chunkEnds[chunk] = offset;
+            }
+
+            payload.resize(sizeof(payloadHeader) + chunkEnds.size() * sizeof(std::uint64_t) + offset);
+            auto out = payload.data();
+            std::memcpy(out, &payloadHeader, sizeof(payloadHeader));
+            out += sizeof(payloadHeader);
+            std::memcpy(out, chunkEnds.data(), chunkEnds.size() * sizeof(std::uint64_t));
+            out += chunkEnds.size() * sizeof(std::uint64_t);
+            for (auto & chunk : chunks)
+            {
+                std::memcpy(out, chunk.constData(), static_cast<size_t>(chunk.size()));
+                out += chunk.size();
+                QByteArray().swap(chunk);
+            }
+        }
+        catch (const std::bad_alloc & /*ex*/)
+        {
+            qWarning() << "Not enough memory to compress results:" << fileName;
+            return false;
+        }
+
+        if (!checksumBlocks(payload.data(), payload.size(), header.dataChecksum, isCancelled))
+        {
+            return false;
+        }
+    }
+    header.headerChecksum = headerChecksum(header);
+
+    std::array<char, headerSize> headerBytes;
+    headerBytes.fill(0);
+    std::memcpy(headerBytes.data(), &header, sizeof(header));
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "Cannot open result file for writing:" << fileName;
+        return false;
+    }
+
+    // Returning without commit() discards the written data.
+    const auto writeBlocks = [&file, blockBytes, &cancelled] (const char * data, size_t numBytes)
+    {
+        for (size_t offset = 0; offset < numBytes; offset += blockBytes)
+        {
+            const auto bytes = static_cast<qint64>(std::min(blockBytes, numBytes - offset));
+            if (cancelled() || file.write(data + offset, bytes) != bytes)
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    bool success = file.write(headerBytes.data(), headerSize) == static_cast<qint64>(headerSize);
+    if (compression.codec == Codec::none)
+    {
+        for (const auto component : components)
+        {
+            success = success && writeBlocks(reinterpret_cast<const char *>(component),
+                numPoints * sizeof(t_FP));
+        }
+    }
+    else
+    {
+        success = success && writeBlocks(payload.data(), payload.size());
+    }
+
+    return success && !cancelled() && file.commit();
+}
+
+template<size_t N>
+bool PCDMResultFile::map(const QString & fileName, const std::uint64_t parametersHash,
+    const size_t numPoints, std::array<const t_FP *, N> & components,
+    std::shared_ptr<const void> & storage, const bool verifyChecksum)
+{
+    Header header;
+    size_t fileSize = 0;
+    auto mapping = mapFile(fileName, parametersHash, numPoints, N, header, fileSize);
+    if (!mapping || header.codec != static_cast<std::uint32_t>(Codec::none))
+    {
+        return false;
+    }
+
+    const auto values = reinterpret_cast<const t_FP *>(mapping.get() + headerSize);
+    if (verifyChecksum
+        && checksum(values, N * numPoints * sizeof(t_FP), fnvOffsetBasis) != header.dataChecksum)
+    {
+        qWarning() << "Result file checksum mismatch:" << fileName;
+        return false;
+    }
+
+    for (size_t c = 0; c < N; ++c)
+    {
+        components[c] = values + c * numPoints;
+    }
+    storage = std::move(mapping);
+
+    return true;
+}
+
+template<size_t N>
+bool PCDMResultFile::load(const QString & fileName, const std::uint64_t parametersHash,
+    const size_t numPoints, std::array<const t_FP *, N> & components,
+    std::shared_ptr<const void> & storage, size_t & memoryUsage, const size_t numThreads,
+    const std::function<bool()> & isCancelled)
+{
+    Header header;
+    size_t fileSize = 0;
+    auto mapping = mapFile(fileName, parametersHash, numPoints, N, header, fileSize);
+    if (!mapping)
+    {
+        return false;
+    }
+    if (header.codec == static_cast<std::uint32_t>(Codec::none))
+    {
+        const auto values = reinterpret_cast<const t_FP *>(mapping.get() + headerSize);
+        for (size_t c = 0; c < N; ++c)
+        {
+            components[c] = values + c * numPoints;
+        }
+        storage = std::move(mapping);
+        memoryUsage = 0;
+        return true;
+    }
+
+    const auto payload = mapping.get() + headerSize;
+    const auto payloadSize = fileSize - headerSize;
+    auto dataChecksum = fnvOffsetBasis;
+    if (!checksumBlocks(payload, payloadSize, dataChecksum, isCancelled))
+    {
+        return false;
+    }
+    if (dataChecksum != header.dataChecksum)
+    {
+        qWarning() << "Result file checksum mismatch:" << fileName;
+        return false;
+    }
+
+    ChunkedPayloadHeader payloadHeader;
+    std::memcpy(&payloadHeader, payload, sizeof(payloadHeader));
+    const auto chunkValues = static_cast<size_t>(payloadHeader.chunkSize);
+    const auto chunksPerComponent = chunkValues == 0 ? 0 : (numPoints + chunkValues - 1) / chunkValues;
+    const auto numChunks = N * chunksPerComponent;
+    const auto tableSize = numChunks * sizeof(std::uint64_t);
+    if ((chunkValues == 0 && numPoints != 0)
+        || payloadSize < sizeof(payloadHeader) + tableSize)
+    {
+        qWarning() << "Invalid chunk table in result file:" << fileName;
+        return false;
+    }
+    const auto chunksData = payload + sizeof(payloadHeader) + tableSize;
+    const auto chunksSize = payloadSize - sizeof(payloadHeader) - tableSize;
+
+    std::vector<std::uint64_t> chunkEnds(numChunks);
+    std::memcpy(chunkEnds.data(), payload + sizeof(payloadHeader), tableSize);
+    if (!std::is_sorted(chunkEnds.begin(), chunkEnds.end())
+        || (!chunkEnds.empty() && chunkEnds.back() != chunksSize))
+    {
+        qWarning() << "Invalid chunk table in result file:" << fileName;
+        return false;
+    }
+
+    auto values = std::make_shared<std::array<std::vector<t_FP>, N>>();
+    std::atomic<bool> valid{ true };
+    std::atomic<bool> cancelled{ false };
+    try
+    {
+        for (auto & component : *values)
+        {
+            component.resize(numPoints);
+        }
+
+        const auto quantizationStep = static_cast<t_FP>(payloadHeader.quantizationStep);
+        pCDM::ThreadPool::instance().parallelFor(numChunks, 1,
+            [&] (size_t begin, size_t end)
+        {
+            for (auto chunk = begin; chunk < end; ++chunk)
+            {
+                if (cancelled || (isCancelled && isCancelled()))
+                {
+                    cancelled = true;
+                    return;
+                }
+                const auto chunkBegin = chunk == 0 ? 0 : chunkEnds[chunk - 1];
+                const auto first = (chunk % chunksPerComponent) * chunkValues;
+                if (!decodeChunk(chunksData + chunkBegin,
+                    static_cast<size_t>(chunkEnds[chunk] - chunkBegin), quantizationStep,
+                    std::min(chunkValues, numPoints - first),
+                    (*values)[chunk / chunksPerComponent].data() + first))
+                {
+                    valid = false;
+                }
+            }
+        }, numThreads);
+    }
+    catch (const std::bad_alloc & /*ex*/)
+    {
+        qWarning() << "Not enough memory to decompress results:" << fileName;
+        return false;
+    }
+
+    if (cancelled)
+    {
+        return false;
+    }
+    if (!valid)
+    {
+        qWarning() << "Failed to decompress result file:" << fileName;
+        return false;
+    }
+
+    for (size_t c = 0; c < N; ++c)
+    {
+        components[c] = (*values)[c].data();
+    }
+    memoryUsage = N * numPoints * sizeof(t_FP);
+    storage = std::move(values);
+
+    return true;
+}
+
+
+template bool PCDMResultFile::write<3>(const QString &, std::uint64_t,
+    const std::array<std::vector<t_FP>, 3> &, const Compression &, size_t,
+    const std::function<bool()> &);
+template bool PCDMResultFile::write<6>(const QString &, std::uint64_t,
+    const std::array<std::vector<t_FP>, 6> &, const Compression &, size_t,
+    const std::function<bool()> &);
+template bool PCDMResultFile::write<3>(const QString &, std::uint64_t,
+    const std::array<const t_FP *, 3> &, size_t, const Compression &, size_t,
+    const std::function<bool()> &);
+template bool PCDMResultFile::map<3>(const QString &, std::uint64_t, size_t,
+    std::array<const t_FP *, 3> &, std::shared_ptr<const void> &, bool);
+template bool PCDMResultFile::map<6>(const QString &, std::uint64_t, size_t,
+    std::array<const t_FP *, 6> &, std::shared_ptr<const void> &, bool);
+template bool PCDMResultFile::load<3>(const QString &, std::uint64_t, size_t,
+    std::array<const t_FP *, 3> &, std::shared_ptr<const void> &, size_t &, size_t,
+    const std::function<bool()> &);
+template bool PCDMResultFile::load<6>(const QString &, std::uint64_t, size_t,
+    std::array<const t_FP *, 6> &, std::shared_ptr<const void> &, size_t &, size_t,
+    const std::function<bool()> &);
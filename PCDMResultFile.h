@@ -0,0 +1,143 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "pCDM_types.h"
+
+
+class QString;
+
+
+/**
+ * Self-describing binary storage of modeling results, such as the displacements of a model or its
+ * Poisson's ratio independent displacement parts.
+ *
+ * Files consist of a header of headerSize bytes, followed by the payload. The header records the
+ * number of points, the scalar type, the component layout, the codec, a hash of the parameters the
+ * results are computed for, a checksum of the payload and a checksum of the header itself.
+ * Mismatching or stale files are rejected from the header only.
+ *
+ * Uncompressed payloads are the components one after another, stored as pCDM::t_FP in native byte
+ * order. They are mapped read-only, so that components are loaded by page faults on first access
+ * instead of being read and copied.
+ * Compressed payloads split each component into chunks of chunkSize values, which are encoded and
+ * decoded independently and in parallel. A table of the chunks' end offsets precedes the chunks.
+ */
+class PCDMResultFile
+{
+public:
+    enum class Codec : std::uint32_t
+    {
+        /** Values as computed, mapped when loaded */
+        none = 0,
+        /**
+         * Lossless: the bytes of the values are grouped by significance (byte shuffle), which
+         * makes the similar sign, exponent and high mantissa bytes compress well with deflate.
+         */
+        shuffleDeflate = 1,
+        /**
+         * Lossy: values are quantized to multiples of 2 * maxError, and the differences of the
+         * quantized values to a linear prediction from the two previous values are stored
+         * shuffled and deflated. Smooth displacement fields yield small differences that mostly
+         * consist of zero bytes. Chunks that cannot be quantized, e.g., because of non-finite
+         * values, are stored lossless.
+         */
+        quantizedDeflate = 2
+    };
+
+    struct Compression
+    {
+        Codec codec;
+        /** Maximum absolute error of each value, for Codec::quantizedDeflate */
+        pCDM::t_FP maxError;
+    };
+
+
+    /**
+     * Stable hash of source parameters (and the Poisson's ratio) identifying results in files.
+     * Unlike std::hash, the hash does not depend on the platform or build.
+     */
+    static std::uint64_t parametersHash(const pCDM::PointCDMParameters & parameters);
+    static std::uint64_t parametersHash(const pCDM::PointCDMParameters & parameters, pCDM::t_FP nu);
+
+    /**
+     * Write all components to fileName. Components must have the same size.
+     * @param numThreads Maximum number of threads encoding chunks, 0 for all threads.
+     * @param isCancelled Polled between chunks. Returning true stops writing, leaving an existing
+     *  file unchanged.
+     * @return false if writing fails or was cancelled.
+     */
+    template<size_t N>
+    static bool write(const QString & fileName, std::uint64_t parametersHash,
+        const std::array<std::vector<pCDM::t_FP>, N> & components,
+        const Compression & compression = { Codec::none, 0 }, size_t numThreads = 0,
+        const std::function<bool()> & isCancelled = {});
+    /** Write numPoints values of each component, e.g., of cached results. */
+    template<size_t N>
+    static bool write(const QString & fileName, std::uint64_t parametersHash,
+        const std::array<const pCDM::t_FP *, N> & components, size_t numPoints,
+        const Compression & compression = { Codec::none, 0 }, size_t numThreads = 0,
+        const std::function<bool()> & isCancelled = {});
+
+    /**
+     * Map the components of an uncompressed file, if its header matches the expected parameters
+     * hash, number of points and components. The mapping is released with the last copy of
+     * storage.
+     * @param verifyChecksum Also compare the checksum of the components. This reads the whole file.
+     * @return false if the file cannot be mapped, if it is compressed, or if it does not match.
+     */
+    template<size_t N>
+    static bool map(const QString & fileName, std::uint64_t parametersHash, size_t numPoints,
+        std::array<const pCDM::t_FP *, N> & components, std::shared_ptr<const void> & storage,
+        bool verifyChecksum = false);
+
+    /**
+     * Same as map() for uncompressed files. Compressed files are decompressed in parallel into
+     * memory held by storage, after verifying their checksum.
+     * @param memoryUsage Set to the bytes allocated for decompressed components, 0 for mappings.
+     * @param isCancelled Polled between chunks while verifying and decompressing. Returning true
+     *  stops loading.
+     * @return false if loading fails or was cancelled.
+     */
+    template<size_t N>
+    static bool load(const QString & fileName, std::uint64_t parametersHash, size_t numPoints,
+        std::array<const pCDM::t_FP *, N> & components, std::shared_ptr<const void> & storage,
+        size_t & memoryUsage, size_t numThreads = 0,
+        const std::function<bool()> & isCancelled = {});
+
+    /** Order of the values in the file */
+    enum class Layout : std::uint32_t
+    {
+        /** All values of the first component, followed by the values of the next component etc. */
+        componentMajor = 0
+    };
+
+    static const char magic[8];
+    static const std::uint32_t version = 1;
+    static const size_t headerSize = 64;
+    /** Number of values per compressed chunk */
+    static const size_t chunkSize = 65536;
+};
@@ -0,0 +1,222 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PCDMResultPrefetcher.h"
+
+#include <algorithm>
+#include <cassert>
+#include <exception>
+
+#include <QDebug>
+
+
+const size_t PCDMResultPrefetcher::defaultDepth;
+
+PCDMResultPrefetcher::PCDMResultPrefetcher(const size_t depth)
+    : m_depth{ std::max(size_t(1), depth) }
+    , m_position{ 0 }
+    , m_generation{ 0 }
+    , m_stop{ false }
+{
+    m_worker = std::thread([this] () { workerLoop(); });
+}
+
+PCDMResultPrefetcher::~PCDMResultPrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_workAvailable.notify_all();
+    m_frameLoaded.notify_all();
+    m_worker.join();
+}
+
+void PCDMResultPrefetcher::setFrames(std::vector<Loader> loaders)
+{
+    std::vector<Loader> previousLoaders;
+    std::vector<PCDMResultCache::SharedResults> previousResults;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_generation;
+        previousLoaders.swap(m_loaders);
+        previousResults.swap(m_results);
+        m_loaders = std::move(loaders);
+        m_results.assign(m_loaders.size(), nullptr);
+        m_loaded.assign(m_loaders.size(), false);
+        m_position = 0;
+    }
+    // Previous results are released outside of the lock, which may unmap files.
+    m_workAvailable.notify_all();
+    m_frameLoaded.notify_all();
+}
+
+size_t PCDMResultPrefetcher::numFrames() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_loaders.size();
+}
+
+size_t PCDMResultPrefetcher::depth() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_depth;
+}
+
+void PCDMResultPrefetcher::setDepth(const size_t depth)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_depth = std::max(size_t(1), depth);
+    }
+    setPosition(position());
+}
+
+void PCDMResultPrefetcher::setPosition(const size_t frame)
+{
+    std::vector<PCDMResultCache::SharedResults> released;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_loaders.empty())
+        {
+            return;
+        }
+        m_position = frame % m_loaders.size();
+        for (size_t f = 0; f < m_loaders.size(); ++f)
+        {
+            if (!isInWindow(f) && m_loaded[f])
+            {
+                released.push_back(std::move(m_results[f]));
+                m_results[f] = nullptr;
+                m_loaded[f] = false;
+            }
+        }
+    }
+    m_workAvailable.notify_all();
+    m_frameLoaded.notify_all();
+}
+
+size_t PCDMResultPrefetcher::position() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_position;
+}
+
+bool PCDMResultPrefetcher::isLoaded(const size_t frame) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return frame < m_loaded.size() && m_loaded[frame];
+}
+
+PCDMResultCache::SharedResults PCDMResultPrefetcher::results(const size_t frame) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return frame < m_results.size() ? m_results[frame] : nullptr;
+}
+
+PCDMResultCache::SharedResults PCDMResultPrefetcher::waitForResults(const size_t frame)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const auto generation = m_generation;
+    m_frameLoaded.wait(lock, [this, frame, generation] ()
+    {
+        return m_stop || generation != m_generation || !isInWindow(frame) || m_loaded[frame];
+    });
+
+    if (generation != m_generation || !isInWindow(frame))
+    {
+        return{};
+    }
+    return m_results[frame];
+}
+
+bool PCDMResultPrefetcher::isInWindow(const size_t frame) const
+{
+    const auto numFrames = m_loaders.size();
+    if (frame >= numFrames)
+    {
+        return false;
+    }
+    return (frame + numFrames - m_position) % numFrames < std::min(m_depth, numFrames);
+}
+
+size_t PCDMResultPrefetcher::nextFrameToLoad() const
+{
+    const auto numFrames = m_loaders.size();
+    const auto windowSize = std::min(m_depth, numFrames);
+    for (size_t i = 0; i < windowSize; ++i)
+    {
+        const auto frame = (m_position + i) % numFrames;
+        if (!m_loaded[frame])
+        {
+            return frame;
+        }
+    }
+    return numFrames;
+}
+
+void PCDMResultPrefetcher::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        size_t frame = 0;
+        m_workAvailable.wait(lock, [this, &frame] ()
+        {
+            frame = nextFrameToLoad();
+            return m_stop || frame < m_loaders.size();
+        });
+        if (m_stop)
+        {
+            return;
+        }
+
+        const auto generation = m_generation;
+        const auto loader = m_loaders[frame];
+
+        lock.unlock();
+
+        PCDMResultCache::SharedResults results;
+        if (loader)
+        {
+            try
+            {
+                results = loader();
+            }
+            catch (const std::exception & ex)
+            {
+                qWarning() << "Prefetching results failed:" << ex.what();
+            }
+        }
+
+        lock.lock();
+
+        // Drop results of replaced frames or frames the window moved past meanwhile.
+        if (generation != m_generation || !isInWindow(frame))
+        {
+            lock.unlock();
+            results = {};
+            lock.lock();
+            continue;
+        }
+
+        m_results[frame] = std::move(results);
+        m_loaded[frame] = true;
+        m_frameLoaded.notify_all();
+    }
+}
@@ -0,0 +1,103 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "PCDMResultCache.h"
+
+
+/**
+ * Loads results of a sequence of frames ahead of playback, e.g., saved models of consecutive
+ * epochs.
+ *
+ * Frames are described by loaders (see PCDMModel::resultsLoader), which a worker thread calls for
+ * the frames of the prefetch window: the current position and the following depth - 1 frames,
+ * wrapping around at the end of the sequence. Loaded results are held until the position moves past
+ * them, so that playback can show them without reading or decoding on the calling thread.
+ * This class is thread-safe.
+ */
+class PCDMResultPrefetcher
+{
+public:
+    using Loader = std::function<PCDMResultCache::SharedResults()>;
+
+    explicit PCDMResultPrefetcher(size_t depth = defaultDepth);
+    /** Stops the worker after the frame it is currently loading. */
+    ~PCDMResultPrefetcher();
+
+    /**
+     * Replace the sequence of frames and move to its first frame. Results of previous frames are
+     * released. Frames with empty loaders have no results.
+     */
+    void setFrames(std::vector<Loader> loaders);
+    size_t numFrames() const;
+
+    /** Number of frames loaded ahead, including the current position. At least 1. */
+    size_t depth() const;
+    void setDepth(size_t depth);
+
+    /**
+     * Move the prefetch window to frame. Results of frames outside of the window are released, the
+     * worker continues with the first frame of the window that is not loaded yet.
+     */
+    void setPosition(size_t frame);
+    size_t position() const;
+
+    /** @return whether loading of frame is done, regardless of whether it succeeded. */
+    bool isLoaded(size_t frame) const;
+    /** @return results of frame, if loaded and inside of the window, nullptr otherwise. Does not block. */
+    PCDMResultCache::SharedResults results(size_t frame) const;
+    /**
+     * Block until frame is loaded. frame must be inside of the window.
+     * @return results of frame, or nullptr if loading failed or the window moved.
+     */
+    PCDMResultCache::SharedResults waitForResults(size_t frame);
+
+    static const size_t defaultDepth = 4;
+
+private:
+    bool isInWindow(size_t frame) const;
+    /** @return the first frame of the window that is not loaded, numFrames() if there is none. */
+    size_t nextFrameToLoad() const;
+    void workerLoop();
+
+private:
+    mutable std::mutex m_mutex;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_frameLoaded;
+    std::vector<Loader> m_loaders;
+    std::vector<PCDMResultCache::SharedResults> m_results;
+    std::vector<char> m_loaded;
+    size_t m_depth;
+    size_t m_position;
+    /** Incremented when frames are replaced. Results loaded for older generations are dropped. */
+    uint64_t m_generation;
+    bool m_stop;
+    std::thread m_worker;
+
+    PCDMResultPrefetcher(const PCDMResultPrefetcher &) = delete;
+    void operator=(const PCDMResultPrefetcher &) = delete;
+};
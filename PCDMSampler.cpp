@@ -0,0 +1,621 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PCDMSampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <new>
+#include <random>
+
+#include <QFile>
+#include <QSaveFile>
+
+#include "PCDMBatchBackend.h"
+
+
+using pCDM::t_FP;
+
+
+namespace
+{
+
+const size_t numParameters = pCDM::numJacobianParameters;
+/** Attempts to draw initial walker positions with finite posterior probability */
+const size_t maxInitializationAttempts = 100;
+
+/** Header fields preceding the accepted counts: magic, six counts, nu, fixed mask, 9 values */
+const size_t headerSize = 8 + 6 * 8 + 8 + 8 + numParameters * 8;
+
+bool writeBytes(QIODevice & device, const void * data, const size_t size)
+{
+    return device.write(reinterpret_cast<const char *>(data), static_cast<qint64>(size))
+        == static_cast<qint64>(size);
+}
+
+bool readBytes(QIODevice & device, void * data, const size_t size)
+{
+    return device.read(reinterpret_cast<char *>(data), static_cast<qint64>(size))
+        == static_cast<qint64>(size);
+}
+
+template<typename T>
+bool writeValue(QIODevice & device, const T & value)
+{
+    return writeBytes(device, &value, sizeof(T));
+}
+
+template<typename T>
+bool readValue(QIODevice & device, T & value)
+{
+    return readBytes(device, &value, sizeof(T));
+}
+
+bool writeHeader(QIODevice & device, const PCDMSampleFile::Header & header)
+{
+    std::uint64_t fixedMask = 0;
+    for (size_t i = 0; i < numParameters; ++i)
+    {
+        fixedMask |= std::uint64_t(header.fixed[i]) << i;
+    }
+
+    bool success = writeBytes(device, PCDMSampleFile::magic, sizeof(PCDMSampleFile::magic))
+        && writeValue(device, PCDMSampleFile::version)
+        && writeValue(device, std::uint64_t(numParameters))
+        && writeValue(device, std::uint64_t(header.numWalkers))
+        && writeValue(device, std::uint64_t(header.thinning))
+        && writeValue(device, std::uint64_t(header.numSteps))
+        && writeValue(device, std::uint64_t(header.numStoredSteps))
+        && writeValue(device, header.nu)
+        && writeValue(device, fixedMask);
+    for (const auto value : header.fixedValues)
+    {
+        success = success && writeValue(device, value);
+    }
+    return success && writeBytes(device, header.acceptedCounts.data(),
+        header.acceptedCounts.size() * sizeof(std::uint64_t));
+}
+
+/**
+ * Streams the samples of a run to a PCDMSampleFile. The file is only replaced when the run is
+ * finished, incomplete files are discarded.
+ */
+class SampleWriter
+{
+public:
+    SampleWriter(const QString & fileName, PCDMSampleFile::Header header,
+        std::vector<size_t> sampledParameters)
+        : m_file{ fileName }
+        , m_good{ false }
+        , m_header{ std::move(header) }
+        , m_sampledParameters{ std::move(sampledParameters) }
+    {
+        m_header.acceptedCounts.assign(m_header.numWalkers, 0);
+        m_good = m_file.open(QIODevice::WriteOnly) && writeHeader(m_file, m_header);
+    }
+
+    bool good() const
+    {
+        return m_good;
+    }
+
+    void writeStep(const std::vector<PCDMSampleFile::ParameterVector> & positions,
+        const std::vector<t_FP> & logPosteriors)
+    {
+        m_buffer.clear();
+        for (size_t k = 0; k < positions.size(); ++k)
+        {
+            for (const auto p : m_sampledParameters)
+            {
+                m_buffer.push_back(positions[k][p]);
+            }
+            m_buffer.push_back(logPosteriors[k]);
+        }
+        m_good = m_good && writeBytes(m_file, m_buffer.data(), m_buffer.size() * sizeof(t_FP));
+        ++m_header.numStoredSteps;
+    }
+
+    /** Update the header with the final counts and replace the file. */
+    bool finish(size_t numSteps, const std::vector<std::uint64_t> & acceptedCounts)
+    {
+        m_header.numSteps = numSteps;
+        m_header.acceptedCounts = acceptedCounts;
+        m_good = m_good && m_file.seek(0) && writeHeader(m_file, m_header) && m_file.commit();
+        return m_good;
+    }
+
+private:
+    QSaveFile m_file;
+    bool m_good;
+    PCDMSampleFile::Header m_header;
+    const std::vector<size_t> m_sampledParameters;
+    std::vector<t_FP> m_buffer;
+};
+
+}
+
+
+PCDMSampler::Settings::Settings()
+    : nu{ 0.25 }
+    , noiseVariance{ 0 }
+    , numWalkers{ 64 }
+    , numSteps{ 1000 }
+    , thinning{ 10 }
+    , stretchScale{ 2 }
+    , seed{ 0 }
+    , numThreads{ 0 }
+{
+    initialSpread.fill(0);
+    lowerBounds.fill(-std::numeric_limits<t_FP>::infinity());
+    upperBounds.fill(std::numeric_limits<t_FP>::infinity());
+    fixed.fill(false);
+}
+
+PCDMSampler::PCDMSampler(PCDMObservations observations)
+    : m_observations{ std::move(observations) }
+{
+}
+
+const PCDMObservations & PCDMSampler::observations() const
+{
+    return m_observations;
+}
+
+auto PCDMSampler::run(const Settings & settings, const QString & samplesFileName) const -> Result
+{
+    Result result;
+    result.status = Status::invalidInput;
+    result.numSteps = 0;
+    result.acceptanceFraction = 0;
+    result.bestParameters = settings.initialParameters;
+    result.bestMisfit = std::numeric_limits<t_FP>::infinity();
+    result.mean.fill(0);
+    result.standardDeviation.fill(0);
+
+    auto lowerBounds = settings.lowerBounds;
+    const auto depthIndex = static_cast<size_t>(pCDM::JacobianParameter::depth);
+    lowerBounds[depthIndex] = std::max(t_FP(0), lowerBounds[depthIndex]);
+    const auto & upperBounds = settings.upperBounds;
+
+    std::vector<size_t> sampledParameters;
+    for (size_t i = 0; i < numParameters; ++i)
+    {
+        if (!settings.fixed[i] && lowerBounds[i] < upperBounds[i])
+        {
+            sampledParameters.push_back(i);
+        }
+    }
+
+    const auto numWalkers = settings.numWalkers;
+    if (!m_observations.isValid() || sampledParameters.empty()
+        || numWalkers % 2 != 0 || numWalkers <= sampledParameters.size()
+        || settings.thinning == 0 || !(settings.noiseVariance >= 0) || !(settings.stretchScale > 1))
+    {
+        return result;
+    }
+
+    auto center = PCDMInversion::toVector(settings.initialParameters);
+    for (size_t i = 0; i < numParameters; ++i)
+    {
+        center[i] = std::min(upperBounds[i], std::max(lowerBounds[i], center[i]));
+    }
+    if (!PCDMInversion::fromVector(center).isValid())
+    {
+        return result;
+    }
+
+    const auto inBounds = [&lowerBounds, &upperBounds] (const ParameterVector & values)
+    {
+        for (size_t i = 0; i < numParameters; ++i)
+        {
+            if (!(values[i] >= lowerBounds[i] && values[i] <= upperBounds[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    try
+    {
+        PCDMBatchBackend batch;
+        batch.setHorizontalCoords(m_observations.coords);
+        batch.setNumThreads(settings.numThreads);
+        batch.setPoissonsRatio(settings.nu);
+
+        PCDMBatchBackend::Observations observations;
+        observations.lineOfSight = m_observations.lineOfSight;
+        observations.pointLineOfSight = m_observations.pointLineOfSight;
+        observations.lineOfSightValues = m_observations.values;
+        observations.lineOfSightWeights = m_observations.weights;
+
+        const auto stateToStatus = [] (PCDMBatchBackend::State state)
+        {
+            return state == PCDMBatchBackend::State::errOutOfMemory
+                ? Status::errOutOfMemory
+                : Status::invalidInput;
+        };
+
+        auto noiseVariance = settings.noiseVariance;
+        if (noiseVariance == 0)
+        {
+            std::vector<t_FP> centerMisfit;
+            const auto state = batch.evaluateMisfits({ PCDMInversion::fromVector(center) },
+                observations, centerMisfit);
+            if (state != PCDMBatchBackend::State::resultsReady)
+            {
+                result.status = stateToStatus(state);
+                return result;
+            }
+            noiseVariance = centerMisfit[0] / static_cast<t_FP>(m_observations.values.size());
+            if (!(noiseVariance > 0) || !std::isfinite(noiseVariance))
+            {
+                return result;
+            }
+        }
+
+        // Misfits and log posterior probabilities of a batch of positions. Positions outside of the
+        // bounds are not evaluated.
+        std::vector<pCDM::PointCDMParameters> batchParameters;
+        std::vector<size_t> batchIndices;
+        std::vector<t_FP> batchMisfits;
+        const auto evaluate = [&] (const std::vector<ParameterVector> & positions,
+            std::vector<t_FP> & misfits, std::vector<t_FP> & logPosteriors)
+        {
+            misfits.assign(positions.size(), std::numeric_limits<t_FP>::infinity());
+            logPosteriors.assign(positions.size(), -std::numeric_limits<t_FP>::infinity());
+            batchParameters.clear();
+            batchIndices.clear();
+            for (size_t k = 0; k < positions.size(); ++k)
+            {
+                if (inBounds(positions[k]))
+                {
+                    batchParameters.push_back(PCDMInversion::fromVector(positions[k]));
+                    batchIndices.push_back(k);
+                }
+            }
+            if (batchParameters.empty())
+            {
+                return PCDMBatchBackend::State::resultsReady;
+            }
+
+            const auto state = batch.evaluateMisfits(batchParameters, observations, batchMisfits);
+            if (state != PCDMBatchBackend::State::resultsReady)
+            {
+                return state;
+            }
+            for (size_t b = 0; b < batchIndices.size(); ++b)
+            {
+                const auto k = batchIndices[b];
+                misfits[k] = batchMisfits[b];
+                // Invalid parameters have infinite misfits.
+                logPosteriors[k] = -batchMisfits[b] / (2 * noiseVariance);
+            }
+            return state;
+        };
+
+        std::mt19937_64 random{ settings.seed };
+        std::normal_distribution<t_FP> normal;
+        std::uniform_real_distribution<t_FP> uniform;
+
+        // Initial ensemble: redraw walkers with zero posterior probability.
+        std::vector<ParameterVector> positions(numWalkers, center);
+        std::vector<t_FP> misfits(numWalkers, std::numeric_limits<t_FP>::infinity());
+        std::vector<t_FP> logPosteriors(numWalkers, -std::numeric_limits<t_FP>::infinity());
+        {
+            std::vector<size_t> redraw(numWalkers);
+            for (size_t k = 0; k < numWalkers; ++k)
+            {
+                redraw[k] = k;
+            }
+            std::vector<ParameterVector> drawn;
+            std::vector<t_FP> drawnMisfits, drawnLogPosteriors;
+            for (size_t attempt = 0; !redraw.empty(); ++attempt)
+            {
+                if (attempt == maxInitializationAttempts)
+                {
+                    return result;
+                }
+                drawn.assign(redraw.size(), center);
+                for (auto & position : drawn)
+                {
+                    for (const auto p : sampledParameters)
+                    {
+                        const auto spread = settings.initialSpread[p] > 0
+                            ? settings.initialSpread[p]
+                            : 1e-3 * std::max(std::abs(center[p]), t_FP(1e-3));
+                        position[p] += spread * normal(random);
+                    }
+                }
+                const auto state = evaluate(drawn, drawnMisfits, drawnLogPosteriors);
+                if (state != PCDMBatchBackend::State::resultsReady)
+                {
+                    result.status = stateToStatus(state);
+                    return result;
+                }
+                std::vector<size_t> remaining;
+                for (size_t d = 0; d < drawn.size(); ++d)
+                {
+                    if (std::isfinite(drawnLogPosteriors[d]))
+                    {
+                        positions[redraw[d]] = drawn[d];
+                        misfits[redraw[d]] = drawnMisfits[d];
+                        logPosteriors[redraw[d]] = drawnLogPosteriors[d];
+                    }
+                    else
+                    {
+                        remaining.push_back(redraw[d]);
+                    }
+                }
+                redraw.swap(remaining);
+            }
+        }
+
+        std::unique_ptr<SampleWriter> writer;
+        if (!samplesFileName.isEmpty())
+        {
+            PCDMSampleFile::Header header;
+            header.numWalkers = numWalkers;
+            header.thinning = settings.thinning;
+            header.numSteps = 0;
+            header.numStoredSteps = 0;
+            header.nu = settings.nu;
+            header.fixed.fill(true);
+            for (const auto p : sampledParameters)
+            {
+                header.fixed[p] = false;
+            }
+            header.fixedValues = center;
+            writer = std::make_unique<SampleWriter>(samplesFileName, std::move(header), sampledParameters);
+            if (!writer->good())
+            {
+                result.status = Status::errWriteFailed;
+                return result;
+            }
+        }
+
+        const auto updateBest = [&result, &positions, &misfits] (size_t k)
+        {
+            if (misfits[k] < result.bestMisfit)
+            {
+                result.bestMisfit = misfits[k];
+                result.bestParameters = PCDMInversion::fromVector(positions[k]);
+            }
+        };
+        for (size_t k = 0; k < numWalkers; ++k)
+        {
+            updateBest(k);
+        }
+
+        // Running mean and sum of squared deviations of the stored samples (Welford's method)
+        ParameterVector mean, m2;
+        mean.fill(0);
+        m2.fill(0);
+        size_t numStoredSamples = 0;
+
+        const auto halfSize = numWalkers / 2;
+        const auto a = settings.stretchScale;
+        const auto numSampled = static_cast<t_FP>(sampledParameters.size());
+        std::vector<std::uint64_t> acceptedCounts(numWalkers, 0);
+        std::vector<ParameterVector> proposals(halfSize);
+        std::vector<t_FP> stretches(halfSize), proposalMisfits, proposalLogPosteriors;
+
+        for (size_t step = 0; step < settings.numSteps; ++step)
+        {
+            for (size_t half = 0; half < 2; ++half)
+            {
+                const auto begin = half * halfSize;
+                const auto otherBegin = (1 - half) * halfSize;
+                for (size_t i = 0; i < halfSize; ++i)
+                {
+                    // z is distributed as 1/sqrt(z) in [1/a, a].
+                    const auto u = uniform(random);
+                    const auto z = std::pow((a - 1) * u + 1, 2) / a;
+                    const auto other = otherBegin
+                        + std::min(halfSize - 1, static_cast<size_t>(uniform(random) * halfSize));
+                    stretches[i] = z;
+                    proposals[i] = positions[begin + i];
+                    for (const auto p : sampledParameters)
+                    {
+                        proposals[i][p] = positions[other][p]
+                            + z * (positions[begin + i][p] - positions[other][p]);
+                    }
+                }
+
+                const auto state = evaluate(proposals, proposalMisfits, proposalLogPosteriors);
+                if (state != PCDMBatchBackend::State::resultsReady)
+                {
+                    result.status = stateToStatus(state);
+                    return result;
+                }
+
+                for (size_t i = 0; i < halfSize; ++i)
+                {
+                    const auto k = begin + i;
+                    const auto logAcceptance = (numSampled - 1) * std::log(stretches[i])
+                        + proposalLogPosteriors[i] - logPosteriors[k];
+                    if (std::isfinite(proposalLogPosteriors[i])
+                        && std::log(uniform(random)) < logAcceptance)
+                    {
+                        positions[k] = proposals[i];
+                        misfits[k] = proposalMisfits[i];
+                        logPosteriors[k] = proposalLogPosteriors[i];
+                        ++acceptedCounts[k];
+                        updateBest(k);
+                    }
+                }
+            }
+
+            if ((step + 1) % settings.thinning != 0)
+            {
+                continue;
+            }
+
+            if (writer)
+            {
+                writer->writeStep(positions, logPosteriors);
+                if (!writer->good())
+                {
+                    result.status = Status::errWriteFailed;
+                    return result;
+                }
+            }
+            for (const auto & position : positions)
+            {
+                ++numStoredSamples;
+                for (size_t p = 0; p < numParameters; ++p)
+                {
+                    const auto delta = position[p] - mean[p];
+                    mean[p] += delta / static_cast<t_FP>(numStoredSamples);
+                    m2[p] += delta * (position[p] - mean[p]);
+                }
+            }
+        }
+
+        if (writer && !writer->finish(settings.numSteps, acceptedCounts))
+        {
+            result.status = Status::errWriteFailed;
+            return result;
+        }
+
+        std::uint64_t numAccepted = 0;
+        for (const auto count : acceptedCounts)
+        {
+            numAccepted += count;
+        }
+
+        result.status = Status::finished;
+        result.numSteps = settings.numSteps;
+        result.acceptanceFraction = settings.numSteps == 0 ? 0
+            : static_cast<t_FP>(numAccepted) / static_cast<t_FP>(settings.numSteps * numWalkers);
+        if (numStoredSamples > 0)
+        {
+            result.mean = mean;
+            for (size_t p = 0; p < numParameters; ++p)
+            {
+                result.standardDeviation[p] = std::sqrt(m2[p] / static_cast<t_FP>(numStoredSamples));
+            }
+        }
+    }
+    catch (const std::bad_alloc & /*ex*/)
+    {
+        result.status = Status::errOutOfMemory;
+    }
+
+    return result;
+}
+
+
+const char PCDMSampleFile::magic[8] = { 'P', 'C', 'D', 'M', 'S', 'M', 'P', 'L' };
+const std::uint64_t PCDMSampleFile::version;
+
+size_t PCDMSampleFile::Header::numSampledParameters() const
+{
+    return static_cast<size_t>(std::count(fixed.begin(), fixed.end(), false));
+}
+
+bool PCDMSampleFile::readHeader(const QString & fileName, Header & header)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    char fileMagic[sizeof(magic)];
+    std::uint64_t fileVersion, fileNumParameters, numWalkers, thinning, numSteps, numStoredSteps,
+        fixedMask;
+    if (!readBytes(file, fileMagic, sizeof(fileMagic))
+        || std::memcmp(fileMagic, magic, sizeof(magic)) != 0
+        || !readValue(file, fileVersion) || fileVersion != version
+        || !readValue(file, fileNumParameters) || fileNumParameters != numParameters
+        || !readValue(file, numWalkers) || !readValue(file, thinning)
+        || !readValue(file, numSteps) || !readValue(file, numStoredSteps)
+        || !readValue(file, header.nu) || !readValue(file, fixedMask))
+    {
+        return false;
+    }
+    for (auto & value : header.fixedValues)
+    {
+        if (!readValue(file, value))
+        {
+            return false;
+        }
+    }
+
+    header.numWalkers = static_cast<size_t>(numWalkers);
+    header.thinning = static_cast<size_t>(thinning);
+    header.numSteps = static_cast<size_t>(numSteps);
+    header.numStoredSteps = static_cast<size_t>(numStoredSteps);
+    for (size_t i = 0; i < numParameters; ++i)
+    {
+        header.fixed[i] = ((fixedMask >> i) & 1u) != 0;
+    }
+
+    header.acceptedCounts.resize(header.numWalkers);
+    return readBytes(file, header.acceptedCounts.data(), header.numWalkers * sizeof(std::uint64_t));
+}
+
+bool PCDMSampleFile::readSamples(const QString & fileName, const Header & header,
+    const size_t stepsBegin, const size_t stepsEnd,
+    std::vector<ParameterVector> & samples, std::vector<t_FP> & logPosteriors)
+{
+    if (stepsBegin > stepsEnd || stepsEnd > header.numStoredSteps)
+    {
+        return false;
+    }
+
+    std::vector<size_t> sampledParameters;
+    for (size_t i = 0; i < numParameters; ++i)
+    {
+        if (!header.fixed[i])
+        {
+            sampledParameters.push_back(i);
+        }
+    }
+    const auto valuesPerSample = sampledParameters.size() + 1;
+    const auto numSamples = (stepsEnd - stepsBegin) * header.numWalkers;
+
+    QFile file(fileName);
+    const auto offset = headerSize + header.numWalkers * sizeof(std::uint64_t)
+        + stepsBegin * header.numWalkers * valuesPerSample * sizeof(t_FP);
+    std::vector<t_FP> values(numSamples * valuesPerSample);
+    if (!file.open(QIODevice::ReadOnly)
+        || !file.seek(static_cast<qint64>(offset))
+        || !readBytes(file, values.data(), values.size() * sizeof(t_FP)))
+    {
+        return false;
+    }
+
+    samples.assign(numSamples, header.fixedValues);
+    logPosteriors.resize(numSamples);
+    for (size_t s = 0; s < numSamples; ++s)
+    {
+        const auto sample = values.data() + s * valuesPerSample;
+        for (size_t j = 0; j < sampledParameters.size(); ++j)
+        {
+            samples[s][sampledParameters[j]] = sample[j];
+        }
+        logPosteriors[s] = sample[sampledParameters.size()];
+    }
+
+    return true;
+}
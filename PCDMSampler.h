@@ -0,0 +1,164 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <QString>
+
+#include "PCDMInversion.h"
+
+
+/**
+ * Samples the posterior distribution of point CDM parameters given line of sight observations,
+ * using the affine-invariant ensemble sampler of Goodman & Weare (2010) with stretch moves.
+ *
+ * The ensemble consists of numWalkers chains. Each step updates the two halves of the ensemble in
+ * turn, proposing new positions for all walkers of a half at once. The proposals are evaluated as
+ * one batch (see PCDMBatchBackendT::evaluateMisfits), which distributes parameter sets and points
+ * to all threads and computes misfits without materializing displacement fields.
+ *
+ * The likelihood assumes Gaussian errors: log L = -misfit / (2 * noiseVariance), where the misfit
+ * is the weighted sum of squared residuals. The prior is uniform within the bounds and for valid
+ * parameters (see pCDM::PointCDMParameters::isValid).
+ * Random numbers are drawn on the calling thread from a seeded generator, so runs are
+ * reproducible and independent of the number of threads.
+ */
+class PCDMSampler
+{
+public:
+    using ParameterVector = PCDMInversion::ParameterVector;
+
+    struct Settings
+    {
+        Settings();
+
+        /** Center of the initial ensemble */
+        pCDM::PointCDMParameters initialParameters;
+        /**
+         * Standard deviations of the initial walker positions around initialParameters. Entries
+         * of 0 (default) use 1e-3 of the parameter's magnitude.
+         */
+        ParameterVector initialSpread;
+        pCDM::t_FP nu;
+        /** Bounds of the uniform prior, infinite by default. The depth is at least 0. */
+        ParameterVector lowerBounds;
+        ParameterVector upperBounds;
+        /** Fixed parameters are not sampled. */
+        std::array<bool, pCDM::numJacobianParameters> fixed;
+        /**
+         * Variance of the observation errors, in case the weights are not inverse variances.
+         * 0 (default) estimates it as the mean weighted squared residual of initialParameters,
+         * which should be a best fit in this case, e.g., the result of a PCDMInversion.
+         */
+        pCDM::t_FP noiseVariance;
+
+        /** Number of chains, an even number larger than the number of sampled parameters */
+        size_t numWalkers;
+        size_t numSteps;
+        /** Store the ensemble of every thinning-th step */
+        size_t thinning;
+        /** Scale parameter a of the stretch moves */
+        pCDM::t_FP stretchScale;
+        std::uint64_t seed;
+        /** Maximum number of threads, 0 for all threads of the pool */
+        size_t numThreads;
+    };
+
+    enum class Status
+    {
+        finished,
+        invalidInput,
+        errOutOfMemory,
+        errWriteFailed
+    };
+
+    struct Result
+    {
+        Status status;
+        size_t numSteps;
+        /** Fraction of accepted proposals of all walkers and steps */
+        pCDM::t_FP acceptanceFraction;
+        /** Sample with the highest posterior probability */
+        pCDM::PointCDMParameters bestParameters;
+        pCDM::t_FP bestMisfit;
+        /** Posterior mean and standard deviation, estimated from the stored samples */
+        ParameterVector mean;
+        ParameterVector standardDeviation;
+    };
+
+    explicit PCDMSampler(PCDMObservations observations);
+
+    const PCDMObservations & observations() const;
+
+    /**
+     * Run the sampler. This function is thread-safe.
+     * @param samplesFileName Stream the chains to this file (see PCDMSampleFile). Nothing is
+     *  stored if empty.
+     */
+    Result run(const Settings & settings, const QString & samplesFileName = {}) const;
+
+private:
+    PCDMObservations m_observations;
+};
+
+
+/**
+ * Compact binary storage of the thinned chains of a PCDMSampler run.
+ *
+ * Files consist of a header, the accepted proposal counts of all walkers and the samples, ordered
+ * by stored step, then by walker. Samples consist of the values of the sampled parameters and the
+ * log posterior probability, stored as pCDM::t_FP in native byte order. Values of fixed parameters
+ * are only stored once in the header.
+ */
+class PCDMSampleFile
+{
+public:
+    using ParameterVector = PCDMSampler::ParameterVector;
+
+    struct Header
+    {
+        size_t numWalkers;
+        size_t thinning;
+        /** Number of steps the sampler ran */
+        size_t numSteps;
+        size_t numStoredSteps;
+        pCDM::t_FP nu;
+        std::array<bool, pCDM::numJacobianParameters> fixed;
+        /** Values of the fixed parameters. Other values are undefined. */
+        ParameterVector fixedValues;
+        std::vector<std::uint64_t> acceptedCounts;
+
+        size_t numSampledParameters() const;
+    };
+
+    static bool readHeader(const QString & fileName, Header & header);
+    /**
+     * Read the samples of the stored steps [stepsBegin, stepsEnd). Values of fixed parameters are
+     * set from the header.
+     */
+    static bool readSamples(const QString & fileName, const Header & header,
+        size_t stepsBegin, size_t stepsEnd,
+        std::vector<ParameterVector> & samples, std::vector<pCDM::t_FP> & logPosteriors);
+
+    static const char magic[8];
+    static const std::uint64_t version = 1;
+};
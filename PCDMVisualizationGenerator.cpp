@@ -18,24 +18,33 @@
 
 #include "PCDMVisualizationGenerator.h"
 
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cmath>
 #include <type_traits>
 
 #include <QCoreApplication>
 #include <QDebug>
 
 #include <vtkAOSDataArrayTemplate.h>
+#include <vtkCellArray.h>
+#include <vtkDataArray.h>
+#include <vtkDataSet.h>
 #include <vtkImageData.h>
 #include <vtkPointData.h>
+#include <vtkPoints.h>
 #include <vtkPolyData.h>
 #include <vtkSmartPointer.h>
+#include <vtkSOADataArrayTemplate.h>
 
 #include <core/AbstractVisualizedData.h>
+#include <core/CoordinateSystems.h>
 #include <core/DataSetHandler.h>
 #include <core/color_mapping/ColorMapping.h>
 #include <core/color_mapping/ColorMappingData.h>
 #include <core/color_mapping/ColorBarRepresentation.h>
+#include <core/data_objects/CoordinateTransformableDataObject.h>
 #include <core/data_objects/ImageDataObject.h>
 #include <core/data_objects/PointCloudDataObject.h>
 #include <core/utility/qthelper.h>
@@ -43,6 +52,8 @@
 #include <gui/data_view/ResidualVerificationView.h>
 
 #include "pCDM_types.h"
+#include "PCDMExternalArray.h"
+#include "PCDMInversion.h"
 #include "PCDMModel.h"
 #include "PCDMProject.h"
 
@@ -56,6 +67,54 @@ namespace
 const char * const deformationArrayName = { "Modeled Deformation" };
 const char * const deformationComponentNames[3] = { "ue", "un", "uv" };
 
+/** Name the array and set it as the scalars of pointData, replacing the previous deformations. */
+void setDeformationArray(vtkPointData & pointData, vtkDataArray & array)
+{
+    array.SetName(deformationArrayName);
+    for (int component = 0; component < 3; ++component)
+    {
+        array.SetComponentName(component, deformationComponentNames[component]);
+    }
+    pointData.SetScalars(&array);
+}
+
+/** Deformation array with zeros, shown if no (valid) results are available */
+vtkSmartPointer<vtkDataArray> zeroDeformationArray(const vtkIdType numPoints)
+{
+    auto array = vtkSmartPointer<vtkSOADataArrayTemplate<t_FP>>::New();
+    array->SetNumberOfComponents(3);
+    array->SetNumberOfTuples(numPoints);
+    array->FillValue(0);
+    return array;
+}
+
+/**
+ * Reference the results in the deformation array of the data object, or set it to zeros if there
+ * are no valid results.
+ * @return whether valid results were assigned.
+ */
+bool assignResults(DataObject & dataObject, const PCDMResultCache::SharedResults & results)
+{
+    const auto numPoints = dataObject.numberOfPoints();
+    auto & pointData = *dataObject.dataSet()->GetPointData();
+
+    if (results)
+    {
+        if (numPoints == static_cast<vtkIdType>(results->size()))
+        {
+            // Show the results in place, they are kept alive while VTK references them.
+            setDeformationArray(pointData, *PCDMExternalArray::wrap(
+                results->components(), results->size(), results));
+            return true;
+        }
+
+        qWarning() << "Coordinate and uvec result data set have different number of data points.";
+    }
+
+    setDeformationArray(pointData, *zeroDeformationArray(numPoints));
+    return false;
+}
+
 }
 
 
@@ -68,6 +127,12 @@ PCDMVisualizationGenerator::PCDMVisualizationGenerator(DataMapping & dataMapping
 PCDMVisualizationGenerator::~PCDMVisualizationGenerator()
 {
     cleanup();
+    cleanupGridSearchResult();
+
+    if (m_gridSearchView && m_gridSearchView->isEmpty())
+    {
+        m_gridSearchView->close();
+    }
 
     if (m_renderView && m_renderView->isEmpty())
     {
@@ -78,6 +143,14 @@ PCDMVisualizationGenerator::~PCDMVisualizationGenerator()
     {
         m_residualView->close();
     }
+
+    for (auto & view : m_comparisonViews)
+    {
+        if (view && view->isEmpty())
+        {
+            view->close();
+        }
+    }
 }
 
 void PCDMVisualizationGenerator::setProject(PCDMProject * project)
@@ -134,50 +207,46 @@ DataObject * PCDMVisualizationGenerator::dataObject()
         return m_dataObject.get();
     }
 
-    auto dataSet = m_project->horizontalCoordinatesDataSet();
+    m_dataObject = newResultDataObject("pCDM Modeling Result");
+    if (!m_dataObject)
+    {
+        return{};
+    }
+
+    m_dataMapping.dataSetHandler().addExternalData({ m_dataObject.get() });
+
+    return m_dataObject.get();
+}
+
+std::unique_ptr<DataObject> PCDMVisualizationGenerator::newResultDataObject(const QString & name) const
+{
+    auto dataSet = m_project ? m_project->horizontalCoordinatesDataSet() : nullptr;
     if (!dataSet)
     {
         return{};
     }
 
+    // The geometry is not modified, so share it with the project's data set. Only the point data
+    // (the deformation array) is specific to each data object.
     auto visDataSet = vtkSmartPointer<vtkDataSet>::Take(dataSet->NewInstance());
-    visDataSet->DeepCopy(dataSet);
+    visDataSet->ShallowCopy(dataSet);
     assert(visDataSet->GetPointData()->GetNumberOfArrays() == 0);
 
-    const auto numPoints = dataSet->GetNumberOfPoints();
-
-    auto visArray = vtkSmartPointer<vtkAOSDataArrayTemplate<t_FP>>::New();
-    visArray->SetNumberOfComponents(3);
-    visArray->SetNumberOfTuples(numPoints);
-    visArray->SetName(deformationArrayName);
-    visArray->SetComponentName(0, deformationComponentNames[0]);
-    visArray->SetComponentName(1, deformationComponentNames[1]);
-    visArray->SetComponentName(2, deformationComponentNames[2]);
-    visArray->FillValue(0);
-    visDataSet->GetPointData()->SetScalars(visArray);
-
-    static const char * dataObjectName = "pCDM Modeling Result";
+    setDeformationArray(*visDataSet->GetPointData(),
+        *zeroDeformationArray(dataSet->GetNumberOfPoints()));
 
     if (auto polyData = vtkPolyData::SafeDownCast(visDataSet))
     {
-        m_dataObject = std::make_unique<PointCloudDataObject>(dataObjectName, *polyData);
-    }
-    else if (auto imageData = vtkImageData::SafeDownCast(visDataSet))
-    {
-        m_dataObject = std::make_unique<ImageDataObject>(dataObjectName, *imageData);
+        return std::make_unique<PointCloudDataObject>(name, *polyData);
     }
-    else
+    if (auto imageData = vtkImageData::SafeDownCast(visDataSet))
     {
-        assert(false);
-        qWarning() << "Unsupported data set type for horizontal coordinates: " << visDataSet->GetClassName();
-        return{};
+        return std::make_unique<ImageDataObject>(name, *imageData);
     }
 
-    assert(m_dataObject);
-
-    m_dataMapping.dataSetHandler().addExternalData({ m_dataObject.get() });
-
-    return m_dataObject.get();
+    assert(false);
+    qWarning() << "Unsupported data set type for horizontal coordinates: " << visDataSet->GetClassName();
+    return{};
 }
 
 void PCDMVisualizationGenerator::showDataObject()
@@ -223,6 +292,23 @@ void PCDMVisualizationGenerator::setModel(PCDMModel & model)
         return;
     }
 
+    setResults(model.hasResults()
+        ? model.results()
+        : PCDMResultCache::SharedResults());
+}
+
+void PCDMVisualizationGenerator::setPreview(const PCDMResultCache::SharedResults & results)
+{
+    if (!m_project)
+    {
+        return;
+    }
+
+    setResults(results);
+}
+
+void PCDMVisualizationGenerator::setResults(const PCDMResultCache::SharedResults & results)
+{
     auto dataSet = m_project->horizontalCoordinatesDataSet();
     if (!dataSet || !dataObject())
     {
@@ -232,88 +318,320 @@ void PCDMVisualizationGenerator::setModel(PCDMModel & model)
 
     const auto eventDeferral = ScopedEventDeferral(*m_dataObject);
 
-    const auto numPoints = m_dataObject->numberOfPoints();
-    auto & pointData = *m_dataObject->dataSet()->GetPointData();
-    auto visArray = vtkAOSDataArrayTemplate<t_FP>::FastDownCast(
-        pointData.GetAbstractArray(deformationArrayName));
-    assert(visArray && visArray->GetNumberOfTuples() == numPoints);
+    const bool validResults = assignResults(*m_dataObject, results);
+
+    m_dataObject->signal_dataChanged();
+
+    configureVisualizations(validResults);
+}
+
+void PCDMVisualizationGenerator::showModel(PCDMModel & model)
+{
+    if (!m_project || &model.project() != m_project)
+    {
+        return;
+    }
+
+    showDataObject();
+
+    if (!m_renderView)
+    {
+        return;
+    }
+
+    setModel(model);
+}
+
+void PCDMVisualizationGenerator::showResidualForModel(PCDMModel & model)
+{
+    if (!m_project || &model.project() != m_project)
+    {
+        return;
+    }
+
+    showDataObjectsInResidualView();
 
-    bool validResults = false;
-    while (model.hasResults())
+    if (!m_residualView)
     {
-        const auto & uvec = model.results();
-        assert(uvec.size() == 3 && uvec[0].size() == uvec[1].size() && uvec[1].size() == uvec[2].size());
+        return;
+    }
+
+    setModel(model);
+}
 
-        if (numPoints != static_cast<vtkIdType>(uvec[0].size()))
+void PCDMVisualizationGenerator::showComparison(const std::vector<PCDMModel *> & models)
+{
+    cleanupComparison();
+
+    if (!m_project)
+    {
+        return;
+    }
+
+    // Reuse views of the previous comparison that are still open.
+    m_comparisonViews.erase(
+        std::remove_if(m_comparisonViews.begin(), m_comparisonViews.end(),
+            [] (const QPointer<AbstractRenderView> & view) { return view.isNull(); }),
+        m_comparisonViews.end());
+
+    for (auto model : models)
+    {
+        if (!model || &model->project() != m_project || !model->hasResults())
         {
-            qWarning() << "Coordinate and uvec result data set have different number of data points.";
-            break;
+            continue;
+        }
+
+        const auto name = "pCDM Model: " + (model->name().isEmpty()
+            ? model->timestamp().toString()
+            : model->name());
+        auto dataObject = newResultDataObject(name);
+        if (!dataObject)
+        {
+            return;
         }
+        const bool validResults = assignResults(*dataObject, model->results());
+        m_dataMapping.dataSetHandler().addExternalData({ dataObject.get() });
 
-        assert(visArray->GetNumberOfComponents() == static_cast<int>(uvec.size()));
+        const auto viewIndex = m_comparisonDataObjects.size();
+        if (viewIndex == m_comparisonViews.size())
+        {
+            m_comparisonViews.emplace_back(m_dataMapping.createDefaultRenderViewType());
+        }
+        auto & view = m_comparisonViews[viewIndex];
 
-        auto uvecIt = uvec.begin();
-        int component = 0;
-        for (; uvecIt != uvec.end(); ++uvecIt, ++component)
+        QList<DataObject *> incompatible;
+        view->showDataObjects({ dataObject.get() }, incompatible);
+        if (!incompatible.isEmpty())
         {
-            for (vtkIdType i = 0; i < numPoints; ++i)
-            {
-                visArray->SetTypedComponent(i, component, (*uvecIt)[static_cast<size_t>(i)]);
-            }
+            // The user might have "misused" the view, as for the render view of dataObject().
+            view = m_dataMapping.createDefaultRenderViewType();
+            view->showDataObjects({ dataObject.get() }, incompatible);
+            assert(incompatible.isEmpty());
+        }
+
+        if (auto vis = view->visualizationFor(dataObject.get()))
+        {
+            vis->colorMapping().setCurrentScalarsByName(deformationArrayName, true, 2);
+            vis->colorMapping().colorBarRepresentation().setVisible(true);
+            vis->colorMapping().setEnabled(validResults);
         }
-        visArray->Modified();
 
-        validResults = true;
-        break;
+        m_comparisonDataObjects.push_back(std::move(dataObject));
     }
 
-    if (!validResults)
+    // Close views that are not required for this comparison.
+    while (m_comparisonViews.size() > m_comparisonDataObjects.size())
     {
-        visArray->FillValue(static_cast<t_FP>(0));
-        visArray->Modified();
+        if (m_comparisonViews.back() && m_comparisonViews.back()->isEmpty())
+        {
+            m_comparisonViews.back()->close();
+        }
+        m_comparisonViews.pop_back();
     }
+}
 
-    m_dataObject->signal_dataChanged();
+PCDMObservations PCDMVisualizationGenerator::residualViewObservations(QString * errorMessage) const
+{
+    PCDMObservations observations;
+    const auto setError = [errorMessage] (const QString & message)
+    {
+        if (errorMessage)
+        {
+            *errorMessage = message;
+        }
+    };
 
-    configureVisualizations(validResults);
+    if (!m_project || !m_residualView)
+    {
+        setError("The residual view is not open.");
+        return observations;
+    }
+
+    auto transformable = dynamic_cast<CoordinateTransformableDataObject *>(
+        m_residualView->observationData());
+    if (!transformable)
+    {
+        setError("The residual view does not show observation data with point coordinates.");
+        return observations;
+    }
+
+    auto dataSet = transformable->coordinateTransformedDataSet(m_project->coordinateSystem());
+    if (!dataSet)
+    {
+        setError("The observation data (" + transformable->name() + ") cannot be transformed to "
+            "the coordinate system of the project.");
+        return observations;
+    }
+
+    auto values = dataSet->GetPointData()->GetScalars();
+    if (!values && dataSet->GetPointData()->GetNumberOfArrays() > 0)
+    {
+        values = dataSet->GetPointData()->GetArray(0);
+    }
+    const auto numPoints = static_cast<size_t>(dataSet->GetNumberOfPoints());
+    if (!values || values->GetNumberOfComponents() != 1
+        || static_cast<size_t>(values->GetNumberOfTuples()) != numPoints || numPoints == 0)
+    {
+        setError("The observation data (" + transformable->name() + ") does not contain "
+            "scalar line of sight displacements at its points.");
+        return observations;
+    }
+
+    // Optional unit vectors per point, e.g., for wide swaths or merged tracks
+    vtkDataArray * pointLos = nullptr;
+    for (int a = 0; a < dataSet->GetPointData()->GetNumberOfArrays(); ++a)
+    {
+        auto array = dataSet->GetPointData()->GetArray(a);
+        const auto name = array && array->GetName() ? QString(array->GetName()) : QString();
+        if (array && array != values && array->GetNumberOfComponents() == 3
+            && (name.compare("Line of Sight", Qt::CaseInsensitive) == 0
+                || name.compare("LOS", Qt::CaseInsensitive) == 0))
+        {
+            pointLos = array;
+            break;
+        }
+    }
+
+    const auto & los = m_residualView->deformationLineOfSight();
+    const auto scale = std::pow(t_FP(10),
+        m_residualView->observationUnitDecimalExponent() - m_residualView->modelUnitDecimalExponent());
+
+    // Points without valid observations (NaN) are not included.
+    pCDM::HorizontalCoordinates::Columns columns;
+    columns[0].reserve(numPoints);
+    columns[1].reserve(numPoints);
+    observations.values.reserve(numPoints);
+    std::array<double, 3> point;
+    std::array<double, 3> direction;
+    for (vtkIdType i = 0; i < static_cast<vtkIdType>(numPoints); ++i)
+    {
+        const auto value = values->GetComponent(i, 0);
+        if (!std::isfinite(value))
+        {
+            continue;
+        }
+        if (pointLos)
+        {
+            pointLos->GetTuple(i, direction.data());
+            if (!std::all_of(direction.begin(), direction.end(),
+                [] (double c) { return std::isfinite(c); }))
+            {
+                continue;
+            }
+            for (size_t c = 0; c < 3; ++c)
+            {
+                observations.pointLineOfSight[c].push_back(static_cast<t_FP>(direction[c]));
+            }
+        }
+        dataSet->GetPoint(i, point.data());
+        columns[0].push_back(static_cast<t_FP>(point[0]));
+        columns[1].push_back(static_cast<t_FP>(point[1]));
+        observations.values.push_back(scale * static_cast<t_FP>(value));
+    }
+    if (observations.values.empty())
+    {
+        setError("The observation data (" + transformable->name() + ") does not contain valid values.");
+        return observations;
+    }
+    observations.coords = std::make_shared<const pCDM::HorizontalCoordinates>(std::move(columns));
+    observations.lineOfSight = {
+        static_cast<t_FP>(los[0]), static_cast<t_FP>(los[1]), static_cast<t_FP>(los[2]) };
+
+    return observations;
 }
 
-void PCDMVisualizationGenerator::showModel(PCDMModel & model)
+void PCDMVisualizationGenerator::showGridSearchResult(const PCDMGridSearch::Result & result)
 {
-    if (!m_project || &model.project() != m_project)
+    cleanupGridSearchResult();
+
+    const auto numNodes = static_cast<vtkIdType>(result.nodes.size());
+    if (numNodes == 0)
     {
         return;
     }
 
-    showDataObject();
+    auto points = vtkSmartPointer<vtkPoints>::New();
+    points->SetDataTypeToDouble();
+    points->SetNumberOfPoints(numNodes);
+    auto misfits = vtkSmartPointer<vtkAOSDataArrayTemplate<t_FP>>::New();
+    misfits->SetName("Misfit");
+    misfits->SetNumberOfTuples(numNodes);
+    auto verts = vtkSmartPointer<vtkCellArray>::New();
+    verts->Allocate(verts->EstimateSize(numNodes, 1));
+    for (vtkIdType i = 0; i < numNodes; ++i)
+    {
+        const auto & node = result.nodes[static_cast<size_t>(i)];
+        points->SetPoint(i,
+            node.parameters.horizontalCoord[0], node.parameters.horizontalCoord[1], -node.parameters.depth);
+        misfits->SetValue(i, node.misfit);
+        verts->InsertNextCell(1, &i);
+    }
 
-    if (!m_renderView)
+    auto polyData = vtkSmartPointer<vtkPolyData>::New();
+    polyData->SetPoints(points);
+    polyData->SetVerts(verts);
+    polyData->GetPointData()->SetScalars(misfits);
+    if (m_project)
     {
-        return;
+        m_project->coordinateSystem().writeToFieldData(*polyData->GetFieldData());
     }
 
-    setModel(model);
+    m_gridSearchDataObject = std::make_unique<PointCloudDataObject>("pCDM Grid Search Misfit", *polyData);
+    m_dataMapping.dataSetHandler().addExternalData({ m_gridSearchDataObject.get() });
+
+    if (!m_gridSearchView)
+    {
+        m_gridSearchView = m_dataMapping.createDefaultRenderViewType();
+    }
+    QList<DataObject *> incompatible;
+    m_gridSearchView->showDataObjects({ m_gridSearchDataObject.get() }, incompatible);
+    if (auto vis = m_gridSearchView->visualizationFor(m_gridSearchDataObject.get()))
+    {
+        vis->colorMapping().setCurrentScalarsByName("Misfit", true, 0);
+        vis->colorMapping().colorBarRepresentation().setVisible(true);
+    }
 }
 
-void PCDMVisualizationGenerator::showResidualForModel(PCDMModel & model)
+void PCDMVisualizationGenerator::cleanupComparison()
 {
-    if (!m_project || &model.project() != m_project)
+    if (m_comparisonDataObjects.empty())
     {
         return;
     }
 
-    showDataObjectsInResidualView();
+    QList<DataObject *> dataObjects;
+    for (auto & dataObject : m_comparisonDataObjects)
+    {
+        dataObjects << dataObject.get();
+    }
 
-    if (!m_residualView)
+    m_dataMapping.removeDataObjects(dataObjects);
+    m_dataMapping.dataSetHandler().removeExternalData(dataObjects);
+
+    qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+
+    m_comparisonDataObjects.clear();
+}
+
+void PCDMVisualizationGenerator::cleanupGridSearchResult()
+{
+    if (!m_gridSearchDataObject)
     {
         return;
     }
 
-    setModel(model);
+    m_dataMapping.removeDataObjects({ m_gridSearchDataObject.get() });
+    m_dataMapping.dataSetHandler().removeExternalData({ m_gridSearchDataObject.get() });
+
+    qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+
+    m_gridSearchDataObject = {};
 }
 
 void PCDMVisualizationGenerator::cleanup()
 {
+    cleanupComparison();
+
     if (!m_dataObject)
     {
         return;
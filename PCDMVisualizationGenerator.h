@@ -24,6 +24,9 @@
 #include <QObject>
 #include <QPointer>
 
+#include "PCDMGridSearch.h"
+#include "PCDMResultCache.h"
+
 
 class AbstractRenderView;
 class DataMapping;
@@ -76,6 +79,12 @@ public:
      * color mappings to visualize "uv" values.
      */
     void setModel(PCDMModel & model);
+    /**
+     * Same as setModel(), but for results that are not requested from a model, e.g., previews
+     * computed while parameters are edited or results prefetched for playback. results must have a
+     * value per coordinate of the project.
+     */
+    void setPreview(const PCDMResultCache::SharedResults & results);
     /**
      * Utility function to open a render view, update the preview data to represent the specified
      * model and visualize it.
@@ -85,10 +94,43 @@ public:
      * Same as showModel(), but uses the residual view created by openResidualView().
      */
     void showResidualForModel(PCDMModel & model);
+    /**
+     * Show the results of several models side by side, each in its own render view. The data
+     * objects share the geometry of dataObject() and only reference the results of their model,
+     * so each compared model only costs the memory of its displacements.
+     * Replaces previously compared models. Models without stored results are skipped.
+     */
+    void showComparison(const std::vector<PCDMModel *> & models);
+    /**
+     * Observation data shown in the residual view, as input for a PCDMInversion. Coordinates are
+     * transformed to the coordinate system of the project. Values must already be line of sight
+     * displacements, they are only scaled to the unit of the modeled displacements. The line of
+     * sight configured in the view, or per point directions of the data, are recorded to project
+     * the modeled displacements.
+     * @return Invalid observations (see PCDMObservations::isValid) if the view is not open or does not
+     *  show compatible observations. errorMessage is set to the reason, in this case.
+     */
+    PCDMObservations residualViewObservations(QString * errorMessage = nullptr) const;
+
+    /**
+     * Show the nodes evaluated by a grid search as point cloud in a separate render view, located
+     * at their positions and depths (as negative elevations) and colored by their misfits.
+     * Replaces previously shown grid search results.
+     */
+    void showGridSearchResult(const PCDMGridSearch::Result & result);
 
     void cleanup();
 
 private:
+    /**
+     * Create a data object for the horizontal coordinates of the current project, sharing the
+     * geometry of the project's data set. The deformation array is initialized with zeros.
+     */
+    std::unique_ptr<DataObject> newResultDataObject(const QString & name) const;
+    /** Results are referenced by the visualization, not copied. */
+    void setResults(const PCDMResultCache::SharedResults & results);
+    void cleanupComparison();
+    void cleanupGridSearchResult();
     void updateForNewCoordinates();
     void configureVisualizations(bool validResults) const;
 
@@ -101,4 +143,10 @@ private:
     std::unique_ptr<DataObject> m_dataObject;
     QPointer<AbstractRenderView> m_renderView;
     QPointer<ResidualVerificationView> m_residualView;
+
+    std::vector<std::unique_ptr<DataObject>> m_comparisonDataObjects;
+    std::vector<QPointer<AbstractRenderView>> m_comparisonViews;
+
+    std::unique_ptr<DataObject> m_gridSearchDataObject;
+    QPointer<AbstractRenderView> m_gridSearchView;
 };
@@ -19,16 +19,21 @@
 #include "PCDMWidget.h"
 #include "ui_PCDMWidget.h"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <limits>
 
 #include <QDesktopServices>
 #include <QFileDialog>
+#include <QFutureWatcher>
 #include <QInputDialog>
 #include <QMenu>
 #include <QMessageBox>
 #include <QSettings>
 #include <QStateMachine>
+#include <QTimer>
+#include <QtConcurrent>
 
 #include <vtkDataSet.h>
 #include <vtkSmartPointer.h>
@@ -41,9 +46,16 @@
 #include <core/utility/qthelper.h>
 #include <gui/plugin/GuiPluginInterface.h>
 
+#include "pCDM_kernel.h"
 #include "PCDMCreateProjectDialog.h"
+#include "PCDMGridSearch.h"
+#include "PCDMInversion.h"
+#include "PCDMInversionDialog.h"
+#include "PCDMSampler.h"
 #include "PCDMModel.h"
+#include "PCDMProgressivePreview.h"
 #include "PCDMProject.h"
+#include "PCDMResultPrefetcher.h"
 #include "PCDMVisualizationGenerator.h"
 #include "PCDMWidget_StateHelper.h"
 
@@ -53,6 +65,30 @@ namespace
 
 const auto degreeSign = QChar(0xb0);
 
+/** Delay after the last parameter edit until a live preview is requested */
+const int previewDebounceInterval = 40;
+/** Live previews are shown at most at this rate, levels computed meanwhile are coalesced. */
+const int maxPreviewFramesPerSecond = 20;
+
+/** @return X min, X max, Y min, Y max of the coordinates */
+std::array<pCDM::t_FP, 4> coordinateBounds(const pCDM::HorizontalCoordinates & coords)
+{
+    if (coords.isGrid())
+    {
+        const auto & grid = coords.grid();
+        return{ {
+            grid.origin[0] + grid.spacing[0] * grid.extent[0],
+            grid.origin[0] + grid.spacing[0] * grid.extent[1],
+            grid.origin[1] + grid.spacing[1] * grid.extent[2],
+            grid.origin[1] + grid.spacing[1] * grid.extent[3] } };
+    }
+
+    const auto & columns = coords.columns();
+    const auto x = std::minmax_element(columns[0], columns[0] + coords.size());
+    const auto y = std::minmax_element(columns[1], columns[1] + coords.size());
+    return{ { *x.first, *x.second, *y.first, *y.second } };
+}
+
 }
 
 using pCDM::t_FP;
@@ -70,6 +106,13 @@ PCDMWidget::PCDMWidget(
     , m_stateMachine{ std::make_unique<QStateMachine>() }
     , m_stateHelper{ std::make_unique<PCDMWidget_StateHelper>() }
     , m_visGenerator{ std::make_unique<PCDMVisualizationGenerator>(pluginInterface.dataMapping()) }
+    , m_preview{ std::make_unique<PCDMProgressivePreview>() }
+    , m_playbackPrefetcher{ std::make_unique<PCDMResultPrefetcher>() }
+    , m_playbackTimer{ std::make_unique<QTimer>() }
+    , m_playbackFrame{ 0 }
+    , m_previewDebounceTimer{ std::make_unique<QTimer>() }
+    , m_previewFrameTimer{ std::make_unique<QTimer>() }
+    , m_previewPending{ false }
     , m_firstShowEventHandlingRequired{ true }
 {
     m_ui->setupUi(this);
@@ -95,7 +138,9 @@ PCDMWidget::PCDMWidget(
             "<br />"
             "The source code of this plugin is licensed under GPL-3.0 and is available at:<br />"
             "<a href=\"https://github.com/kateyy/geohazardvis_modeling_pCDM\">"
-                      "https://github.com/kateyy/geohazardvis_modeling_pCDM</a>"
+                      "https://github.com/kateyy/geohazardvis_modeling_pCDM</a><br />"
+            "<br />"
+            "Computing kernel: " + QString(pCDM::kernelVariantName(pCDM::bestKernelVariant()))
         );
         about.exec();
     });
@@ -135,16 +180,85 @@ PCDMWidget::PCDMWidget(
     });
 
     connect(m_ui->surfaceSaveButton, &QAbstractButton::clicked, this, &PCDMWidget::saveSurfaceParameters);
+    // The error bound only applies to lossy storage.
+    connect(m_ui->resultStorageComboBox, static_cast<void(QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+        [this] (int index)
+    {
+        m_ui->maxStorageErrorSpinBox->setEnabled(
+            index == static_cast<int>(PCDMResultFile::Codec::quantizedDeflate));
+    });
 
     connect(m_ui->runButton, &QAbstractButton::clicked, this, &PCDMWidget::runModel);
+    connect(m_ui->cancelComputationButton, &QAbstractButton::clicked, [this] ()
+    {
+        if (m_computingModel)
+        {
+            m_computingModel->cancelRequest();
+        }
+    });
     connect(m_ui->saveModelButton, &QAbstractButton::clicked, this, &PCDMWidget::saveModelDialog);
     connect(m_ui->openVisualizationButton, &QAbstractButton::clicked, this, &PCDMWidget::showVisualization);
     connect(m_ui->visualizeResidualsButton, &QAbstractButton::clicked, this, &PCDMWidget::showResidual);
+    connect(m_ui->invertButton, &QAbstractButton::clicked, this, &PCDMWidget::fitToObservations);
+    connect(m_ui->samplePosteriorButton, &QAbstractButton::clicked, this, &PCDMWidget::samplePosterior);
+    connect(m_ui->gridSearchButton, &QAbstractButton::clicked, this, &PCDMWidget::runGridSearch);
+
+    for (auto spinBox : { m_ui->positionXSpinBox, m_ui->positionYSpinBox, m_ui->depthSpinBox,
+        m_ui->omegaXSpinBox, m_ui->omegaYSpinBox, m_ui->omegaZSpinBox,
+        m_ui->dvXSpinBox, m_ui->dvYSpinBox, m_ui->dvZSpinBox })
+    {
+        // Restarting the timer on each edit coalesces edits, e.g., while holding a spin box arrow.
+        connect(spinBox, static_cast<void(QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged),
+            m_previewDebounceTimer.get(), static_cast<void(QTimer::*)()>(&QTimer::start));
+    }
+    m_previewDebounceTimer->setSingleShot(true);
+    m_previewDebounceTimer->setInterval(previewDebounceInterval);
+    connect(m_previewDebounceTimer.get(), &QTimer::timeout, this, &PCDMWidget::updatePreview);
+    m_previewFrameTimer->setSingleShot(true);
+    m_previewFrameTimer->setInterval(1000 / maxPreviewFramesPerSecond);
+    connect(m_previewFrameTimer.get(), &QTimer::timeout, [this] ()
+    {
+        if (m_previewPending)
+        {
+            showPreview();
+        }
+    });
+    connect(m_ui->livePreviewCheckBox, &QAbstractButton::toggled, [this] (bool checked)
+    {
+        if (!checked)
+        {
+            cancelPreview();
+            storePreviewParameters(true);
+            return;
+        }
+        m_visGenerator->showDataObject();
+        updatePreview();
+    });
+    // Levels are reported from the worker thread, so this connection is queued.
+    connect(m_preview.get(), &PCDMProgressivePreview::levelReady, this, &PCDMWidget::showPreview);
 
     connect(m_ui->savedModelsTable, &QTableWidget::itemSelectionChanged, this, &PCDMWidget::updateModelSummary);
     connect(m_ui->renameModelButton, &QAbstractButton::clicked, this, &PCDMWidget::renameSelectedModel);
     connect(m_ui->deleteModelButton, &QAbstractButton::clicked, this, &PCDMWidget::deleteSelectedModel);
     connect(m_ui->resetToSelectedButton, &QAbstractButton::clicked, this, &PCDMWidget::resetToSelectedModel);
+    connect(m_ui->compareModelsButton, &QAbstractButton::clicked, this, &PCDMWidget::compareSelectedModels);
+    connect(m_ui->playModelsButton, &QAbstractButton::toggled, [this] (bool checked)
+    {
+        if (checked)
+        {
+            startPlayback();
+        }
+        else
+        {
+            stopPlayback();
+        }
+    });
+    connect(m_ui->playbackRateSpinBox, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+        [this] (int framesPerSecond)
+    {
+        m_playbackTimer->setInterval(1000 / framesPerSecond);
+    });
+    connect(m_playbackTimer.get(), &QTimer::timeout, this, &PCDMWidget::showNextPlaybackFrame);
     connect(m_ui->savedModelsTable, &QTableWidget::doubleClicked, this, &PCDMWidget::resetToSelectedModel);
 
     setupStateMachine();
@@ -153,6 +267,7 @@ PCDMWidget::PCDMWidget(
 
 PCDMWidget::~PCDMWidget()
 {
+    endLivePreview();
     saveSettings();
 }
 
@@ -188,8 +303,10 @@ void PCDMWidget::setupStateMachine()
 
     // Setup steps are done and the user inputs pCDM parameters.
     auto sModelUserInput = new QState(sProjectLoaded);
-    // The model is currently being computed. Most UI part are blocked.
+    // A long running job is executed. Most UI part are blocked.
     auto sComputeModel = new QState(sProjectLoaded);
+    // Model results are computed. Parameters can be changed to supersede the computation.
+    auto sComputeResults = new QState(sProjectLoaded);
 
     sProjectLoaded->addTransition(helper, &PCDMWidget_StateHelper::projectUnloaded, sNoProject);
 
@@ -202,6 +319,8 @@ void PCDMWidget::setupStateMachine()
 
     sModelUserInput->addTransition(helper, &PCDMWidget_StateHelper::computingModel, sComputeModel);
     sComputeModel->addTransition(helper, &PCDMWidget_StateHelper::computingEnded, sModelUserInput);
+    sModelUserInput->addTransition(helper, &PCDMWidget_StateHelper::computingResults, sComputeResults);
+    sComputeResults->addTransition(helper, &PCDMWidget_StateHelper::computingEnded, sModelUserInput);
 
 
     machine.setGlobalRestorePolicy(QState::RestoreProperties);
@@ -226,11 +345,29 @@ void PCDMWidget::setupStateMachine()
     sComputeModel->assignProperty(m_ui->pCDMRotationGroup, "enabled", false);
     sComputeModel->assignProperty(m_ui->pCDMPotenciesGroup, "enabled", false);
     sComputeModel->assignProperty(m_ui->runButton, "enabled", false);
+    sComputeModel->assignProperty(m_ui->livePreviewCheckBox, "enabled", false);
     sComputeModel->assignProperty(m_ui->saveModelButton, "enabled", false);
     sComputeModel->assignProperty(m_ui->openVisualizationButton, "enabled", false);
     sComputeModel->assignProperty(m_ui->visualizeResidualsButton, "enabled", false);
+    sComputeModel->assignProperty(m_ui->invertButton, "enabled", false);
+    sComputeModel->assignProperty(m_ui->samplePosteriorButton, "enabled", false);
+    sComputeModel->assignProperty(m_ui->gridSearchButton, "enabled", false);
     sComputeModel->assignProperty(m_ui->savedModelsTab, "enabled", false);
 
+    sComputeResults->assignProperty(m_ui->progressBar, "visible", true);
+    sComputeResults->assignProperty(m_ui->progressBar, "maximum", 100);
+    sComputeResults->assignProperty(m_ui->cancelComputationButton, "visible", true);
+    sComputeResults->assignProperty(m_ui->projectWidget, "enabled", false);
+    sComputeResults->assignProperty(m_ui->surfaceGroupBox, "enabled", false);
+    sComputeResults->assignProperty(m_ui->livePreviewCheckBox, "enabled", false);
+    sComputeResults->assignProperty(m_ui->saveModelButton, "enabled", false);
+    sComputeResults->assignProperty(m_ui->openVisualizationButton, "enabled", false);
+    sComputeResults->assignProperty(m_ui->visualizeResidualsButton, "enabled", false);
+    sComputeResults->assignProperty(m_ui->invertButton, "enabled", false);
+    sComputeResults->assignProperty(m_ui->samplePosteriorButton, "enabled", false);
+    sComputeResults->assignProperty(m_ui->gridSearchButton, "enabled", false);
+    sComputeResults->assignProperty(m_ui->savedModelsTab, "enabled", false);
+
 
     connect(sSetupSurface, &QState::entered, this, &PCDMWidget::prepareSetupSurfaceParameters);
     connect(sSetupSurface, &QState::exited, this, &PCDMWidget::cleanupSurfaceParameterSetup);
@@ -356,8 +493,11 @@ void PCDMWidget::loadProjectFrom(const QString & rootFolder)
             return;
         }
 
+        endLivePreview();
+
         const auto toBeDeleted = std::move(m_project);
 
+        stopPlayback();
         m_visGenerator->setProject(nullptr);
 
         updateSurfaceSummary();
@@ -479,6 +619,14 @@ void PCDMWidget::prepareSetupSurfaceParameters()
     if (m_project)
     {
         m_ui->poissonsRatioEdit->setValue(m_project->poissonsRatio());
+        m_ui->precisionComboBox->setCurrentIndex(
+            m_project->computationPrecision() == pCDM::Precision::singlePrecision ? 1 : 0);
+        const auto & compression = m_project->resultCompression();
+        m_ui->resultStorageComboBox->setCurrentIndex(static_cast<int>(compression.codec));
+        m_ui->maxStorageErrorSpinBox->setValue(compression.maxError);
+        m_ui->maxStorageErrorSpinBox->setEnabled(
+            compression.codec == PCDMResultFile::Codec::quantizedDeflate);
+        m_ui->storeNuPartsCheckBox->setChecked(m_project->storeNuParts());
     }
 }
 
@@ -553,6 +701,14 @@ void PCDMWidget::saveSurfaceParameters()
     assert(m_project->horizontalCoordinatesDataSet());
 
     m_project->setPoissonsRatio(static_cast<pCDM::t_FP>(m_ui->poissonsRatioEdit->value()));
+    m_project->setComputationPrecision(m_ui->precisionComboBox->currentIndex() == 1
+        ? pCDM::Precision::singlePrecision
+        : pCDM::Precision::doublePrecision);
+    // Combo box entries are ordered as the codecs.
+    m_project->setResultCompression({
+        static_cast<PCDMResultFile::Codec>(m_ui->resultStorageComboBox->currentIndex()),
+        static_cast<pCDM::t_FP>(m_ui->maxStorageErrorSpinBox->value()) });
+    m_project->setStoreNuParts(m_ui->storeNuPartsCheckBox->isChecked());
 
     updateSurfaceSummary();
 
@@ -587,6 +743,14 @@ void PCDMWidget::updateSurfaceSummary()
         auto && unit = coords.unitOfMeasurement;
 
         addRow("Poisson's Ratio", QString::number(m_project->poissonsRatio()));
+        addRow("Computation Precision",
+            m_project->computationPrecision() == pCDM::Precision::singlePrecision ? "Single" : "Double");
+        const auto & compression = m_project->resultCompression();
+        addRow("Result Storage",
+            compression.codec == PCDMResultFile::Codec::quantizedDeflate
+            ? "Lossy, max. error " + QString::number(compression.maxError)
+            : (compression.codec == PCDMResultFile::Codec::shuffleDeflate ? "Lossless" : "Uncompressed"));
+        addRow("Poisson's Ratio Parts", m_project->storeNuParts() ? "Stored" : "Not Stored");
         addRow("Geometry", m_project->horizontalCoordinatesGeometryType());
         addRow("Number of Coordinates", QString::number(numCoordinates));
         addRow("Extent (West-East)", bounds.isEmpty() ? ""
@@ -637,6 +801,15 @@ void PCDMWidget::runModel()
         return;
     }
 
+    // Final results replace the preview.
+    cancelPreview();
+
+    if (m_computingModel && m_computingModel->parameters() == sourceParams)
+    {
+        // Already computing these parameters
+        return;
+    }
+
     PCDMModel * modelPtr = nullptr;
     auto lastModel = m_project->model(m_project->lastModelTimestamp());
     if (lastModel && (lastModel->parameters() == sourceParams))
@@ -660,11 +833,115 @@ void PCDMWidget::runModel()
 
     m_project->setLastModelTimestamp(model.timestamp());
 
-    connect(&model, &PCDMModel::requestCompleted, this, &PCDMWidget::handleModelDone);
-    emit m_stateHelper->computingModel();
+    requestModelResults(model);
+}
+
+void PCDMWidget::requestModelResults(PCDMModel & model)
+{
+    // Results of the computation replace the shown frame.
+    stopPlayback();
+
+    if (m_computingModel && m_computingModel != &model)
+    {
+        // The latest request wins, results of the previous one are not required anymore.
+        disconnect(m_computingModel, nullptr, this, nullptr);
+        m_computingModel->cancelRequest();
+    }
+    m_computingModel = &model;
+
+    m_ui->progressBar->setValue(0);
+    connect(&model, &PCDMModel::progressChanged, m_ui->progressBar, &QProgressBar::setValue,
+        Qt::UniqueConnection);
+    connect(&model, &PCDMModel::requestCompleted, this, &PCDMWidget::handleModelDone,
+        Qt::UniqueConnection);
+    emit m_stateHelper->computingResults();
     model.requestResultsAsync();
 }
 
+void PCDMWidget::updatePreview()
+{
+    // Results of a running computation would replace the preview.
+    if (!m_project || !m_ui->livePreviewCheckBox->isChecked() || m_computingModel
+        || m_playbackTimer->isActive())
+    {
+        return;
+    }
+
+    const PCDMBackendBase::Parameters parameters{ sourceParametersFromUi(), m_project->poissonsRatio() };
+    m_preview->request(m_project->horizontalCoordinateValues(), parameters, m_project->numThreads());
+}
+
+void PCDMWidget::showPreview()
+{
+    // Levels may be computed faster than they can be rendered, so only the most recent one is
+    // shown when the frame timer expires.
+    if (m_previewFrameTimer->isActive())
+    {
+        m_previewPending = true;
+        return;
+    }
+    m_previewPending = false;
+
+    const auto preview = m_preview->preview();
+    if (!m_project || !preview.results
+        || preview.results->size() != m_project->numHorizontalCoordinates())
+    {
+        return;
+    }
+
+    m_visGenerator->setPreview(preview.results);
+    m_previewFrameTimer->start();
+}
+
+void PCDMWidget::cancelPreview()
+{
+    m_previewDebounceTimer->stop();
+    m_previewPending = false;
+    m_preview->cancel();
+}
+
+void PCDMWidget::storePreviewParameters(const bool computeResults)
+{
+    const auto sourceParams = sourceParametersFromUi();
+    if (!m_project || m_computingModel || !sourceParams.isValid())
+    {
+        return;
+    }
+
+    const auto lastModel = m_project->model(m_project->lastModelTimestamp());
+    if (lastModel && lastModel->parameters() == sourceParams
+        && (lastModel->hasResults() || !computeResults))
+    {
+        return;
+    }
+
+    if (computeResults)
+    {
+        runModel();
+        return;
+    }
+
+    // Results are computed when the parameters are run again.
+    auto model = m_project->addModel();
+    if (!model)
+    {
+        return;
+    }
+    model->setParameters(sourceParams);
+    m_project->setLastModelTimestamp(model->timestamp());
+    updateModelsList();
+}
+
+void PCDMWidget::endLivePreview()
+{
+    cancelPreview();
+
+    if (m_ui->livePreviewCheckBox->isChecked())
+    {
+        storePreviewParameters(false);
+    }
+}
+
 void PCDMWidget::handleModelDone()
 {
     assert(m_project);
@@ -676,13 +953,20 @@ void PCDMWidget::handleModelDone()
     }
 
     disconnect(modelPtr, &PCDMModel::requestCompleted, this, &PCDMWidget::handleModelDone);
+    disconnect(modelPtr, &PCDMModel::progressChanged, m_ui->progressBar, &QProgressBar::setValue);
+    m_computingModel.clear();
 
     auto & model = *modelPtr;
 
     emit m_stateHelper->computingEnded();
 
+    if (model.errorFlags().testFlag(PCDMModel::cancelled))
+    {
+        return;
+    }
+
     if (model.errorFlags() != PCDMModel::noError
-        || !model.hasResults() || model.results()[0].empty())
+        || !model.hasResults() || !model.results())
     {
         if (model.errorFlags().testFlag(PCDMModel::outOfMemory))
         {
@@ -768,6 +1052,264 @@ void PCDMWidget::showResidual()
     m_visGenerator->showResidualForModel(*model);
 }
 
+void PCDMWidget::fitToObservations()
+{
+    if (!m_project)
+    {
+        return;
+    }
+
+    static const QString title = "Fit to Observations";
+
+    QString errorMessage;
+    auto observations = m_visGenerator->residualViewObservations(&errorMessage);
+    if (!observations.isValid())
+    {
+        QMessageBox::information(this, title,
+            "Please show the residuals and select observation data in the residual view to fit the "
+            "model to. " + errorMessage);
+        return;
+    }
+
+    PCDMInversion::Settings initialSettings;
+    initialSettings.initialParameters = sourceParametersFromUi();
+    initialSettings.nu = m_project->poissonsRatio();
+    initialSettings.numThreads = m_project->numThreads();
+    if (!initialSettings.initialParameters.isValid(&errorMessage))
+    {
+        QMessageBox::warning(this, title,
+            "The supplied initial point CDM parameters are not valid: " + errorMessage);
+        return;
+    }
+
+    PCDMInversionDialog dialog(initialSettings, this);
+    if (dialog.exec() != QDialog::Accepted)
+    {
+        return;
+    }
+    const auto settings = dialog.settings();
+
+    auto watcher = new QFutureWatcher<PCDMInversion::Result>(this);
+    connect(watcher, &QFutureWatcher<PCDMInversion::Result>::finished, [this, watcher] ()
+    {
+        watcher->deleteLater();
+        const auto result = watcher->result();
+
+        emit m_stateHelper->computingEnded();
+
+        if (result.status == PCDMInversion::Status::errOutOfMemory)
+        {
+            QMessageBox::warning(this, title,
+                "Not enough main memory to fit the model to the observations. Please try to close "
+                "other applications, or choose a smaller model setup.");
+            return;
+        }
+        if (result.status == PCDMInversion::Status::invalidInput || !m_project)
+        {
+            QMessageBox::critical(this, title,
+                "An unexpected error occurred in the modeling back-end.");
+            return;
+        }
+
+        auto model = m_project->addModel();
+        if (!model)
+        {
+            QMessageBox::warning(this, title,
+                "Could not create required files in the project folder. Please make sure that the "
+                "project folder is accessible for writing.");
+            return;
+        }
+        model->setParameters(result.parameters);
+        model->setName(QString("Fit (misfit %1 of initial, %2 iterations%3)")
+            .arg(result.initialMisfit > 0 ? result.misfit / result.initialMisfit : 0)
+            .arg(result.iterations)
+            .arg(result.status == PCDMInversion::Status::maxIterationsReached
+                ? ", not converged" : ""));
+        sourceParametersToUi(result.parameters);
+        m_project->setLastModelTimestamp(model->timestamp());
+
+        requestModelResults(*model);
+    });
+
+    emit m_stateHelper->computingModel();
+    const auto inversion = std::make_shared<const PCDMInversion>(std::move(observations));
+    watcher->setFuture(QtConcurrent::run([inversion, settings] ()
+    {
+        return inversion->run(settings);
+    }));
+}
+
+void PCDMWidget::samplePosterior()
+{
+    if (!m_project)
+    {
+        return;
+    }
+
+    static const QString title = "Sample Posterior";
+
+    QString errorMessage;
+    auto observations = m_visGenerator->residualViewObservations(&errorMessage);
+    if (!observations.isValid())
+    {
+        QMessageBox::information(this, title,
+            "Please show the residuals and select observation data in the residual view to sample "
+            "the posterior distribution for. " + errorMessage);
+        return;
+    }
+
+    PCDMSampler::Settings settings;
+    settings.initialParameters = sourceParametersFromUi();
+    settings.nu = m_project->poissonsRatio();
+    settings.numThreads = m_project->numThreads();
+    if (!settings.initialParameters.isValid(&errorMessage))
+    {
+        QMessageBox::warning(this, title,
+            "The supplied point CDM parameters are not valid: " + errorMessage);
+        return;
+    }
+
+    bool okay;
+    settings.numSteps = static_cast<size_t>(QInputDialog::getInt(this, title,
+        QString("Number of steps of the %1 chains. The noise level is estimated from the residual "
+            "of the current parameters, which should be a best fit.").arg(settings.numWalkers),
+        2000, 1, std::numeric_limits<int>::max(), 100, &okay));
+    if (!okay)
+    {
+        return;
+    }
+
+    const auto fileName = m_project->samplesFileName();
+    if (fileName.isEmpty())
+    {
+        QMessageBox::warning(this, title,
+            "Could not create required files in the project folder. Please make sure that the "
+            "project folder is accessible for writing.");
+        return;
+    }
+
+    auto watcher = new QFutureWatcher<PCDMSampler::Result>(this);
+    connect(watcher, &QFutureWatcher<PCDMSampler::Result>::finished, [this, watcher, fileName] ()
+    {
+        watcher->deleteLater();
+        const auto result = watcher->result();
+
+        emit m_stateHelper->computingEnded();
+
+        switch (result.status)
+        {
+        case PCDMSampler::Status::finished:
+            break;
+        case PCDMSampler::Status::errOutOfMemory:
+            QMessageBox::warning(this, title,
+                "Not enough main memory to sample the posterior distribution. Please try to close "
+                "other applications, or choose a smaller model setup.");
+            return;
+        case PCDMSampler::Status::errWriteFailed:
+            QMessageBox::warning(this, title, "Could not write the samples to " + fileName + ".");
+            return;
+        case PCDMSampler::Status::invalidInput:
+            QMessageBox::warning(this, title,
+                "Could not sample the posterior distribution. Please make sure that the current "
+                "parameters fit the observations, but not exactly.");
+            return;
+        }
+
+        static const char * const names[] = {
+            "X0", "Y0", "Depth", "Omega X", "Omega Y", "Omega Z", "DV X", "DV Y", "DV Z" };
+        QString summary = QString("Acceptance fraction: %1\n\n").arg(result.acceptanceFraction);
+        for (size_t i = 0; i < result.mean.size(); ++i)
+        {
+            summary += QString("%1: %2 +/- %3\n")
+                .arg(names[i]).arg(result.mean[i]).arg(result.standardDeviation[i]);
+        }
+        summary += "\nSamples are stored in " + fileName;
+        QMessageBox::information(this, title, summary);
+    });
+
+    emit m_stateHelper->computingModel();
+    const auto sampler = std::make_shared<const PCDMSampler>(std::move(observations));
+    watcher->setFuture(QtConcurrent::run([sampler, settings, fileName] ()
+    {
+        return sampler->run(settings, fileName);
+    }));
+}
+
+void PCDMWidget::runGridSearch()
+{
+    if (!m_project)
+    {
+        return;
+    }
+
+    static const QString title = "Grid Search";
+
+    QString errorMessage;
+    auto observations = m_visGenerator->residualViewObservations(&errorMessage);
+    if (!observations.isValid())
+    {
+        QMessageBox::information(this, title,
+            "Please show the residuals and select observation data in the residual view to search "
+            "the source for. " + errorMessage);
+        return;
+    }
+
+    // Search below the extent of the observations, down to a depth of its size.
+    const auto bounds = coordinateBounds(*observations.coords);
+    const auto size = std::max(bounds[1] - bounds[0], bounds[3] - bounds[2]);
+    PCDMGridSearch::Settings settings;
+    settings.xRange = { bounds[0], bounds[1] };
+    settings.yRange = { bounds[2], bounds[3] };
+    settings.depthRange = { 0.02 * size, size };
+    settings.omega = sourceParametersFromUi().omega;
+    settings.nu = m_project->poissonsRatio();
+    settings.numThreads = m_project->numThreads();
+
+    auto watcher = new QFutureWatcher<PCDMGridSearch::Result>(this);
+    connect(watcher, &QFutureWatcher<PCDMGridSearch::Result>::finished, [this, watcher] ()
+    {
+        watcher->deleteLater();
+        const auto result = watcher->result();
+
+        emit m_stateHelper->computingEnded();
+
+        if (result.status == PCDMGridSearch::Status::errOutOfMemory)
+        {
+            QMessageBox::warning(this, title,
+                "Not enough main memory for the grid search. Please try to close other "
+                "applications, or choose a smaller model setup.");
+            return;
+        }
+        if (result.status != PCDMGridSearch::Status::finished || result.candidates.empty())
+        {
+            QMessageBox::critical(this, title,
+                "An unexpected error occurred in the modeling back-end.");
+            return;
+        }
+
+        m_visGenerator->showGridSearchResult(result);
+        sourceParametersToUi(result.candidates.front().parameters);
+
+        QString summary = "Best candidates (X0, Y0, Depth: misfit):\n";
+        for (const auto & candidate : result.candidates)
+        {
+            const auto & p = candidate.parameters;
+            summary += QString("%1, %2, %3: %4\n")
+                .arg(p.horizontalCoord[0]).arg(p.horizontalCoord[1]).arg(p.depth).arg(candidate.misfit);
+        }
+        summary += "\nThe best candidate is set as current parameters. Use \"Fit to Observations\" "
+            "to refine it.";
+        QMessageBox::information(this, title, summary);
+    });
+
+    emit m_stateHelper->computingModel();
+    const auto search = std::make_shared<const PCDMGridSearch>(std::move(observations));
+    watcher->setFuture(QtConcurrent::run([search, settings] ()
+    {
+        return search->run(settings);
+    }));
+}
+
 void PCDMWidget::sourceParametersToUi(const pCDM::PointCDMParameters & parameters)
 {
     m_ui->positionXSpinBox->setValue(parameters.horizontalCoord[0]);
@@ -968,6 +1510,7 @@ void PCDMWidget::resetToSelectedModel()
         return;
     }
 
+    stopPlayback();
     sourceParametersToUi(model->parameters());
     m_project->setLastModelTimestamp(model->timestamp());
     m_visGenerator->setModel(*model);
@@ -995,6 +1538,9 @@ void PCDMWidget::deleteSelectedModel()
         return;
     }
 
+    // Prefetched results reference files of the models.
+    stopPlayback();
+
     const QSignalBlocker signalBlocker(m_ui->savedModelsTable);
 
     for (auto && item : selection)
@@ -1006,3 +1552,116 @@ void PCDMWidget::deleteSelectedModel()
 
     updateModelsList();
 }
+
+void PCDMWidget::compareSelectedModels()
+{
+    const auto selection = m_ui->savedModelsTable->selectionModel()->selectedRows();
+    if (selection.isEmpty())
+    {
+        return;
+    }
+    assert(m_project);
+
+    std::vector<PCDMModel *> models;
+    QStringList withoutResults;
+    for (auto && item : selection)
+    {
+        const int row = item.row();
+        const auto timestamp = m_ui->savedModelsTable->item(row, 0)->data(Qt::DisplayRole).toDateTime();
+        auto model = m_project->model(timestamp);
+        assert(model);
+        if (!model->hasResults())
+        {
+            withoutResults << m_ui->savedModelsTable->item(row, 1)->text();
+            continue;
+        }
+        models.push_back(model);
+    }
+
+    if (!withoutResults.isEmpty())
+    {
+        QMessageBox::information(this, "pCDM Project",
+            "Results are not stored for the following models, they are not compared: "
+            + withoutResults.join(", "));
+    }
+
+    m_visGenerator->showComparison(models);
+}
+
+void PCDMWidget::startPlayback()
+{
+    assert(m_project);
+
+    std::vector<PCDMModel *> models;
+    const auto selection = m_ui->savedModelsTable->selectionModel()->selectedRows();
+    for (int row = 0; row < m_ui->savedModelsTable->rowCount(); ++row)
+    {
+        if (selection.size() > 1 && !m_ui->savedModelsTable->selectionModel()->isRowSelected(row, {}))
+        {
+            continue;
+        }
+        const auto timestamp = m_ui->savedModelsTable->item(row, 0)->data(Qt::DisplayRole).toDateTime();
+        if (auto model = m_project->model(timestamp))
+        {
+            models.push_back(model);
+        }
+    }
+    std::sort(models.begin(), models.end(), [] (const PCDMModel * lhs, const PCDMModel * rhs)
+    {
+        return lhs->timestamp() < rhs->timestamp();
+    });
+
+    std::vector<PCDMResultPrefetcher::Loader> loaders;
+    for (auto model : models)
+    {
+        if (auto loader = model->resultsLoader())
+        {
+            loaders.push_back(std::move(loader));
+        }
+    }
+
+    if (loaders.size() < 2)
+    {
+        QMessageBox::information(this, "pCDM Project",
+            "Playback requires at least two models with stored results.");
+        const QSignalBlocker signalBlocker(m_ui->playModelsButton);
+        m_ui->playModelsButton->setChecked(false);
+        return;
+    }
+
+    endLivePreview();
+
+    m_playbackFrame = 0;
+    m_playbackPrefetcher->setFrames(std::move(loaders));
+    m_visGenerator->showDataObject();
+
+    m_playbackTimer->start(1000 / m_ui->playbackRateSpinBox->value());
+}
+
+void PCDMWidget::stopPlayback()
+{
+    m_playbackTimer->stop();
+    m_playbackPrefetcher->setFrames({});
+
+    const QSignalBlocker signalBlocker(m_ui->playModelsButton);
+    m_ui->playModelsButton->setChecked(false);
+}
+
+void PCDMWidget::showNextPlaybackFrame()
+{
+    // Don't block the GUI thread if the frame is still being read, but keep the frame rate for the
+    // following frames.
+    if (!m_playbackPrefetcher->isLoaded(m_playbackFrame))
+    {
+        return;
+    }
+
+    // Frames that cannot be read are skipped.
+    if (auto results = m_playbackPrefetcher->results(m_playbackFrame))
+    {
+        m_visGenerator->setPreview(results);
+    }
+
+    m_playbackFrame = (m_playbackFrame + 1) % m_playbackPrefetcher->numFrames();
+    m_playbackPrefetcher->setPosition(m_playbackFrame);
+}
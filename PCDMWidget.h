@@ -20,6 +20,7 @@
 
 #include <QDateTime>
 #include <QDockWidget>
+#include <QPointer>
 #include <QStringList>
 
 #include <memory>
@@ -29,11 +30,14 @@
 
 class QMenu;
 class QStateMachine;
+class QTimer;
 
 class DataSetFilter;
 class GuiPluginInterface;
 class PCDMModel;
+class PCDMProgressivePreview;
 class PCDMProject;
+class PCDMResultPrefetcher;
 class PCDMVisualizationGenerator;
 class PCDMWidget_StateHelper;
 class Ui_PCDMWidget;
@@ -74,10 +78,48 @@ private:
     void updateSurfaceSummary();
 
     void runModel();
+    /**
+     * Compute the results of model in the background, showing the progress. A computation that is
+     * still running for another model is cancelled.
+     */
+    void requestModelResults(PCDMModel & model);
+    /**
+     * Request a progressive preview of the parameters in the UI, if the live preview is enabled.
+     * Previews of previous parameters are cancelled.
+     */
+    void updatePreview();
+    /** Show the current preview, at most at a fixed frame rate. */
+    void showPreview();
+    /** Discard pending and running preview requests. */
+    void cancelPreview();
+    /**
+     * Store the parameters in the UI as model when leaving the live preview, unless they are
+     * already stored. Previews themselves are not stored.
+     * @param computeResults Also compute results, as when disabling the live preview. Otherwise,
+     *  only the parameters are stored, e.g., before unloading the project.
+     */
+    void storePreviewParameters(bool computeResults);
+    /**
+     * Discard previews when they are replaced, e.g., by playback, or when the project is unloaded.
+     * Parameters of an enabled live preview are stored without computing results.
+     */
+    void endLivePreview();
     void handleModelDone();
     void saveModelDialog();
     void showVisualization();
     void showResidual();
+    /** Fit the source parameters to the observations of the residual view, see PCDMInversion */
+    void fitToObservations();
+    /**
+     * Sample the posterior distribution of the source parameters around the current parameters,
+     * given the observations of the residual view. Samples are stored in the project folder.
+     */
+    void samplePosterior();
+    /**
+     * Search the source location in the extent of the observations of the residual view, see
+     * PCDMGridSearch. The best candidate is set as current parameters.
+     */
+    void runGridSearch();
 
     void sourceParametersToUi(const pCDM::PointCDMParameters & parameters);
     pCDM::PointCDMParameters sourceParametersFromUi() const;
@@ -89,6 +131,16 @@ private:
     void renameSelectedModel();
     void resetToSelectedModel();
     void deleteSelectedModel();
+    void compareSelectedModels();
+    /**
+     * Show the results of the selected models, or of all models if at most one is selected, in
+     * chronological order and in a loop. Results are prefetched in the background, so that frames
+     * are shown without reading them on the GUI thread.
+     */
+    void startPlayback();
+    void stopPlayback();
+    /** Show the current frame if it is prefetched, otherwise try again at the next timer event. */
+    void showNextPlaybackFrame();
 
 private:
     const QString m_settingsGroup;
@@ -104,7 +156,18 @@ private:
     std::unique_ptr<PCDMWidget_StateHelper> m_stateHelper;
     std::unique_ptr<DataSetFilter> m_coordsDataSetFilter;
     std::unique_ptr<PCDMVisualizationGenerator> m_visGenerator;
+    std::unique_ptr<PCDMProgressivePreview> m_preview;
+    std::unique_ptr<PCDMResultPrefetcher> m_playbackPrefetcher;
+    std::unique_ptr<QTimer> m_playbackTimer;
+    size_t m_playbackFrame;
+    /** Delays preview requests until parameter edits pause */
+    std::unique_ptr<QTimer> m_previewDebounceTimer;
+    /** Limits the rate at which previews are shown */
+    std::unique_ptr<QTimer> m_previewFrameTimer;
+    /** Whether a preview level was computed while m_previewFrameTimer was active */
+    bool m_previewPending;
     bool m_firstShowEventHandlingRequired;
 
     std::unique_ptr<PCDMProject> m_project;
+    QPointer<PCDMModel> m_computingModel;
 };
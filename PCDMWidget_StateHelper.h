@@ -32,6 +32,9 @@ signals:
 
     void validSurfaceSaved();
 
+    /** A long running job is started, e.g., an inversion. */
     void computingModel();
+    /** Model results are computed. Parameters can be edited to supersede the computation. */
+    void computingResults();
     void computingEnded();
 };
@@ -0,0 +1,338 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pCDM_kernel.h"
+#include "pCDM_kernel_impl.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+
+#if defined(PCDM_KERNEL_SSE2) || defined(PCDM_KERNEL_AVX2) || defined(PCDM_KERNEL_AVX512)
+#define PCDM_KERNEL_DISPATCH
+#endif
+
+
+#if defined(PCDM_KERNEL_DISPATCH)
+namespace
+{
+
+struct CPUFeatures
+{
+    bool sse2 = false;
+    bool avx2 = false;
+    bool avx512 = false;
+};
+
+CPUFeatures detectCPUFeatures()
+{
+    CPUFeatures features;
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 0);
+    const int maxId = info[0];
+
+    __cpuid(info, 1);
+    features.sse2 = (info[3] & (1 << 26)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool fma = (info[2] & (1 << 12)) != 0;
+
+    // The OS has to save the AVX (YMM) and AVX-512 (opmask, ZMM) registers on context switches.
+    const auto xcr0 = osxsave ? _xgetbv(0) : 0u;
+    const bool osAVX = (xcr0 & 0x6) == 0x6;
+    const bool osAVX512 = (xcr0 & 0xe6) == 0xe6;
+
+    if (maxId >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        features.avx2 = osAVX && fma && (info[1] & (1 << 5)) != 0;
+        features.avx512 = osAVX512 && (info[1] & (1 << 16)) != 0;
+    }
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    features.sse2 = __builtin_cpu_supports("sse2") != 0;
+    features.avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    features.avx512 = __builtin_cpu_supports("avx512f") != 0;
+#endif
+
+    return features;
+}
+
+const CPUFeatures & cpuFeatures()
+{
+    static const CPUFeatures features = detectCPUFeatures();
+    return features;
+}
+
+}
+#endif
+
+
+namespace
+{
+
+/** @return whether the variant is part of this build and the CPU supports it. */
+bool isVariantAvailable(pCDM::KernelVariant variant)
+{
+    switch (variant)
+    {
+    case pCDM::KernelVariant::scalar:
+        return true;
+#if defined(PCDM_KERNEL_SSE2)
+    case pCDM::KernelVariant::sse2:
+        return cpuFeatures().sse2;
+#endif
+#if defined(PCDM_KERNEL_AVX2)
+    case pCDM::KernelVariant::avx2:
+        return cpuFeatures().avx2;
+#endif
+#if defined(PCDM_KERNEL_AVX512)
+    case pCDM::KernelVariant::avx512:
+        return cpuFeatures().avx512;
+#endif
+    default:
+        return false;
+    }
+}
+
+}
+
+
+namespace pCDM
+{
+
+namespace kernels
+{
+
+void dispSurfScalar(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * ue, float * un, float * uv)
+{
+    dispSurf<ScalarTraits<float>>(constants, x, y, begin, end, ue, un, uv);
+}
+
+void dispSurfScalar(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * ue, double * un, double * uv)
+{
+    dispSurf<ScalarTraits<double>>(constants, x, y, begin, end, ue, un, uv);
+}
+
+void dispSurfPartsScalar(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs)
+{
+    dispSurfParts<ScalarTraits<float>>(constants, x, y, begin, end, outputs);
+}
+
+void dispSurfPartsScalar(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs)
+{
+    dispSurfParts<ScalarTraits<double>>(constants, x, y, begin, end, outputs);
+}
+
+void dispSurfPerPTDScalar(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs)
+{
+    dispSurfPerPTD<ScalarTraits<float>>(constants, x, y, begin, end, outputs);
+}
+
+void dispSurfPerPTDScalar(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs)
+{
+    dispSurfPerPTD<ScalarTraits<double>>(constants, x, y, begin, end, outputs);
+}
+
+void dispSurfJacobianScalar(const PCDMJacobianConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs)
+{
+    dispSurfJacobian<ScalarTraits<float>>(constants, x, y, begin, end, outputs);
+}
+
+void dispSurfJacobianScalar(const PCDMJacobianConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs)
+{
+    dispSurfJacobian<ScalarTraits<double>>(constants, x, y, begin, end, outputs);
+}
+
+}
+
+bool isKernelVariantSupported(KernelVariant variant)
+{
+    return isVariantAvailable(variant);
+}
+
+KernelVariant bestKernelVariant()
+{
+    static const KernelVariant best = [] ()
+    {
+        for (auto variant : { KernelVariant::avx512, KernelVariant::avx2, KernelVariant::sse2 })
+        {
+            if (isKernelVariantSupported(variant))
+            {
+                return variant;
+            }
+        }
+        return KernelVariant::scalar;
+    }();
+
+    return best;
+}
+
+template<typename T>
+KernelFunction<T> kernelFunction(KernelVariant variant)
+{
+    if (!isVariantAvailable(variant))
+    {
+        return nullptr;
+    }
+
+    switch (variant)
+    {
+    case KernelVariant::scalar:
+        return static_cast<KernelFunction<T>>(&kernels::dispSurfScalar);
+#if defined(PCDM_KERNEL_SSE2)
+    case KernelVariant::sse2:
+        return static_cast<KernelFunction<T>>(&kernels::dispSurfSSE2);
+#endif
+#if defined(PCDM_KERNEL_AVX2)
+    case KernelVariant::avx2:
+        return static_cast<KernelFunction<T>>(&kernels::dispSurfAVX2);
+#endif
+#if defined(PCDM_KERNEL_AVX512)
+    case KernelVariant::avx512:
+        return static_cast<KernelFunction<T>>(&kernels::dispSurfAVX512);
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+template<typename T>
+PartsKernelFunction<T> partsKernelFunction(KernelVariant variant)
+{
+    if (!isVariantAvailable(variant))
+    {
+        return nullptr;
+    }
+
+    switch (variant)
+    {
+    case KernelVariant::scalar:
+        return static_cast<PartsKernelFunction<T>>(&kernels::dispSurfPartsScalar);
+#if defined(PCDM_KERNEL_SSE2)
+    case KernelVariant::sse2:
+        return static_cast<PartsKernelFunction<T>>(&kernels::dispSurfPartsSSE2);
+#endif
+#if defined(PCDM_KERNEL_AVX2)
+    case KernelVariant::avx2:
+        return static_cast<PartsKernelFunction<T>>(&kernels::dispSurfPartsAVX2);
+#endif
+#if defined(PCDM_KERNEL_AVX512)
+    case KernelVariant::avx512:
+        return static_cast<PartsKernelFunction<T>>(&kernels::dispSurfPartsAVX512);
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+template<typename T>
+PTDKernelFunction<T> ptdKernelFunction(KernelVariant variant)
+{
+    if (!isVariantAvailable(variant))
+    {
+        return nullptr;
+    }
+
+    switch (variant)
+    {
+    case KernelVariant::scalar:
+        return static_cast<PTDKernelFunction<T>>(&kernels::dispSurfPerPTDScalar);
+#if defined(PCDM_KERNEL_SSE2)
+    case KernelVariant::sse2:
+        return static_cast<PTDKernelFunction<T>>(&kernels::dispSurfPerPTDSSE2);
+#endif
+#if defined(PCDM_KERNEL_AVX2)
+    case KernelVariant::avx2:
+        return static_cast<PTDKernelFunction<T>>(&kernels::dispSurfPerPTDAVX2);
+#endif
+#if defined(PCDM_KERNEL_AVX512)
+    case KernelVariant::avx512:
+        return static_cast<PTDKernelFunction<T>>(&kernels::dispSurfPerPTDAVX512);
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+template<typename T>
+JacobianKernelFunction<T> jacobianKernelFunction(KernelVariant variant)
+{
+    if (!isVariantAvailable(variant))
+    {
+        return nullptr;
+    }
+
+    switch (variant)
+    {
+    case KernelVariant::scalar:
+        return static_cast<JacobianKernelFunction<T>>(&kernels::dispSurfJacobianScalar);
+#if defined(PCDM_KERNEL_SSE2)
+    case KernelVariant::sse2:
+        return static_cast<JacobianKernelFunction<T>>(&kernels::dispSurfJacobianSSE2);
+#endif
+#if defined(PCDM_KERNEL_AVX2)
+    case KernelVariant::avx2:
+        return static_cast<JacobianKernelFunction<T>>(&kernels::dispSurfJacobianAVX2);
+#endif
+#if defined(PCDM_KERNEL_AVX512)
+    case KernelVariant::avx512:
+        return static_cast<JacobianKernelFunction<T>>(&kernels::dispSurfJacobianAVX512);
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+template KernelFunction<float> kernelFunction<float>(KernelVariant);
+template KernelFunction<double> kernelFunction<double>(KernelVariant);
+template PartsKernelFunction<float> partsKernelFunction<float>(KernelVariant);
+template PartsKernelFunction<double> partsKernelFunction<double>(KernelVariant);
+template PTDKernelFunction<float> ptdKernelFunction<float>(KernelVariant);
+template PTDKernelFunction<double> ptdKernelFunction<double>(KernelVariant);
+template JacobianKernelFunction<float> jacobianKernelFunction<float>(KernelVariant);
+template JacobianKernelFunction<double> jacobianKernelFunction<double>(KernelVariant);
+
+const char * kernelVariantName(KernelVariant variant)
+{
+    switch (variant)
+    {
+    case KernelVariant::scalar:
+        return "Scalar";
+    case KernelVariant::sse2:
+        return "SSE2";
+    case KernelVariant::avx2:
+        return "AVX2";
+    case KernelVariant::avx512:
+        return "AVX-512";
+    }
+
+    return "";
+}
+
+}
@@ -0,0 +1,199 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#include "pCDM_types.h"
+
+
+namespace pCDM
+{
+
+/**
+ * Parameters of a single point tensile dislocation (PTD) that do not depend on the observation
+ * points.
+ * Kernel constants are plain structs on purpose: they are accessed in translation units that are
+ * compiled for specific instruction sets, which must not instantiate templates shared with other
+ * translation units.
+ */
+struct PTDConstants
+{
+    /** Rotation of the horizontal coordinates into the strike-aligned system of the PTD */
+    t_FP cosBeta;
+    t_FP sinBeta;
+    t_FP sinDip;
+    t_FP cosDip;
+    /** DV / 2 / pi, note: For a PTD M0 = DV*mu! */
+    t_FP scaledDV;
+};
+
+/** Point independent parameters of the three PTDs of a point CDM. PTDs without potency are omitted. */
+struct PCDMConstants
+{
+    t_FP xy0[2];
+    t_FP depth;
+    /** 1 - 2 * nu */
+    t_FP nuScaled;
+    PTDConstants ptds[3];
+    size_t numPTDs;
+};
+
+/**
+ * Source parameters of the displacement derivatives computed by a JacobianKernelFunction, in
+ * output order. Derivatives with respect to the angles omega are per degree.
+ */
+enum class JacobianParameter
+{
+    x0,
+    y0,
+    depth,
+    omegaX,
+    omegaY,
+    omegaZ,
+    dv1,
+    dv2,
+    dv3
+};
+
+const size_t numJacobianParameters = 9;
+/** Displacements (east, north, up), followed by three derivatives per parameter */
+const size_t numJacobianOutputs = 3 + 3 * numJacobianParameters;
+
+/** @return index of the derivative of the displacement component with respect to parameter */
+constexpr size_t jacobianOutput(JacobianParameter parameter, size_t component)
+{
+    return 3 + 3 * static_cast<size_t>(parameter) + component;
+}
+
+/**
+ * Point independent parameters for displacements and their derivatives.
+ * The displacements of a point CDM are linear in its potency tensor M = R * diag(DV) * R^T / 2 / pi,
+ * where the columns of R are the normals of the PTDs. The derivatives with respect to omega and DV
+ * are thus the displacements of the derivatives of M, which are derived once per source.
+ */
+struct PCDMJacobianConstants
+{
+    t_FP xy0[2];
+    t_FP depth;
+    /** 1 - 2 * nu */
+    t_FP nuScaled;
+    /**
+     * Symmetric tensors, each ordered as M00, M11, M22, M01, M02, M12: M, followed by its
+     * derivatives with respect to omega (x, y, z) and DV (1, 2, 3).
+     */
+    t_FP tensors[7][6];
+};
+
+/**
+ * Calculates surface displacements associated with a point CDM for the coordinates in
+ * [begin, end) and writes them to ue, un, uv.
+ * Coordinates are always passed in t_FP. Their offsets to the source position are computed in t_FP
+ * before converting them to the kernel's scalar type T. Thus, single precision kernels remain
+ * accurate for coordinates far from the origin.
+ */
+template<typename T>
+using KernelFunction = void (*)(
+    const PCDMConstants & constants,
+    const t_FP * x, const t_FP * y,
+    size_t begin, size_t end,
+    T * ue, T * un, T * uv);
+
+/**
+ * Calculates surface displacements separated into a part A that is independent of the Poisson's
+ * ratio and a part B that is scaled by constants.nuScaled.
+ * outputs holds 6 arrays: A (east, north, up), B (east, north, up). Called with nuScaled = 1, the
+ * displacements for any Poisson's ratio nu are A + (1 - 2nu) * B.
+ */
+template<typename T>
+using PartsKernelFunction = void (*)(
+    const PCDMConstants & constants,
+    const t_FP * x, const t_FP * y,
+    size_t begin, size_t end,
+    T * const * outputs);
+
+/**
+ * Calculates surface displacement parts (see PartsKernelFunction) of each PTD separately.
+ * outputs holds 18 arrays, ordered as outputs[6 * PTD + 3 * part + component]. The constants have
+ * to contain all three PTDs. Called with unit potencies and nuScaled = 1, this computes the unit
+ * responses of a point CDM, which can be linearly combined to results for any potencies and
+ * Poisson's ratios.
+ */
+template<typename T>
+using PTDKernelFunction = void (*)(
+    const PCDMConstants & constants,
+    const t_FP * x, const t_FP * y,
+    size_t begin, size_t end,
+    T * const * outputs);
+
+/**
+ * Calculates surface displacements and their derivatives with respect to the source parameters in
+ * a single pass. outputs holds numJacobianOutputs arrays, see jacobianOutput.
+ */
+template<typename T>
+using JacobianKernelFunction = void (*)(
+    const PCDMJacobianConstants & constants,
+    const t_FP * x, const t_FP * y,
+    size_t begin, size_t end,
+    T * const * outputs);
+
+/**
+ * Implementations of the surface displacement kernel. All variants that the compiler supports are
+ * part of the build; the variant used for computations is selected at runtime depending on the
+ * features of the CPU.
+ */
+enum class KernelVariant
+{
+    scalar,
+    sse2,
+    avx2,
+    avx512
+};
+
+/** @return whether the variant is part of this build and the CPU supports it. */
+bool isKernelVariantSupported(KernelVariant variant);
+/** @return the fastest kernel variant supported by the build and the CPU. */
+KernelVariant bestKernelVariant();
+/**
+ * @return the implementation of a variant for scalar type T, or nullptr if the variant is not
+ * supported. Implementations are available for float and double.
+ */
+template<typename T>
+KernelFunction<T> kernelFunction(KernelVariant variant);
+/** @return the parts implementation of a variant, or nullptr if the variant is not supported. */
+template<typename T>
+PartsKernelFunction<T> partsKernelFunction(KernelVariant variant);
+/** @return the per PTD implementation of a variant, or nullptr if the variant is not supported. */
+template<typename T>
+PTDKernelFunction<T> ptdKernelFunction(KernelVariant variant);
+/** @return the Jacobian implementation of a variant, or nullptr if the variant is not supported. */
+template<typename T>
+JacobianKernelFunction<T> jacobianKernelFunction(KernelVariant variant);
+const char * kernelVariantName(KernelVariant variant);
+
+extern template KernelFunction<float> kernelFunction<float>(KernelVariant);
+extern template KernelFunction<double> kernelFunction<double>(KernelVariant);
+extern template PartsKernelFunction<float> partsKernelFunction<float>(KernelVariant);
+extern template PartsKernelFunction<double> partsKernelFunction<double>(KernelVariant);
+extern template PTDKernelFunction<float> ptdKernelFunction<float>(KernelVariant);
+extern template PTDKernelFunction<double> ptdKernelFunction<double>(KernelVariant);
+extern template JacobianKernelFunction<float> jacobianKernelFunction<float>(KernelVariant);
+extern template JacobianKernelFunction<double> jacobianKernelFunction<double>(KernelVariant);
+
+}
@@ -0,0 +1,128 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Compiled with the AVX2 instruction set enabled. Only called if the CPU supports it, and FMA,
+// which compilers may use with AVX2 enabled.
+
+#include "pCDM_kernel_impl.h"
+
+#include <immintrin.h>
+
+
+namespace
+{
+
+struct AVX2DoubleTraits
+{
+    using value_type = double;
+    using reg = __m256d;
+    static const size_t width = 4;
+
+    static reg set1(double value) { return _mm256_set1_pd(value); }
+    static reg loadu(const double * ptr) { return _mm256_loadu_pd(ptr); }
+    static reg loadOffset(const t_FP * ptr, t_FP offset) { return sub(loadu(ptr), set1(offset)); }
+    static void storeu(double * ptr, reg a) { _mm256_storeu_pd(ptr, a); }
+    static reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+    static reg sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+    static reg div(reg a, reg b) { return _mm256_div_pd(a, b); }
+    static reg sqrt(reg a) { return _mm256_sqrt_pd(a); }
+};
+
+struct AVX2FloatTraits
+{
+    using value_type = float;
+    using reg = __m256;
+    static const size_t width = 8;
+
+    static reg set1(float value) { return _mm256_set1_ps(value); }
+    static reg loadu(const float * ptr) { return _mm256_loadu_ps(ptr); }
+    static reg loadOffset(const t_FP * ptr, t_FP offset)
+    {
+        // Compute offsets in double precision, then convert both halves to single precision.
+        const auto lower = AVX2DoubleTraits::loadOffset(ptr, offset);
+        const auto upper = AVX2DoubleTraits::loadOffset(ptr + AVX2DoubleTraits::width, offset);
+        return _mm256_insertf128_ps(
+            _mm256_castps128_ps256(_mm256_cvtpd_ps(lower)), _mm256_cvtpd_ps(upper), 1);
+    }
+    static void storeu(float * ptr, reg a) { _mm256_storeu_ps(ptr, a); }
+    static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+    static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+    static reg div(reg a, reg b) { return _mm256_div_ps(a, b); }
+    static reg sqrt(reg a) { return _mm256_sqrt_ps(a); }
+};
+
+}
+
+
+namespace pCDM
+{
+namespace kernels
+{
+
+void dispSurfAVX2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * ue, float * un, float * uv)
+{
+    dispSurf<AVX2FloatTraits>(constants, x, y, begin, end, ue, un, uv);
+}
+
+void dispSurfAVX2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * ue, double * un, double * uv)
+{
+    dispSurf<AVX2DoubleTraits>(constants, x, y, begin, end, ue, un, uv);
+}
+
+void dispSurfPartsAVX2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs)
+{
+    dispSurfParts<AVX2FloatTraits>(constants, x, y, begin, end, outputs);
+}
+
+void dispSurfPartsAVX2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs)
+{
+    dispSurfParts<AVX2DoubleTraits>(constants, x, y, begin, end, outputs);
+}
+
+void dispSurfPerPTDAVX2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs)
+{
+    dispSurfPerPTD<AVX2FloatTraits>(constants, x, y, begin, end, outputs);
+}
+
+void dispSurfPerPTDAVX2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs)
+{
+    dispSurfPerPTD<AVX2DoubleTraits>(constants, x, y, begin, end, outputs);
+}
+
+void dispSurfJacobianAVX2(const PCDMJacobianConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs)
+{
+    dispSurfJacobian<AVX2FloatTraits>(constants, x, y, begin, end, outputs);
+}
+
+void dispSurfJacobianAVX2(const PCDMJacobianConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs)
+{
+    dispSurfJacobian<AVX2DoubleTraits>(constants, x, y, begin, end, outputs);
+}
+
+}
+}
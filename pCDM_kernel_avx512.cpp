@@ -0,0 +1,139 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Compiled with the AVX-512F instruction set enabled. Only called if the CPU supports it.
+
+#include "pCDM_kernel_impl.h"
+
+// GCC 12.1 and 12.2 report the intentionally undefined registers of AVX-512 intrinsics, e.g., the
+// pass-through operand of unmasked conversions, as uninitialized (GCC bug 105593, fixed in 12.3).
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ == 12
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <immintrin.h>
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ == 12
+#pragma GCC diagnostic pop
+#endif
+
+
+namespace
+{
+
+struct AVX512DoubleTraits
+{
+    using value_type = double;
+    using reg = __m512d;
+    static const size_t width = 8;
+
+    static reg set1(double value) { return _mm512_set1_pd(value); }
+    static reg loadu(const double * ptr) { return _mm512_loadu_pd(ptr); }
+    static reg loadOffset(const t_FP * ptr, t_FP offset) { return sub(loadu(ptr), set1(offset)); }
+    static void storeu(double * ptr, reg a) { _mm512_storeu_pd(ptr, a); }
+    static reg add(reg a, reg b) { return _mm512_add_pd(a, b); }
+    static reg sub(reg a, reg b) { return _mm512_sub_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm512_mul_pd(a, b); }
+    static reg div(reg a, reg b) { return _mm512_div_pd(a, b); }
+    static reg sqrt(reg a) { return _mm512_sqrt_pd(a); }
+};
+
+struct AVX512FloatTraits
+{
+    using value_type = float;
+    using reg = __m512;
+    static const size_t width = 16;
+
+    static reg set1(float value) { return _mm512_set1_ps(value); }
+    static reg loadu(const float * ptr) { return _mm512_loadu_ps(ptr); }
+    static reg loadOffset(const t_FP * ptr, t_FP offset)
+    {
+        // Compute offsets in double precision, then convert both halves to single precision.
+        const auto lower = AVX512DoubleTraits::loadOffset(ptr, offset);
+        const auto upper = AVX512DoubleTraits::loadOffset(ptr + AVX512DoubleTraits::width, offset);
+        // _mm512_insertf32x8 would require AVX-512DQ, so insert the upper half as 64 bit lanes.
+        const auto lowerPs = _mm512_castps256_ps512(_mm512_cvtpd_ps(lower));
+        return _mm512_castpd_ps(_mm512_insertf64x4(
+            _mm512_castps_pd(lowerPs), _mm256_castps_pd(_mm512_cvtpd_ps(upper)), 1));
+    }
+    static void storeu(float * ptr, reg a) { _mm512_storeu_ps(ptr, a); }
+    static reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+    static reg sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+    static reg div(reg a, reg b) { return _mm512_div_ps(a, b); }
+    static reg sqrt(reg a) { return _mm512_sqrt_ps(a); }
+};
+
+}
+
+
+namespace pCDM
+{
+namespace kernels
+{
+
+void dispSurfAVX512(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * ue, float * un, float * uv)
+{
+    dispSurf<AVX512FloatTraits>(constants, x, y, begin, end, ue, un, uv);
+}
+
+void dispSurfAVX512(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * ue, double * un, double * uv)
+{
+    dispSurf<AVX512DoubleTraits>(constants, x, y, begin, end, ue, un, uv);
+}
+
+void dispSurfPartsAVX512(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs)
+{
+    dispSurfParts<AVX512FloatTraits>(constants, x, y, begin, end, outputs);
+}
+
+void dispSurfPartsAVX512(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs)
+{
+    dispSurfParts<AVX512DoubleTraits>(constants, x, y, begin, end, outputs);
+}
+
+void dispSurfPerPTDAVX512(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs)
+{
+    dispSurfPerPTD<AVX512FloatTraits>(constants, x, y, begin, end, outputs);
+}
+
+void dispSurfPerPTDAVX512(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs)
+{
+    dispSurfPerPTD<AVX512DoubleTraits>(constants, x, y, begin, end, outputs);
+}
+
+void dispSurfJacobianAVX512(const PCDMJacobianConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs)
+{
+    dispSurfJacobian<AVX512FloatTraits>(constants, x, y, begin, end, outputs);
+}
+
+void dispSurfJacobianAVX512(const PCDMJacobianConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs)
+{
+    dispSurfJacobian<AVX512DoubleTraits>(constants, x, y, begin, end, outputs);
+}
+
+}
+}
@@ -0,0 +1,776 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/**
+ * Generic implementation of the pCDM surface displacement kernel.
+ *
+ * This header is included by the kernel translation units, which are compiled with different
+ * instruction set flags. Everything in here has internal linkage, so that the linker never merges
+ * functions compiled for different instruction sets.
+ */
+
+#include <cassert>
+#include <cmath>
+
+#include "pCDM_kernel.h"
+
+
+namespace
+{
+
+using pCDM::t_FP;
+
+/**
+ * pCDM::jacobianOutput with internal linkage. The linker could otherwise keep an out-of-line copy
+ * of the inline function compiled for an instruction set that the CPU does not support.
+ */
+constexpr size_t jacobianOutputIndex(const pCDM::JacobianParameter parameter, const size_t component)
+{
+    return 3 + 3 * static_cast<size_t>(parameter) + component;
+}
+static_assert(jacobianOutputIndex(pCDM::JacobianParameter::dv3, 2)
+    == pCDM::jacobianOutput(pCDM::JacobianParameter::dv3, 2), "Jacobian output order mismatch");
+
+/**
+ * Lane-wise arithmetic on top of a set of register operations (Traits).
+ * Traits define the scalar type (value_type), register type (reg), the number of lanes (width) and
+ * set1, loadu, storeu, add, sub, mul, div, sqrt.
+ * loadOffset(ptr, offset) loads width values of type t_FP, subtracts offset and converts the
+ * differences to value_type.
+ */
+template<typename Traits>
+struct Batch
+{
+    using value_type = typename Traits::value_type;
+    using reg = typename Traits::reg;
+    static const size_t width = Traits::width;
+
+    reg v;
+
+    static Batch broadcast(t_FP value) { return{ Traits::set1(static_cast<value_type>(value)) }; }
+    static Batch load(const value_type * ptr) { return{ Traits::loadu(ptr) }; }
+    static Batch loadOffset(const t_FP * ptr, t_FP offset) { return{ Traits::loadOffset(ptr, offset) }; }
+    void store(value_type * ptr) const { Traits::storeu(ptr, v); }
+
+    friend Batch operator+(Batch a, Batch b) { return{ Traits::add(a.v, b.v) }; }
+    friend Batch operator-(Batch a, Batch b) { return{ Traits::sub(a.v, b.v) }; }
+    friend Batch operator*(Batch a, Batch b) { return{ Traits::mul(a.v, b.v) }; }
+    friend Batch operator/(Batch a, Batch b) { return{ Traits::div(a.v, b.v) }; }
+    friend Batch sqrt(Batch a) { return{ Traits::sqrt(a.v) }; }
+};
+
+template<typename T>
+struct ScalarTraits
+{
+    using value_type = T;
+    using reg = T;
+    static const size_t width = 1;
+
+    static reg set1(T value) { return value; }
+    static reg loadu(const T * ptr) { return *ptr; }
+    static reg loadOffset(const t_FP * ptr, t_FP offset) { return static_cast<T>(*ptr - offset); }
+    static void storeu(T * ptr, reg a) { *ptr = a; }
+    static reg add(reg a, reg b) { return a + b; }
+    static reg sub(reg a, reg b) { return a - b; }
+    static reg mul(reg a, reg b) { return a * b; }
+    static reg div(reg a, reg b) { return a / b; }
+    static reg sqrt(reg a) { return std::sqrt(a); }
+};
+
+
+/** Kernel constants, broadcasted to all lanes. */
+template<typename V>
+struct BatchConstants
+{
+    explicit BatchConstants(const pCDM::PCDMConstants & constants)
+        : x0{ constants.xy0[0] }
+        , y0{ constants.xy0[1] }
+        , d{ V::broadcast(constants.depth) }
+        , dSq{ V::broadcast(constants.depth * constants.depth) }
+        , one{ V::broadcast(1) }
+    {
+        for (size_t p = 0; p < constants.numPTDs; ++p)
+        {
+            const auto & ptd = constants.ptds[p];
+            ptds[p].cosBeta = V::broadcast(ptd.cosBeta);
+            ptds[p].sinBeta = V::broadcast(ptd.sinBeta);
+            ptds[p].sinDip = V::broadcast(ptd.sinDip);
+            ptds[p].dCosDip = V::broadcast(constants.depth * ptd.cosDip);
+            ptds[p].radialScale = V::broadcast(3 * ptd.scaledDV);
+            ptds[p].scale = V::broadcast(
+                -ptd.scaledDV * ptd.sinDip * ptd.sinDip * constants.nuScaled);
+        }
+    }
+
+    /** The source position remains in t_FP, see pCDM::KernelFunction */
+    t_FP x0, y0;
+    V d, dSq, one;
+
+    struct PTD
+    {
+        V cosBeta, sinBeta, sinDip, dCosDip;
+        /** 3 * DV / 2 / pi */
+        V radialScale;
+        /** -DV / 2 / pi * sin(dip)^2 * (1 - 2nu) */
+        V scale;
+    };
+    PTD ptds[3];
+};
+
+/** Terms that only depend on the distance to the source, shared between the PTDs. */
+template<typename V>
+struct DistanceTerms
+{
+    V invRPow5, c1, c2, c3, c4, c5;
+};
+
+/**
+ * All divisions and powers of r are derived from a single division per lane.
+ * V is a Batch or a Dual of Batches.
+ */
+template<typename V>
+inline DistanceTerms<V> distanceTerms(const V r, const V d, const V one)
+{
+    const V rd = r + d;
+
+    // 1/r and 1/(r+d) from 1/(r*(r+d))
+    const V invRRd = one / (r * rd);
+    const V invR = invRRd * rd;
+    const V invRd = invRRd * r;
+    const V invRSq = invR * invR;
+    const V invRCb = invRSq * invR;
+    const V invRdSq = invRd * invRd;
+
+    DistanceTerms<V> t;
+    t.invRPow5 = invRCb * invRSq;
+    t.c1 = invR * invRdSq;
+    t.c2 = (r + r + r + d) * invRCb * invRdSq * invRd;
+    t.c3 = invRRd;
+    t.c4 = (r + r + d) * invRCb * invRdSq;
+    t.c5 = invRCb - t.c1;
+    return t;
+}
+
+template<typename V>
+inline DistanceTerms<V> distanceTerms(const BatchConstants<V> & c, const V X, const V Y)
+{
+    return distanceTerms(sqrt(X * X + Y * Y + c.dSq), c.d, c.one);
+}
+
+/**
+ * Contribution of a single PTD: radial is the factor of the source-to-point vector (X, Y, d),
+ * ue, un, uv are the terms scaled by (1 - 2nu).
+ *
+ * This evaluates the formulas of the tensile point dislocation (PTD) in an elastic half-space
+ * (Okada, 1985) as in Mehdi Nikkhoo's PTDdispSurf. Terms not scaled by (1 - 2nu) are parallel to
+ * the source-to-point vector, so rotating them into and out of the strike-aligned system cancels
+ * out.
+ */
+template<typename V>
+inline void ptdDisplacements(const typename BatchConstants<V>::PTD & ptd,
+    const DistanceTerms<V> & t, const V X, const V Y,
+    V & radial, V & ue, V & un, V & uv)
+{
+    const V aX = ptd.cosBeta * X - ptd.sinBeta * Y;
+    const V aY = ptd.sinBeta * X + ptd.cosBeta * Y;
+    const V aXSq = aX * aX;
+    const V q = aY * ptd.sinDip - ptd.dCosDip;
+
+    radial = ptd.radialScale * q * q * t.invRPow5;
+
+    // I1, I3, I5 without the (1 - 2nu) factor
+    const V I1 = aY * (t.c1 - aXSq * t.c2);
+    const V I3 = aX * (t.c5 + aY * aY * t.c2);
+    const V I5 = t.c3 - aXSq * t.c4;
+
+    const V e = ptd.scale * I3;
+    const V n = ptd.scale * I1;
+    ue = ptd.cosBeta * e + ptd.sinBeta * n;
+    un = ptd.cosBeta * n - ptd.sinBeta * e;
+    uv = ptd.scale * I5;
+}
+
+/**
+ * Surface displacements associated with a point CDM for the lanes of X, Y (coordinates relative to
+ * the source position), separated into the part independent of the Poisson's ratio (a) and the
+ * part scaled by (1 - 2nu) (b). b includes the factor constants.nuScaled.
+ */
+template<size_t numPTDs, typename V>
+inline void pointDisplacementParts(const BatchConstants<V> & c,
+    const V X, const V Y, V (&a)[3], V (&b)[3])
+{
+    static_assert(numPTDs >= 1, "At least one PTD is required");
+
+    const auto t = distanceTerms(c, X, Y);
+
+    V radial;
+    ptdDisplacements(c.ptds[0], t, X, Y, radial, b[0], b[1], b[2]);
+
+    for (size_t p = 1; p < numPTDs; ++p)
+    {
+        V radialP, ueP, unP, uvP;
+        ptdDisplacements(c.ptds[p], t, X, Y, radialP, ueP, unP, uvP);
+
+        radial = radial + radialP;
+        b[0] = b[0] + ueP;
+        b[1] = b[1] + unP;
+        b[2] = b[2] + uvP;
+    }
+
+    a[0] = radial * X;
+    a[1] = radial * Y;
+    a[2] = radial * c.d;
+}
+
+/** Surface displacements associated with a point CDM: sum of the PTD contributions. */
+template<size_t numPTDs, typename V>
+inline void pointDisplacements(const BatchConstants<V> & c,
+    const V X, const V Y, V (&u)[3])
+{
+    V a[3], b[3];
+    pointDisplacementParts<numPTDs>(c, X, Y, a, b);
+
+    u[0] = a[0] + b[0];
+    u[1] = a[1] + b[1];
+    u[2] = a[2] + b[2];
+}
+
+/**
+ * Surface displacement parts (see pointDisplacementParts) of each PTD separately, ordered as
+ * u[6 * PTD + 3 * part + component].
+ */
+template<size_t numPTDs, typename V>
+inline void pointDisplacementPartsPerPTD(const BatchConstants<V> & c,
+    const V X, const V Y, V (&u)[6 * numPTDs])
+{
+    const auto t = distanceTerms(c, X, Y);
+
+    for (size_t p = 0; p < numPTDs; ++p)
+    {
+        V radial;
+        ptdDisplacements(c.ptds[p], t, X, Y, radial, u[6 * p + 3], u[6 * p + 4], u[6 * p + 5]);
+        u[6 * p + 0] = radial * X;
+        u[6 * p + 1] = radial * Y;
+        u[6 * p + 2] = radial * c.d;
+    }
+}
+
+/**
+ * Evaluate pointFunc(X, Y, outputs) for the coordinates in [begin, end) and store numOutputs
+ * values per coordinate. The kernel constants c provide the source position x0, y0.
+ */
+template<size_t numOutputs, template<typename> class Constants, typename V, typename T,
+    typename PointFunc>
+void forRange(const Constants<V> & c,
+    const t_FP * const x, const t_FP * const y,
+    const size_t begin, const size_t end,
+    T * const * const outputs, PointFunc pointFunc)
+{
+    size_t i = begin;
+    V u[numOutputs];
+
+    for (; i + V::width <= end; i += V::width)
+    {
+        pointFunc(V::loadOffset(x + i, c.x0), V::loadOffset(y + i, c.y0), u);
+        for (size_t o = 0; o < numOutputs; ++o)
+        {
+            u[o].store(outputs[o] + i);
+        }
+    }
+
+    if (i == end)
+    {
+        return;
+    }
+
+    // Remaining points: pad a full batch with copies of the last point.
+    const size_t numRemaining = end - i;
+    t_FP xPad[V::width], yPad[V::width];
+    T uPad[V::width];
+    for (size_t l = 0; l < V::width; ++l)
+    {
+        const size_t src = l < numRemaining ? i + l : end - 1;
+        xPad[l] = x[src];
+        yPad[l] = y[src];
+    }
+    pointFunc(V::loadOffset(xPad, c.x0), V::loadOffset(yPad, c.y0), u);
+    for (size_t o = 0; o < numOutputs; ++o)
+    {
+        u[o].store(uPad);
+        for (size_t l = 0; l < numRemaining; ++l)
+        {
+            outputs[o][i + l] = uPad[l];
+        }
+    }
+}
+
+template<size_t numPTDs, typename V, typename T = typename V::value_type>
+void dispSurfRange(const BatchConstants<V> & c,
+    const t_FP * const x, const t_FP * const y,
+    const size_t begin, const size_t end,
+    T * const ue, T * const un, T * const uv)
+{
+    T * const outputs[3] = { ue, un, uv };
+    forRange<3>(c, x, y, begin, end, outputs, [&c] (const V X, const V Y, V (&u)[3])
+    {
+        pointDisplacements<numPTDs>(c, X, Y, u);
+    });
+}
+
+/** Instantiate the kernel for the number of PTDs with non-zero potency. */
+template<typename Traits, typename T = typename Traits::value_type>
+void dispSurf(const pCDM::PCDMConstants & constants,
+    const t_FP * const x, const t_FP * const y,
+    const size_t begin, const size_t end,
+    T * const ue, T * const un, T * const uv)
+{
+    using V = Batch<Traits>;
+    const BatchConstants<V> c(constants);
+
+    switch (constants.numPTDs)
+    {
+    case 1:
+        return dispSurfRange<1>(c, x, y, begin, end, ue, un, uv);
+    case 2:
+        return dispSurfRange<2>(c, x, y, begin, end, ue, un, uv);
+    case 3:
+        return dispSurfRange<3>(c, x, y, begin, end, ue, un, uv);
+    default:
+        for (size_t i = begin; i < end; ++i)
+        {
+            ue[i] = un[i] = uv[i] = 0;
+        }
+    }
+}
+
+template<size_t numPTDs, typename V, typename T = typename V::value_type>
+void dispSurfPartsRange(const BatchConstants<V> & c,
+    const t_FP * const x, const t_FP * const y,
+    const size_t begin, const size_t end,
+    T * const * const outputs)
+{
+    forRange<6>(c, x, y, begin, end, outputs, [&c] (const V X, const V Y, V (&u)[6])
+    {
+        V a[3], b[3];
+        pointDisplacementParts<numPTDs>(c, X, Y, a, b);
+        for (size_t i = 0; i < 3; ++i)
+        {
+            u[i] = a[i];
+            u[3 + i] = b[i];
+        }
+    });
+}
+
+/** Displacements separated by the influence of the Poisson's ratio, see pCDM::PartsKernelFunction */
+template<typename Traits, typename T = typename Traits::value_type>
+void dispSurfParts(const pCDM::PCDMConstants & constants,
+    const t_FP * const x, const t_FP * const y,
+    const size_t begin, const size_t end,
+    T * const * const outputs)
+{
+    using V = Batch<Traits>;
+    const BatchConstants<V> c(constants);
+
+    switch (constants.numPTDs)
+    {
+    case 1:
+        return dispSurfPartsRange<1>(c, x, y, begin, end, outputs);
+    case 2:
+        return dispSurfPartsRange<2>(c, x, y, begin, end, outputs);
+    case 3:
+        return dispSurfPartsRange<3>(c, x, y, begin, end, outputs);
+    default:
+        for (size_t o = 0; o < 6; ++o)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                outputs[o][i] = 0;
+            }
+        }
+    }
+}
+
+/** Displacement parts of each of the three PTDs, see pCDM::PTDKernelFunction */
+template<typename Traits, typename T = typename Traits::value_type>
+void dispSurfPerPTD(const pCDM::PCDMConstants & constants,
+    const t_FP * const x, const t_FP * const y,
+    const size_t begin, const size_t end,
+    T * const * const outputs)
+{
+    assert(constants.numPTDs == 3);
+
+    using V = Batch<Traits>;
+    const BatchConstants<V> c(constants);
+
+    forRange<18>(c, x, y, begin, end, outputs, [&c] (const V X, const V Y, V (&u)[18])
+    {
+        pointDisplacementPartsPerPTD<3>(c, X, Y, u);
+    });
+}
+
+
+/**
+ * Forward mode dual number: values of a Batch V and their partial derivatives with respect to N
+ * variables.
+ */
+template<typename V, size_t N>
+struct Dual
+{
+    V v;
+    V d[N];
+
+    static Dual constant(const V value)
+    {
+        Dual r;
+        r.v = value;
+        for (auto & derivative : r.d)
+        {
+            derivative = V::broadcast(0);
+        }
+        return r;
+    }
+
+    /** The variable with index i */
+    static Dual variable(const V value, const size_t i)
+    {
+        auto r = constant(value);
+        r.d[i] = V::broadcast(1);
+        return r;
+    }
+
+    friend Dual operator+(const Dual & a, const Dual & b)
+    {
+        Dual r;
+        r.v = a.v + b.v;
+        for (size_t i = 0; i < N; ++i)
+        {
+            r.d[i] = a.d[i] + b.d[i];
+        }
+        return r;
+    }
+
+    friend Dual operator-(const Dual & a, const Dual & b)
+    {
+        Dual r;
+        r.v = a.v - b.v;
+        for (size_t i = 0; i < N; ++i)
+        {
+            r.d[i] = a.d[i] - b.d[i];
+        }
+        return r;
+    }
+
+    friend Dual operator*(const Dual & a, const Dual & b)
+    {
+        Dual r;
+        r.v = a.v * b.v;
+        for (size_t i = 0; i < N; ++i)
+        {
+            r.d[i] = a.d[i] * b.v + a.v * b.d[i];
+        }
+        return r;
+    }
+
+    friend Dual operator*(const Dual & a, const V b)
+    {
+        Dual r;
+        r.v = a.v * b;
+        for (size_t i = 0; i < N; ++i)
+        {
+            r.d[i] = a.d[i] * b;
+        }
+        return r;
+    }
+
+    friend Dual operator/(const Dual & a, const Dual & b)
+    {
+        const V invB = V::broadcast(1) / b.v;
+        Dual r;
+        r.v = a.v * invB;
+        for (size_t i = 0; i < N; ++i)
+        {
+            r.d[i] = (a.d[i] - r.v * b.d[i]) * invB;
+        }
+        return r;
+    }
+};
+
+/** Jacobian kernel constants, broadcasted to all lanes. */
+template<typename V>
+struct JacobianBatchConstants
+{
+    explicit JacobianBatchConstants(const pCDM::PCDMJacobianConstants & constants)
+        : x0{ constants.xy0[0] }
+        , y0{ constants.xy0[1] }
+        , d{ V::broadcast(constants.depth) }
+        , nuScaled{ V::broadcast(constants.nuScaled) }
+        , zero{ V::broadcast(0) }
+        , one{ V::broadcast(1) }
+    {
+        for (size_t i = 0; i < 7; ++i)
+        {
+            const auto & m = constants.tensors[i];
+            tensors[i].m00 = V::broadcast(m[0]);
+            tensors[i].m11 = V::broadcast(m[1]);
+            tensors[i].m22 = V::broadcast(m[2]);
+            tensors[i].m01 = V::broadcast(m[3]);
+            tensors[i].m01x2 = V::broadcast(2 * m[3]);
+            tensors[i].m02x2 = V::broadcast(2 * m[4]);
+            tensors[i].m12x2 = V::broadcast(2 * m[5]);
+        }
+    }
+
+    t_FP x0, y0;
+    V d, nuScaled, zero, one;
+
+    struct Tensor
+    {
+        V m00, m11, m22, m01, m01x2, m02x2, m12x2;
+    };
+    /** See pCDM::PCDMJacobianConstants::tensors */
+    Tensor tensors[7];
+};
+
+/**
+ * Point dependent terms of the displacements as linear function of the potency tensor M, with the
+ * source-to-point vector P = (X, Y, d):
+ *   u = 3 / r^5 * (P^T M P) * P + (1 - 2nu) * B(M00, M11, M01)
+ * B follows from the PTD formulas (see ptdDisplacements) by expressing the strike and dip of each
+ * PTD by its normal n, which is free of singularities for vertical normals.
+ */
+template<typename S>
+struct TensorTerms
+{
+    S X, Y, d, dSq, XX, YY, XY;
+    /** 3 / r^5 */
+    S radialScale;
+    /** Factors of the east, north components of B */
+    S e0, e1, e2, n0, n1, n2;
+    S c3, c4;
+
+    template<typename V>
+    TensorTerms<V> values() const
+    {
+        return{ X.v, Y.v, d.v, dSq.v, XX.v, YY.v, XY.v, radialScale.v,
+            e0.v, e1.v, e2.v, n0.v, n1.v, n2.v, c3.v, c4.v };
+    }
+};
+
+template<typename S>
+inline TensorTerms<S> tensorTerms(const S X, const S Y, const S d, const DistanceTerms<S> & t)
+{
+    TensorTerms<S> terms;
+    terms.X = X;
+    terms.Y = Y;
+    terms.d = d;
+    terms.dSq = d * d;
+    terms.XX = X * X;
+    terms.YY = Y * Y;
+    terms.XY = X * Y;
+    terms.radialScale = t.invRPow5 + t.invRPow5 + t.invRPow5;
+
+    const S c2XX = t.c2 * terms.XX;
+    const S c2YY = t.c2 * terms.YY;
+    const S c5c1 = t.c5 - t.c1;
+    terms.e0 = c2YY - t.c1;
+    terms.e1 = t.c5 + c2YY;
+    terms.e2 = c5c1 - c2XX + c2YY;
+    terms.n0 = t.c5 + c2XX;
+    terms.n1 = c2XX - t.c1;
+    terms.n2 = c5c1 + c2XX - c2YY;
+    terms.c3 = t.c3;
+    terms.c4 = t.c4;
+    return terms;
+}
+
+/** Displacements for the potency tensor m, see TensorTerms */
+template<typename S, typename Tensor, typename V>
+inline void tensorDisplacements(const TensorTerms<S> & t, const Tensor & m, const V nuScaled,
+    S (&u)[3])
+{
+    const S PMP = t.X * (t.X * m.m00 + t.Y * m.m01x2 + t.d * m.m02x2)
+        + t.Y * (t.Y * m.m11 + t.d * m.m12x2)
+        + t.dSq * m.m22;
+    const S radial = t.radialScale * PMP;
+
+    const S Be = t.X * (t.e0 * m.m00 - t.e1 * m.m11) + t.Y * (t.e2 * m.m01);
+    const S Bn = t.Y * (t.n1 * m.m11 - t.n0 * m.m00) + t.X * (t.n2 * m.m01);
+    const S Bv = t.c4 * (t.YY * m.m00 + t.XX * m.m11 - t.XY * m.m01x2) - t.c3 * (m.m00 + m.m11);
+
+    u[0] = radial * t.X + Be * nuScaled;
+    u[1] = radial * t.Y + Bn * nuScaled;
+    u[2] = radial * t.d + Bv * nuScaled;
+}
+
+/**
+ * Displacements and their derivatives, ordered as the outputs of pCDM::JacobianKernelFunction.
+ * Derivatives with respect to the position follow from dual numbers in X, Y, d, all others
+ * from the derivatives of the potency tensor.
+ */
+template<typename V>
+inline void pointDisplacementJacobian(const JacobianBatchConstants<V> & c, const V X, const V Y,
+    V (&u)[pCDM::numJacobianOutputs])
+{
+    // The distance terms only depend on r and d. Derive them with respect to r and d, then apply
+    // the chain rule with dr/dX = X/r, dr/dY = Y/r, dr/dd = d/r.
+    using DR = Dual<V, 2>;
+    const V r = sqrt(X * X + Y * Y + c.d * c.d);
+    const auto tR = distanceTerms(DR::variable(r, 0), DR::variable(c.d, 1), DR::constant(c.one));
+    const V invR = tR.c3.v * (r + c.d);
+    const V drdX = X * invR, drdY = Y * invR, drdd = c.d * invR;
+
+    using D = Dual<V, 3>;
+    const auto chain = [drdX, drdY, drdd] (const DR & f)
+    {
+        D result;
+        result.v = f.v;
+        result.d[0] = f.d[0] * drdX;
+        result.d[1] = f.d[0] * drdY;
+        result.d[2] = f.d[0] * drdd + f.d[1];
+        return result;
+    };
+    DistanceTerms<D> t;
+    t.invRPow5 = chain(tR.invRPow5);
+    t.c1 = chain(tR.c1);
+    t.c2 = chain(tR.c2);
+    t.c3 = chain(tR.c3);
+    t.c4 = chain(tR.c4);
+    t.c5 = chain(tR.c5);
+
+    const auto terms = tensorTerms(D::variable(X, 0), D::variable(Y, 1), D::variable(c.d, 2), t);
+
+    D uDual[3];
+    tensorDisplacements(terms, c.tensors[0], c.nuScaled, uDual);
+
+    using pCDM::JacobianParameter;
+    for (size_t i = 0; i < 3; ++i)
+    {
+        u[i] = uDual[i].v;
+        // X = x - x0, Y = y - y0
+        u[jacobianOutputIndex(JacobianParameter::x0, i)] = c.zero - uDual[i].d[0];
+        u[jacobianOutputIndex(JacobianParameter::y0, i)] = c.zero - uDual[i].d[1];
+        u[jacobianOutputIndex(JacobianParameter::depth, i)] = uDual[i].d[2];
+    }
+
+    const auto values = terms.template values<V>();
+    for (size_t k = 1; k < 7; ++k)
+    {
+        V uK[3];
+        tensorDisplacements(values, c.tensors[k], c.nuScaled, uK);
+        for (size_t i = 0; i < 3; ++i)
+        {
+            u[3 + 3 * (2 + k) + i] = uK[i];
+        }
+    }
+}
+
+/** Displacements and derivatives, see pCDM::JacobianKernelFunction */
+template<typename Traits, typename T = typename Traits::value_type>
+void dispSurfJacobian(const pCDM::PCDMJacobianConstants & constants,
+    const t_FP * const x, const t_FP * const y,
+    const size_t begin, const size_t end,
+    T * const * const outputs)
+{
+    using V = Batch<Traits>;
+    const JacobianBatchConstants<V> c(constants);
+
+    forRange<pCDM::numJacobianOutputs>(c, x, y, begin, end, outputs,
+        [&c] (const V X, const V Y, V (&u)[pCDM::numJacobianOutputs])
+    {
+        pointDisplacementJacobian(c, X, Y, u);
+    });
+}
+
+}
+
+
+namespace pCDM
+{
+namespace kernels
+{
+
+void dispSurfScalar(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * ue, float * un, float * uv);
+void dispSurfScalar(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * ue, double * un, double * uv);
+void dispSurfSSE2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * ue, float * un, float * uv);
+void dispSurfSSE2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * ue, double * un, double * uv);
+void dispSurfAVX2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * ue, float * un, float * uv);
+void dispSurfAVX2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * ue, double * un, double * uv);
+void dispSurfAVX512(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * ue, float * un, float * uv);
+void dispSurfAVX512(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * ue, double * un, double * uv);
+
+void dispSurfPartsScalar(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs);
+void dispSurfPartsScalar(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs);
+void dispSurfPartsSSE2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs);
+void dispSurfPartsSSE2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs);
+void dispSurfPartsAVX2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs);
+void dispSurfPartsAVX2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs);
+void dispSurfPartsAVX512(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs);
+void dispSurfPartsAVX512(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs);
+void dispSurfPerPTDScalar(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs);
+void dispSurfPerPTDScalar(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs);
+void dispSurfPerPTDSSE2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs);
+void dispSurfPerPTDSSE2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs);
+void dispSurfPerPTDAVX2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs);
+void dispSurfPerPTDAVX2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs);
+void dispSurfPerPTDAVX512(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs);
+void dispSurfPerPTDAVX512(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs);
+void dispSurfJacobianScalar(const PCDMJacobianConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs);
+void dispSurfJacobianScalar(const PCDMJacobianConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs);
+void dispSurfJacobianSSE2(const PCDMJacobianConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs);
+void dispSurfJacobianSSE2(const PCDMJacobianConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs);
+void dispSurfJacobianAVX2(const PCDMJacobianConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs);
+void dispSurfJacobianAVX2(const PCDMJacobianConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs);
+void dispSurfJacobianAVX512(const PCDMJacobianConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs);
+void dispSurfJacobianAVX512(const PCDMJacobianConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs);
+
+}
+}
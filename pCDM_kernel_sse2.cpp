@@ -0,0 +1,126 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Compiled with SSE2 support, which is the baseline for x86-64 builds.
+
+#include "pCDM_kernel_impl.h"
+
+#include <emmintrin.h>
+
+
+namespace
+{
+
+struct SSE2DoubleTraits
+{
+    using value_type = double;
+    using reg = __m128d;
+    static const size_t width = 2;
+
+    static reg set1(double value) { return _mm_set1_pd(value); }
+    static reg loadu(const double * ptr) { return _mm_loadu_pd(ptr); }
+    static reg loadOffset(const t_FP * ptr, t_FP offset) { return sub(loadu(ptr), set1(offset)); }
+    static void storeu(double * ptr, reg a) { _mm_storeu_pd(ptr, a); }
+    static reg add(reg a, reg b) { return _mm_add_pd(a, b); }
+    static reg sub(reg a, reg b) { return _mm_sub_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm_mul_pd(a, b); }
+    static reg div(reg a, reg b) { return _mm_div_pd(a, b); }
+    static reg sqrt(reg a) { return _mm_sqrt_pd(a); }
+};
+
+struct SSE2FloatTraits
+{
+    using value_type = float;
+    using reg = __m128;
+    static const size_t width = 4;
+
+    static reg set1(float value) { return _mm_set1_ps(value); }
+    static reg loadu(const float * ptr) { return _mm_loadu_ps(ptr); }
+    static reg loadOffset(const t_FP * ptr, t_FP offset)
+    {
+        // Compute offsets in double precision, then convert both halves to single precision.
+        const auto lower = SSE2DoubleTraits::loadOffset(ptr, offset);
+        const auto upper = SSE2DoubleTraits::loadOffset(ptr + SSE2DoubleTraits::width, offset);
+        return _mm_movelh_ps(_mm_cvtpd_ps(lower), _mm_cvtpd_ps(upper));
+    }
+    static void storeu(float * ptr, reg a) { _mm_storeu_ps(ptr, a); }
+    static reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+    static reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+    static reg div(reg a, reg b) { return _mm_div_ps(a, b); }
+    static reg sqrt(reg a) { return _mm_sqrt_ps(a); }
+};
+
+}
+
+
+namespace pCDM
+{
+namespace kernels
+{
+
+void dispSurfSSE2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * ue, float * un, float * uv)
+{
+    dispSurf<SSE2FloatTraits>(constants, x, y, begin, end, ue, un, uv);
+}
+
+void dispSurfSSE2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * ue, double * un, double * uv)
+{
+    dispSurf<SSE2DoubleTraits>(constants, x, y, begin, end, ue, un, uv);
+}
+
+void dispSurfPartsSSE2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs)
+{
+    dispSurfParts<SSE2FloatTraits>(constants, x, y, begin, end, outputs);
+}
+
+void dispSurfPartsSSE2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs)
+{
+    dispSurfParts<SSE2DoubleTraits>(constants, x, y, begin, end, outputs);
+}
+
+void dispSurfPerPTDSSE2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs)
+{
+    dispSurfPerPTD<SSE2FloatTraits>(constants, x, y, begin, end, outputs);
+}
+
+void dispSurfPerPTDSSE2(const PCDMConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs)
+{
+    dispSurfPerPTD<SSE2DoubleTraits>(constants, x, y, begin, end, outputs);
+}
+
+void dispSurfJacobianSSE2(const PCDMJacobianConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, float * const * outputs)
+{
+    dispSurfJacobian<SSE2FloatTraits>(constants, x, y, begin, end, outputs);
+}
+
+void dispSurfJacobianSSE2(const PCDMJacobianConstants & constants, const t_FP * x, const t_FP * y,
+    size_t begin, size_t end, double * const * outputs)
+{
+    dispSurfJacobian<SSE2DoubleTraits>(constants, x, y, begin, end, outputs);
+}
+
+}
+}
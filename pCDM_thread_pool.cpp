@@ -0,0 +1,317 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pCDM_thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <exception>
+
+
+namespace pCDM
+{
+
+namespace
+{
+
+size_t defaultNumThreads()
+{
+    const auto numCores = static_cast<size_t>(std::thread::hardware_concurrency());
+    return numCores > 1 ? numCores - 1 : 0;
+}
+
+}
+
+
+/**
+ * State of a running parallelFor. Block indices are distributed to one share per participant.
+ * Participants process their own share from the front and steal halves from the end of other
+ * shares.
+ */
+struct ThreadPool::Job
+{
+    struct Share
+    {
+        std::mutex mutex;
+        size_t next = 0;
+        size_t end = 0;
+    };
+
+    Job(size_t count, size_t blockSize, size_t numShares,
+        const std::function<void(size_t, size_t)> & func)
+        : func{ func }
+        , count{ count }
+        , blockSize{ blockSize }
+        , numShares{ numShares }
+        , shares{ new Share[numShares] }
+        , nextShare{ 1 } // share 0 is reserved for the calling thread
+        , remainingBlocks{ (count + blockSize - 1) / blockSize }
+        , exhausted{ false }
+    {
+        const auto numBlocks = remainingBlocks.load();
+        for (size_t s = 0; s < numShares; ++s)
+        {
+            shares[s].next = numBlocks * s / numShares;
+            shares[s].end = numBlocks * (s + 1) / numShares;
+        }
+    }
+
+    bool takeOwn(size_t share, size_t & block)
+    {
+        auto & own = shares[share];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.next == own.end)
+        {
+            return false;
+        }
+        block = own.next++;
+        return true;
+    }
+
+    bool steal(size_t thief, size_t & block)
+    {
+        for (size_t i = 1; i < numShares; ++i)
+        {
+            auto & victim = shares[(thief + i) % numShares];
+            size_t begin, end;
+            {
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (victim.next == victim.end)
+                {
+                    continue;
+                }
+                // Take the back half, rounded up so that single remaining blocks can be stolen.
+                end = victim.end;
+                begin = end - (end - victim.next + 1) / 2;
+                victim.end = begin;
+            }
+
+            block = begin;
+            if (begin + 1 < end)
+            {
+                auto & own = shares[thief];
+                std::lock_guard<std::mutex> lock(own.mutex);
+                own.next = begin + 1;
+                own.end = end;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void process(size_t block)
+    {
+        const auto begin = block * blockSize;
+        const auto end = std::min(count, begin + blockSize);
+        try
+        {
+            func(begin, end);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (!exception)
+            {
+                exception = std::current_exception();
+            }
+        }
+
+        if (remainingBlocks.fetch_sub(1) == 1)
+        {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            done.notify_all();
+        }
+    }
+
+    void participate(size_t share)
+    {
+        size_t block;
+        while (takeOwn(share, block) || steal(share, block))
+        {
+            process(block);
+        }
+        exhausted = true;
+    }
+
+    void waitForCompletion()
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        done.wait(lock, [this] () { return remainingBlocks == 0; });
+    }
+
+    const std::function<void(size_t, size_t)> & func;
+    const size_t count;
+    const size_t blockSize;
+    const size_t numShares;
+    std::unique_ptr<Share[]> shares;
+
+    /** Only accessed while holding the pool's mutex */
+    size_t nextShare;
+    std::atomic<size_t> remainingBlocks;
+    std::atomic<bool> exhausted;
+
+    std::mutex doneMutex;
+    std::condition_variable done;
+    std::exception_ptr exception;
+};
+
+
+ThreadPool::ThreadPool(size_t numThreads)
+    : m_stop{ false }
+{
+    startWorkers(numThreads);
+}
+
+ThreadPool::~ThreadPool()
+{
+    stopWorkers();
+}
+
+ThreadPool & ThreadPool::instance()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+size_t ThreadPool::numThreads() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_workers.size();
+}
+
+void ThreadPool::setNumThreads(size_t numThreads)
+{
+    stopWorkers();
+    startWorkers(numThreads);
+}
+
+void ThreadPool::parallelFor(const size_t count, const size_t blockSize,
+    const std::function<void(size_t, size_t)> & func,
+    const size_t maxThreads)
+{
+    assert(blockSize > 0);
+    if (count == 0)
+    {
+        return;
+    }
+
+    const auto numBlocks = (count + blockSize - 1) / blockSize;
+    auto numShares = std::min(numBlocks, numThreads() + 1);
+    if (maxThreads > 0)
+    {
+        numShares = std::min(numShares, maxThreads);
+    }
+
+    if (numShares <= 1)
+    {
+        for (size_t begin = 0; begin < count; begin += blockSize)
+        {
+            func(begin, std::min(count, begin + blockSize));
+        }
+        return;
+    }
+
+    const auto job = std::make_shared<Job>(count, blockSize, numShares, func);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(job);
+    }
+    m_jobAvailable.notify_all();
+
+    job->participate(0);
+    job->waitForCompletion();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto it = std::find(m_jobs.begin(), m_jobs.end(), job);
+        if (it != m_jobs.end())
+        {
+            m_jobs.erase(it);
+        }
+    }
+
+    if (job->exception)
+    {
+        std::rethrow_exception(job->exception);
+    }
+}
+
+void ThreadPool::startWorkers(size_t numThreads)
+{
+    if (numThreads == 0)
+    {
+        numThreads = defaultNumThreads();
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = false;
+    for (size_t i = 0; i < numThreads; ++i)
+    {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+void ThreadPool::stopWorkers()
+{
+    std::vector<std::thread> workers;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        workers.swap(m_workers);
+    }
+    m_jobAvailable.notify_all();
+
+    for (auto & worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::workerLoop()
+{
+    while (true)
+    {
+        std::shared_ptr<Job> job;
+        size_t share;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_jobAvailable.wait(lock, [this] () { return m_stop || !m_jobs.empty(); });
+            if (m_stop)
+            {
+                return;
+            }
+
+            job = m_jobs.front();
+            share = job->nextShare++;
+            if (share + 1 >= job->numShares || job->exhausted)
+            {
+                // No further participants required
+                m_jobs.pop_front();
+            }
+            if (share >= job->numShares || job->exhausted)
+            {
+                continue;
+            }
+        }
+
+        job->participate(share);
+    }
+}
+
+}
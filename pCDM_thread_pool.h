@@ -0,0 +1,88 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace pCDM
+{
+
+/**
+ * Persistent pool of worker threads for data-parallel loops.
+ *
+ * parallelFor splits an index range into blocks. Each participating thread starts with a
+ * contiguous share of the blocks and steals blocks from the end of other shares when its own share
+ * is done. Thus, the load remains balanced if blocks differ in cost.
+ * The calling thread always participates in its loops, so loops complete even if all workers are
+ * busy. Multiple threads may run loops on the same pool concurrently.
+ */
+class ThreadPool
+{
+public:
+    /** @param numThreads Number of worker threads, 0 to use one less than the number of cores. */
+    explicit ThreadPool(size_t numThreads = 0);
+    ~ThreadPool();
+
+    /** Pool shared by all computations of the plugin */
+    static ThreadPool & instance();
+
+    size_t numThreads() const;
+    /**
+     * Restart the pool with numThreads workers (0: number of cores - 1). Loops currently running
+     * complete with the remaining participants.
+     */
+    void setNumThreads(size_t numThreads);
+
+    /**
+     * Call func(begin, end) for blocks of at most blockSize indices covering [0, count).
+     * Returns when all blocks are processed. Exceptions thrown by func are rethrown here.
+     * @param maxThreads Maximum number of threads working on the loop, including the calling
+     *  thread. 0 to use all workers.
+     */
+    void parallelFor(size_t count, size_t blockSize,
+        const std::function<void(size_t, size_t)> & func,
+        size_t maxThreads = 0);
+
+private:
+    struct Job;
+
+    void startWorkers(size_t numThreads);
+    void stopWorkers();
+    void workerLoop();
+
+private:
+    mutable std::mutex m_mutex;
+    std::condition_variable m_jobAvailable;
+    std::deque<std::shared_ptr<Job>> m_jobs;
+    std::vector<std::thread> m_workers;
+    bool m_stop;
+
+    ThreadPool(const ThreadPool &) = delete;
+    void operator=(const ThreadPool &) = delete;
+};
+
+}
@@ -18,6 +18,8 @@
 
 #include "pCDM_types.h"
 
+#include <algorithm>
+#include <cassert>
 #include <cmath>
 #include <limits>
 
@@ -90,4 +92,166 @@ bool PointCDMParameters::operator!=(const PointCDMParameters & other) const
     return !(*this == other);
 }
 
+
+size_t HorizontalGrid::numColumns() const
+{
+    return extent[1] >= extent[0] ? static_cast<size_t>(extent[1] - extent[0] + 1) : 0u;
+}
+
+size_t HorizontalGrid::numRows() const
+{
+    return extent[3] >= extent[2] ? static_cast<size_t>(extent[3] - extent[2] + 1) : 0u;
+}
+
+size_t HorizontalGrid::numPoints() const
+{
+    return numColumns() * numRows();
+}
+
+void HorizontalGrid::generateCoordinates(const size_t begin, const size_t end,
+    t_FP * const x, t_FP * const y) const
+{
+    assert(end <= numPoints());
+    const auto columns = numColumns();
+
+    auto row = begin / columns;
+    auto column = begin % columns;
+    for (size_t i = begin; i < end; ++row, column = 0)
+    {
+        const auto yRow = origin[1] + static_cast<t_FP>(extent[2] + static_cast<int>(row)) * spacing[1];
+        const auto rowEnd = std::min(end, i + columns - column);
+        for (; i < rowEnd; ++i, ++column)
+        {
+            x[i - begin] = origin[0]
+                + static_cast<t_FP>(extent[0] + static_cast<int>(column)) * spacing[0];
+            y[i - begin] = yRow;
+        }
+    }
+}
+
+bool HorizontalGrid::operator==(const HorizontalGrid & other) const
+{
+    return origin == other.origin
+        && spacing == other.spacing
+        && extent == other.extent;
+}
+
+
+HorizontalCoordinates::HorizontalCoordinates()
+    : m_storage{}
+    , m_columns{}
+    , m_numPoints{ 0 }
+    , m_isValid{ true }
+    , m_grid{}
+    , m_isGrid{ false }
+{
+}
+
+HorizontalCoordinates::HorizontalCoordinates(Columns columns)
+    : HorizontalCoordinates()
+{
+    m_numPoints = columns[0].size();
+    m_isValid = columns[0].size() == columns[1].size();
+
+    auto storage = std::make_shared<const Columns>(std::move(columns));
+    m_columns = { { (*storage)[0].data(), (*storage)[1].data() } };
+    m_storage = std::move(storage);
+}
+
+HorizontalCoordinates::HorizontalCoordinates(const ColumnPointers & columns, const size_t numPoints,
+    std::shared_ptr<const void> storage)
+    : m_storage{ std::move(storage) }
+    , m_columns{ columns }
+    , m_numPoints{ numPoints }
+    , m_isValid{ numPoints == 0 || (columns[0] && columns[1]) }
+    , m_grid{}
+    , m_isGrid{ false }
+{
+}
+
+HorizontalCoordinates::HorizontalCoordinates(const HorizontalGrid & grid)
+    : m_storage{}
+    , m_columns{}
+    , m_numPoints{ grid.numPoints() }
+    , m_isValid{ true }
+    , m_grid{ grid }
+    , m_isGrid{ true }
+{
+}
+
+size_t HorizontalCoordinates::size() const
+{
+    return m_numPoints;
+}
+
+bool HorizontalCoordinates::empty() const
+{
+    return size() == 0;
+}
+
+bool HorizontalCoordinates::isValid() const
+{
+    return m_isValid;
+}
+
+bool HorizontalCoordinates::isGrid() const
+{
+    return m_isGrid;
+}
+
+const HorizontalGrid & HorizontalCoordinates::grid() const
+{
+    assert(m_isGrid);
+    return m_grid;
+}
+
+auto HorizontalCoordinates::columns() const -> const ColumnPointers &
+{
+    return m_columns;
+}
+
+std::array<const t_FP *, 2> HorizontalCoordinates::block(const size_t begin, const size_t end,
+    Columns & buffers) const
+{
+    assert(begin <= end && end <= size());
+    if (!m_isGrid)
+    {
+        return{ { m_columns[0] + begin, m_columns[1] + begin } };
+    }
+
+    for (auto & buffer : buffers)
+    {
+        if (buffer.size() < end - begin)
+        {
+            buffer.resize(end - begin);
+        }
+    }
+    m_grid.generateCoordinates(begin, end, buffers[0].data(), buffers[1].data());
+
+    return{ { buffers[0].data(), buffers[1].data() } };
+}
+
+LineOfSight::LineOfSight()
+    : LineOfSight(std::array<t_FP, 3>{ { 0, 0, 1 } })
+{
+}
+
+LineOfSight::LineOfSight(const std::array<t_FP, 3> & direction, const t_FP wavelength)
+    : direction{ direction }
+    , pointDirections{ { nullptr, nullptr, nullptr } }
+    , wavelength{ wavelength }
+{
+}
+
+bool LineOfSight::hasPointDirections() const
+{
+    return pointDirections[0] && pointDirections[1] && pointDirections[2];
+}
+
+t_FP wrapPhase(const t_FP phase)
+{
+    static const auto pi = std::acos(t_FP(-1));
+    return phase - 2 * pi * std::floor((phase + pi) / (2 * pi));
+}
+
 }
@@ -19,6 +19,8 @@
 #pragma once
 
 #include <array>
+#include <memory>
+#include <vector>
 
 class QString;
 
@@ -28,6 +30,97 @@ namespace pCDM
 
 using t_FP = double;
 
+/**
+ * Regular grid of observation points, as stored in the project's Coordinates.txt.
+ * Points are ordered as in vtkImageData, with the X index varying fastest.
+ */
+struct HorizontalGrid
+{
+    std::array<t_FP, 2> origin;
+    std::array<t_FP, 2> spacing;
+    /** xMin, xMax, yMin, yMax point indices */
+    std::array<int, 4> extent;
+
+    size_t numColumns() const;
+    size_t numRows() const;
+    size_t numPoints() const;
+
+    /**
+     * Generate X and Y of the points [begin, end). X only depends on the column, Y only on the
+     * row, so rows are filled with a constant Y.
+     */
+    void generateCoordinates(size_t begin, size_t end, t_FP * x, t_FP * y) const;
+
+    bool operator==(const HorizontalGrid & other) const;
+};
+
+/**
+ * Horizontal coordinates of the observation points, either as separate X and Y columns or as a
+ * regular grid. Grid coordinates are not stored per point, but generated for blocks of points
+ * when required.
+ * Columns are either owned by the coordinates or reference external storage, e.g., a memory
+ * mapped file, that is kept alive by the coordinates.
+ */
+class HorizontalCoordinates
+{
+public:
+    using Columns = std::array<std::vector<t_FP>, 2>;
+    using ColumnPointers = std::array<const t_FP *, 2>;
+
+    HorizontalCoordinates();
+    explicit HorizontalCoordinates(Columns columns);
+    /**
+     * Reference X and Y columns of numPoints values each. storage keeps the columns valid as long
+     * as the coordinates (or copies of them) exist.
+     */
+    HorizontalCoordinates(const ColumnPointers & columns, size_t numPoints,
+        std::shared_ptr<const void> storage);
+    explicit HorizontalCoordinates(const HorizontalGrid & grid);
+
+    size_t size() const;
+    bool empty() const;
+    /** @return false if the X and Y columns differ in size. */
+    bool isValid() const;
+
+    bool isGrid() const;
+    /** Only valid if isGrid() */
+    const HorizontalGrid & grid() const;
+    /** X and Y columns of size() values, nullptr for grids */
+    const ColumnPointers & columns() const;
+
+    /**
+     * X and Y of the points [begin, end). Columns are referenced directly, grid coordinates are
+     * generated into buffers, which are resized as required.
+     * @return Pointers to X and Y of the point begin.
+     */
+    std::array<const t_FP *, 2> block(size_t begin, size_t end, Columns & buffers) const;
+
+private:
+    std::shared_ptr<const void> m_storage;
+    ColumnPointers m_columns;
+    size_t m_numPoints;
+    bool m_isValid;
+    HorizontalGrid m_grid;
+    bool m_isGrid;
+};
+
+/**
+ * Immutable, reference counted coordinates. Coordinate snapshots are shared between the project,
+ * backends and worker threads without copying them.
+ */
+using SharedHorizontalCoordinates = std::shared_ptr<const HorizontalCoordinates>;
+
+/**
+ * Floating point precision used for computations.
+ * Single precision halves the memory traffic and doubles the SIMD width, double precision should
+ * be used for final results.
+ */
+enum class Precision
+{
+    singlePrecision,
+    doublePrecision
+};
+
 
 struct PointCDMParameters
 {
@@ -54,4 +147,33 @@ struct PointCDMParameters
     bool operator!=(const PointCDMParameters & other) const;
 };
 
+/**
+ * Line of sight of displacement observations, e.g., of InSAR data. Displacements (east, north, up)
+ * are projected onto unit vectors, which are either constant or given per point.
+ */
+struct LineOfSight
+{
+    /** Constant line of sight pointing up, without wavelength */
+    LineOfSight();
+    explicit LineOfSight(const std::array<t_FP, 3> & direction, t_FP wavelength = 0);
+
+    /** Unit vector (east, north, up) used for all points, if pointDirections are not set */
+    std::array<t_FP, 3> direction;
+    /**
+     * East, north and up components of a unit vector per point, e.g., from arrays of the
+     * observation data set. The components are not owned. nullptr to use direction for all points.
+     */
+    std::array<const t_FP *, 3> pointDirections;
+    /**
+     * Radar wavelength in the unit of the displacements. If larger than 0, the wrapped phase
+     * 4 pi d / wavelength of the line of sight displacement d is computed instead of d.
+     */
+    t_FP wavelength;
+
+    bool hasPointDirections() const;
+};
+
+/** @return phase wrapped to [-pi, pi) */
+t_FP wrapPhase(t_FP phase);
+
 }
@@ -18,7 +18,12 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cmath>
+#include <memory>
+#include <type_traits>
 
 #include <PCDMBackend.h>
 
@@ -26,9 +31,44 @@
 using pCDM::t_FP;
 
 
+template<typename Backend>
 class PCDMBackend_test : public ::testing::Test
 {
 public:
+    using Backend_t = Backend;
+    using value_type = typename Backend::value_type;
+
+    static const bool isSinglePrecision = std::is_same<value_type, float>::value;
+
+    /**
+     * Compare results to reference values. Double precision engines have to match in float
+     * precision (as ASSERT_FLOAT_EQ), single precision engines within a relative tolerance.
+     */
+    static ::testing::AssertionResult resultsMatch(t_FP expected, value_type actual,
+        t_FP singlePrecisionTolerance = 1e-5)
+    {
+        if (!isSinglePrecision)
+        {
+            const auto expectedF = static_cast<float>(expected);
+            const auto actualF = static_cast<float>(actual);
+            if (::testing::FloatLE("expected", "actual", expectedF, actualF)
+                && ::testing::FloatLE("actual", "expected", actualF, expectedF))
+            {
+                return ::testing::AssertionSuccess();
+            }
+            return ::testing::AssertionFailure()
+                << "expected " << expected << ", actual " << actual;
+        }
+
+        const auto tolerance = std::abs(expected) * singlePrecisionTolerance;
+        if (std::abs(expected - static_cast<t_FP>(actual)) <= tolerance)
+        {
+            return ::testing::AssertionSuccess();
+        }
+        return ::testing::AssertionFailure()
+            << "expected " << expected << ", actual " << actual << ", tolerance " << tolerance;
+    }
+
     std::array<std::vector<t_FP>, 2> genInputData(
         t_FP minValX, t_FP stepX, t_FP maxValX,
         t_FP minValY, t_FP stepY, t_FP maxValY)
@@ -64,12 +104,15 @@ public:
     }
 };
 
+using BackendTypes = ::testing::Types<PCDMBackend, PCDMBackendFloat>;
+TYPED_TEST_CASE(PCDMBackend_test, BackendTypes);
+
 
-TEST_F(PCDMBackend_test, test1)
+TYPED_TEST(PCDMBackend_test, test1)
 {
-    PCDMBackend backend;
+    typename TestFixture::Backend_t backend;
 
-    auto && input = genInputData(
+    auto && input = this->genInputData(
         -7, 0.1f, 7,
         -5, 0.1f, 5);
 
@@ -107,15 +150,754 @@ TEST_F(PCDMBackend_test, test1)
     ASSERT_EQ(results[1].size(), 14241);
     ASSERT_EQ(results[2].size(), 14241);
 
-    ASSERT_FLOAT_EQ(results[0][0], ue0);
-    ASSERT_FLOAT_EQ(results[1][0], un0);
-    ASSERT_FLOAT_EQ(results[2][0], uv0);
+    ASSERT_TRUE(this->resultsMatch(ue0, results[0][0]));
+    ASSERT_TRUE(this->resultsMatch(un0, results[1][0]));
+    ASSERT_TRUE(this->resultsMatch(uv0, results[2][0]));
+
+    ASSERT_TRUE(this->resultsMatch(ue1, results[0][1]));
+    ASSERT_TRUE(this->resultsMatch(un1, results[1][1]));
+    ASSERT_TRUE(this->resultsMatch(uv1, results[2][1]));
+
+    ASSERT_TRUE(this->resultsMatch(ue14240, results[0][14240]));
+    ASSERT_TRUE(this->resultsMatch(un14240, results[1][14240]));
+    ASSERT_TRUE(this->resultsMatch(uv14240, results[2][14240]));
+}
+
+TYPED_TEST(PCDMBackend_test, resultsAreLinearInPotencies)
+{
+    auto && input = this->genInputData(
+        -7, 0.5f, 7,
+        -5, 0.5f, 5);
+
+    PCDMBackend::Parameters params;
+    params.sourceParameters.horizontalCoord = { 0.5f, -0.25f };
+    params.sourceParameters.depth = 2.75f;
+    params.sourceParameters.omega = { 5, -8, 30 };
+    params.sourceParameters.dv = { 0.00144f, 0.00128f, 0.00072f };
+    params.nu = 0.25f;
+
+    typename TestFixture::Backend_t backend;
+    backend.setHorizontalCoords(input);
+    backend.setParameters(params);
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.run());
+    const auto allResults = backend.results();
+
+    // Displacements are linear in the potencies: the sum of the single PTD results must match
+    // the result of the complete point CDM.
+    std::array<std::vector<typename TestFixture::value_type>, 3> summedResults;
+    for (auto & component : summedResults)
+    {
+        component.resize(input[0].size(), 0);
+    }
+
+    for (size_t i = 0; i < 3; ++i)
+    {
+        auto singleParams = params;
+        singleParams.sourceParameters.dv = { 0, 0, 0 };
+        singleParams.sourceParameters.dv[i] = params.sourceParameters.dv[i];
+
+        typename TestFixture::Backend_t singleBackend;
+        singleBackend.setHorizontalCoords(input);
+        singleBackend.setParameters(singleParams);
+        ASSERT_EQ(PCDMBackend::State::resultsReady, singleBackend.run());
+
+        const auto & singleResults = singleBackend.results();
+        for (size_t c = 0; c < 3; ++c)
+        {
+            ASSERT_EQ(input[0].size(), singleResults[c].size());
+            for (size_t p = 0; p < singleResults[c].size(); ++p)
+            {
+                summedResults[c][p] += singleResults[c][p];
+            }
+        }
+    }
+
+    for (size_t c = 0; c < 3; ++c)
+    {
+        for (size_t p = 0; p < summedResults[c].size(); ++p)
+        {
+            ASSERT_TRUE(this->resultsMatch(allResults[c][p], summedResults[c][p]));
+        }
+    }
+}
+
+TYPED_TEST(PCDMBackend_test, zeroPotenciesAreSkipped)
+{
+    auto && input = this->genInputData(
+        -7, 0.5f, 7,
+        -5, 0.5f, 5);
+
+    PCDMBackend::Parameters params;
+    params.sourceParameters.horizontalCoord = { 0.5f, -0.25f };
+    params.sourceParameters.depth = 2.75f;
+    params.sourceParameters.omega = { 5, -8, 30 };
+    params.sourceParameters.dv = { 0.00144f, 0, 0.00072f };
+    params.nu = 0.25f;
+
+    // Only PTDs with potency are passed to the kernel, in their original order.
+    const auto all = PCDMBackendBase::kernelConstantsFor(params, true);
+    const auto skipped = PCDMBackendBase::kernelConstantsFor(params);
+    ASSERT_EQ(3u, all.numPTDs);
+    ASSERT_EQ(2u, skipped.numPTDs);
+    const std::array<std::array<size_t, 2>, 2> matches = { { { 0, 0 }, { 2, 1 } } };
+    for (const auto & match : matches)
+    {
+        const auto & expected = all.ptds[match[0]];
+        const auto & actual = skipped.ptds[match[1]];
+        EXPECT_EQ(expected.cosBeta, actual.cosBeta);
+        EXPECT_EQ(expected.sinBeta, actual.sinBeta);
+        EXPECT_EQ(expected.sinDip, actual.sinDip);
+        EXPECT_EQ(expected.cosDip, actual.cosDip);
+    }
+
+    // Without potencies, no PTD is evaluated and the displacements are zero.
+    params.sourceParameters.dv = { 0, 0, 0 };
+    ASSERT_EQ(0u, PCDMBackendBase::kernelConstantsFor(params).numPTDs);
+
+    typename TestFixture::Backend_t backend;
+    backend.setHorizontalCoords(input);
+    backend.setParameters(params);
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.run());
+    for (const auto & component : backend.results())
+    {
+        ASSERT_EQ(input[0].size(), component.size());
+        for (const auto value : component)
+        {
+            ASSERT_EQ(0, value);
+        }
+    }
+}
+
+TYPED_TEST(PCDMBackend_test, kernelVariantsMatchScalarKernel)
+{
+    // Also cover incomplete SIMD batches
+    auto && input = this->genInputData(
+        -7, 0.1f, 7,
+        -5, 0.1f, 5);
+    ASSERT_NE(0u, input[0].size() % 8);
+
+    PCDMBackend::Parameters params;
+    params.sourceParameters.horizontalCoord = { 0.5f, -0.25f };
+    params.sourceParameters.depth = 2.75f;
+    params.sourceParameters.omega = { 5, -8, 30 };
+    params.sourceParameters.dv = { 0.00144f, 0.00128f, 0.00072f };
+    params.nu = 0.25f;
+
+    typename TestFixture::Backend_t scalarBackend;
+    ASSERT_TRUE(scalarBackend.setKernelVariant(pCDM::KernelVariant::scalar));
+    scalarBackend.setHorizontalCoords(input);
+    scalarBackend.setParameters(params);
+    ASSERT_EQ(PCDMBackend::State::resultsReady, scalarBackend.run());
+    const auto & expected = scalarBackend.results();
+
+    for (auto variant : {
+        pCDM::KernelVariant::sse2, pCDM::KernelVariant::avx2, pCDM::KernelVariant::avx512 })
+    {
+        typename TestFixture::Backend_t backend;
+        if (!backend.setKernelVariant(variant))
+        {
+            continue;
+        }
+        ASSERT_EQ(variant, backend.kernelVariant());
+
+        backend.setHorizontalCoords(input);
+        backend.setParameters(params);
+        ASSERT_EQ(PCDMBackend::State::resultsReady, backend.run());
+        const auto & results = backend.results();
+
+        for (size_t c = 0; c < 3; ++c)
+        {
+            ASSERT_EQ(expected[c].size(), results[c].size());
+
+            // Variants may differ in rounding, e.g., where MSVC uses fused multiply-add.
+            // Tolerances are relative to the magnitude of the component, as values close to zero
+            // result from cancellation.
+            const auto maxAbsValue = std::abs(*std::max_element(expected[c].begin(), expected[c].end(),
+                [] (typename TestFixture::value_type a, typename TestFixture::value_type b)
+                { return std::abs(a) < std::abs(b); }));
+            const auto tolerance = maxAbsValue * (TestFixture::isSinglePrecision ? 1e-5 : 1e-12);
+
+            for (size_t p = 0; p < expected[c].size(); ++p)
+            {
+                ASSERT_NEAR(expected[c][p], results[c][p], tolerance)
+                    << pCDM::kernelVariantName(variant) << ", component " << c << ", point " << p;
+            }
+        }
+    }
+}
+
+TYPED_TEST(PCDMBackend_test, chunkedEvaluationMatchesRun)
+{
+    // Multiple chunks, the last one incomplete
+    auto && input = this->genInputData(
+        -7, 0.05f, 7,
+        -5, 0.05f, 5);
+    ASSERT_LT(PCDMBackend::chunkSize, input[0].size());
+    ASSERT_NE(0u, input[0].size() % PCDMBackend::chunkSize);
+
+    PCDMBackend::Parameters params;
+    params.sourceParameters.horizontalCoord = { 0.5f, -0.25f };
+    params.sourceParameters.depth = 2.75f;
+    params.sourceParameters.omega = { 5, -8, 30 };
+    params.sourceParameters.dv = { 0.00144f, 0.00128f, 0.00072f };
+    params.nu = 0.25f;
+
+    typename TestFixture::Backend_t backend;
+    backend.setHorizontalCoords(input);
+    backend.setParameters(params);
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.run());
+    const auto expected = backend.results();
+
+    typename TestFixture::Backend_t chunkedBackend;
+    chunkedBackend.setHorizontalCoords(input);
+    chunkedBackend.setParameters(params);
+    std::array<std::vector<t_FP>, 3> results;
+    ASSERT_EQ(PCDMBackend::State::resultsReady, chunkedBackend.runInto(results));
+    ASSERT_EQ(PCDMBackend::State::parametersChanged, chunkedBackend.state());
+
+    for (size_t c = 0; c < 3; ++c)
+    {
+        ASSERT_EQ(expected[c].size(), results[c].size());
+        for (size_t p = 0; p < expected[c].size(); ++p)
+        {
+            ASSERT_EQ(static_cast<t_FP>(expected[c][p]), results[c][p])
+                << "component " << c << ", point " << p;
+        }
+    }
+}
+
+TYPED_TEST(PCDMBackend_test, runIntoCallerOwnedBuffers)
+{
+    auto && input = this->genInputData(
+        -7, 0.05f, 7,
+        -5, 0.05f, 5);
+    const auto numPoints = input[0].size();
+
+    PCDMBackend::Parameters params;
+    params.sourceParameters.horizontalCoord = { 0.5f, -0.25f };
+    params.sourceParameters.depth = 2.75f;
+    params.sourceParameters.omega = { 5, -8, 30 };
+    params.sourceParameters.dv = { 0.00144f, 0.00128f, 0.00072f };
+    params.nu = 0.25f;
+
+    typename TestFixture::Backend_t backend;
+    backend.setHorizontalCoords(input);
+    backend.setParameters(params);
+    std::array<std::vector<t_FP>, 3> expected;
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.runInto(expected));
+
+    // One buffer for all components, as in a memory-mapped file
+    std::vector<t_FP> buffer(3 * numPoints, -1);
+    const std::array<t_FP *, 3> targets = {
+        buffer.data(), buffer.data() + numPoints, buffer.data() + 2 * numPoints };
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.runInto(targets));
+    ASSERT_EQ(PCDMBackend::State::parametersChanged, backend.state());
+
+    // Results stored in the backend are copied.
+    std::vector<t_FP> copied(3 * numPoints, -1);
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.run());
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.runInto(std::array<t_FP *, 3>{
+        copied.data(), copied.data() + numPoints, copied.data() + 2 * numPoints }));
+
+    for (size_t c = 0; c < 3; ++c)
+    {
+        for (size_t p = 0; p < numPoints; ++p)
+        {
+            ASSERT_EQ(expected[c][p], buffer[c * numPoints + p])
+                << "component " << c << ", point " << p;
+            ASSERT_EQ(expected[c][p], copied[c * numPoints + p])
+                << "component " << c << ", point " << p;
+        }
+    }
+}
+
+TYPED_TEST(PCDMBackend_test, lineOfSightProjection)
+{
+    auto && input = this->genInputData(
+        -7, 0.05f, 7,
+        -5, 0.05f, 5);
+    const auto numPoints = input[0].size();
+
+    PCDMBackend::Parameters params;
+    params.sourceParameters.horizontalCoord = { 0.5f, -0.25f };
+    params.sourceParameters.depth = 2.75f;
+    params.sourceParameters.omega = { 5, -8, 30 };
+    params.sourceParameters.dv = { 0.00144f, 0.00128f, 0.00072f };
+    params.nu = 0.25f;
+
+    typename TestFixture::Backend_t backend;
+    backend.setHorizontalCoords(input);
+    backend.setParameters(params);
+    std::array<std::vector<t_FP>, 3> u;
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.runInto(u));
+
+    // Constant direction, and per point directions varying over the swath
+    const pCDM::LineOfSight constantLos(std::array<t_FP, 3>{ { t_FP(-0.6), t_FP(0.1), t_FP(0.79) } });
+    std::array<std::vector<t_FP>, 3> directions;
+    for (auto & component : directions)
+    {
+        component.resize(numPoints);
+    }
+    for (size_t p = 0; p < numPoints; ++p)
+    {
+        const auto incidence = t_FP(0.3) + t_FP(0.4) * static_cast<t_FP>(p) / static_cast<t_FP>(numPoints);
+        directions[0][p] = -std::sin(incidence);
+        directions[1][p] = 0;
+        directions[2][p] = std::cos(incidence);
+    }
+    pCDM::LineOfSight pointLos;
+    pointLos.pointDirections = { directions[0].data(), directions[1].data(), directions[2].data() };
+    pCDM::LineOfSight phaseLos = constantLos;
+    phaseLos.wavelength = t_FP(0.0555);
+
+    std::vector<t_FP> constantValues, pointValues, phases;
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.runLineOfSightInto(constantLos, constantValues));
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.runLineOfSightInto(pointLos, pointValues));
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.runLineOfSightInto(phaseLos, phases));
+    ASSERT_EQ(numPoints, constantValues.size());
+
+    // Projection of results that are stored in the backend
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.run());
+    std::vector<t_FP> storedValues(numPoints);
+    ASSERT_EQ(PCDMBackend::State::resultsReady,
+        backend.runLineOfSightInto(constantLos, storedValues.data()));
+
+    const auto pi = std::acos(t_FP(-1));
+    const auto & l = constantLos.direction;
+    for (size_t p = 0; p < numPoints; ++p)
+    {
+        const auto expected = l[0] * u[0][p] + l[1] * u[1][p] + l[2] * u[2][p];
+        const auto expectedPoint = directions[0][p] * u[0][p] + directions[2][p] * u[2][p];
+        const auto tolerance = std::is_same<typename TestFixture::value_type, float>::value
+            ? t_FP(1e-6) : t_FP(1e-15);
+        ASSERT_NEAR(expected, constantValues[p], tolerance) << "point " << p;
+        ASSERT_NEAR(expected, storedValues[p], tolerance) << "point " << p;
+        ASSERT_NEAR(expectedPoint, pointValues[p], tolerance) << "point " << p;
+
+        ASSERT_LE(-pi, phases[p]);
+        ASSERT_GT(pi, phases[p]);
+        const auto phaseDifference = pCDM::wrapPhase(
+            phases[p] - 4 * pi * expected / phaseLos.wavelength);
+        ASSERT_NEAR(0, phaseDifference, 4 * pi * tolerance / phaseLos.wavelength) << "point " << p;
+    }
+}
+
+TYPED_TEST(PCDMBackend_test, resultsIndependentOfNumThreads)
+{
+    auto && input = this->genInputData(
+        -7, 0.05f, 7,
+        -5, 0.05f, 5);
 
-    ASSERT_FLOAT_EQ(results[0][1], ue1);
-    ASSERT_FLOAT_EQ(results[1][1], un1);
-    ASSERT_FLOAT_EQ(results[2][1], uv1);
+    PCDMBackend::Parameters params;
+    params.sourceParameters.horizontalCoord = { 0.5f, -0.25f };
+    params.sourceParameters.depth = 2.75f;
+    params.sourceParameters.omega = { 5, -8, 30 };
+    params.sourceParameters.dv = { 0.00144f, 0.00128f, 0.00072f };
+    params.nu = 0.25f;
+
+    typename TestFixture::Backend_t singleThreadedBackend;
+    singleThreadedBackend.setNumThreads(1);
+    singleThreadedBackend.setHorizontalCoords(input);
+    singleThreadedBackend.setParameters(params);
+    ASSERT_EQ(PCDMBackend::State::resultsReady, singleThreadedBackend.run());
+
+    typename TestFixture::Backend_t backend;
+    ASSERT_EQ(0u, backend.numThreads());
+    backend.setHorizontalCoords(input);
+    backend.setParameters(params);
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.run());
+
+    ASSERT_EQ(singleThreadedBackend.results(), backend.results());
+}
+
+TYPED_TEST(PCDMBackend_test, sharedCoordinatesAreNotCopied)
+{
+    const pCDM::SharedHorizontalCoordinates coords = std::make_shared<const pCDM::HorizontalCoordinates>(
+        this->genInputData(
+            -7, 0.5f, 7,
+            -5, 0.5f, 5));
+
+    PCDMBackend::Parameters params;
+    params.sourceParameters.horizontalCoord = { 0.5f, -0.25f };
+    params.sourceParameters.depth = 2.75f;
+    params.sourceParameters.omega = { 5, -8, 30 };
+    params.sourceParameters.dv = { 0.00144f, 0.00128f, 0.00072f };
+    params.nu = 0.25f;
+
+    typename TestFixture::Backend_t backend1, backend2;
+    backend1.setHorizontalCoords(coords);
+    backend2.setHorizontalCoords(coords);
+    ASSERT_EQ(coords.get(), &backend1.horizontalCoords());
+    ASSERT_EQ(coords.get(), &backend2.horizontalCoords());
+
+    backend1.setParameters(params);
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend1.run());
+    ASSERT_EQ(coords->size(), backend1.results()[0].size());
+}
+
+TYPED_TEST(PCDMBackend_test, unitResponseCacheOnlyRecomputesGeometryChanges)
+{
+    using value_type = typename TestFixture::value_type;
+
+    auto && input = this->genInputData(
+        -7, 0.1f, 7,
+        -5, 0.1f, 5);
+
+    PCDMBackend::Parameters params;
+    params.sourceParameters.horizontalCoord = { 0.5f, -0.25f };
+    params.sourceParameters.depth = 2.75f;
+    params.sourceParameters.omega = { 5, -8, 30 };
+    params.sourceParameters.dv = { 0.00144f, 0.00128f, 0.00072f };
+    params.nu = 0.25f;
+
+    const auto cache = std::make_shared<PCDMUnitResponseCache>();
+
+    typename TestFixture::Backend_t backend;
+    backend.setUnitResponseCache(cache);
+    backend.setHorizontalCoords(input);
+    backend.setParameters(params);
+    // The first run of a geometry uses the fused kernel.
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.run());
+    ASSERT_FALSE(cache->template responses<value_type>());
+
+    auto checkResults = [&input, &backend] (const PCDMBackend::Parameters & parameters)
+    {
+        typename TestFixture::Backend_t uncachedBackend;
+        uncachedBackend.setHorizontalCoords(input);
+        uncachedBackend.setParameters(parameters);
+        ASSERT_EQ(PCDMBackend::State::resultsReady, uncachedBackend.run());
+        const auto & expected = uncachedBackend.results();
+        const auto & results = backend.results();
+
+        for (size_t c = 0; c < 3; ++c)
+        {
+            ASSERT_EQ(expected[c].size(), results[c].size());
+            const auto maxAbsValue = std::abs(*std::max_element(expected[c].begin(), expected[c].end(),
+                [] (value_type a, value_type b) { return std::abs(a) < std::abs(b); }));
+            const auto tolerance = maxAbsValue * (TestFixture::isSinglePrecision ? 1e-5 : 1e-12);
+            for (size_t p = 0; p < expected[c].size(); ++p)
+            {
+                ASSERT_NEAR(expected[c][p], results[c][p], tolerance)
+                    << "component " << c << ", point " << p;
+            }
+        }
+    };
+    checkResults(params);
+
+    // Only potencies changed: compute the responses, which are reused for further changes
+    params.sourceParameters.dv = { 0.001f, 0.002f, 0.0005f };
+    backend.setParameters(params);
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.run());
+    const auto responses = cache->template responses<value_type>();
+    ASSERT_TRUE(responses);
+    checkResults(params);
+
+    // Only potencies changed, including zero potencies: combine the cached responses
+    params.sourceParameters.dv = { 0.002f, 0, 0.0005f };
+    backend.setParameters(params);
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.run());
+    ASSERT_EQ(responses, cache->template responses<value_type>());
+    checkResults(params);
+
+    // Poisson's ratio changed: the responses are independent of nu
+    params.nu = 0.3f;
+    backend.setParameters(params);
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.run());
+    ASSERT_EQ(responses, cache->template responses<value_type>());
+    checkResults(params);
+
+    // Geometry changed: release the responses and use the fused kernel
+    params.sourceParameters.depth = 3.5f;
+    backend.setParameters(params);
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.run());
+    ASSERT_FALSE(cache->template responses<value_type>());
+    checkResults(params);
+
+    params.sourceParameters.dv = { 0.00144f, 0.00128f, 0.00072f };
+    backend.setParameters(params);
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.run());
+    ASSERT_TRUE(cache->template responses<value_type>());
+    ASSERT_NE(responses, cache->template responses<value_type>());
+    checkResults(params);
+}
+
+TYPED_TEST(PCDMBackend_test, nuPartsCombineToResults)
+{
+    using value_type = typename TestFixture::value_type;
+
+    auto && input = this->genInputData(
+        -7, 0.1f, 7,
+        -5, 0.1f, 5);
+
+    PCDMBackend::Parameters params;
+    params.sourceParameters.horizontalCoord = { 0.5f, -0.25f };
+    params.sourceParameters.depth = 2.75f;
+    params.sourceParameters.omega = { 5, -8, 30 };
+    params.sourceParameters.dv = { 0.00144f, 0.00128f, 0.00072f };
+    params.nu = 0.25f;
+
+    for (const bool cached : { false, true })
+    {
+        typename TestFixture::Backend_t partsBackend;
+        partsBackend.setHorizontalCoords(input);
+        const auto cache = std::make_shared<PCDMUnitResponseCache>();
+        if (cached)
+        {
+            // Responses are computed when the geometry of the previous run is repeated.
+            partsBackend.setUnitResponseCache(cache);
+            auto otherPotencies = params;
+            otherPotencies.sourceParameters.dv = { 0.001f, 0.001f, 0.001f };
+            partsBackend.setParameters(otherPotencies);
+            ASSERT_EQ(PCDMBackend::State::resultsReady, partsBackend.run());
+        }
+        partsBackend.setParameters(params);
+        std::array<std::vector<t_FP>, 6> parts;
+        ASSERT_EQ(PCDMBackend::State::resultsReady, partsBackend.runPartsInto(parts));
+        ASSERT_EQ(cached, !!cache->template responses<value_type>());
+
+        for (const t_FP nu : { 0.25, 0.3, 0.4 })
+        {
+            std::array<std::vector<t_FP>, 3> results;
+            ASSERT_TRUE(PCDMBackendBase::combineParts(parts, nu, results));
+
+            auto nuParams = params;
+            nuParams.nu = nu;
+            typename TestFixture::Backend_t backend;
+            backend.setHorizontalCoords(input);
+            backend.setParameters(nuParams);
+            ASSERT_EQ(PCDMBackend::State::resultsReady, backend.run());
+            const auto & expected = backend.results();
+
+            for (size_t c = 0; c < 3; ++c)
+            {
+                ASSERT_EQ(expected[c].size(), results[c].size());
+                const auto maxAbsValue = std::abs(*std::max_element(expected[c].begin(), expected[c].end(),
+                    [] (value_type a, value_type b) { return std::abs(a) < std::abs(b); }));
+                const auto tolerance = maxAbsValue * (TestFixture::isSinglePrecision ? 1e-5 : 1e-12);
+                for (size_t p = 0; p < expected[c].size(); ++p)
+                {
+                    ASSERT_NEAR(expected[c][p], results[c][p], tolerance)
+                        << "nu " << nu << ", component " << c << ", point " << p;
+                }
+            }
+        }
+    }
+}
+
+TYPED_TEST(PCDMBackend_test, gridCoordinatesMatchExplicitCoordinates)
+{
+    pCDM::HorizontalGrid grid;
+    grid.origin = { -7, -5 };
+    grid.spacing = { 0.1, 0.125 };
+    grid.extent = { 0, 140, -4, 76 };
+    const auto numPoints = grid.numPoints();
+    // Blocks start within rows
+    ASSERT_NE(0u, PCDMBackend::chunkSize % grid.numColumns());
+
+    pCDM::HorizontalCoordinates::Columns columns;
+    for (int row = grid.extent[2]; row <= grid.extent[3]; ++row)
+    {
+        for (int column = grid.extent[0]; column <= grid.extent[1]; ++column)
+        {
+            columns[0].push_back(grid.origin[0] + column * grid.spacing[0]);
+            columns[1].push_back(grid.origin[1] + row * grid.spacing[1]);
+        }
+    }
+    ASSERT_EQ(numPoints, columns[0].size());
+
+    const pCDM::HorizontalCoordinates gridCoords(grid);
+    ASSERT_TRUE(gridCoords.isGrid());
+    ASSERT_EQ(numPoints, gridCoords.size());
+
+    pCDM::HorizontalCoordinates::Columns buffers;
+    const size_t begin = 1000, end = 1500;
+    const auto xy = gridCoords.block(begin, end, buffers);
+    for (size_t i = begin; i < end; ++i)
+    {
+        ASSERT_EQ(columns[0][i], xy[0][i - begin]) << "point " << i;
+        ASSERT_EQ(columns[1][i], xy[1][i - begin]) << "point " << i;
+    }
+
+    PCDMBackend::Parameters params;
+    params.sourceParameters.horizontalCoord = { 0.5f, -0.25f };
+    params.sourceParameters.depth = 2.75f;
+    params.sourceParameters.omega = { 5, -8, 30 };
+    params.sourceParameters.dv = { 0.00144f, 0.00128f, 0.00072f };
+    params.nu = 0.25f;
+
+    typename TestFixture::Backend_t explicitBackend;
+    explicitBackend.setHorizontalCoords(columns);
+    explicitBackend.setParameters(params);
+    ASSERT_EQ(PCDMBackend::State::resultsReady, explicitBackend.run());
+
+    typename TestFixture::Backend_t gridBackend;
+    gridBackend.setHorizontalCoords(gridCoords);
+    gridBackend.setParameters(params);
+    ASSERT_EQ(PCDMBackend::State::resultsReady, gridBackend.run());
+
+    std::array<std::vector<t_FP>, 3> chunked;
+    typename TestFixture::Backend_t chunkedGridBackend;
+    chunkedGridBackend.setHorizontalCoords(gridCoords);
+    chunkedGridBackend.setParameters(params);
+    ASSERT_EQ(PCDMBackend::State::resultsReady, chunkedGridBackend.runInto(chunked));
+
+    const auto & expected = explicitBackend.results();
+    const auto & results = gridBackend.results();
+    for (size_t c = 0; c < 3; ++c)
+    {
+        ASSERT_EQ(numPoints, results[c].size());
+        for (size_t p = 0; p < numPoints; ++p)
+        {
+            ASSERT_EQ(expected[c][p], results[c][p]) << "component " << c << ", point " << p;
+            ASSERT_EQ(static_cast<t_FP>(expected[c][p]), chunked[c][p])
+                << "component " << c << ", point " << p;
+        }
+    }
+}
+
+TYPED_TEST(PCDMBackend_test, jacobianMatchesFiniteDifferences)
+{
+    using pCDM::JacobianParameter;
+
+    auto && input = this->genInputData(
+        -7, 0.25f, 7,
+        -5, 0.25f, 5);
+
+    PCDMBackend::Parameters params;
+    params.sourceParameters.horizontalCoord = { 0.5f, -0.25f };
+    params.sourceParameters.depth = 2.75f;
+    params.sourceParameters.dv = { 0.00144f, 0.00128f, 0.00072f };
+    params.nu = 0.3f;
+
+    /** Parameter of the source parameters, in the order of pCDM::JacobianParameter */
+    const auto parameter = [] (PCDMBackend::Parameters & p, size_t index) -> t_FP &
+    {
+        auto & s = p.sourceParameters;
+        switch (index)
+        {
+        case 0: case 1: return s.horizontalCoord[index];
+        case 2: return s.depth;
+        case 3: case 4: case 5: return s.omega[index - 3];
+        default: return s.dv[index - 6];
+        }
+    };
+    const t_FP steps[pCDM::numJacobianParameters] = {
+        1e-4, 1e-4, 1e-4, 1e-3, 1e-3, 1e-3, 1e-6, 1e-6, 1e-6 };
+
+    // Vertical PTD normals (all angles zero) are a special case of the strike computation.
+    for (const auto omega : { std::array<t_FP, 3>{ { 5, -8, 30 } }, std::array<t_FP, 3>{ { 0, 0, 0 } } })
+    {
+        params.sourceParameters.omega = omega;
+
+        typename TestFixture::Backend_t backend;
+        backend.setHorizontalCoords(input);
+        backend.setParameters(params);
+        typename TestFixture::Backend_t::JacobianOutputs outputs;
+        ASSERT_EQ(PCDMBackend::State::resultsReady, backend.runJacobianInto(outputs));
+
+        PCDMBackend reference;
+        reference.setHorizontalCoords(input);
+        reference.setParameters(params);
+        ASSERT_EQ(PCDMBackend::State::resultsReady, reference.run());
+        for (size_t c = 0; c < 3; ++c)
+        {
+            const auto & expected = reference.results()[c];
+            const auto maxAbsValue = std::abs(*std::max_element(expected.begin(), expected.end(),
+                [] (t_FP a, t_FP b) { return std::abs(a) < std::abs(b); }));
+            const auto tolerance = maxAbsValue * (TestFixture::isSinglePrecision ? 1e-5 : 1e-12);
+            for (size_t p = 0; p < expected.size(); ++p)
+            {
+                ASSERT_NEAR(expected[p], outputs[c][p], tolerance)
+                    << "component " << c << ", point " << p;
+            }
+        }
+
+        // Central differences in double precision
+        for (size_t i = 0; i < pCDM::numJacobianParameters; ++i)
+        {
+            auto lower = params, upper = params;
+            parameter(lower, i) -= steps[i];
+            parameter(upper, i) += steps[i];
+            PCDMBackend lowerBackend, upperBackend;
+            lowerBackend.setHorizontalCoords(input);
+            lowerBackend.setParameters(lower);
+            upperBackend.setHorizontalCoords(input);
+            upperBackend.setParameters(upper);
+            ASSERT_EQ(PCDMBackend::State::resultsReady, lowerBackend.run());
+            ASSERT_EQ(PCDMBackend::State::resultsReady, upperBackend.run());
+
+            for (size_t c = 0; c < 3; ++c)
+            {
+                const auto & derivatives =
+                    outputs[pCDM::jacobianOutput(static_cast<JacobianParameter>(i), c)];
+                std::vector<t_FP> expected(derivatives.size());
+                t_FP maxAbsValue = 0;
+                for (size_t p = 0; p < expected.size(); ++p)
+                {
+                    expected[p] = (upperBackend.results()[c][p] - lowerBackend.results()[c][p])
+                        / (2 * steps[i]);
+                    maxAbsValue = std::max(maxAbsValue, std::abs(expected[p]));
+                }
+                const auto tolerance = maxAbsValue * (TestFixture::isSinglePrecision ? 1e-4 : 1e-6);
+                for (size_t p = 0; p < expected.size(); ++p)
+                {
+                    ASSERT_NEAR(expected[p], derivatives[p], tolerance)
+                        << "parameter " << i << ", component " << c << ", point " << p;
+                }
+            }
+        }
+    }
+}
+
+TYPED_TEST(PCDMBackend_test, progressCallbackReportsAndCancels)
+{
+    auto && input = this->genInputData(
+        -7, 0.05f, 7,
+        -5, 0.05f, 5);
+    const auto numTuples = input[0].size();
+
+    PCDMBackend::Parameters params;
+    params.sourceParameters.horizontalCoord = { 0.5f, -0.25f };
+    params.sourceParameters.depth = 2.75f;
+    params.sourceParameters.omega = { 5, -8, 30 };
+    params.sourceParameters.dv = { 0.00144f, 0.00128f, 0.00072f };
+    params.nu = 0.25f;
+
+    typename TestFixture::Backend_t backend;
+    backend.setHorizontalCoords(input);
+    backend.setParameters(params);
+
+    std::atomic<size_t> maxProcessed{ 0 };
+    std::atomic<size_t> numCalls{ 0 };
+    backend.setProgressCallback([&maxProcessed, &numCalls, numTuples] (size_t numProcessed, size_t numTotal)
+    {
+        EXPECT_EQ(numTuples, numTotal);
+        ++numCalls;
+        auto previous = maxProcessed.load();
+        while (numProcessed > previous && !maxProcessed.compare_exchange_weak(previous, numProcessed))
+        {
+        }
+        return true;
+    });
+    std::array<std::vector<t_FP>, 3> results;
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.runInto(results));
+    ASSERT_EQ(numTuples, maxProcessed.load());
+    ASSERT_EQ((numTuples + PCDMBackend::chunkSize - 1) / PCDMBackend::chunkSize, numCalls.load());
+
+    // Cancel after the first block: the remaining blocks are skipped.
+    numCalls = 0;
+    backend.setProgressCallback([&numCalls] (size_t, size_t)
+    {
+        ++numCalls;
+        return false;
+    });
+    backend.setNumThreads(1);
+    ASSERT_EQ(PCDMBackend::State::cancelled, backend.run());
+    ASSERT_EQ(PCDMBackend::State::cancelled, backend.state());
+    ASSERT_EQ(1u, numCalls.load());
 
-    ASSERT_FLOAT_EQ(results[0][14240], ue14240);
-    ASSERT_FLOAT_EQ(results[1][14240], un14240);
-    ASSERT_FLOAT_EQ(results[2][14240], uv14240);
+    // The next run starts over.
+    backend.setProgressCallback(nullptr);
+    ASSERT_EQ(PCDMBackend::State::resultsReady, backend.run());
+    ASSERT_EQ(numTuples, backend.results()[0].size());
 }
@@ -0,0 +1,198 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+
+#include <PCDMBatchBackend.h>
+
+
+using pCDM::t_FP;
+
+
+template<typename Backend>
+class PCDMBatchBackend_test : public ::testing::Test
+{
+public:
+    using Backend_t = Backend;
+    using value_type = typename Backend::value_type;
+    using SingleBackend_t = PCDMBackendT<value_type>;
+
+    /** Regular grid with multiple point blocks, the last one incomplete */
+    static pCDM::SharedHorizontalCoordinates genCoordinates()
+    {
+        pCDM::HorizontalGrid grid;
+        grid.origin = { -7, -5 };
+        grid.spacing = { 0.1, 0.1 };
+        grid.extent = { 0, 140, 0, 100 };
+        return std::make_shared<const pCDM::HorizontalCoordinates>(grid);
+    }
+
+    /** Parameter sets spanning multiple parameter tiles */
+    static std::vector<pCDM::PointCDMParameters> genParameters(size_t numSets)
+    {
+        std::vector<pCDM::PointCDMParameters> parameters(numSets);
+        for (size_t s = 0; s < numSets; ++s)
+        {
+            auto & p = parameters[s];
+            p.horizontalCoord = { 0.5 + 0.01 * s, -0.25 };
+            p.depth = 2.75 + 0.005 * s;
+            p.omega = { 5, -8, 30 };
+            p.dv = { 0.00144, 0.00128, 0.00072 };
+        }
+        return parameters;
+    }
+};
+
+using BatchBackendTypes = ::testing::Types<PCDMBatchBackend, PCDMBatchBackendFloat>;
+TYPED_TEST_CASE(PCDMBatchBackend_test, BatchBackendTypes);
+
+
+TYPED_TEST(PCDMBatchBackend_test, fieldsMatchSingleEvaluations)
+{
+    const auto coords = this->genCoordinates();
+    ASSERT_NE(0u, coords->size() % TestFixture::Backend_t::pointBlockSize);
+    auto parameters = this->genParameters(TestFixture::Backend_t::parameterTileSize + 3);
+    // Negative depths are invalid.
+    parameters[2].depth = -1;
+
+    typename TestFixture::Backend_t batch;
+    batch.setHorizontalCoords(coords);
+    batch.setPoissonsRatio(0.3);
+    std::vector<typename TestFixture::Backend_t::Fields> fields;
+    ASSERT_EQ(PCDMBackend::State::resultsReady, batch.evaluateFields(parameters, fields));
+    ASSERT_EQ(parameters.size(), fields.size());
+
+    for (size_t s = 0; s < parameters.size(); ++s)
+    {
+        if (s == 2)
+        {
+            for (const auto & component : fields[s])
+            {
+                ASSERT_EQ(coords->size(), component.size());
+                ASSERT_TRUE(std::isnan(component.front()));
+            }
+            continue;
+        }
+
+        typename TestFixture::SingleBackend_t backend;
+        backend.setHorizontalCoords(coords);
+        backend.setParameters({ parameters[s], 0.3 });
+        ASSERT_EQ(PCDMBackend::State::resultsReady, backend.run());
+
+        for (size_t c = 0; c < 3; ++c)
+        {
+            ASSERT_EQ(backend.results()[c], fields[s][c]) << "set " << s << ", component " << c;
+        }
+    }
+}
+
+TYPED_TEST(PCDMBatchBackend_test, misfitsMatchFields)
+{
+    const auto coords = this->genCoordinates();
+    const auto numTuples = coords->size();
+    auto parameters = this->genParameters(TestFixture::Backend_t::parameterTileSize + 3);
+    parameters[5].depth = -1;
+
+    typename TestFixture::Backend_t batch;
+    batch.setHorizontalCoords(coords);
+    std::vector<typename TestFixture::Backend_t::Fields> fields;
+    ASSERT_EQ(PCDMBackend::State::resultsReady, batch.evaluateFields(parameters, fields));
+
+    // Observe the field of set 0 with an offset, and no vertical displacements.
+    typename TestFixture::Backend_t::Observations observations;
+    for (size_t c = 0; c < 2; ++c)
+    {
+        observations.values[c].resize(numTuples);
+        for (size_t i = 0; i < numTuples; ++i)
+        {
+            observations.values[c][i] = fields[0][c][i] + 1e-6 * (c + 1);
+        }
+    }
+    observations.weights[1].assign(numTuples, 4);
+
+    std::vector<t_FP> misfits;
+    ASSERT_EQ(PCDMBackend::State::resultsReady, batch.evaluateMisfits(parameters, observations, misfits));
+    ASSERT_EQ(parameters.size(), misfits.size());
+    ASSERT_TRUE(std::isinf(misfits[5]));
+
+    for (size_t s = 0; s < parameters.size(); ++s)
+    {
+        if (s == 5)
+        {
+            continue;
+        }
+        t_FP expected = 0;
+        for (size_t c = 0; c < 2; ++c)
+        {
+            const t_FP weight = c == 1 ? 4 : 1;
+            for (size_t i = 0; i < numTuples; ++i)
+            {
+                const auto residual = observations.values[c][i] - static_cast<t_FP>(fields[s][c][i]);
+                expected += weight * residual * residual;
+            }
+        }
+        ASSERT_NEAR(expected, misfits[s], expected * 1e-10) << "set " << s;
+    }
+
+    // Sums are reduced in a fixed order.
+    batch.setNumThreads(1);
+    std::vector<t_FP> singleThreadedMisfits;
+    ASSERT_EQ(PCDMBackend::State::resultsReady,
+        batch.evaluateMisfits(parameters, observations, singleThreadedMisfits));
+    ASSERT_EQ(misfits, singleThreadedMisfits);
+
+    // Observations have to match the coordinates.
+    observations.weights[0].resize(10);
+    ASSERT_EQ(PCDMBackend::State::invalidParameters,
+        batch.evaluateMisfits(parameters, observations, misfits));
+}
+
+TYPED_TEST(PCDMBatchBackend_test, lineOfSightMisfitsMatchFields)
+{
+    const auto coords = this->genCoordinates();
+    const auto numTuples = coords->size();
+    const auto parameters = this->genParameters(3);
+
+    typename TestFixture::Backend_t batch;
+    batch.setHorizontalCoords(coords);
+    std::vector<typename TestFixture::Backend_t::Fields> fields;
+    ASSERT_EQ(PCDMBackend::State::resultsReady, batch.evaluateFields(parameters, fields));
+
+    typename TestFixture::Backend_t::Observations observations;
+    observations.lineOfSight = { 0.6, 0, 0.8 };
+    observations.lineOfSightValues.assign(numTuples, 1e-5);
+    observations.lineOfSightWeights.assign(numTuples, 0.5);
+
+    std::vector<t_FP> misfits;
+    ASSERT_EQ(PCDMBackend::State::resultsReady, batch.evaluateMisfits(parameters, observations, misfits));
+
+    for (size_t s = 0; s < parameters.size(); ++s)
+    {
+        t_FP expected = 0;
+        for (size_t i = 0; i < numTuples; ++i)
+        {
+            const auto residual = 1e-5 - (0.6 * static_cast<t_FP>(fields[s][0][i])
+                + 0.8 * static_cast<t_FP>(fields[s][2][i]));
+            expected += 0.5 * residual * residual;
+        }
+        ASSERT_NEAR(expected, misfits[s], expected * 1e-10) << "set " << s;
+    }
+}
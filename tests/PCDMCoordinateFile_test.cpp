@@ -0,0 +1,114 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include <QFile>
+#include <QTemporaryDir>
+
+#include <PCDMCoordinateFile.h>
+
+
+using pCDM::t_FP;
+
+
+class PCDMCoordinateFile_test : public ::testing::Test
+{
+public:
+    void SetUp() override
+    {
+        ASSERT_TRUE(m_dir.isValid());
+    }
+
+    QString filePath(const QString & fileName) const
+    {
+        return m_dir.path() + "/" + fileName;
+    }
+
+    static pCDM::HorizontalCoordinates::Columns genColumns(size_t numPoints)
+    {
+        pCDM::HorizontalCoordinates::Columns columns;
+        for (size_t i = 0; i < numPoints; ++i)
+        {
+            columns[0].push_back(static_cast<t_FP>(i) * 0.5 - 3);
+            columns[1].push_back(static_cast<t_FP>(i * i) * 0.25);
+        }
+        return columns;
+    }
+
+private:
+    QTemporaryDir m_dir;
+};
+
+
+TEST_F(PCDMCoordinateFile_test, writeAndMap)
+{
+    const auto columns = genColumns(1000);
+    const auto fileName = filePath("coords.bin");
+    ASSERT_TRUE(PCDMCoordinateFile::write(fileName, pCDM::HorizontalCoordinates(columns)));
+
+    auto mapped = PCDMCoordinateFile::map(fileName);
+    ASSERT_TRUE(mapped);
+    ASSERT_TRUE(mapped->isValid());
+    ASSERT_FALSE(mapped->isGrid());
+    ASSERT_EQ(columns[0].size(), mapped->size());
+    for (size_t c = 0; c < 2; ++c)
+    {
+        for (size_t i = 0; i < columns[c].size(); ++i)
+        {
+            ASSERT_EQ(columns[c][i], mapped->columns()[c][i]);
+        }
+    }
+
+    // Blocks of mapped point coordinates reference the mapping.
+    pCDM::HorizontalCoordinates::Columns buffers;
+    const auto xy = mapped->block(10, 20, buffers);
+    ASSERT_EQ(mapped->columns()[0] + 10, xy[0]);
+    ASSERT_EQ(mapped->columns()[1] + 10, xy[1]);
+}
+
+TEST_F(PCDMCoordinateFile_test, rejectsInvalidFiles)
+{
+    const auto fileName = filePath("coords.bin");
+    ASSERT_FALSE(PCDMCoordinateFile::map(fileName));
+
+    pCDM::HorizontalGrid grid;
+    grid.origin = { 0, 0 };
+    grid.spacing = { 1, 1 };
+    grid.extent = { 0, 9, 0, 9 };
+    ASSERT_FALSE(PCDMCoordinateFile::write(fileName, pCDM::HorizontalCoordinates(grid)));
+
+    {
+        QFile file(fileName);
+        ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+        const QByteArray text(256, 'x');
+        ASSERT_EQ(text.size(), file.write(text));
+    }
+    ASSERT_FALSE(PCDMCoordinateFile::map(fileName));
+
+    // Truncated files don't match their header.
+    ASSERT_TRUE(PCDMCoordinateFile::write(fileName, pCDM::HorizontalCoordinates(genColumns(100))));
+    {
+        QFile file(fileName);
+        ASSERT_TRUE(file.resize(file.size() - 8));
+    }
+    ASSERT_FALSE(PCDMCoordinateFile::map(fileName));
+}
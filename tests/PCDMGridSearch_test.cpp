@@ -0,0 +1,118 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include <PCDMGridSearch.h>
+
+#include "PCDMSyntheticObservations.h"
+
+
+using pCDM::t_FP;
+using PCDMSyntheticObservations::trueParameters;
+
+
+class PCDMGridSearch_test : public ::testing::Test
+{
+public:
+    /** Synthetic line of sight observations of trueParameters() */
+    static PCDMObservations genObservations()
+    {
+        return PCDMSyntheticObservations::generate(
+            PCDMSyntheticObservations::defaultGrid(), { 0.6, 0, 0.8 });
+    }
+
+    /** The true position and depth are nodes of the finest lattice. */
+    static PCDMGridSearch::Settings genSettings()
+    {
+        PCDMGridSearch::Settings settings;
+        settings.xRange = { -2, 2 };
+        settings.yRange = { -2, 2 };
+        settings.depthRange = { 1, 5 };
+        settings.divisions = { 8, 8, 4 };
+        settings.numLevels = 4;
+        settings.numRefinedCells = 8;
+        settings.omega = trueParameters().omega;
+        return settings;
+    }
+};
+
+
+TEST_F(PCDMGridSearch_test, findsSourceAndPotencies)
+{
+    const PCDMGridSearch search{ genObservations() };
+    const auto settings = genSettings();
+
+    const auto result = search.run(settings);
+
+    ASSERT_EQ(PCDMGridSearch::Status::finished, result.status);
+    ASSERT_EQ(settings.numCandidates, result.candidates.size());
+    for (size_t c = 1; c < result.candidates.size(); ++c)
+    {
+        EXPECT_LE(result.candidates[c - 1].misfit, result.candidates[c].misfit);
+    }
+
+    const auto expected = trueParameters();
+    const auto & best = result.candidates.front();
+    EXPECT_NEAR(expected.horizontalCoord[0], best.parameters.horizontalCoord[0], 1e-12);
+    EXPECT_NEAR(expected.horizontalCoord[1], best.parameters.horizontalCoord[1], 1e-12);
+    EXPECT_NEAR(expected.depth, best.parameters.depth, 1e-12);
+    EXPECT_EQ(expected.omega, best.parameters.omega);
+    for (size_t k = 0; k < 3; ++k)
+    {
+        EXPECT_NEAR(expected.dv[k], best.parameters.dv[k], 1e-6 * expected.dv[k]);
+    }
+    EXPECT_TRUE(best.parameters.isValid());
+    EXPECT_GT(best.level, 0u);
+
+    // Only refined cells are evaluated on finer levels.
+    EXPECT_EQ(9u * 9u * 5u, result.misfitVolume.size());
+    EXPECT_LT(result.nodes.size(), 65u * 65u * 33u / 10);
+    EXPECT_EQ(0.5, result.volumeSpacing[0]);
+    EXPECT_EQ(1, result.volumeSpacing[2]);
+}
+
+TEST_F(PCDMGridSearch_test, resultsDontDependOnThreads)
+{
+    const PCDMGridSearch search{ genObservations() };
+    auto settings = genSettings();
+    settings.numLevels = 2;
+
+    const auto result = search.run(settings);
+    settings.numThreads = 1;
+    const auto singleThreadedResult = search.run(settings);
+
+    ASSERT_EQ(PCDMGridSearch::Status::finished, result.status);
+    ASSERT_EQ(result.nodes.size(), singleThreadedResult.nodes.size());
+    EXPECT_EQ(result.misfitVolume, singleThreadedResult.misfitVolume);
+    for (size_t n = 0; n < result.nodes.size(); ++n)
+    {
+        EXPECT_EQ(result.nodes[n].misfit, singleThreadedResult.nodes[n].misfit);
+    }
+}
+
+TEST_F(PCDMGridSearch_test, rejectsInvalidSettings)
+{
+    const PCDMGridSearch search{ genObservations() };
+    auto settings = genSettings();
+    settings.depthRange = { -1, 2 };
+
+    EXPECT_EQ(PCDMGridSearch::Status::invalidInput, search.run(settings).status);
+}
@@ -0,0 +1,139 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cmath>
+
+#include <PCDMInversion.h>
+
+#include "PCDMSyntheticObservations.h"
+
+
+using pCDM::t_FP;
+using PCDMSyntheticObservations::trueParameters;
+
+
+class PCDMInversion_test : public ::testing::Test
+{
+public:
+    /** Synthetic line of sight observations of trueParameters() */
+    static PCDMObservations genObservations()
+    {
+        return PCDMSyntheticObservations::generate(
+            PCDMSyntheticObservations::defaultGrid(), { 0.38, -0.08, 0.92 });
+    }
+
+    /** Initial guess off the true location, depth and potencies */
+    static PCDMInversion::Settings genSettings()
+    {
+        PCDMInversion::Settings settings;
+        settings.initialParameters = trueParameters();
+        settings.initialParameters.horizontalCoord = { 0, 0.5 };
+        settings.initialParameters.depth = 3.5;
+        settings.initialParameters.dv = { 0.001, 0.001, 0.001 };
+        return settings;
+    }
+};
+
+
+TEST_F(PCDMInversion_test, recoversSourceParametersWithPointLineOfSight)
+{
+    // Incidence angle varying across the swath
+    auto observations = PCDMSyntheticObservations::generate(
+        PCDMSyntheticObservations::defaultGrid(), { 0, 0, 1 },
+        [] (t_FP x, t_FP /*y*/)
+    {
+        const auto incidence = t_FP(0.3) + t_FP(0.03) * x;
+        return std::array<t_FP, 3>{ { std::sin(incidence), 0, std::cos(incidence) } };
+    });
+    ASSERT_TRUE(observations.isValid());
+
+    const PCDMInversion inversion{ std::move(observations) };
+    auto settings = genSettings();
+    for (auto p : { pCDM::JacobianParameter::omegaX, pCDM::JacobianParameter::omegaY,
+        pCDM::JacobianParameter::omegaZ })
+    {
+        settings.fixed[static_cast<size_t>(p)] = true;
+    }
+
+    const auto result = inversion.run(settings);
+
+    ASSERT_EQ(PCDMInversion::Status::converged, result.status);
+    const auto expected = PCDMInversion::toVector(trueParameters());
+    const auto actual = PCDMInversion::toVector(result.parameters);
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        EXPECT_NEAR(expected[i], actual[i], 1e-5 * std::max(t_FP(1), std::abs(expected[i])))
+            << "Parameter " << i;
+    }
+}
+
+TEST_F(PCDMInversion_test, recoversSourceParameters)
+{
+    const PCDMInversion inversion{ genObservations() };
+    auto settings = genSettings();
+    // Orientations are ambiguous for the potencies (permutations of the PTDs), so keep them fixed.
+    for (auto p : { pCDM::JacobianParameter::omegaX, pCDM::JacobianParameter::omegaY,
+        pCDM::JacobianParameter::omegaZ })
+    {
+        settings.fixed[static_cast<size_t>(p)] = true;
+    }
+
+    const auto result = inversion.run(settings);
+
+    ASSERT_EQ(PCDMInversion::Status::converged, result.status);
+    EXPECT_LT(result.misfit, 1e-12 * result.initialMisfit);
+
+    const auto expected = PCDMInversion::toVector(trueParameters());
+    const auto actual = PCDMInversion::toVector(result.parameters);
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        EXPECT_NEAR(expected[i], actual[i], 1e-5 * std::max(t_FP(1), std::abs(expected[i])))
+            << "Parameter " << i;
+    }
+}
+
+TEST_F(PCDMInversion_test, respectsFixedParametersAndBounds)
+{
+    const PCDMInversion inversion{ genObservations() };
+    auto settings = genSettings();
+    const auto depth = static_cast<size_t>(pCDM::JacobianParameter::depth);
+    const auto omegaZ = static_cast<size_t>(pCDM::JacobianParameter::omegaZ);
+    settings.upperBounds[depth] = 3;
+    settings.lowerBounds[depth] = 3;
+    settings.fixed[omegaZ] = true;
+    settings.initialParameters.omega[2] = 20;
+
+    const auto result = inversion.run(settings);
+
+    ASSERT_NE(PCDMInversion::Status::invalidInput, result.status);
+    EXPECT_LT(result.misfit, result.initialMisfit);
+    EXPECT_EQ(3, result.parameters.depth);
+    EXPECT_EQ(20, result.parameters.omega[2]);
+}
+
+TEST_F(PCDMInversion_test, rejectsInvalidInput)
+{
+    auto observations = genObservations();
+    observations.values.pop_back();
+    const PCDMInversion inversion{ std::move(observations) };
+
+    EXPECT_EQ(PCDMInversion::Status::invalidInput, inversion.run(genSettings()).status);
+}
@@ -0,0 +1,161 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+#include <random>
+
+#include <PCDMLevelOfDetail.h>
+
+
+using pCDM::t_FP;
+
+
+class PCDMLevelOfDetail_test : public ::testing::Test
+{
+public:
+    static pCDM::SharedHorizontalCoordinates genGrid()
+    {
+        pCDM::HorizontalGrid grid;
+        grid.origin = { -10, 5 };
+        grid.spacing = { 0.5, 0.25 };
+        grid.extent = { -100, 156, 10, 138 };
+        return std::make_shared<const pCDM::HorizontalCoordinates>(grid);
+    }
+
+    static pCDM::SharedHorizontalCoordinates genPoints(size_t numPoints)
+    {
+        std::mt19937 engine{ 42 };
+        std::uniform_real_distribution<t_FP> distribution{ -50, 50 };
+        pCDM::HorizontalCoordinates::Columns columns;
+        for (size_t i = 0; i < numPoints; ++i)
+        {
+            columns[0].push_back(distribution(engine));
+            columns[1].push_back(distribution(engine) * 0.5);
+        }
+        return std::make_shared<const pCDM::HorizontalCoordinates>(std::move(columns));
+    }
+
+    /** X, Y and the index of each point of a level */
+    static std::array<std::vector<t_FP>, 3> pointValues(const pCDM::HorizontalCoordinates & coords)
+    {
+        std::array<std::vector<t_FP>, 3> values;
+        pCDM::HorizontalCoordinates::Columns buffers;
+        const auto xy = coords.block(0, coords.size(), buffers);
+        for (size_t i = 0; i < coords.size(); ++i)
+        {
+            values[0].push_back(xy[0][i]);
+            values[1].push_back(xy[1][i]);
+            values[2].push_back(static_cast<t_FP>(i));
+        }
+        return values;
+    }
+};
+
+
+TEST_F(PCDMLevelOfDetail_test, gridLevelsAreStridedSubGrids)
+{
+    const auto coords = genGrid();
+    const auto & grid = coords->grid();
+    const PCDMLevelOfDetail lod{ coords, 1000, 4 };
+
+    ASSERT_EQ(3u, lod.numLevels());
+    ASSERT_EQ(coords, lod.levelCoordinates(2));
+    ASSERT_EQ(65u * 33u, lod.levelCoordinates(1)->size());
+    ASSERT_EQ(17u * 9u, lod.levelCoordinates(0)->size());
+
+    const auto full = pointValues(*coords);
+    for (size_t level = 0; level < lod.numLevels(); ++level)
+    {
+        const auto stride = static_cast<t_FP>(1u << (2 * (lod.numLevels() - 1 - level)));
+        std::array<std::vector<t_FP>, 3> expanded;
+        lod.expand(level, pointValues(*lod.levelCoordinates(level)), expanded);
+        ASSERT_EQ(coords->size(), expanded[0].size());
+
+        // Each point gets the values of the nearest node of the sub-grid.
+        for (size_t i = 0; i < coords->size(); ++i)
+        {
+            ASSERT_LE(std::abs(expanded[0][i] - full[0][i]), 0.5 * stride * grid.spacing[0] + 1e-9);
+            ASSERT_LE(std::abs(expanded[1][i] - full[1][i]), 0.5 * stride * grid.spacing[1] + 1e-9);
+            if (std::fmod(full[0][i] - full[0].front(), stride * grid.spacing[0]) == 0
+                && std::fmod(full[1][i] - full[1].front(), stride * grid.spacing[1]) == 0)
+            {
+                ASSERT_EQ(full[0][i], expanded[0][i]);
+                ASSERT_EQ(full[1][i], expanded[1][i]);
+            }
+        }
+    }
+}
+
+TEST_F(PCDMLevelOfDetail_test, pointLevelsRepresentAllPoints)
+{
+    const size_t numPoints = 50000;
+    const auto coords = genPoints(numPoints);
+    const PCDMLevelOfDetail lod{ coords, 256, 2 };
+
+    ASSERT_GT(lod.numLevels(), 2u);
+    ASSERT_EQ(coords, lod.levelCoordinates(lod.numLevels() - 1));
+    ASSERT_LE(lod.levelCoordinates(0)->size(), 256u);
+
+    const auto full = pointValues(*coords);
+    for (size_t level = 0; level < lod.numLevels(); ++level)
+    {
+        const auto & levelCoords = *lod.levelCoordinates(level);
+        if (level > 0)
+        {
+            ASSERT_GT(levelCoords.size(), lod.levelCoordinates(level - 1)->size());
+        }
+
+        std::array<std::vector<t_FP>, 3> expanded;
+        lod.expand(level, pointValues(levelCoords), expanded);
+        ASSERT_EQ(numPoints, expanded[0].size());
+
+        // Samples are taken from the points' quadtree cells: 16 x 16 cells on the first level
+        const auto numCells = static_cast<t_FP>(16u << level);
+        std::vector<char> isSampleUsed(levelCoords.size(), 0);
+        for (size_t i = 0; i < numPoints; ++i)
+        {
+            ASSERT_LE(std::abs(expanded[0][i] - full[0][i]), 100 / numCells);
+            ASSERT_LE(std::abs(expanded[1][i] - full[1][i]), 50 / numCells);
+            isSampleUsed[static_cast<size_t>(expanded[2][i])] = 1;
+        }
+        for (const auto used : isSampleUsed)
+        {
+            ASSERT_TRUE(used);
+        }
+    }
+
+    std::array<std::vector<t_FP>, 3> expanded;
+    lod.expand(lod.numLevels() - 1, full, expanded);
+    ASSERT_EQ(full, expanded);
+}
+
+TEST_F(PCDMLevelOfDetail_test, smallInputsHaveSingleLevel)
+{
+    const auto points = genPoints(100);
+    const PCDMLevelOfDetail pointLod{ points, 1000 };
+    ASSERT_EQ(1u, pointLod.numLevels());
+    ASSERT_EQ(points, pointLod.levelCoordinates(0));
+
+    const auto grid = genGrid();
+    const PCDMLevelOfDetail gridLod{ grid, grid->size() };
+    ASSERT_EQ(1u, gridLod.numLevels());
+}
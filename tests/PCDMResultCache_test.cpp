@@ -0,0 +1,180 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <PCDMResultCache.h>
+
+
+using pCDM::t_FP;
+
+
+namespace
+{
+
+PCDMResultCache::Key makeKey(t_FP depth, const pCDM::SharedHorizontalCoordinates & coords,
+    t_FP nu = 0.25)
+{
+    PCDMResultCache::Key key;
+    key.sourceParameters.horizontalCoord = { 0, 0 };
+    key.sourceParameters.depth = depth;
+    key.sourceParameters.omega = { 0, 0, 0 };
+    key.sourceParameters.dv = { 1, 1, 1 };
+    key.nu = nu;
+    key.coords = coords;
+    return key;
+}
+
+/** Results referencing external memory, e.g., a mapped file, which does not count as memory usage */
+PCDMResultCache::SharedResults makeMappedResults(const std::shared_ptr<const std::vector<t_FP>> & values)
+{
+    const auto data = values->data();
+    return std::make_shared<const PCDMResultCache::Displacements>(
+        PCDMResultCache::Displacements::Components{ { data, data, data } }, values->size(), values);
+}
+
+/** Results of numTuples points, requiring numTuples * 3 * sizeof(t_FP) bytes */
+PCDMResultCache::SharedResults makeResults(size_t numTuples, t_FP value)
+{
+    PCDMResultCache::Results results;
+    for (auto & component : results)
+    {
+        component.assign(numTuples, value);
+    }
+    return std::make_shared<const PCDMResultCache::Displacements>(std::move(results));
+}
+
+}
+
+
+TEST(PCDMResultCache_test, keysIncludeNuAndCoordinates)
+{
+    const auto coords = std::make_shared<const pCDM::HorizontalCoordinates>();
+    const auto otherCoords = std::make_shared<const pCDM::HorizontalCoordinates>();
+
+    PCDMResultCache cache(1024 * 1024);
+    cache.insert(makeKey(1, coords), makeResults(10, 1));
+
+    ASSERT_TRUE(cache.find(makeKey(1, coords)));
+    ASSERT_FALSE(cache.find(makeKey(2, coords)));
+    ASSERT_FALSE(cache.find(makeKey(1, coords, 0.3)));
+    // Equal but separate snapshots are different coordinate sets.
+    ASSERT_FALSE(cache.find(makeKey(1, otherCoords)));
+
+    // Replace the entry instead of adding another one.
+    cache.insert(makeKey(1, coords), makeResults(10, 2));
+    ASSERT_EQ(1u, cache.size());
+    ASSERT_EQ(10u * 3u * sizeof(t_FP), cache.memoryUsage());
+    ASSERT_EQ(2, (*cache.find(makeKey(1, coords)))[0][0]);
+}
+
+TEST(PCDMResultCache_test, evictsLeastRecentlyUsed)
+{
+    const auto coords = std::make_shared<const pCDM::HorizontalCoordinates>();
+    const size_t entryBytes = 10u * 3u * sizeof(t_FP);
+
+    PCDMResultCache cache(3 * entryBytes);
+    cache.insert(makeKey(1, coords), makeResults(10, 1));
+    cache.insert(makeKey(2, coords), makeResults(10, 2));
+    cache.insert(makeKey(3, coords), makeResults(10, 3));
+    ASSERT_EQ(3u, cache.size());
+
+    // Use 1, so that 2 is the least recently used entry. contains() does not count as use.
+    ASSERT_TRUE(cache.find(makeKey(1, coords)));
+    ASSERT_TRUE(cache.contains(makeKey(2, coords)));
+    cache.insert(makeKey(4, coords), makeResults(10, 4));
+
+    ASSERT_EQ(3u, cache.size());
+    ASSERT_EQ(3 * entryBytes, cache.memoryUsage());
+    ASSERT_FALSE(cache.contains(makeKey(2, coords)));
+    ASSERT_TRUE(cache.contains(makeKey(1, coords)));
+    ASSERT_TRUE(cache.contains(makeKey(3, coords)));
+    ASSERT_TRUE(cache.contains(makeKey(4, coords)));
+
+    // Evicted results remain valid while referenced.
+    const auto results = cache.find(makeKey(3, coords));
+    cache.setMemoryBudget(entryBytes);
+    ASSERT_EQ(1u, cache.size());
+    ASSERT_TRUE(cache.contains(makeKey(3, coords)));
+    ASSERT_EQ(3, (*results)[2][9]);
+
+    cache.clear();
+    ASSERT_EQ(0u, cache.size());
+    ASSERT_EQ(0u, cache.memoryUsage());
+    ASSERT_EQ(3, (*results)[2][9]);
+}
+
+TEST(PCDMResultCache_test, keepsMostRecentResultsExceedingBudget)
+{
+    const auto coords = std::make_shared<const pCDM::HorizontalCoordinates>();
+
+    PCDMResultCache cache(100);
+    cache.insert(makeKey(1, coords), makeResults(1, 1));
+    cache.insert(makeKey(2, coords), makeResults(1000, 2));
+
+    ASSERT_EQ(1u, cache.size());
+    ASSERT_TRUE(cache.contains(makeKey(2, coords)));
+}
+
+TEST(PCDMResultCache_test, keysCompareParametersExactly)
+{
+    const auto coords = std::make_shared<const pCDM::HorizontalCoordinates>();
+
+    // PointCDMParameters::operator== tolerates differences up to epsilon, the cache must not, as
+    // equal keys are required to have equal hashes.
+    const auto key = makeKey(0.25, coords);
+    auto nearKey = key;
+    nearKey.sourceParameters.depth += std::numeric_limits<t_FP>::epsilon() / 2;
+    ASSERT_EQ(key.sourceParameters, nearKey.sourceParameters);
+    ASSERT_FALSE(key == nearKey);
+
+    auto negativeZeroKey = key;
+    negativeZeroKey.sourceParameters.omega = { -0.0, 0, -0.0 };
+    ASSERT_TRUE(key == negativeZeroKey);
+    ASSERT_EQ(PCDMResultCache::KeyHash()(key), PCDMResultCache::KeyHash()(negativeZeroKey));
+
+    PCDMResultCache cache(1024 * 1024);
+    cache.insert(key, makeResults(10, 1));
+    ASSERT_TRUE(cache.find(negativeZeroKey));
+    ASSERT_FALSE(cache.find(nearKey));
+}
+
+TEST(PCDMResultCache_test, limitsNumberOfMappedResults)
+{
+    const auto coords = std::make_shared<const pCDM::HorizontalCoordinates>();
+    const auto values = std::make_shared<const std::vector<t_FP>>(10, t_FP(1));
+
+    PCDMResultCache cache(1024 * 1024);
+    cache.insert(makeKey(0, coords), makeResults(10, 1));
+    for (size_t i = 1; i <= PCDMResultCache::maxMappedEntries + 1; ++i)
+    {
+        cache.insert(makeKey(static_cast<t_FP>(i), coords), makeMappedResults(values));
+    }
+
+    // The least recently used mapped results are evicted, results in memory are kept.
+    ASSERT_EQ(PCDMResultCache::maxMappedEntries + 1, cache.size());
+    ASSERT_TRUE(cache.contains(makeKey(0, coords)));
+    ASSERT_FALSE(cache.contains(makeKey(1, coords)));
+    ASSERT_TRUE(cache.contains(makeKey(2, coords)));
+    ASSERT_TRUE(cache.contains(
+        makeKey(static_cast<t_FP>(PCDMResultCache::maxMappedEntries + 1), coords)));
+}
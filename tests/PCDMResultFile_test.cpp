@@ -0,0 +1,271 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <memory>
+
+#include <QFile>
+#include <QTemporaryDir>
+
+#include <PCDMResultFile.h>
+
+
+using pCDM::t_FP;
+
+
+class PCDMResultFile_test : public ::testing::Test
+{
+public:
+    void SetUp() override
+    {
+        ASSERT_TRUE(m_dir.isValid());
+
+        m_parameters.horizontalCoord = { 1, 2 };
+        m_parameters.depth = 500;
+        m_parameters.omega = { 10, 20, 30 };
+        m_parameters.dv = { 1e6, 2e6, 3e6 };
+    }
+
+    QString filePath(const QString & fileName) const
+    {
+        return m_dir.path() + "/" + fileName;
+    }
+
+    static std::array<std::vector<t_FP>, 3> genComponents(size_t numPoints)
+    {
+        std::array<std::vector<t_FP>, 3> components;
+        for (size_t i = 0; i < numPoints; ++i)
+        {
+            components[0].push_back(static_cast<t_FP>(i) * 0.5);
+            components[1].push_back(-static_cast<t_FP>(i));
+            components[2].push_back(static_cast<t_FP>(i * i) * 1e-3);
+        }
+        return components;
+    }
+
+protected:
+    pCDM::PointCDMParameters m_parameters;
+
+private:
+    QTemporaryDir m_dir;
+};
+
+
+TEST_F(PCDMResultFile_test, parametersHash)
+{
+    const auto hash = PCDMResultFile::parametersHash(m_parameters, 0.25);
+    ASSERT_EQ(hash, PCDMResultFile::parametersHash(m_parameters, 0.25));
+    ASSERT_NE(hash, PCDMResultFile::parametersHash(m_parameters, 0.3));
+    ASSERT_NE(hash, PCDMResultFile::parametersHash(m_parameters));
+
+    auto other = m_parameters;
+    other.dv[2] += 1;
+    ASSERT_NE(hash, PCDMResultFile::parametersHash(other, 0.25));
+
+    // Parameters comparing equal have equal hashes.
+    other = m_parameters;
+    other.horizontalCoord = { 0, 2 };
+    auto negativeZero = other;
+    negativeZero.horizontalCoord[0] = -t_FP(0);
+    ASSERT_EQ(PCDMResultFile::parametersHash(other), PCDMResultFile::parametersHash(negativeZero));
+}
+
+TEST_F(PCDMResultFile_test, writeAndMap)
+{
+    const size_t numPoints = 1000;
+    const auto components = genComponents(numPoints);
+    const auto hash = PCDMResultFile::parametersHash(m_parameters, 0.25);
+    const auto fileName = filePath("results.bin");
+    ASSERT_TRUE(PCDMResultFile::write(fileName, hash, components));
+
+    std::array<const t_FP *, 3> mapped;
+    std::shared_ptr<const void> storage;
+    ASSERT_TRUE(PCDMResultFile::map(fileName, hash, numPoints, mapped, storage, true));
+    ASSERT_TRUE(storage);
+    for (size_t c = 0; c < 3; ++c)
+    {
+        for (size_t i = 0; i < numPoints; ++i)
+        {
+            ASSERT_EQ(components[c][i], mapped[c][i]);
+        }
+    }
+}
+
+TEST_F(PCDMResultFile_test, cancelledWriteKeepsExistingFile)
+{
+    const size_t numPoints = PCDMResultFile::chunkSize * 2 + 123;
+    const auto components = genComponents(numPoints);
+    const auto hash = PCDMResultFile::parametersHash(m_parameters, 0.25);
+    const auto fileName = filePath("results.bin");
+    ASSERT_TRUE(PCDMResultFile::write(fileName, hash, components));
+
+    for (const auto codec : { PCDMResultFile::Codec::none, PCDMResultFile::Codec::shuffleDeflate })
+    {
+        // Cancel before the first block, while checksumming or encoding, and while writing
+        for (const int numPolls : { 0, 4, 10 })
+        {
+            std::atomic<int> polls{ 0 };
+            ASSERT_FALSE(PCDMResultFile::write(fileName, hash + 1, components, { codec, 0 }, 0,
+                [&polls, numPolls] () { return polls++ >= numPolls; }));
+
+            std::array<const t_FP *, 3> mapped;
+            std::shared_ptr<const void> storage;
+            ASSERT_TRUE(PCDMResultFile::map(fileName, hash, numPoints, mapped, storage, true));
+        }
+    }
+}
+
+TEST_F(PCDMResultFile_test, cancelledLoad)
+{
+    const size_t numPoints = PCDMResultFile::chunkSize * 2 + 123;
+    const auto hash = PCDMResultFile::parametersHash(m_parameters, 0.25);
+    const auto fileName = filePath("results.bin");
+    ASSERT_TRUE(PCDMResultFile::write(fileName, hash, genComponents(numPoints),
+        { PCDMResultFile::Codec::shuffleDeflate, 0 }));
+
+    std::array<const t_FP *, 3> loaded;
+    std::shared_ptr<const void> storage;
+    size_t memoryUsage = 0;
+    // Cancel while verifying the checksum and while decompressing
+    for (const int numPolls : { 0, 3 })
+    {
+        std::atomic<int> polls{ 0 };
+        ASSERT_FALSE(PCDMResultFile::load(fileName, hash, numPoints, loaded, storage, memoryUsage, 0,
+            [&polls, numPolls] () { return polls++ >= numPolls; }));
+        ASSERT_FALSE(storage);
+    }
+    ASSERT_TRUE(PCDMResultFile::load(fileName, hash, numPoints, loaded, storage, memoryUsage, 0,
+        [] () { return false; }));
+}
+
+TEST_F(PCDMResultFile_test, rejectsMismatchingFiles)
+{
+    const size_t numPoints = 100;
+    const auto hash = PCDMResultFile::parametersHash(m_parameters, 0.25);
+    const auto fileName = filePath("results.bin");
+
+    std::array<const t_FP *, 3> mapped;
+    std::array<const t_FP *, 6> mappedParts;
+    std::shared_ptr<const void> storage;
+    ASSERT_FALSE(PCDMResultFile::map(fileName, hash, numPoints, mapped, storage));
+
+    ASSERT_TRUE(PCDMResultFile::write(fileName, hash, genComponents(numPoints)));
+    ASSERT_TRUE(PCDMResultFile::map(fileName, hash, numPoints, mapped, storage));
+
+    // Stale results of other parameters or coordinates
+    ASSERT_FALSE(PCDMResultFile::map(fileName, hash + 1, numPoints, mapped, storage));
+    ASSERT_FALSE(PCDMResultFile::map(fileName, hash, numPoints + 1, mapped, storage));
+    ASSERT_FALSE(PCDMResultFile::map(fileName, hash, numPoints, mappedParts, storage));
+
+    // Corrupted values are detected by the checksum.
+    {
+        std::fstream file(fileName.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(PCDMResultFile::headerSize + 10 * sizeof(t_FP));
+        const t_FP value = 42;
+        file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+    ASSERT_TRUE(PCDMResultFile::map(fileName, hash, numPoints, mapped, storage));
+    ASSERT_FALSE(PCDMResultFile::map(fileName, hash, numPoints, mapped, storage, true));
+
+    // Corrupted headers are detected by the header checksum.
+    {
+        std::fstream file(fileName.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(32);
+        const char byte = 1;
+        file.write(&byte, 1);
+    }
+    ASSERT_FALSE(PCDMResultFile::map(fileName, hash, numPoints, mapped, storage));
+}
+
+TEST_F(PCDMResultFile_test, losslessCompression)
+{
+    // Several chunks per component, the last one partially filled
+    const size_t numPoints = PCDMResultFile::chunkSize * 2 + 123;
+    const auto components = genComponents(numPoints);
+    const auto hash = PCDMResultFile::parametersHash(m_parameters, 0.25);
+    const auto fileName = filePath("results.bin");
+    ASSERT_TRUE(PCDMResultFile::write(fileName, hash, components,
+        { PCDMResultFile::Codec::shuffleDeflate, 0 }));
+
+    std::array<const t_FP *, 3> loaded;
+    std::shared_ptr<const void> storage;
+    size_t memoryUsage = 0;
+    ASSERT_FALSE(PCDMResultFile::map(fileName, hash, numPoints, loaded, storage));
+    ASSERT_TRUE(PCDMResultFile::load(fileName, hash, numPoints, loaded, storage, memoryUsage));
+    ASSERT_EQ(numPoints * 3 * sizeof(t_FP), memoryUsage);
+    for (size_t c = 0; c < 3; ++c)
+    {
+        for (size_t i = 0; i < numPoints; ++i)
+        {
+            ASSERT_EQ(components[c][i], loaded[c][i]);
+        }
+    }
+
+    ASSERT_FALSE(PCDMResultFile::load(fileName, hash + 1, numPoints, loaded, storage, memoryUsage));
+}
+
+TEST_F(PCDMResultFile_test, lossyCompressionIsErrorBounded)
+{
+    const size_t numPoints = PCDMResultFile::chunkSize + 1000;
+    std::array<std::vector<t_FP>, 3> components;
+    for (size_t i = 0; i < numPoints; ++i)
+    {
+        // Smooth field, similar to displacements along a grid row
+        const auto x = static_cast<t_FP>(i) * 1e-3;
+        components[0].push_back(0.05 * std::sin(x));
+        components[1].push_back(-0.02 * std::cos(0.5 * x));
+        components[2].push_back(0.1 / (1 + x * x));
+    }
+    // Non-finite values are stored lossless.
+    components[1][10] = std::numeric_limits<t_FP>::quiet_NaN();
+
+    const t_FP maxError = 1e-6;
+    const auto hash = PCDMResultFile::parametersHash(m_parameters, 0.25);
+    const auto lossyFileName = filePath("lossy.bin");
+    const auto losslessFileName = filePath("lossless.bin");
+    ASSERT_TRUE(PCDMResultFile::write(lossyFileName, hash, components,
+        { PCDMResultFile::Codec::quantizedDeflate, maxError }));
+    ASSERT_TRUE(PCDMResultFile::write(losslessFileName, hash, components,
+        { PCDMResultFile::Codec::shuffleDeflate, 0 }));
+    ASSERT_LT(QFile(lossyFileName).size() * 2, QFile(losslessFileName).size());
+
+    std::array<const t_FP *, 3> loaded;
+    std::shared_ptr<const void> storage;
+    size_t memoryUsage = 0;
+    ASSERT_TRUE(PCDMResultFile::load(lossyFileName, hash, numPoints, loaded, storage, memoryUsage));
+    for (size_t c = 0; c < 3; ++c)
+    {
+        for (size_t i = 0; i < numPoints; ++i)
+        {
+            if (std::isnan(components[c][i]))
+            {
+                ASSERT_TRUE(std::isnan(loaded[c][i]));
+                continue;
+            }
+            ASSERT_LE(std::abs(components[c][i] - loaded[c][i]), maxError * (1 + 1e-9));
+        }
+    }
+    // Values of the chunk containing the NaN are exact.
+    ASSERT_EQ(components[1][11], loaded[1][11]);
+}
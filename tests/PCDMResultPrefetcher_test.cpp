@@ -0,0 +1,137 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <PCDMResultPrefetcher.h>
+
+
+using pCDM::t_FP;
+
+
+namespace
+{
+
+/** Loaders of numFrames frames, each returning a single point with the frame index as values */
+std::vector<PCDMResultPrefetcher::Loader> makeLoaders(size_t numFrames,
+    std::shared_ptr<std::vector<std::atomic<int>>> & numCalls)
+{
+    numCalls = std::make_shared<std::vector<std::atomic<int>>>(numFrames);
+    std::vector<PCDMResultPrefetcher::Loader> loaders;
+    for (size_t f = 0; f < numFrames; ++f)
+    {
+        (*numCalls)[f] = 0;
+        loaders.push_back([f, numCalls] () -> PCDMResultCache::SharedResults
+        {
+            ++(*numCalls)[f];
+            PCDMResultCache::Results results;
+            for (auto & component : results)
+            {
+                component.assign(1, static_cast<t_FP>(f));
+            }
+            return std::make_shared<const PCDMResultCache::Displacements>(std::move(results));
+        });
+    }
+    return loaders;
+}
+
+}
+
+
+TEST(PCDMResultPrefetcher_test, loadsWindowAhead)
+{
+    std::shared_ptr<std::vector<std::atomic<int>>> numCalls;
+    PCDMResultPrefetcher prefetcher(3);
+    prefetcher.setFrames(makeLoaders(10, numCalls));
+
+    for (size_t f = 0; f < 3; ++f)
+    {
+        const auto results = prefetcher.waitForResults(f);
+        ASSERT_TRUE(results);
+        ASSERT_EQ(static_cast<t_FP>(f), (*results)[2][0]);
+    }
+    ASSERT_FALSE(prefetcher.isLoaded(3));
+    ASSERT_FALSE(prefetcher.results(3));
+
+    // Moving forward releases the first frame and loads the next one, without reloading the others.
+    prefetcher.setPosition(1);
+    ASSERT_FALSE(prefetcher.results(0));
+    const auto results = prefetcher.waitForResults(3);
+    ASSERT_TRUE(results);
+    ASSERT_EQ(t_FP(3), (*results)[0][0]);
+    for (size_t f = 0; f < 4; ++f)
+    {
+        ASSERT_EQ(1, (*numCalls)[f].load()) << "frame " << f;
+    }
+    ASSERT_FALSE(prefetcher.isLoaded(4));
+}
+
+TEST(PCDMResultPrefetcher_test, windowWrapsAround)
+{
+    std::shared_ptr<std::vector<std::atomic<int>>> numCalls;
+    PCDMResultPrefetcher prefetcher(3);
+    prefetcher.setFrames(makeLoaders(5, numCalls));
+    prefetcher.setPosition(4);
+
+    ASSERT_TRUE(prefetcher.waitForResults(4));
+    ASSERT_TRUE(prefetcher.waitForResults(0));
+    ASSERT_TRUE(prefetcher.waitForResults(1));
+    ASSERT_FALSE(prefetcher.isLoaded(2));
+    ASSERT_FALSE(prefetcher.isLoaded(3));
+}
+
+TEST(PCDMResultPrefetcher_test, failedFramesDontBlock)
+{
+    std::vector<PCDMResultPrefetcher::Loader> loaders(3);
+    loaders[1] = [] () -> PCDMResultCache::SharedResults { return{}; };
+    PCDMResultPrefetcher prefetcher(3);
+    prefetcher.setFrames(std::move(loaders));
+
+    ASSERT_FALSE(prefetcher.waitForResults(0));
+    ASSERT_FALSE(prefetcher.waitForResults(1));
+    ASSERT_FALSE(prefetcher.waitForResults(2));
+    ASSERT_TRUE(prefetcher.isLoaded(0));
+    ASSERT_TRUE(prefetcher.isLoaded(1));
+    ASSERT_TRUE(prefetcher.isLoaded(2));
+}
+
+TEST(PCDMResultPrefetcher_test, setFramesReplacesSequence)
+{
+    std::shared_ptr<std::vector<std::atomic<int>>> numCalls;
+    PCDMResultPrefetcher prefetcher(2);
+    prefetcher.setFrames(makeLoaders(4, numCalls));
+    prefetcher.setPosition(2);
+    ASSERT_TRUE(prefetcher.waitForResults(2));
+
+    std::shared_ptr<std::vector<std::atomic<int>>> newNumCalls;
+    prefetcher.setFrames(makeLoaders(2, newNumCalls));
+    ASSERT_EQ(2u, prefetcher.numFrames());
+    ASSERT_EQ(0u, prefetcher.position());
+
+    const auto results = prefetcher.waitForResults(1);
+    ASSERT_TRUE(results);
+    ASSERT_EQ(t_FP(1), (*results)[1][0]);
+
+    prefetcher.setFrames({});
+    ASSERT_EQ(0u, prefetcher.numFrames());
+    ASSERT_FALSE(prefetcher.results(0));
+}
@@ -0,0 +1,161 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include <QTemporaryDir>
+
+#include <PCDMSampler.h>
+
+#include "PCDMSyntheticObservations.h"
+
+
+using pCDM::t_FP;
+using PCDMSyntheticObservations::trueParameters;
+
+
+class PCDMSampler_test : public ::testing::Test
+{
+public:
+    void SetUp() override
+    {
+        ASSERT_TRUE(m_dir.isValid());
+        m_fileName = m_dir.path() + "/samples.bin";
+    }
+
+    /** Synthetic vertical displacements of trueParameters(), on a coarser grid than the default */
+    static PCDMObservations genObservations()
+    {
+        pCDM::HorizontalGrid grid;
+        grid.origin = { -5, -5 };
+        grid.spacing = { 0.25, 0.25 };
+        grid.extent = { 0, 40, 0, 40 };
+        return PCDMSyntheticObservations::generate(grid, { 0, 0, 1 });
+    }
+
+    /** Sample position, depth and potencies with a noise level of 1e-6 */
+    static PCDMSampler::Settings genSettings()
+    {
+        PCDMSampler::Settings settings;
+        settings.initialParameters = trueParameters();
+        settings.noiseVariance = 1e-12;
+        settings.fixed[static_cast<size_t>(pCDM::JacobianParameter::omegaX)] = true;
+        settings.fixed[static_cast<size_t>(pCDM::JacobianParameter::omegaY)] = true;
+        settings.fixed[static_cast<size_t>(pCDM::JacobianParameter::omegaZ)] = true;
+        settings.numWalkers = 32;
+        settings.numSteps = 200;
+        settings.thinning = 5;
+        settings.seed = 42;
+        return settings;
+    }
+
+protected:
+    QString m_fileName;
+
+private:
+    QTemporaryDir m_dir;
+};
+
+
+TEST_F(PCDMSampler_test, samplesAroundTrueParameters)
+{
+    const PCDMSampler sampler{ genObservations() };
+    const auto settings = genSettings();
+
+    const auto result = sampler.run(settings);
+
+    ASSERT_EQ(PCDMSampler::Status::finished, result.status);
+    EXPECT_EQ(settings.numSteps, result.numSteps);
+    EXPECT_GT(result.acceptanceFraction, 0.05);
+    EXPECT_LT(result.acceptanceFraction, 0.95);
+
+    const auto expected = PCDMInversion::toVector(trueParameters());
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        if (settings.fixed[i])
+        {
+            EXPECT_EQ(expected[i], result.mean[i]);
+            EXPECT_EQ(0, result.standardDeviation[i]);
+            continue;
+        }
+        EXPECT_GT(result.standardDeviation[i], 0) << "Parameter " << i;
+        EXPECT_NEAR(expected[i], result.mean[i],
+            5 * result.standardDeviation[i] + 1e-3 * std::abs(expected[i])) << "Parameter " << i;
+    }
+}
+
+TEST_F(PCDMSampler_test, storesReproducibleChains)
+{
+    const PCDMSampler sampler{ genObservations() };
+    auto settings = genSettings();
+    settings.numSteps = 23;
+
+    const auto result = sampler.run(settings, m_fileName);
+    ASSERT_EQ(PCDMSampler::Status::finished, result.status);
+
+    PCDMSampleFile::Header header;
+    ASSERT_TRUE(PCDMSampleFile::readHeader(m_fileName, header));
+    EXPECT_EQ(settings.numWalkers, header.numWalkers);
+    EXPECT_EQ(settings.thinning, header.thinning);
+    EXPECT_EQ(settings.numSteps, header.numSteps);
+    EXPECT_EQ(4u, header.numStoredSteps);
+    EXPECT_EQ(6u, header.numSampledParameters());
+    ASSERT_EQ(settings.numWalkers, header.acceptedCounts.size());
+    std::uint64_t numAccepted = 0;
+    for (const auto count : header.acceptedCounts)
+    {
+        numAccepted += count;
+    }
+    EXPECT_DOUBLE_EQ(result.acceptanceFraction,
+        static_cast<t_FP>(numAccepted) / static_cast<t_FP>(settings.numSteps * settings.numWalkers));
+
+    std::vector<PCDMSampleFile::ParameterVector> samples;
+    std::vector<t_FP> logPosteriors;
+    ASSERT_TRUE(PCDMSampleFile::readSamples(m_fileName, header, 0, header.numStoredSteps,
+        samples, logPosteriors));
+    ASSERT_EQ(header.numStoredSteps * header.numWalkers, samples.size());
+    for (size_t s = 0; s < samples.size(); ++s)
+    {
+        EXPECT_EQ(settings.initialParameters.omega[2],
+            samples[s][static_cast<size_t>(pCDM::JacobianParameter::omegaZ)]);
+        EXPECT_TRUE(std::isfinite(logPosteriors[s]));
+    }
+    EXPECT_FALSE(PCDMSampleFile::readSamples(m_fileName, header, 0, header.numStoredSteps + 1,
+        samples, logPosteriors));
+
+    // Random numbers don't depend on the number of threads.
+    settings.numThreads = 1;
+    const auto singleThreadedResult = sampler.run(settings);
+    EXPECT_EQ(result.mean, singleThreadedResult.mean);
+    EXPECT_EQ(result.bestMisfit, singleThreadedResult.bestMisfit);
+}
+
+TEST_F(PCDMSampler_test, rejectsInvalidSettings)
+{
+    const PCDMSampler sampler{ genObservations() };
+    auto settings = genSettings();
+    settings.numWalkers = 5;
+    EXPECT_EQ(PCDMSampler::Status::invalidInput, sampler.run(settings).status);
+
+    // The noise level cannot be estimated from a perfect fit.
+    settings = genSettings();
+    settings.noiseVariance = 0;
+    EXPECT_EQ(PCDMSampler::Status::invalidInput, sampler.run(settings).status);
+}
@@ -0,0 +1,107 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <PCDMBackend.h>
+#include <PCDMInversion.h>
+
+
+/**
+ * Synthetic observations for the tests of the inversion, the posterior sampler and the grid search.
+ */
+namespace PCDMSyntheticObservations
+{
+
+/** Source the observations are generated for */
+inline pCDM::PointCDMParameters trueParameters()
+{
+    pCDM::PointCDMParameters p;
+    p.horizontalCoord = { 0.5, -0.25 };
+    p.depth = 2.75;
+    p.omega = { 5, -8, 30 };
+    p.dv = { 0.00144, 0.00128, 0.00072 };
+    return p;
+}
+
+/** 71 x 51 points around the source */
+inline pCDM::HorizontalGrid defaultGrid()
+{
+    pCDM::HorizontalGrid grid;
+    grid.origin = { -7, -5 };
+    grid.spacing = { 0.2, 0.2 };
+    grid.extent = { 0, 70, 0, 50 };
+    return grid;
+}
+
+/** Line of sight per point, as a function of the point coordinates */
+using PointLineOfSight = std::function<std::array<pCDM::t_FP, 3>(pCDM::t_FP x, pCDM::t_FP y)>;
+
+/**
+ * Observations of trueParameters() without noise, at the grid points.
+ * Values are the displacements projected onto lineOfSight, which is normalized, or onto
+ * pointLineOfSight for each point, if set.
+ */
+inline PCDMObservations generate(const pCDM::HorizontalGrid & grid,
+    const std::array<pCDM::t_FP, 3> & lineOfSight,
+    const PointLineOfSight & pointLineOfSight = {})
+{
+    using pCDM::t_FP;
+
+    PCDMObservations observations;
+    observations.coords = std::make_shared<const pCDM::HorizontalCoordinates>(grid);
+    const auto norm = std::sqrt(lineOfSight[0] * lineOfSight[0]
+        + lineOfSight[1] * lineOfSight[1] + lineOfSight[2] * lineOfSight[2]);
+    observations.lineOfSight = { lineOfSight[0] / norm, lineOfSight[1] / norm, lineOfSight[2] / norm };
+
+    PCDMBackend backend;
+    backend.setHorizontalCoords(observations.coords);
+    backend.setParameters({ trueParameters(), 0.25 });
+    std::array<std::vector<t_FP>, 3> u;
+    EXPECT_EQ(PCDMBackend::State::resultsReady, backend.runInto(u));
+
+    const auto & coords = *observations.coords;
+    pCDM::HorizontalCoordinates::Columns buffers;
+    const auto xy = coords.block(0, coords.size(), buffers);
+
+    observations.values.resize(coords.size());
+    auto l = observations.lineOfSight;
+    for (size_t i = 0; i < coords.size(); ++i)
+    {
+        if (pointLineOfSight)
+        {
+            l = pointLineOfSight(xy[0][i], xy[1][i]);
+            for (size_t c = 0; c < 3; ++c)
+            {
+                observations.pointLineOfSight[c].push_back(l[c]);
+            }
+        }
+        observations.values[i] = l[0] * u[0][i] + l[1] * u[1][i] + l[2] * u[2][i];
+    }
+    return observations;
+}
+
+}
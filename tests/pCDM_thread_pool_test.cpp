@@ -0,0 +1,114 @@
+/*
+ * GeohazardVis plug-in: pCDM Modeling
+ * Copyright (C) 2017 Karsten Tausche <geodev@posteo.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <pCDM_thread_pool.h>
+
+
+using pCDM::ThreadPool;
+
+
+TEST(pCDM_thread_pool_test, processesEachIndexOnce)
+{
+    ThreadPool pool(4);
+    ASSERT_EQ(4u, pool.numThreads());
+
+    const size_t count = 10007;
+    std::vector<std::atomic<int>> visited(count);
+    for (auto & v : visited)
+    {
+        v = 0;
+    }
+
+    pool.parallelFor(count, 64, [&visited] (size_t begin, size_t end)
+    {
+        ASSERT_LE(end - begin, 64u);
+        for (size_t i = begin; i < end; ++i)
+        {
+            ++visited[i];
+        }
+    });
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        ASSERT_EQ(1, visited[i]) << "index " << i;
+    }
+}
+
+TEST(pCDM_thread_pool_test, unevenBlocksAndConcurrentLoops)
+{
+    ThreadPool pool(3);
+
+    // Only the first blocks are expensive, so that the remaining blocks have to be stolen.
+    auto loop = [&pool] ()
+    {
+        std::atomic<size_t> sum{ 0 };
+        pool.parallelFor(1000, 10, [&sum] (size_t begin, size_t end)
+        {
+            if (begin < 100)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            for (size_t i = begin; i < end; ++i)
+            {
+                sum += i;
+            }
+        });
+        return sum.load();
+    };
+
+    std::thread other([&loop] () { EXPECT_EQ(499500u, loop()); });
+    EXPECT_EQ(499500u, loop());
+    other.join();
+}
+
+TEST(pCDM_thread_pool_test, rethrowsExceptions)
+{
+    ThreadPool pool(2);
+
+    ASSERT_THROW(pool.parallelFor(100, 1, [] (size_t begin, size_t /*end*/)
+    {
+        if (begin == 50)
+        {
+            throw std::runtime_error("test");
+        }
+    }), std::runtime_error);
+
+    // The pool remains usable.
+    std::atomic<size_t> count{ 0 };
+    pool.parallelFor(100, 1, [&count] (size_t begin, size_t end) { count += end - begin; });
+    ASSERT_EQ(100u, count);
+}
+
+TEST(pCDM_thread_pool_test, setNumThreads)
+{
+    ThreadPool pool(1);
+    pool.setNumThreads(5);
+    ASSERT_EQ(5u, pool.numThreads());
+
+    std::atomic<size_t> count{ 0 };
+    pool.parallelFor(100, 3, [&count] (size_t begin, size_t end) { count += end - begin; }, 2);
+    ASSERT_EQ(100u, count);
+}